@@ -0,0 +1,201 @@
+#include "apk_archive.h"
+
+#include <cstring>
+#include <cstdlib>
+
+#define END_OF_DIRECTORY_SIGNATURE 0x06054B50u
+#define END_OF_DIRECTORY_SIZE 22
+#define DIRECTORY_ENTRY_SIGNATURE 0x02014B50u
+#define DIRECTORY_ENTRY_SIZE 46
+#define LOCAL_HEADER_SIGNATURE 0x04034B50u
+#define LOCAL_HEADER_SIZE 30
+#define MAX_COMMENT_SIZE 0xFFFF
+#define ZIP64_MARKER 0xFFFFFFFFu
+
+// Little endian fields, unaligned
+inline uint16_t read_u16(const uint8_t *data) {
+    uint16_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+inline uint32_t read_u32(const uint8_t *data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint64_t ApkArchive::hash_name(const char *name,
+                               const size_t length) {
+    // FNV-1a
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for(size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t) name[i]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// ARCHIVE ===================
+bool sApkArchive::open(const char *archive_dir) {
+    if (!file.open(archive_dir) || file.size < END_OF_DIRECTORY_SIZE) {
+        file.close();
+        return false;
+    }
+    const uint8_t *data = (const uint8_t*) file.data;
+
+    // The end of directory record is last, before a comment of up to 64 KB
+    const size_t search_end = (file.size > END_OF_DIRECTORY_SIZE + MAX_COMMENT_SIZE) ? file.size - END_OF_DIRECTORY_SIZE - MAX_COMMENT_SIZE : 0;
+    size_t end_offset = file.size - END_OF_DIRECTORY_SIZE;
+    for(; end_offset > search_end && read_u32(data + end_offset) != END_OF_DIRECTORY_SIGNATURE; end_offset--);
+    if (read_u32(data + end_offset) != END_OF_DIRECTORY_SIGNATURE) {
+        close();
+        return false;
+    }
+
+    const uint32_t directory_count = read_u16(data + end_offset + 10);
+    const uint64_t directory_size = read_u32(data + end_offset + 12);
+    const uint64_t directory_offset = read_u32(data + end_offset + 16);
+    if (directory_offset + directory_size > end_offset) {
+        close();
+        return false;
+    }
+
+    entries = (sArchiveEntry*) calloc((directory_count > 0) ? directory_count : 1, sizeof(sArchiveEntry));
+    entry_count = 0;
+    entry_of_name.reserve(directory_count);
+
+    uint64_t offset = directory_offset;
+    for(uint32_t i = 0; i < directory_count; i++) {
+        if (offset + DIRECTORY_ENTRY_SIZE > directory_offset + directory_size ||
+            read_u32(data + offset) != DIRECTORY_ENTRY_SIGNATURE) {
+            break;
+        }
+        const uint8_t *record = data + offset;
+        const uint16_t name_length = read_u16(record + 28);
+        const uint16_t extra_length = read_u16(record + 30);
+        const uint16_t comment_length = read_u16(record + 32);
+        const uint32_t compressed_size = read_u32(record + 20);
+        const uint32_t size = read_u32(record + 24);
+        const uint64_t header_offset = read_u32(record + 42);
+        offset += DIRECTORY_ENTRY_SIZE + name_length + extra_length + comment_length;
+
+        // Skip the entries that cannot be read in place
+        const uint16_t method = read_u16(record + 10);
+        if (compressed_size == ZIP64_MARKER || size == ZIP64_MARKER || header_offset == ZIP64_MARKER ||
+            (method != ARCHIVE_STORED && method != ARCHIVE_DEFLATED) ||
+            header_offset + LOCAL_HEADER_SIZE > file.size ||
+            read_u32(data + header_offset) != LOCAL_HEADER_SIGNATURE) {
+            continue;
+        }
+
+        // The local header can have its own extra field, so the data starts after it
+        const uint64_t data_offset = header_offset + LOCAL_HEADER_SIZE + read_u16(data + header_offset + 26) + read_u16(data + header_offset + 28);
+        if (data_offset + compressed_size > file.size) {
+            continue;
+        }
+
+        sArchiveEntry &entry = entries[entry_count];
+        entry.name = (const char*) record + DIRECTORY_ENTRY_SIZE;
+        entry.name_length = name_length;
+        entry.method = method;
+        entry.crc = read_u32(record + 16);
+        entry.compressed_size = compressed_size;
+        entry.size = size;
+        entry.data_offset = data_offset;
+
+        entry_of_name[ApkArchive::hash_name(entry.name, name_length)] = entry_count;
+        entry_count++;
+    }
+
+    return true;
+}
+
+void sApkArchive::close() {
+    free(entries);
+    entries = NULL;
+    entry_count = 0;
+    entry_of_name.clear();
+    file.close();
+}
+
+uint32_t sApkArchive::find_entry(const char *name) const {
+    const size_t name_length = strlen(name);
+    const auto it = entry_of_name.find(ApkArchive::hash_name(name, name_length));
+    if (it == entry_of_name.end()) {
+        return ARCHIVE_NO_ENTRY;
+    }
+
+    // A collision of the hash is a miss
+    const sArchiveEntry &entry = entries[it->second];
+    if (entry.name_length != name_length || memcmp(entry.name, name, name_length) != 0) {
+        return ARCHIVE_NO_ENTRY;
+    }
+    return it->second;
+}
+
+// READER ===================
+bool sArchiveReader::open(const sApkArchive &archive,
+                          const uint32_t entry_id) {
+    const sArchiveEntry &entry = archive.entries[entry_id];
+    source = (const uint8_t*) archive.file.data + entry.data_offset;
+    source_size = entry.compressed_size;
+    size = entry.size;
+    position = 0;
+    is_deflated = entry.method == ARCHIVE_DEFLATED;
+
+    if (!is_deflated) {
+        return true;
+    }
+
+    // Raw deflate, the zip has no zlib header
+    stream = {};
+    stream.next_in = (Bytef*) source;
+    stream.avail_in = (uInt) source_size;
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        is_deflated = false;
+        source = NULL;
+        return false;
+    }
+    return true;
+}
+
+size_t sArchiveReader::read(void *dst,
+                            const size_t bytes) {
+    const size_t to_read = (position + bytes > size) ? (size_t) (size - position) : bytes;
+    if (to_read == 0) {
+        return 0;
+    }
+
+    if (!is_deflated) {
+        memcpy(dst,
+               source + position,
+               to_read);
+        position += to_read;
+        return to_read;
+    }
+
+    stream.next_out = (Bytef*) dst;
+    stream.avail_out = (uInt) to_read;
+    while (stream.avail_out > 0) {
+        const int result = inflate(&stream, Z_NO_FLUSH);
+        if (result == Z_STREAM_END) {
+            break;
+        }
+        if (result != Z_OK) {
+            // Corrupt entry
+            break;
+        }
+    }
+
+    const size_t read_bytes = to_read - stream.avail_out;
+    position += read_bytes;
+    return read_bytes;
+}
+
+void sArchiveReader::close() {
+    if (is_deflated) {
+        inflateEnd(&stream);
+        is_deflated = false;
+    }
+    source = NULL;
+}
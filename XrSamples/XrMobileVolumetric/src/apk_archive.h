@@ -0,0 +1,91 @@
+#ifndef APK_ARCHIVE_H_
+#define APK_ARCHIVE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+#include <zlib.h>
+
+#include "mapped_file.h"
+
+#define ARCHIVE_NO_ENTRY 0xFFFFFFFFu
+#define ARCHIVE_MAX_NAME_LENGTH 512
+
+/**
+ * Read only access to the entries of a zip (the APK), without extracting them
+ * The archive is mapped once, and its central directory is indexed by name
+ * on open; after that it is only read, so any thread can use it.
+ * The stored entries are read-only views straight into the mapping; the
+ * deflated ones are inflated in chunks, by a reader, right into the buffer
+ * of whoever needs them.
+ * Zip64 archives (entries or archives over 4 GB) are not supported.
+ * */
+
+enum eArchiveMethod : uint16_t {
+    ARCHIVE_STORED = 0,
+    ARCHIVE_DEFLATED = 8
+};
+
+struct sArchiveEntry {
+    const char  *name = NULL; // On the central directory, not null terminated
+    uint16_t    name_length = 0;
+    uint16_t    method = ARCHIVE_STORED;
+    uint32_t    crc = 0;
+    uint64_t    compressed_size = 0;
+    uint64_t    size = 0;
+    uint64_t    data_offset = 0; // Past the local header
+};
+
+struct sApkArchive {
+    sMappedFile     file = {};
+    sArchiveEntry   *entries = NULL;
+    uint32_t        entry_count = 0;
+    std::unordered_map<uint64_t, uint32_t> entry_of_name; // By name hash
+
+    // Maps the archive & indexes its central directory; false if it is not a zip
+    bool open(const char *archive_dir);
+    void close();
+
+    uint32_t find_entry(const char *name) const;
+
+    // The entry, as it is on the archive; NULL if it is compressed
+    inline const uint8_t* get_view(const uint32_t entry_id) const {
+        const sArchiveEntry &entry = entries[entry_id];
+        return (entry.method == ARCHIVE_STORED) ? (const uint8_t*) file.data + entry.data_offset : NULL;
+    }
+
+    inline bool is_open() const {
+        return entries != NULL;
+    }
+};
+
+// Sequential reads of an entry, inflated chunk by chunk if it is deflated
+struct sArchiveReader {
+    const uint8_t   *source = NULL; // Entry data on the mapping
+    uint64_t        source_size = 0;
+    uint64_t        size = 0; // Uncompressed
+    uint64_t        position = 0;
+    bool            is_deflated = false;
+    z_stream        stream = {};
+
+    bool open(const sApkArchive &archive,
+              const uint32_t entry_id);
+
+    // Reads up to bytes on dst; returns the bytes read, less only at the end or on a corrupt entry
+    size_t read(void *dst,
+                const size_t bytes);
+
+    // The whole entry as it is, if it is not compressed
+    inline const uint8_t* get_view() const {
+        return (is_deflated) ? NULL : source;
+    }
+
+    void close();
+};
+
+namespace ApkArchive {
+    uint64_t hash_name(const char *name,
+                       const size_t length);
+};
+
+#endif // APK_ARCHIVE_H_
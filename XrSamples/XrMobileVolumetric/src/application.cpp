@@ -20,23 +20,30 @@ void ApplicationLogic::config_render_pipeline(Render::sInstance &renderer) {
     //const uint8_t plaincolor_shader = renderer.material_man.add_raw_shader(RawShaders::basic_vertex,
     //                                                                        RawShaders::basic_fragment);
 
-    // Load textures async (TODO)
-    // For now, just load sync
-    char *volume_tex_dir = NULL;
-    Assets::get_asset_dir("assets/bonsai_256x256x256_uint8.raw",
-                          &volume_tex_dir);
-    const uint8_t volume_texture = renderer.material_man.add_volume_texture(volume_tex_dir,
-                                                                            256,
-                                                                            256,
-                                                                            256);
-    free(volume_tex_dir);
+    // Load the volume async: the render loop keeps running while its streamed.
+    // If the APK has a baked bundle (tools/bake_bundle.cpp), the volume & the noise
+    // are uploaded from it as they are; if not, the volume is preprocessed on
+    // the first run, and then read from the derived cache on the internal data path
+    renderer.material_man.derived_cache.init(Assets::fetch_asset_locator()->root_asset_dir);
+    const bool is_baked = Assets::get_asset_hash(BAKED_VOLUME_ASSET) != 0 && Assets::get_asset_hash(BAKED_NOISE_ASSET) != 0;
+#ifndef PROCEDURAL_VOLUME_SHAPE
+    const uint8_t volume_texture = (is_baked) ? renderer.material_man.load_async_baked_texture3D(BAKED_VOLUME_ASSET)
+                                              : renderer.material_man.load_async_asset_texture3D("assets/bonsai_256x256x256_uint8.raw",
+                                                                                                 256,
+                                                                                                 256,
+                                                                                                 256);
+#else
+    sProceduralVolumeDesc procedural_desc = {};
+    procedural_desc.shape = PROCEDURAL_VOLUME_SHAPE;
+    procedural_desc.dims[0] = procedural_desc.dims[1] = procedural_desc.dims[2] = PROCEDURAL_VOLUME_SIZE;
+    procedural_desc.occupancy = PROCEDURAL_VOLUME_OCCUPANCY;
+    procedural_desc.frequency = PROCEDURAL_VOLUME_FREQUENCY;
+    const uint8_t volume_texture = renderer.material_man.add_procedural_volume_texture(procedural_desc);
+#endif
 
     // Load the blue noise texutre
-    char *blue_noise_tex_dir = NULL;
-    Assets::get_asset_dir("assets/blueNoise.png",
-                          &blue_noise_tex_dir);
-
-    const uint8_t blue_noise_texture = renderer.material_man.add_texture(blue_noise_tex_dir);
+    const uint8_t blue_noise_texture = (is_baked) ? renderer.material_man.add_baked_texture(BAKED_NOISE_ASSET)
+                                                  : renderer.material_man.add_asset_texture("assets/blueNoise.png");
 
     // Create materials
     const uint8_t volumetric_material = renderer.material_man.add_material(volume_shader,
@@ -75,6 +82,17 @@ void ApplicationLogic::config_render_pipeline(Render::sInstance &renderer) {
                                           .culling_mode = GL_FRONT
                                     },
                                     .enabled = true });
+
+    // On the swapchain, whose depth is discarded after the pass
+    const uint8_t scene_pass = renderer.render_graph.add_pass("scene",
+                                                              render_pass);
+    renderer.render_graph.write(scene_pass,
+                                renderer.swapchain_color_resource,
+                                GRAPH_ATTACHMENT_COLOR0);
+    renderer.render_graph.write(scene_pass,
+                                renderer.swapchain_depth_resource,
+                                GRAPH_ATTACHMENT_DEPTH);
+    renderer.compile_render_graph();
 }
 
 void ApplicationLogic::update_logic(const double delta_time,
@@ -6,6 +6,21 @@
 #include "openxr_instance.h"
 #include "render.h"
 
+// Baked with: bake_bundle assets/bundle --volume bonsai <bonsai raw> 256 256 256 --image blue_noise assets/blueNoise.png
+#define BAKED_VOLUME_ASSET "assets/bundle/bonsai.vdc"
+#define BAKED_NOISE_ASSET "assets/bundle/blue_noise.vdc"
+
+// Uncomment to render a procedural volume instead of the bonsai, to measure how
+// the rendering scales with the size & the sparsity (see sProceduralVolume)
+//#define PROCEDURAL_VOLUME_SHAPE PROCEDURAL_FRACTAL_NOISE
+#define PROCEDURAL_VOLUME_SIZE 256
+#define PROCEDURAL_VOLUME_OCCUPANCY 0.1f
+#define PROCEDURAL_VOLUME_FREQUENCY 4.0f
+
+// Records the frames on their own thread, while the next one is simulated (see
+// sFramePipeline); comment out to measure the serial loop
+#define USE_RENDER_THREAD
+
 namespace ApplicationLogic {
 
     void config_render_pipeline(Render::sInstance &renderer);
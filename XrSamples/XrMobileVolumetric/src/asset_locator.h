@@ -12,15 +12,21 @@
 #include <cstdlib>
 #include <unistd.h>
 #include <sys/stat.h>
-#include <zip.h>
+#include <cassert>
 
+#include "apk_archive.h"
 
-//TODO only unzip assets once!
+
+/**
+ * The APK is mapped once, on init, with its central directory indexed; the
+ * assets are read from there, without extracting them
+ * */
 namespace Assets {
     struct sAssetLocator {
         const char* apk_dir;
         char* root_asset_dir;
         uint32_t   root_asset_length = 0;
+        sApkArchive apk;
 
         void init(JNIEnv *env,
                   ANativeActivity *activity) {
@@ -35,9 +41,12 @@ namespace Assets {
             apk_dir = env->GetStringUTFChars( (jstring)result_str,
                                               &isCopy);
 
+            const bool apk_opened = apk.open(apk_dir);
+            assert(apk_opened && "Cannot open the APK");
+
             // TODO: Dynamically fetch this folder or wherever you are supposed to store it
             root_asset_length = strlen(activity->internalDataPath);
-            root_asset_dir = (char*) malloc(strlen(activity->internalDataPath) + 6);
+            root_asset_dir = (char*) malloc(root_asset_length + sizeof("/assets"));
             strcpy((char*) root_asset_dir,
                    activity->internalDataPath);
             strcat((char*) root_asset_dir,
@@ -56,6 +65,7 @@ namespace Assets {
         }
 
         void destroy() {
+            apk.close();
             //free(apk_dir);
             //free(root_asset_dir);
         }
@@ -66,63 +76,71 @@ namespace Assets {
         return &asset_loc;
     }
 
-    // Wrapper arround asset locator
-    inline void get_asset_dir(const char* asset_name,
-                              char** asset_dir) {
-        sAssetLocator * asset_loc = fetch_asset_locator();
-        int err_code;
-        struct zip_stat apk_zip_st;
-        FILE *dump_file = NULL;
-
-        zip *apk = zip_open(asset_loc->apk_dir,
-                            0,
-                            &err_code);
-
-        // TODO:Check errcode
-
-        zip_stat_init(&apk_zip_st);
-        zip_stat(apk,
-                 asset_name,
-                 0,
-                 &apk_zip_st);
-
-        char* raw_file = (char*) malloc(apk_zip_st.size);
-
-        zip_file *file = zip_fopen(apk,
-                                   asset_name,
-                                   0);
-        zip_fread(file,
-                  raw_file,
-                  apk_zip_st.size);
-
-        int asset_name_len = strlen(asset_name);
-
-        *asset_dir = (char*) malloc( asset_loc->root_asset_length + asset_name_len + 1);
-        strcpy(*asset_dir,
-               asset_loc->root_asset_dir);
-        strcat(*asset_dir,
-               "/");
-        strcat(*asset_dir,
-               asset_name);
-        //*asset_dir[strlen(asset_loc->root_asset_dir) + asset_name_len] = '\0';
-
-        dump_file = fopen(*asset_dir,
-                          "wb");
-
-        //char* error = strerror(errno);
-        //error[2] = 0;
-
-        assert(dump_file != NULL && "Cannot open file to store asset");
-
-        fwrite(raw_file,
-               apk_zip_st.size,
-               1,
-               dump_file);
-
-        zip_fclose(file);
-        fclose(dump_file);
-        zip_close(apk);
-        free(raw_file);
+    // Identity of the content of an asset, from the CRC & size on the central
+    // directory of the APK, without reading it; 0 if it is not there
+    inline uint64_t get_asset_hash(const char* asset_name) {
+        const sApkArchive &apk = fetch_asset_locator()->apk;
+        const uint32_t entry_id = apk.find_entry(asset_name);
+        if (entry_id == ARCHIVE_NO_ENTRY) {
+            return 0;
+        }
+
+        return ((uint64_t) apk.entries[entry_id].crc << 32) ^ apk.entries[entry_id].size;
+    }
+
+    // Read-only view of an asset on the mapped APK, valid for the whole run;
+    // NULL if it is not there, or if it is compressed (see open_asset_reader)
+    inline const uint8_t* get_asset_view(const char* asset_name,
+                                         size_t *size) {
+        const sApkArchive &apk = fetch_asset_locator()->apk;
+        const uint32_t entry_id = apk.find_entry(asset_name);
+        if (entry_id == ARCHIVE_NO_ENTRY) {
+            return NULL;
+        }
+
+        *size = apk.entries[entry_id].size;
+        return apk.get_view(entry_id);
+    }
+
+    // Sequential reads of an asset, stored or deflated; false if it is not there
+    inline bool open_asset_reader(const char* asset_name,
+                                  sArchiveReader *reader) {
+        const sApkArchive &apk = fetch_asset_locator()->apk;
+        const uint32_t entry_id = apk.find_entry(asset_name);
+        if (entry_id == ARCHIVE_NO_ENTRY) {
+            return false;
+        }
+
+        return reader->open(apk,
+                            entry_id);
+    }
+
+    /**
+     * Whole asset on memory: the view on the APK if it is stored, and if not,
+     * inflated into a new buffer, that is returned on owned_data to be freed.
+     * NULL if it is not there
+     * */
+    inline const uint8_t* load_asset(const char* asset_name,
+                                     size_t *size,
+                                     uint8_t **owned_data) {
+        *owned_data = NULL;
+        sArchiveReader reader = {};
+        if (!open_asset_reader(asset_name, &reader)) {
+            return NULL;
+        }
+
+        *size = reader.size;
+        const uint8_t *view = reader.get_view();
+        if (view == NULL) {
+            *owned_data = (uint8_t*) malloc(reader.size);
+            const size_t read_bytes = reader.read(*owned_data,
+                                                  reader.size);
+            assert(read_bytes == reader.size && "Corrupt asset on the APK");
+            view = *owned_data;
+        }
+        reader.close();
+
+        return view;
     }
 }
 
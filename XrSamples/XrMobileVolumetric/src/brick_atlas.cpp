@@ -0,0 +1,141 @@
+#include "brick_atlas.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+#include "parallel_for.h"
+
+void sBrickAtlas::clean() {
+    free(page_table);
+    free(atlas);
+    page_table = NULL;
+    atlas = NULL;
+    resident_bricks = 0;
+}
+
+inline uint32_t clamp_coord(const int64_t coord,
+                            const uint32_t size) {
+    return (coord < 0) ? 0 : ((coord >= size) ? size - 1 : (uint32_t) coord);
+}
+
+bool BrickAtlas::build(const uint8_t *volume,
+                       const uint32_t volume_dims[3],
+                       const uint32_t brick_size,
+                       const uint8_t empty_value,
+                       const uint32_t thread_count,
+                       sBrickAtlas *result,
+                       const uint32_t max_texture_size) {
+    result->clean();
+    result->brick_size = brick_size;
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        result->volume_dims[axis] = volume_dims[axis];
+        result->brick_count[axis] = (volume_dims[axis] + brick_size - 1) / brick_size;
+    }
+
+    const size_t row = volume_dims[0];
+    const size_t slice = row * volume_dims[1];
+    const uint32_t total_bricks = result->get_total_bricks();
+    const uint32_t *brick_count = result->brick_count;
+
+    // Find the resident bricks; the border is included, since it is sampled too
+    uint8_t *is_resident = (uint8_t*) calloc(total_bricks, 1);
+    Parallel::for_range(0, brick_count[2], thread_count, [&](const uint32_t bz_start, const uint32_t bz_end) {
+        for(uint32_t bz = bz_start; bz < bz_end; bz++) {
+            for(uint32_t by = 0; by < brick_count[1]; by++) {
+                for(uint32_t bx = 0; bx < brick_count[0]; bx++) {
+                    const uint32_t start[3] = {clamp_coord((int64_t) bx * brick_size - 1, volume_dims[0]),
+                                               clamp_coord((int64_t) by * brick_size - 1, volume_dims[1]),
+                                               clamp_coord((int64_t) bz * brick_size - 1, volume_dims[2])};
+                    const uint32_t end[3] = {clamp_coord((int64_t) (bx + 1) * brick_size, volume_dims[0]),
+                                             clamp_coord((int64_t) (by + 1) * brick_size, volume_dims[1]),
+                                             clamp_coord((int64_t) (bz + 1) * brick_size, volume_dims[2])};
+
+                    bool resident = false;
+                    for(uint32_t z = start[2]; z <= end[2] && !resident; z++) {
+                        for(uint32_t y = start[1]; y <= end[1] && !resident; y++) {
+                            const uint8_t *voxels = volume + z * slice + y * row;
+                            for(uint32_t x = start[0]; x <= end[0]; x++) {
+                                if (voxels[x] > empty_value) {
+                                    resident = true;
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                    is_resident[bx + (by + bz * brick_count[1]) * brick_count[0]] = resident;
+                }
+            }
+        }
+    });
+
+    for(uint32_t i = 0; i < total_bricks; i++) {
+        result->resident_bricks += is_resident[i];
+    }
+
+    // Slots as close to a cube as possible
+    const uint32_t resident_bricks = (result->resident_bricks > 0) ? result->resident_bricks : 1;
+    uint32_t *slot_count = result->slot_count;
+    slot_count[0] = (uint32_t) ceil(cbrt((double) resident_bricks));
+    slot_count[1] = (uint32_t) ceil(sqrt((double) resident_bricks / slot_count[0]));
+    slot_count[2] = (resident_bricks + slot_count[0] * slot_count[1] - 1) / (slot_count[0] * slot_count[1]);
+    const uint32_t max_slots = BrickAtlas::get_max_slots_per_axis(result->get_slot_side(),
+                                                                  max_texture_size);
+    if (slot_count[0] > max_slots || slot_count[1] > max_slots || slot_count[2] > max_slots) {
+        free(is_resident);
+        return false;
+    }
+
+    const uint32_t slot_side = result->get_slot_side();
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        result->atlas_dims[axis] = slot_count[axis] * slot_side;
+    }
+
+    // Page table, the resident bricks take the slots in order
+    result->page_table = (uint8_t*) calloc(total_bricks, 4);
+    uint32_t next_slot = 0;
+    for(uint32_t i = 0; i < total_bricks; i++) {
+        if (!is_resident[i]) {
+            continue;
+        }
+        uint8_t *page = result->page_table + i * 4;
+        page[0] = (uint8_t) (next_slot % slot_count[0]);
+        page[1] = (uint8_t) ((next_slot / slot_count[0]) % slot_count[1]);
+        page[2] = (uint8_t) (next_slot / (slot_count[0] * slot_count[1]));
+        page[3] = 255;
+        next_slot++;
+    }
+
+    // Copy the resident bricks with their border
+    result->atlas = (uint8_t*) calloc(result->get_atlas_size(), 1);
+    const size_t atlas_row = result->atlas_dims[0];
+    const size_t atlas_slice = atlas_row * result->atlas_dims[1];
+    Parallel::for_range(0, total_bricks, thread_count, [&](const uint32_t brick_start, const uint32_t brick_end) {
+        for(uint32_t i = brick_start; i < brick_end; i++) {
+            if (!is_resident[i]) {
+                continue;
+            }
+            const int64_t origin[3] = {(int64_t) (i % brick_count[0]) * brick_size - BRICK_ATLAS_BORDER,
+                                       (int64_t) ((i / brick_count[0]) % brick_count[1]) * brick_size - BRICK_ATLAS_BORDER,
+                                       (int64_t) (i / (brick_count[0] * brick_count[1])) * brick_size - BRICK_ATLAS_BORDER};
+            const uint8_t *page = result->page_table + i * 4;
+            uint8_t *slot = result->atlas + page[2] * slot_side * atlas_slice + page[1] * slot_side * atlas_row + page[0] * slot_side;
+
+            for(uint32_t z = 0; z < slot_side; z++) {
+                const uint32_t vz = clamp_coord(origin[2] + z, volume_dims[2]);
+                for(uint32_t y = 0; y < slot_side; y++) {
+                    const uint32_t vy = clamp_coord(origin[1] + y, volume_dims[1]);
+                    const uint8_t *voxels = volume + vz * slice + vy * row;
+                    uint8_t *slot_row = slot + z * atlas_slice + y * atlas_row;
+                    for(uint32_t x = 0; x < slot_side; x++) {
+                        slot_row[x] = voxels[clamp_coord(origin[0] + x, volume_dims[0])];
+                    }
+                }
+            }
+        }
+    });
+
+    free(is_resident);
+
+    return true;
+}
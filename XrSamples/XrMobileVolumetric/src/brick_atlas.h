@@ -0,0 +1,75 @@
+#ifndef BRICK_ATLAS_H_
+#define BRICK_ATLAS_H_
+
+#include <cstdint>
+#include <cstddef>
+
+#define BRICK_ATLAS_BRICK_SIZE 16 // Voxels per side, without the border; BRICK_SIZE on the shaders
+#define BRICK_ATLAS_BORDER 1
+#define BRICK_ATLAS_MAX_SLOTS_PER_AXIS 255 // Slot coords are stored as 8 bits
+#define BRICK_ATLAS_MAX_TEXTURE_SIZE 2048 // GL_MAX_3D_TEXTURE_SIZE of the Quest, when there is no GL
+
+/**
+ * Sparse volume: only the non-empty bricks are stored, packed on an atlas,
+ * and a page table maps each brick of the volume to its atlas slot.
+ * Each brick on the atlas carries a border of one voxel copied from its
+ * neighbours (clamped on the volume edges), so the trilinear samples next
+ * to the brick faces are the same as on the dense volume.
+ * The page table is RGBA8: the atlas slot on xyz, and a = 255 if the brick
+ * is resident, 0 if its empty.
+ * */
+struct sBrickAtlas {
+    uint32_t    brick_size = BRICK_ATLAS_BRICK_SIZE;
+    uint32_t    volume_dims[3] = {0, 0, 0};
+
+    // Page table
+    uint32_t    brick_count[3] = {0, 0, 0};
+    uint8_t     *page_table = NULL;
+
+    // Atlas
+    uint32_t    resident_bricks = 0;
+    uint32_t    slot_count[3] = {0, 0, 0};
+    uint32_t    atlas_dims[3] = {0, 0, 0};
+    uint8_t     *atlas = NULL;
+
+    inline uint32_t get_total_bricks() const {
+        return brick_count[0] * brick_count[1] * brick_count[2];
+    }
+
+    inline size_t get_atlas_size() const {
+        return (size_t) atlas_dims[0] * atlas_dims[1] * atlas_dims[2];
+    }
+
+    inline uint32_t get_slot_side() const {
+        return brick_size + 2 * BRICK_ATLAS_BORDER;
+    }
+
+    void clean();
+};
+
+namespace BrickAtlas {
+    // Slots that fit on an axis of the atlas, with slots of slot_side voxels
+    inline uint32_t get_max_slots_per_axis(const uint32_t slot_side,
+                                           const uint32_t max_texture_size) {
+        const uint32_t texture_slots = max_texture_size / slot_side;
+        return (texture_slots < BRICK_ATLAS_MAX_SLOTS_PER_AXIS) ? texture_slots : BRICK_ATLAS_MAX_SLOTS_PER_AXIS;
+    }
+
+    /**
+     * Builds the atlas of a GL_R8 volume. The volume can be a file mapping:
+     * only the resident bricks are copied, so there is never a dense copy on memory.
+     * A brick is empty if it, and its border, are all <= empty_value.
+     * Returns false if the resident bricks do not fit on the slot limits, or
+     * on an atlas of max_texture_size (GL_MAX_3D_TEXTURE_SIZE).
+     * thread_count == 0 uses all the cores.
+     * */
+    bool build(const uint8_t *volume,
+               const uint32_t volume_dims[3],
+               const uint32_t brick_size,
+               const uint8_t empty_value,
+               const uint32_t thread_count,
+               sBrickAtlas *result,
+               const uint32_t max_texture_size = BRICK_ATLAS_MAX_TEXTURE_SIZE);
+};
+
+#endif // BRICK_ATLAS_H_
@@ -0,0 +1,199 @@
+#include "brick_codec.h"
+
+#include <cstdlib>
+#include <cstring>
+
+inline uint32_t read_u32(const uint8_t *data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+inline uint32_t hash_sequence(const uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - BRICK_CODEC_HASH_BITS);
+}
+
+// Lengths over 15 go on extra bytes of 255, and a last one with the rest
+inline bool write_length(size_t length,
+                         uint8_t *dst,
+                         const size_t dst_capacity,
+                         size_t *out) {
+    for(; length >= 255; length -= 255) {
+        if (*out >= dst_capacity) {
+            return false;
+        }
+        dst[(*out)++] = 255;
+    }
+    if (*out >= dst_capacity) {
+        return false;
+    }
+    dst[(*out)++] = (uint8_t) length;
+    return true;
+}
+
+inline bool read_length(const uint8_t *src,
+                        const size_t src_size,
+                        size_t *in,
+                        size_t *length) {
+    uint8_t byte = 255;
+    while (byte == 255) {
+        if (*in >= src_size) {
+            return false;
+        }
+        byte = src[(*in)++];
+        *length += byte;
+    }
+    return true;
+}
+
+// A token, the literals, and the match if there is one (match_length 0 on the last sequence)
+inline bool write_sequence(const uint8_t *literals,
+                           const size_t literal_length,
+                           const uint32_t offset,
+                           const size_t match_length,
+                           uint8_t *dst,
+                           const size_t dst_capacity,
+                           size_t *out) {
+    const size_t match_code = (match_length > 0) ? match_length - BRICK_CODEC_MIN_MATCH : 0;
+    if (*out >= dst_capacity) {
+        return false;
+    }
+    dst[(*out)++] = (uint8_t) (((literal_length < 15) ? literal_length : 15) << 4 | ((match_code < 15) ? match_code : 15));
+
+    if (literal_length >= 15 && !write_length(literal_length - 15, dst, dst_capacity, out)) {
+        return false;
+    }
+    if (*out + literal_length > dst_capacity) {
+        return false;
+    }
+    memcpy(dst + *out, literals, literal_length);
+    *out += literal_length;
+
+    if (match_length == 0) {
+        return true;
+    }
+    if (*out + 2 > dst_capacity) {
+        return false;
+    }
+    dst[(*out)++] = (uint8_t) (offset & 0xFF);
+    dst[(*out)++] = (uint8_t) (offset >> 8);
+    return match_code < 15 || write_length(match_code - 15, dst, dst_capacity, out);
+}
+
+size_t BrickCodec::compress(const uint8_t *src,
+                            const size_t size,
+                            const uint32_t stride,
+                            uint8_t *dst,
+                            const size_t dst_capacity) {
+    // Delta filter
+    uint8_t *filtered = (uint8_t*) malloc((size > 0) ? size : 1);
+    for(size_t i = 0; i < size; i++) {
+        filtered[i] = (i < stride) ? src[i] : (uint8_t) (src[i] - src[i - stride]);
+    }
+
+    uint32_t *positions = (uint32_t*) malloc(sizeof(uint32_t) << BRICK_CODEC_HASH_BITS);
+    memset(positions, 0xFF, sizeof(uint32_t) << BRICK_CODEC_HASH_BITS);
+
+    size_t out = 0, anchor = 0, position = 0;
+    bool fits = true;
+    while (fits && position + BRICK_CODEC_MIN_MATCH <= size) {
+        const uint32_t sequence = read_u32(filtered + position);
+        const uint32_t hash = hash_sequence(sequence);
+        const uint32_t candidate = positions[hash];
+        positions[hash] = (uint32_t) position;
+
+        if (candidate == UINT32_MAX || position - candidate > BRICK_CODEC_MAX_OFFSET || read_u32(filtered + candidate) != sequence) {
+            position++;
+            continue;
+        }
+
+        size_t match_length = BRICK_CODEC_MIN_MATCH;
+        while (position + match_length < size && filtered[candidate + match_length] == filtered[position + match_length]) {
+            match_length++;
+        }
+
+        fits = write_sequence(filtered + anchor,
+                              position - anchor,
+                              (uint32_t) (position - candidate),
+                              match_length,
+                              dst,
+                              dst_capacity,
+                              &out);
+        position += match_length;
+        anchor = position;
+    }
+
+    fits = fits && write_sequence(filtered + anchor,
+                                  size - anchor,
+                                  0,
+                                  0,
+                                  dst,
+                                  dst_capacity,
+                                  &out);
+
+    free(positions);
+    free(filtered);
+
+    return (fits) ? out : 0;
+}
+
+bool BrickCodec::decompress(const uint8_t *src,
+                            const size_t src_size,
+                            const uint32_t stride,
+                            uint8_t *dst,
+                            const size_t size) {
+    size_t in = 0, out = 0;
+    while (out < size) {
+        if (in >= src_size) {
+            return false;
+        }
+        const uint8_t token = src[in++];
+
+        size_t literal_length = token >> 4;
+        if (literal_length == 15 && !read_length(src, src_size, &in, &literal_length)) {
+            return false;
+        }
+        if (in + literal_length > src_size || out + literal_length > size) {
+            return false;
+        }
+        memcpy(dst + out, src + in, literal_length);
+        in += literal_length;
+        out += literal_length;
+
+        // The last sequence has no match
+        if (out == size) {
+            break;
+        }
+
+        if (in + 2 > src_size) {
+            return false;
+        }
+        const size_t offset = src[in] | ((size_t) src[in + 1] << 8);
+        in += 2;
+        size_t match_length = token & 0xF;
+        if (match_length == 15 && !read_length(src, src_size, &in, &match_length)) {
+            return false;
+        }
+        match_length += BRICK_CODEC_MIN_MATCH;
+        if (offset == 0 || offset > out || out + match_length > size) {
+            return false;
+        }
+
+        // The runs overlap their own output, so byte by byte
+        const uint8_t *match = dst + out - offset;
+        if (offset >= match_length) {
+            memcpy(dst + out, match, match_length);
+        } else {
+            for(size_t i = 0; i < match_length; i++) {
+                dst[out + i] = match[i];
+            }
+        }
+        out += match_length;
+    }
+
+    // Undo the delta filter
+    for(size_t i = stride; i < size; i++) {
+        dst[i] = (uint8_t) (dst[i] + dst[i - stride]);
+    }
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef BRICK_CODEC_H_
+#define BRICK_CODEC_H_
+
+#include <cstdint>
+#include <cstddef>
+
+#define BRICK_CODEC_MIN_MATCH 4
+#define BRICK_CODEC_MAX_OFFSET 0xFFFF
+#define BRICK_CODEC_HASH_BITS 12
+
+/**
+ * Lossless codec for the bricks of a volume, with no dependencies
+ * The voxels are delta filtered (each one minus the previous of the same
+ * byte of the voxel), so the smooth & empty regions become runs of small
+ * values, and then LZ compressed, with LZ4-like sequences: a token with the
+ * literal & match lengths, the literals, and a 16 bit offset. A match can
+ * overlap its own output, so the runs need no special case.
+ * Each brick is compressed on its own, so they can be decoded in any order,
+ * and from any thread.
+ * */
+
+enum eBrickCodec : uint8_t {
+    BRICK_CODEC_RAW = 0,
+    BRICK_CODEC_DELTA_LZ
+};
+
+namespace BrickCodec {
+    // Worst case of compress, for data that cannot be compressed
+    inline size_t get_max_compressed_size(const size_t size) {
+        return size + size / 255 + 16;
+    }
+
+    /**
+     * Compresses size bytes of voxels of stride bytes each; returns the
+     * compressed size, or 0 if it does not fit on dst_capacity
+     * */
+    size_t compress(const uint8_t *src,
+                    const size_t size,
+                    const uint32_t stride,
+                    uint8_t *dst,
+                    const size_t dst_capacity);
+
+    // Decompresses exactly size bytes to dst; false if the data is corrupt
+    bool decompress(const uint8_t *src,
+                    const size_t src_size,
+                    const uint32_t stride,
+                    uint8_t *dst,
+                    const size_t size);
+};
+
+#endif // BRICK_CODEC_H_
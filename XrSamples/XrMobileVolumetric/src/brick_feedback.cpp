@@ -0,0 +1,114 @@
+#include "brick_feedback.h"
+
+#include <cstdlib>
+#include <cstring>
+
+// The FBOs are RGBA8, read back as they are (the pages)
+#define FEEDBACK_TEXEL_SIZE 4
+
+void sBrickFeedback::init(const uint32_t width_i,
+                          const uint32_t height_i) {
+    width = width_i;
+    height = height_i;
+
+    glGenBuffers(FEEDBACK_READBACK_COUNT, pbos);
+    for(uint8_t i = 0; i < FEEDBACK_READBACK_COUNT; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER,
+                     get_page_count() * FEEDBACK_TEXEL_SIZE,
+                     NULL,
+                     GL_STREAM_READ);
+        fences[i] = 0;
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    pages = (uint8_t*) calloc(get_page_count(), 4);
+    next_readback = 0;
+    created = true;
+}
+
+void sBrickFeedback::destroy() {
+    if (!created) {
+        return;
+    }
+
+    for(uint8_t i = 0; i < FEEDBACK_READBACK_COUNT; i++) {
+        if (fences[i] != 0) {
+            glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+    }
+    glDeleteBuffers(FEEDBACK_READBACK_COUNT, pbos);
+    free(pages);
+    pages = NULL;
+    created = false;
+}
+
+void sBrickFeedback::read_back(const sFBO &fbo) {
+    // The oldest one has not been read yet
+    if (fences[next_readback] != 0) {
+        readbacks_skipped++;
+        return;
+    }
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo.id);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[next_readback]);
+    glReadPixels(0,
+                 0,
+                 width,
+                 height,
+                 GL_RGBA,
+                 GL_UNSIGNED_BYTE,
+                 0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+
+    fences[next_readback] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    next_readback = (next_readback + 1) % FEEDBACK_READBACK_COUNT;
+    readbacks_issued++;
+}
+
+const uint8_t* sBrickFeedback::poll() {
+    // From the oldest; only the newest finished one is copied
+    int32_t finished = -1;
+    for(uint8_t i = 0; i < FEEDBACK_READBACK_COUNT; i++) {
+        const uint8_t readback = (next_readback + i) % FEEDBACK_READBACK_COUNT;
+        if (fences[readback] == 0) {
+            continue;
+        }
+
+        const GLenum status = glClientWaitSync(fences[readback], 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        glDeleteSync(fences[readback]);
+        fences[readback] = 0;
+        finished = readback;
+        readbacks_completed++;
+    }
+
+    if (finished < 0) {
+        return NULL;
+    }
+
+    const uint32_t page_count = get_page_count();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[finished]);
+    const uint8_t *texels = (const uint8_t*) glMapBufferRange(GL_PIXEL_PACK_BUFFER,
+                                                              0,
+                                                              page_count * FEEDBACK_TEXEL_SIZE,
+                                                              GL_MAP_READ_BIT);
+    if (texels == NULL) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        return NULL;
+    }
+
+    memcpy(pages,
+           texels,
+           page_count * FEEDBACK_TEXEL_SIZE);
+
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    return pages;
+}
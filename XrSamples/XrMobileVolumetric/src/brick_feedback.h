@@ -0,0 +1,50 @@
+#ifndef BRICK_FEEDBACK_H_
+#define BRICK_FEEDBACK_H_
+
+#include <cstdint>
+#include <GLES3/gl3.h>
+
+#include "fbo.h"
+
+#define FEEDBACK_READBACK_COUNT 3 // Frames in flight before a readback is read
+#define FEEDBACK_DEFAULT_SIZE 128
+
+/**
+ * Async readback of a brick feedback pass (see streamed_feedback_shader)
+ * After the pass is drawn its FBO is copied to a pixel-pack buffer, with a
+ * fence behind it; frames later, once the fence has passed, the buffer is
+ * mapped & copied to the RGBA8 pages, so the CPU never waits on the GPU.
+ * If all the buffers are still in flight, that frame is not read back.
+ * */
+struct sBrickFeedback {
+    uint32_t    width = 0;
+    uint32_t    height = 0;
+
+    uint32_t    pbos[FEEDBACK_READBACK_COUNT] = {};
+    GLsync      fences[FEEDBACK_READBACK_COUNT] = {};
+    uint8_t     next_readback = 0; // Also the oldest in flight
+    bool        created = false;
+
+    uint8_t     *pages = NULL; // Of the last readback that finished
+
+    uint32_t    readbacks_issued = 0;
+    uint32_t    readbacks_skipped = 0;
+    uint32_t    readbacks_completed = 0;
+
+    void init(const uint32_t width_i,
+              const uint32_t height_i);
+    void destroy();
+
+    // Right after the feedback pass
+    void read_back(const sFBO &fbo);
+
+    // The pages of the newest readback that has finished since the last
+    // call, or NULL if none has
+    const uint8_t* poll();
+
+    inline uint32_t get_page_count() const {
+        return width * height;
+    }
+};
+
+#endif // BRICK_FEEDBACK_H_
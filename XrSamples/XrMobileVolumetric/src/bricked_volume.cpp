@@ -0,0 +1,293 @@
+#include "bricked_volume.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// The structs are written as is to disk
+static_assert(sizeof(sBrickedVolumeHeader) == 48, "Bricked volume header layout changed");
+static_assert(sizeof(sBrickEntry) == 24, "Bricked volume brick entry layout changed");
+
+bool sBrickedVolume::open(const char *file_dir) {
+    if (!file.open(file_dir)) {
+        return false;
+    }
+
+    if (file.size < sizeof(sBrickedVolumeHeader)) {
+        close();
+        return false;
+    }
+
+    header = (const sBrickedVolumeHeader*) file.data;
+
+    if (header->magic != BRICKED_VOLUME_MAGIC ||
+        header->version == 0 || header->version > BRICKED_VOLUME_VERSION ||
+        header->voxel_type >= VOXEL_TYPE_COUNT ||
+        header->brick_size == 0) {
+        close();
+        return false;
+    }
+
+    const size_t table_size = sizeof(sBrickEntry) * get_brick_count();
+    if (header->brick_table_offset + table_size > file.size) {
+        close();
+        return false;
+    }
+
+    bricks = (const sBrickEntry*) (file.data + header->brick_table_offset);
+
+    // Check that no brick points outside the file, or has an unknown codec
+    for(uint32_t i = 0; i < get_brick_count(); i++) {
+        if (!(bricks[i].flags & BRICK_EMPTY) &&
+            (bricks[i].offset + bricks[i].size > file.size || bricks[i].codec > BRICK_CODEC_DELTA_LZ)) {
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void sBrickedVolume::close() {
+    file.close();
+    header = NULL;
+    bricks = NULL;
+}
+
+void sBrickedVolume::get_brick_extent(const uint32_t brick_index,
+                                      uint32_t origin[3],
+                                      uint32_t size[3]) const {
+    const uint32_t dims[3] = {header->width, header->height, header->depth};
+    const uint32_t brick_coords[3] = {
+        brick_index % header->brick_count[0],
+        (brick_index / header->brick_count[0]) % header->brick_count[1],
+        brick_index / (header->brick_count[0] * header->brick_count[1])
+    };
+
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        origin[axis] = brick_coords[axis] * header->brick_size;
+        size[axis] = header->brick_size;
+        if (origin[axis] + size[axis] > dims[axis]) {
+            size[axis] = dims[axis] - origin[axis];
+        }
+    }
+}
+
+size_t sBrickedVolume::get_brick_voxel_size(const uint32_t brick_index) const {
+    uint32_t origin[3], size[3];
+    get_brick_extent(brick_index,
+                     origin,
+                     size);
+    return (size_t) size[0] * size[1] * size[2] * get_voxel_type_size((eVoxelType) header->voxel_type);
+}
+
+bool sBrickedVolume::decode_brick(const uint32_t brick_index,
+                                  uint8_t *dst) const {
+    const sBrickEntry &brick = bricks[brick_index];
+    const size_t voxel_size = get_brick_voxel_size(brick_index);
+
+    if (brick.flags & BRICK_EMPTY) {
+        memset(dst, 0, voxel_size);
+        return true;
+    }
+
+    const uint8_t *data = (const uint8_t*) file.data + brick.offset;
+    if (brick.codec == BRICK_CODEC_RAW) {
+        memcpy(dst, data, voxel_size);
+        return true;
+    }
+
+    return BrickCodec::decompress(data,
+                                  brick.size,
+                                  get_voxel_type_size((eVoxelType) header->voxel_type),
+                                  dst,
+                                  voxel_size);
+}
+
+sBrickRegion sBrickedVolume::get_full_region() const {
+    sBrickRegion region = {};
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        region.max[axis] = header->brick_count[axis];
+    }
+    return region;
+}
+
+// CONVERSION ===================
+inline uint32_t read_voxel(const char *raw,
+                           const size_t index,
+                           const eVoxelType voxel_type) {
+    if (voxel_type == VOXEL_UINT16) {
+        uint16_t value;
+        memcpy(&value, raw + index * 2, sizeof(uint16_t));
+        return value;
+    }
+    return (uint8_t) raw[index];
+}
+
+bool BrickedVolume::convert_from_raw(const char *raw_dir,
+                                     const uint32_t width,
+                                     const uint32_t height,
+                                     const uint32_t depth,
+                                     const eVoxelType voxel_type,
+                                     const uint32_t brick_size,
+                                     const uint32_t empty_value,
+                                     const char *result_dir,
+                                     const eBrickCodec codec) {
+    const uint32_t voxel_size = get_voxel_type_size(voxel_type);
+
+    sMappedFile raw_file = {};
+    if (!raw_file.open(raw_dir)) {
+        return false;
+    }
+    if (raw_file.size < (size_t) width * height * depth * voxel_size) {
+        raw_file.close();
+        return false;
+    }
+    raw_file.advise_sequential_read();
+
+    const bool success = convert_from_memory(raw_file.data,
+                                             width,
+                                             height,
+                                             depth,
+                                             voxel_type,
+                                             brick_size,
+                                             empty_value,
+                                             result_dir,
+                                             codec);
+    raw_file.close();
+
+    return success;
+}
+
+bool BrickedVolume::convert_from_memory(const char *raw_data,
+                                        const uint32_t width,
+                                        const uint32_t height,
+                                        const uint32_t depth,
+                                        const eVoxelType voxel_type,
+                                        const uint32_t brick_size,
+                                        const uint32_t empty_value,
+                                        const char *result_dir,
+                                        const eBrickCodec codec) {
+    const uint32_t voxel_size = get_voxel_type_size(voxel_type);
+    const float max_voxel_value = (voxel_type == VOXEL_UINT16) ? 65535.0f : 255.0f;
+
+    FILE *result_file = fopen(result_dir, "wb");
+    if (result_file == NULL) {
+        return false;
+    }
+
+    sBrickedVolumeHeader header = {};
+    header.voxel_type = voxel_type;
+    header.width = width;
+    header.height = height;
+    header.depth = depth;
+    header.brick_size = brick_size;
+    header.brick_count[0] = (width + brick_size - 1) / brick_size;
+    header.brick_count[1] = (height + brick_size - 1) / brick_size;
+    header.brick_count[2] = (depth + brick_size - 1) / brick_size;
+    header.brick_table_offset = sizeof(sBrickedVolumeHeader);
+
+    const uint32_t brick_count = header.brick_count[0] * header.brick_count[1] * header.brick_count[2];
+    sBrickEntry *brick_table = (sBrickEntry*) malloc(sizeof(sBrickEntry) * brick_count);
+    const size_t max_brick_size = (size_t) brick_size * brick_size * brick_size * voxel_size;
+    char *brick_data = (char*) malloc(max_brick_size);
+    uint8_t *compressed_data = (uint8_t*) malloc(BrickCodec::get_max_compressed_size(max_brick_size));
+
+    // The data starts after the table; the header and table are written at the end
+    uint64_t data_offset = header.brick_table_offset + sizeof(sBrickEntry) * brick_count;
+    fseek(result_file, (long) data_offset, SEEK_SET);
+
+    bool success = true;
+    uint32_t brick_index = 0;
+    for(uint32_t bz = 0; bz < header.brick_count[2]; bz++) {
+        for(uint32_t by = 0; by < header.brick_count[1]; by++) {
+            for(uint32_t bx = 0; bx < header.brick_count[0]; bx++) {
+                const uint32_t origin[3] = {bx * brick_size, by * brick_size, bz * brick_size};
+                uint32_t size[3] = {brick_size, brick_size, brick_size};
+                if (origin[0] + size[0] > width) size[0] = width - origin[0];
+                if (origin[1] + size[1] > height) size[1] = height - origin[1];
+                if (origin[2] + size[2] > depth) size[2] = depth - origin[2];
+
+                // Gather the brick & get its range
+                uint32_t min_value = UINT32_MAX, max_value = 0;
+                size_t brick_voxel = 0;
+                for(uint32_t z = 0; z < size[2]; z++) {
+                    for(uint32_t y = 0; y < size[1]; y++) {
+                        const size_t row_start = (origin[0]) +
+                                                 (size_t) (origin[1] + y) * width +
+                                                 (size_t) (origin[2] + z) * width * height;
+                        memcpy(brick_data + brick_voxel * voxel_size,
+                               raw_data + row_start * voxel_size,
+                               size[0] * voxel_size);
+
+                        for(uint32_t x = 0; x < size[0]; x++) {
+                            const uint32_t value = read_voxel(raw_data,
+                                                              row_start + x,
+                                                              voxel_type);
+                            min_value = (value < min_value) ? value : min_value;
+                            max_value = (value > max_value) ? value : max_value;
+                        }
+                        brick_voxel += size[0];
+                    }
+                }
+
+                sBrickEntry &entry = brick_table[brick_index++];
+                entry = {};
+                entry.min = min_value / max_voxel_value;
+                entry.max = max_value / max_voxel_value;
+
+                if (max_value <= empty_value) {
+                    entry.flags = BRICK_EMPTY;
+                    continue;
+                }
+
+                entry.offset = data_offset;
+                entry.size = (uint32_t) (brick_voxel * voxel_size);
+
+                // Raw if the compression does not pay off
+                const char *stored_data = brick_data;
+                if (codec == BRICK_CODEC_DELTA_LZ) {
+                    const size_t compressed_size = BrickCodec::compress((const uint8_t*) brick_data,
+                                                                        entry.size,
+                                                                        voxel_size,
+                                                                        compressed_data,
+                                                                        BrickCodec::get_max_compressed_size(max_brick_size));
+                    if (compressed_size > 0 && compressed_size < entry.size) {
+                        entry.codec = BRICK_CODEC_DELTA_LZ;
+                        entry.size = (uint32_t) compressed_size;
+                        stored_data = (const char*) compressed_data;
+                    }
+                }
+
+                if (fwrite(stored_data, 1, entry.size, result_file) != entry.size) {
+                    success = false;
+                }
+                data_offset += entry.size;
+            }
+        }
+    }
+
+    fseek(result_file, 0, SEEK_SET);
+    if (fwrite(&header, sizeof(sBrickedVolumeHeader), 1, result_file) != 1 ||
+        fwrite(brick_table, sizeof(sBrickEntry), brick_count, result_file) != brick_count) {
+        success = false;
+    }
+
+    fclose(result_file);
+    free(brick_table);
+    free(brick_data);
+    free(compressed_data);
+
+    return success;
+}
+
+void BrickedVolume::get_lod_dir(const char *base_dir,
+                                const uint32_t level,
+                                char *result,
+                                const size_t result_size) {
+    if (level == 0) {
+        snprintf(result, result_size, "%s", base_dir);
+    } else {
+        snprintf(result, result_size, "%s.lod%u", base_dir, level);
+    }
+}
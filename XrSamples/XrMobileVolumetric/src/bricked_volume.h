@@ -0,0 +1,175 @@
+#ifndef BRICKED_VOLUME_H_
+#define BRICKED_VOLUME_H_
+
+#include <cstdint>
+#include <cstddef>
+
+#include "mapped_file.h"
+#include "brick_codec.h"
+
+/**
+ * Bricked volume container (.vbrk)
+ * Layout on disk (little endian):
+ *  - sBrickedVolumeHeader
+ *  - brick table: one sBrickEntry per brick, x major, then y, then z
+ *  - brick data: the voxels of each non-empty brick, stored tightly with its
+ *    real extent (the bricks on the borders can be smaller than brick_size)
+ * Empty bricks have no data on disk, so they cost nothing to read.
+ * Since version 2, each brick can be compressed on its own (see BrickCodec),
+ * so any brick can still be read without the rest; version 1 files are
+ * all raw, and open as they are.
+ * The min/max on the table are normalized to [0, 1], the same range the
+ * shaders see the densities in.
+ * */
+
+#define BRICKED_VOLUME_MAGIC 0x4B524256 // "VBRK"
+#define BRICKED_VOLUME_VERSION 2
+#define BRICKED_VOLUME_DEFAULT_BRICK_SIZE 32
+
+enum eVoxelType : uint8_t {
+    VOXEL_UINT8 = 0,
+    VOXEL_UINT16,
+    VOXEL_TYPE_COUNT
+};
+
+enum eBrickFlags : uint8_t {
+    BRICK_EMPTY = 0b1
+};
+
+inline uint32_t get_voxel_type_size(const eVoxelType type) {
+    return (type == VOXEL_UINT16) ? 2 : 1;
+}
+
+struct sBrickedVolumeHeader {
+    uint32_t magic = BRICKED_VOLUME_MAGIC;
+    uint16_t version = BRICKED_VOLUME_VERSION;
+    uint8_t  voxel_type = VOXEL_UINT8;
+    uint8_t  padding = 0;
+
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t depth = 0;
+
+    uint32_t brick_size = BRICKED_VOLUME_DEFAULT_BRICK_SIZE;
+    uint32_t brick_count[3] = {0, 0, 0}; // Bricks on x, y, z
+    uint32_t reserved = 0;
+
+    uint64_t brick_table_offset = 0;
+};
+
+struct sBrickEntry {
+    uint64_t offset = 0; // From the start of the file, 0 if empty
+    uint32_t size = 0; // Bytes of data on disk, compressed or not
+    float    min = 0.0f;
+    float    max = 0.0f;
+    uint8_t  flags = 0;
+    uint8_t  codec = BRICK_CODEC_RAW; // eBrickCodec
+    uint8_t  padding[2] = {0, 0};
+};
+
+// Range of bricks, max is exclusive
+struct sBrickRegion {
+    uint32_t min[3] = {0, 0, 0};
+    uint32_t max[3] = {0, 0, 0};
+};
+
+struct sBrickedVolume {
+    sMappedFile                 file = {};
+    const sBrickedVolumeHeader  *header = NULL;
+    const sBrickEntry           *bricks = NULL;
+
+    // Returns false if the file cannot be opened, or if its not a valid container
+    bool open(const char *file_dir);
+    void close();
+
+    inline uint32_t get_brick_count() const {
+        return header->brick_count[0] * header->brick_count[1] * header->brick_count[2];
+    }
+
+    inline uint32_t get_brick_index(const uint32_t x,
+                                    const uint32_t y,
+                                    const uint32_t z) const {
+        return x + (y * header->brick_count[0]) + (z * header->brick_count[0] * header->brick_count[1]);
+    }
+
+    // Origin and size in voxels of a brick
+    void get_brick_extent(const uint32_t brick_index,
+                          uint32_t origin[3],
+                          uint32_t size[3]) const;
+
+    // Empty space decision only from the brick table, without touching the voxels
+    inline bool is_brick_empty(const uint32_t brick_index,
+                               const float density_threshold) const {
+        const sBrickEntry &brick = bricks[brick_index];
+        return (brick.flags & BRICK_EMPTY) || brick.max < density_threshold;
+    }
+
+    inline bool is_brick_compressed(const uint32_t brick_index) const {
+        return bricks[brick_index].codec != BRICK_CODEC_RAW;
+    }
+
+    // The voxels of a raw brick, on the mapping; NULL if it is empty or
+    // compressed (see decode_brick)
+    inline const char* get_brick_data(const uint32_t brick_index) const {
+        const sBrickEntry &brick = bricks[brick_index];
+        if ((brick.flags & BRICK_EMPTY) || brick.codec != BRICK_CODEC_RAW) {
+            return NULL;
+        }
+        return file.data + brick.offset;
+    }
+
+    // Bytes of the voxels of a brick, once decoded
+    size_t get_brick_voxel_size(const uint32_t brick_index) const;
+
+    /**
+     * The voxels of a brick on dst, decompressed if needed, with its real
+     * extent; an empty brick is filled with zeroes. Any thread can decode,
+     * any brick. False if the brick data is corrupt
+     * */
+    bool decode_brick(const uint32_t brick_index,
+                      uint8_t *dst) const;
+
+    // The whole volume, as a region
+    sBrickRegion get_full_region() const;
+};
+
+namespace BrickedVolume {
+    /**
+     * Converts a headerless raw volume to the bricked container.
+     * Bricks with all their voxels at or below empty_value are flagged as empty
+     * and not stored. With BRICK_CODEC_DELTA_LZ, each brick is compressed,
+     * unless that does not make it smaller.
+     * Returns false if the raw file cannot be read, or the output cannot be written
+     * */
+    bool convert_from_raw(const char *raw_dir,
+                          const uint32_t width,
+                          const uint32_t height,
+                          const uint32_t depth,
+                          const eVoxelType voxel_type,
+                          const uint32_t brick_size,
+                          const uint32_t empty_value,
+                          const char *result_dir,
+                          const eBrickCodec codec = BRICK_CODEC_RAW);
+
+    // Same as convert_from_raw, from a volume on memory
+    bool convert_from_memory(const char *raw_data,
+                             const uint32_t width,
+                             const uint32_t height,
+                             const uint32_t depth,
+                             const eVoxelType voxel_type,
+                             const uint32_t brick_size,
+                             const uint32_t empty_value,
+                             const char *result_dir,
+                             const eBrickCodec codec = BRICK_CODEC_RAW);
+
+    /**
+     * Path of a level of detail of a volume: base_dir for level 0, and
+     * base_dir.lodN for the level N (each one max-reduced from the previous)
+     * */
+    void get_lod_dir(const char *base_dir,
+                     const uint32_t level,
+                     char *result,
+                     const size_t result_size);
+};
+
+#endif // BRICKED_VOLUME_H_
@@ -0,0 +1,290 @@
+#include "derived_cache.h"
+
+#include <cassert>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <sys/stat.h>
+
+#define HASH_PRIME_1 0x9E3779B185EBCA87ull
+#define HASH_PRIME_2 0xC2B2AE3D27D4EB4Full
+
+// The internal formats of the sections
+#define FORMAT_R8 0x8229
+#define FORMAT_RG8 0x822B
+#define FORMAT_RGBA8 0x8058
+
+// Bytes per texel; 0 on the formats that are not cached
+static uint32_t get_texel_size(const uint32_t gl_format) {
+    switch(gl_format) {
+        case FORMAT_R8: return 1;
+        case FORMAT_RG8: return 2;
+        case FORMAT_RGBA8: return 4;
+        default: return 0;
+    }
+}
+
+// BLOB ===================
+bool sDerivedBlob::view(const uint8_t *data,
+                        const size_t size) {
+    if (data == NULL || size < sizeof(sDerivedBlobHeader)) {
+        return false;
+    }
+
+    // Its 64 bit fields may not be aligned
+    sDerivedBlobHeader candidate;
+    memcpy(&candidate,
+           data,
+           sizeof(sDerivedBlobHeader));
+    bool is_valid = candidate.magic == DERIVED_CACHE_MAGIC &&
+                    candidate.version == DERIVED_CACHE_FORMAT_VERSION &&
+                    candidate.section_count <= DERIVED_CACHE_MAX_SECTIONS;
+    // Each section inside the data, and as large as its dimensions say, so a
+    // stale or truncated entry is a miss instead of a read past its end
+    for(uint32_t i = 0; is_valid && i < candidate.section_count; i++) {
+        const sDerivedSection &section = candidate.sections[i];
+        const uint32_t texel_size = get_texel_size(section.gl_format);
+        const uint64_t texels_size = (uint64_t) section.dims[0] * section.dims[1] * section.dims[2] * texel_size;
+        is_valid = texel_size > 0 &&
+                   section.offset <= size &&
+                   section.size <= size - section.offset &&
+                   section.size >= texels_size;
+    }
+    if (!is_valid) {
+        return false;
+    }
+
+    base = data;
+    header = candidate;
+    return true;
+}
+
+const sDerivedSection* sDerivedBlob::find_section(const uint32_t type,
+                                                  const uint32_t level) const {
+    for(uint32_t i = 0; i < header.section_count; i++) {
+        if (header.sections[i].type == type && header.sections[i].level == level) {
+            return &header.sections[i];
+        }
+    }
+    return NULL;
+}
+
+uint32_t sDerivedBlob::count_sections(const uint32_t type) const {
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < header.section_count; i++) {
+        count += (header.sections[i].type == type) ? 1 : 0;
+    }
+    return count;
+}
+
+void sDerivedBlob::close() {
+    file.close();
+    base = NULL;
+    header = {};
+}
+
+void sDerivedBlobWriter::add_section(const uint32_t type,
+                                     const uint32_t level,
+                                     const uint32_t dims[3],
+                                     const uint32_t gl_format,
+                                     const void *data,
+                                     const size_t size,
+                                     const float value) {
+    assert(header.section_count < DERIVED_CACHE_MAX_SECTIONS && "Too many sections for a derived cache entry");
+
+    sDerivedSection &section = header.sections[header.section_count];
+    section.type = type;
+    section.level = level;
+    memcpy(section.dims, dims, sizeof(section.dims));
+    section.gl_format = gl_format;
+    section.size = size;
+    section.value = value;
+    section_data[header.section_count] = data;
+    header.section_count++;
+}
+
+bool sDerivedBlobWriter::write(const char *file_dir) {
+    // Each section on its own page, so it can be mapped & uploaded as is
+    uint64_t offset = sizeof(sDerivedBlobHeader);
+    for(uint32_t i = 0; i < header.section_count; i++) {
+        offset = (offset + DERIVED_CACHE_ALIGNMENT - 1) / DERIVED_CACHE_ALIGNMENT * DERIVED_CACHE_ALIGNMENT;
+        header.sections[i].offset = offset;
+        offset += header.sections[i].size;
+    }
+
+    char temp_dir[520];
+    snprintf(temp_dir,
+             sizeof(temp_dir),
+             "%s.tmp",
+             file_dir);
+
+    FILE *file = fopen(temp_dir, "wb");
+    if (file == NULL) {
+        return false;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    for(uint32_t i = 0; written && i < header.section_count; i++) {
+        written = fseek(file, (long) header.sections[i].offset, SEEK_SET) == 0 &&
+                  fwrite(section_data[i], 1, header.sections[i].size, file) == header.sections[i].size;
+    }
+    written = (fclose(file) == 0) && written;
+
+    if (!written || rename(temp_dir, file_dir) != 0) {
+        remove(temp_dir);
+        return false;
+    }
+    return true;
+}
+
+// CACHE ===================
+bool sDerivedCache::init(const char *data_dir) {
+    snprintf(cache_dir,
+             sizeof(cache_dir),
+             "%s/%s",
+             data_dir,
+             DERIVED_CACHE_DIR_NAME);
+
+    mkdir(cache_dir,
+          0777);
+    struct stat dir_stat;
+    enabled = stat(cache_dir, &dir_stat) == 0 && S_ISDIR(dir_stat.st_mode);
+
+    return enabled;
+}
+
+bool sDerivedCache::open(const uint64_t key,
+                         sDerivedBlob *blob) {
+    if (!enabled) {
+        return false;
+    }
+
+    char entry_dir[512];
+    get_entry_dir(key,
+                  entry_dir,
+                  sizeof(entry_dir));
+
+    // A stale or foreign entry is a miss, and is overwritten on the store
+    if (!blob->file.open(entry_dir) ||
+        !blob->view((const uint8_t*) blob->file.data, blob->file.size) ||
+        blob->header.key != key) {
+        blob->close();
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    hits.fetch_add(1, std::memory_order_relaxed);
+    saved_us.fetch_add((uint64_t) (blob->header.build_ms * 1000.0f), std::memory_order_relaxed);
+
+    return true;
+}
+
+bool sDerivedCache::store(const uint64_t key,
+                          sDerivedBlobWriter *writer,
+                          const float build_ms) {
+    if (!enabled) {
+        return false;
+    }
+
+    sDerivedBlobHeader &header = writer->header;
+    header.magic = DERIVED_CACHE_MAGIC;
+    header.version = DERIVED_CACHE_FORMAT_VERSION;
+    header.key = key;
+    header.build_ms = build_ms;
+
+    char entry_dir[512];
+    get_entry_dir(key,
+                  entry_dir,
+                  sizeof(entry_dir));
+    if (!writer->write(entry_dir)) {
+        return false;
+    }
+
+    stores.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+sDerivedCacheStats sDerivedCache::get_stats() const {
+    sDerivedCacheStats stats = {};
+    stats.hits = hits.load(std::memory_order_relaxed);
+    stats.misses = misses.load(std::memory_order_relaxed);
+    stats.stores = stores.load(std::memory_order_relaxed);
+    stats.saved_ms = saved_us.load(std::memory_order_relaxed) / 1000.0;
+    return stats;
+}
+
+// HASHING ===================
+inline uint64_t rotate_left(const uint64_t value,
+                            const uint32_t bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Final mix, so every input bit affects every output bit
+inline uint64_t avalanche(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+uint64_t DerivedCache::hash(const void *data,
+                            const size_t size,
+                            const uint64_t seed) {
+    const uint8_t *bytes = (const uint8_t*) data;
+
+    // Four independent lanes of 8 bytes, so the multiplies can overlap
+    uint64_t lanes[4] = {seed + HASH_PRIME_1 + HASH_PRIME_2,
+                         seed + HASH_PRIME_2,
+                         seed,
+                         seed - HASH_PRIME_1};
+    size_t i = 0;
+    for(; i + 32 <= size; i += 32) {
+        for(uint32_t lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, bytes + i + lane * 8, sizeof(word));
+            lanes[lane] = rotate_left(lanes[lane] + word * HASH_PRIME_2, 31) * HASH_PRIME_1;
+        }
+    }
+
+    uint64_t result = rotate_left(lanes[0], 1) + rotate_left(lanes[1], 7) + rotate_left(lanes[2], 12) + rotate_left(lanes[3], 18);
+    result ^= (uint64_t) size * HASH_PRIME_1;
+    for(; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        result = rotate_left(result ^ (word * HASH_PRIME_2), 27) * HASH_PRIME_1;
+    }
+    for(; i < size; i++) {
+        result = rotate_left(result ^ (bytes[i] * HASH_PRIME_1), 11) * HASH_PRIME_2;
+    }
+
+    return avalanche(result);
+}
+
+uint64_t DerivedCache::combine(const uint64_t hash_a,
+                               const uint64_t hash_b) {
+    return avalanche(hash_a ^ (hash_b + HASH_PRIME_1 + (hash_a << 6) + (hash_a >> 2)));
+}
+
+uint64_t DerivedCache::hash_file(const char *file_dir) {
+    sMappedFile file = {};
+    if (!file.open(file_dir)) {
+        return 0;
+    }
+    file.advise_sequential_read();
+    const uint64_t result = hash(file.data,
+                                 file.size);
+    file.close();
+
+    return result;
+}
+
+uint64_t DerivedCache::make_key(const uint64_t source_hash,
+                                const void *params,
+                                const size_t params_size) {
+    return combine(combine(source_hash,
+                           DERIVED_CACHE_FORMAT_VERSION),
+                   hash(params,
+                        params_size));
+}
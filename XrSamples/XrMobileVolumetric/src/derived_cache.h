@@ -0,0 +1,170 @@
+#ifndef DERIVED_CACHE_H_
+#define DERIVED_CACHE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <atomic>
+
+#include "mapped_file.h"
+
+#define DERIVED_CACHE_MAGIC 0x31434456u // "VDC1"
+#define DERIVED_CACHE_FORMAT_VERSION 1 // Bump when the layout or the derivations change
+#define DERIVED_CACHE_MAX_SECTIONS 32
+#define DERIVED_CACHE_ALIGNMENT 4096 // Sections start on a page of the file
+#define DERIVED_CACHE_DIR_NAME "derived_cache"
+
+/**
+ * Persistent cache of the data derived from the volumes
+ * Each entry is a file of GPU ready sections (the volume itself, the max
+ * mips, the min/max grid, the distance field...), named by a 64 bit key of
+ * the source content, the derivation parameters and the format version. A
+ * warm start maps the entry and uploads straight from it, skipping both the
+ * extraction of the source and its preprocessing.
+ * The entries are written to a temporary file and renamed, so a partial
+ * write never looks like a valid entry; an entry with a different magic,
+ * version or key, or with sections smaller than their dimensions, is a miss.
+ * The baked bundles (tools/bake_bundle.cpp) are entries of this same format,
+ * built offline and shipped on the APK, where they are only viewed.
+ * */
+
+enum eDerivedSectionType : uint32_t {
+    DERIVED_VOLUME = 0,     // Level 0 voxels
+    DERIVED_MAX_MIP,        // A level of the max chain, level is its GL mip level
+    DERIVED_MINMAX_GRID,
+    DERIVED_DISTANCE_FIELD,
+    DERIVED_TEXTURE_2D      // A level of a 2D texture (baked bundles), level is its GL mip level
+};
+
+struct sDerivedSection {
+    uint32_t    type = DERIVED_VOLUME;
+    uint32_t    level = 0;
+    uint32_t    dims[3] = {0, 0, 0};
+    uint32_t    gl_format = 0; // Internal format, as it is uploaded
+    float       value = 0.0f; // Of the type: cell size of a min/max grid, threshold of a distance field
+    uint64_t    offset = 0; // From the start of the file
+    uint64_t    size = 0;
+};
+
+struct sDerivedBlobHeader {
+    uint32_t        magic = DERIVED_CACHE_MAGIC;
+    uint32_t        version = DERIVED_CACHE_FORMAT_VERSION;
+    uint64_t        key = 0;
+    float           build_ms = 0.0f; // What the derivation took, so what a hit saves
+    uint32_t        section_count = 0;
+    sDerivedSection sections[DERIVED_CACHE_MAX_SECTIONS];
+};
+
+// A mapped entry, or a view of one on memory (a baked bundle on the APK);
+// the section data is valid until close. The header is copied out: the
+// entries on the APK are only 4 byte aligned (zipalign), so it cannot be
+// read in place
+struct sDerivedBlob {
+    sMappedFile                 file = {}; // Not open on views
+    const uint8_t               *base = NULL;
+    sDerivedBlobHeader          header = {};
+
+    // Validates the header & the sections of an entry that is on memory; the
+    // data has to outlive the blob
+    bool view(const uint8_t *data,
+              const size_t size);
+
+    const sDerivedSection* find_section(const uint32_t type,
+                                        const uint32_t level = 0) const;
+
+    // Sections of a type, that is, the levels of a texture
+    uint32_t count_sections(const uint32_t type) const;
+
+    inline const uint8_t* get_section_data(const sDerivedSection *section) const {
+        return base + section->offset;
+    }
+
+    inline bool is_open() const {
+        return base != NULL;
+    }
+
+    void close();
+};
+
+// The sections of a new entry; the data stays on the caller until the store
+struct sDerivedBlobWriter {
+    sDerivedBlobHeader  header = {};
+    const void          *section_data[DERIVED_CACHE_MAX_SECTIONS] = {};
+
+    void add_section(const uint32_t type,
+                     const uint32_t level,
+                     const uint32_t dims[3],
+                     const uint32_t gl_format,
+                     const void *data,
+                     const size_t size,
+                     const float value = 0.0f);
+
+    // Lays the sections out on pages, and writes them to a temporary file
+    // that is renamed to file_dir once it is complete
+    bool write(const char *file_dir);
+};
+
+struct sDerivedCacheStats {
+    uint32_t    hits = 0;
+    uint32_t    misses = 0;
+    uint32_t    stores = 0;
+    double      saved_ms = 0.0;
+};
+
+struct sDerivedCache {
+    char    cache_dir[256] = "";
+    bool    enabled = false;
+
+    // The entries can be opened & stored from the loader threads
+    std::atomic<uint32_t>   hits{0};
+    std::atomic<uint32_t>   misses{0};
+    std::atomic<uint32_t>   stores{0};
+    std::atomic<uint64_t>   saved_us{0};
+
+    // Creates the cache folder under data_dir (the internal data path of the app)
+    bool init(const char *data_dir);
+
+    /**
+     * Maps the entry of key, if there is a valid one; counts the hit, and the
+     * time that its derivation took as saved.
+     * */
+    bool open(const uint64_t key,
+              sDerivedBlob *blob);
+
+    // Writes the entry of key, replacing the previous one
+    bool store(const uint64_t key,
+               sDerivedBlobWriter *writer,
+               const float build_ms);
+
+    sDerivedCacheStats get_stats() const;
+
+    inline void get_entry_dir(const uint64_t key,
+                              char *result,
+                              const size_t result_size) const {
+        snprintf(result,
+                 result_size,
+                 "%s/%016llx.vdc",
+                 cache_dir,
+                 (unsigned long long) key);
+    }
+};
+
+namespace DerivedCache {
+    // 64 bit hash of a buffer, not cryptographic
+    uint64_t hash(const void *data,
+                  const size_t size,
+                  const uint64_t seed = 0);
+
+    uint64_t combine(const uint64_t hash_a,
+                     const uint64_t hash_b);
+
+    // Hash of the content of a file on disk, 0 if it cannot be read
+    uint64_t hash_file(const char *file_dir);
+
+    // Key of an entry: the source, the parameters of the derivation & the format version
+    uint64_t make_key(const uint64_t source_hash,
+                      const void *params,
+                      const size_t params_size);
+};
+
+#endif // DERIVED_CACHE_H_
@@ -0,0 +1,134 @@
+#include "distance_field.h"
+
+#include <cstdlib>
+#include <cmath>
+
+#include "parallel_for.h"
+
+#define DT_INFINITY 1e20f
+
+void sDistanceField::clean() {
+    free(distances);
+    distances = NULL;
+    dims[0] = dims[1] = dims[2] = 0;
+}
+
+/**
+ * 1D squared distance transform of f, on d.
+ * v & z are the scratch of the lower envelope, sized count and count + 1
+ * */
+inline void distance_transform_1D(const float *f,
+                                  const uint32_t count,
+                                  float *d,
+                                  uint32_t *v,
+                                  float *z) {
+    uint32_t k = 0;
+    v[0] = 0;
+    z[0] = -DT_INFINITY;
+    z[1] = DT_INFINITY;
+
+    for(uint32_t q = 1; q < count; q++) {
+        const float fq = f[q] + (float) q * q;
+        float s = (fq - (f[v[k]] + (float) v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+        while (s <= z[k]) {
+            k--;
+            s = (fq - (f[v[k]] + (float) v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+        }
+        k++;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = DT_INFINITY;
+    }
+
+    k = 0;
+    for(uint32_t q = 0; q < count; q++) {
+        while (z[k + 1] < q) {
+            k++;
+        }
+        const float delta = (float) q - v[k];
+        d[q] = delta * delta + f[v[k]];
+    }
+}
+
+/**
+ * Transform of all the lines of the axis, in place over the squared distances.
+ * The lines are gathered to contiguous buffers, since only x is contiguous
+ * */
+void transform_axis(float *squared_distances,
+                    const uint32_t dims[3],
+                    const uint32_t axis,
+                    const uint32_t thread_count) {
+    const size_t strides[3] = {1, dims[0], (size_t) dims[0] * dims[1]};
+    // The two other axes, the first is the one the lines are split over threads
+    const uint32_t outer_axis = (axis == 2) ? 1 : 2;
+    const uint32_t inner_axis = (axis == 0) ? 1 : 0;
+    const uint32_t count = dims[axis];
+
+    Parallel::for_range(0, dims[outer_axis], thread_count, [&](const uint32_t outer_start, const uint32_t outer_end) {
+        float *line = (float*) malloc(sizeof(float) * count);
+        float *result = (float*) malloc(sizeof(float) * count);
+        uint32_t *v = (uint32_t*) malloc(sizeof(uint32_t) * count);
+        float *z = (float*) malloc(sizeof(float) * (count + 1));
+
+        for(uint32_t outer = outer_start; outer < outer_end; outer++) {
+            for(uint32_t inner = 0; inner < dims[inner_axis]; inner++) {
+                float *line_start = squared_distances + outer * strides[outer_axis] + inner * strides[inner_axis];
+
+                for(uint32_t i = 0; i < count; i++) {
+                    line[i] = line_start[i * strides[axis]];
+                }
+                distance_transform_1D(line,
+                                      count,
+                                      result,
+                                      v,
+                                      z);
+                for(uint32_t i = 0; i < count; i++) {
+                    line_start[i * strides[axis]] = result[i];
+                }
+            }
+        }
+
+        free(line);
+        free(result);
+        free(v);
+        free(z);
+    });
+}
+
+void DistanceField::build(const uint8_t *volume,
+                          const uint32_t volume_dims[3],
+                          const float threshold,
+                          const uint32_t thread_count,
+                          sDistanceField *field) {
+    field->clean();
+    field->threshold = threshold;
+    field->dims[0] = volume_dims[0];
+    field->dims[1] = volume_dims[1];
+    field->dims[2] = volume_dims[2];
+
+    const size_t voxel_count = field->get_voxel_count();
+    const size_t slice = (size_t) volume_dims[0] * volume_dims[1];
+    // Same as u_density_threshold <= texture value on the shaders
+    const float threshold_value = threshold * 255.0f;
+
+    float *squared_distances = (float*) malloc(sizeof(float) * voxel_count);
+    Parallel::for_range(0, volume_dims[2], thread_count, [&](const uint32_t z_start, const uint32_t z_end) {
+        for(size_t i = z_start * slice; i < z_end * slice; i++) {
+            squared_distances[i] = (threshold_value <= volume[i]) ? 0.0f : DT_INFINITY;
+        }
+    });
+
+    transform_axis(squared_distances, volume_dims, 0, thread_count);
+    transform_axis(squared_distances, volume_dims, 1, thread_count);
+    transform_axis(squared_distances, volume_dims, 2, thread_count);
+
+    field->distances = (uint8_t*) malloc(voxel_count);
+    Parallel::for_range(0, volume_dims[2], thread_count, [&](const uint32_t z_start, const uint32_t z_end) {
+        for(size_t i = z_start * slice; i < z_end * slice; i++) {
+            const float distance = sqrtf(squared_distances[i]);
+            field->distances[i] = (distance < DISTANCE_FIELD_MAX_DISTANCE) ? (uint8_t) distance : DISTANCE_FIELD_MAX_DISTANCE;
+        }
+    });
+
+    free(squared_distances);
+}
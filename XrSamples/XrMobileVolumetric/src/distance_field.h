@@ -0,0 +1,43 @@
+#ifndef DISTANCE_FIELD_H_
+#define DISTANCE_FIELD_H_
+
+#include <cstdint>
+#include <cstddef>
+
+#define DISTANCE_FIELD_DEFAULT_THRESHOLD 0.15f
+#define DISTANCE_FIELD_MAX_DISTANCE 255 // In voxels, the R8 range
+
+/**
+ * Distance field for sphere tracing the isosurface
+ * Each voxel stores the euclidean distance, in voxels, to the closest voxel
+ * over the threshold, clamped to 255. It is computed with the separable exact
+ * transform of Felzenszwalb & Huttenlocher: a 1D lower envelope of parabolas
+ * per line, on x, then y, then z; every pass splits its lines over threads.
+ * The field is only valid for isovalues >= the threshold it was built with,
+ * since a higher isovalue can only empty voxels.
+ * */
+struct sDistanceField {
+    float       threshold = DISTANCE_FIELD_DEFAULT_THRESHOLD;
+    uint32_t    dims[3] = {0, 0, 0};
+    uint8_t     *distances = NULL;
+
+    inline size_t get_voxel_count() const {
+        return (size_t) dims[0] * dims[1] * dims[2];
+    }
+
+    void clean();
+};
+
+namespace DistanceField {
+    /**
+     * Builds the field of a GL_R8 volume; threshold is normalized, [0, 1].
+     * thread_count == 0 uses all the cores.
+     * */
+    void build(const uint8_t *volume,
+               const uint32_t volume_dims[3],
+               const float threshold,
+               const uint32_t thread_count,
+               sDistanceField *field);
+};
+
+#endif // DISTANCE_FIELD_H_
@@ -0,0 +1,72 @@
+#include "draw_list.h"
+
+#include <cstdlib>
+
+#define RADIX_BUCKETS 256
+#define RADIX_PASSES 8
+
+void sDrawList::init(const uint32_t max_count) {
+    capacity = max_count;
+    count = 0;
+    items = (sDrawListItem*) malloc(sizeof(sDrawListItem) * capacity);
+    sort_scratch = (sDrawListItem*) malloc(sizeof(sDrawListItem) * capacity);
+}
+
+void sDrawList::sort() {
+    skipped_radix_passes = 0;
+    if (count < 2) {
+        return;
+    }
+
+    // The histograms of every byte, on a single read of the keys
+    uint32_t histograms[RADIX_PASSES][RADIX_BUCKETS];
+    memset(histograms, 0, sizeof(histograms));
+    for(uint32_t i = 0; i < count; i++) {
+        const uint64_t key = items[i].key;
+        for(uint32_t byte = 0; byte < RADIX_PASSES; byte++) {
+            histograms[byte][(key >> (byte * 8)) & 0xFFu]++;
+        }
+    }
+
+    sDrawListItem *source = items;
+    sDrawListItem *destination = sort_scratch;
+    for(uint32_t byte = 0; byte < RADIX_PASSES; byte++) {
+        uint32_t *histogram = histograms[byte];
+
+        // The same on every key, nothing to reorder
+        if (histogram[(source[0].key >> (byte * 8)) & 0xFFu] == count) {
+            skipped_radix_passes++;
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for(uint32_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+            const uint32_t bucket_count = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucket_count;
+        }
+
+        for(uint32_t i = 0; i < count; i++) {
+            destination[histogram[(source[i].key >> (byte * 8)) & 0xFFu]++] = source[i];
+        }
+
+        sDrawListItem *swap = source;
+        source = destination;
+        destination = swap;
+    }
+
+    // An odd number of passes leaves the result on the scratch buffer
+    if (source != items) {
+        sort_scratch = items;
+        items = source;
+    }
+}
+
+void sDrawList::clean() {
+    free(items);
+    free(sort_scratch);
+    items = NULL;
+    sort_scratch = NULL;
+    capacity = 0;
+    count = 0;
+}
@@ -0,0 +1,123 @@
+#ifndef DRAW_LIST_H_
+#define DRAW_LIST_H_
+
+#include <cstdint>
+#include <cstring>
+#include <cassert>
+
+#define DRAW_KEY_PASS_SHIFT 56
+#define DRAW_KEY_LAYER_SHIFT 55
+#define DRAW_KEY_DEPTH_BITS 24
+#define DRAW_KEY_ID_MASK 0xFFu
+#define DRAW_KEY_DEPTH_MASK ((1u << DRAW_KEY_DEPTH_BITS) - 1u)
+
+/**
+ * Draw list of a view, compiled to 64 bit sort keys, so the draws are
+ * submitted with the fewest state changes:
+ *  - opaque:      | pass 8 | 0 | shader 8 | material 8 | mesh 8 | depth 24 | 7 |
+ *  - transparent: | pass 8 | 1 | ~depth 24 | shader 8 | material 8 | mesh 8 | 7 |
+ * Sorted, the passes keep their order, the opaque draws of a pass go before
+ * its transparent ones, grouped by program, textures & mesh (and front to back
+ * inside each group), and the transparent ones go back to front, as they
+ * blend. Consecutive draws with the same state bits of the key share their
+ * bindings.
+ * The depth is the distance along the view direction; the bits of a positive
+ * float keep its order, so the key holds its top 24 (exponent & 16 bits of
+ * mantissa).
+ * The sort is a LSD radix sort, one byte per pass; it is stable, so the draws
+ * with the same key keep the order they were added on, and the bytes that are
+ * the same on every key (usually most of them) are skipped.
+ * */
+
+enum eDrawLayer : uint8_t {
+    DRAW_LAYER_OPAQUE = 0,
+    DRAW_LAYER_TRANSPARENT
+};
+
+struct sDrawListItem {
+    uint64_t key;
+    uint16_t draw_id; // Of the pass
+    uint16_t uniforms_id; // Draw uniforms record
+};
+
+namespace DrawKey {
+    inline uint32_t quantize_depth(const float depth) {
+        uint32_t bits = 0;
+        const float positive_depth = (depth > 0.0f) ? depth : 0.0f;
+        memcpy(&bits, &positive_depth, sizeof(bits));
+        return bits >> (31 - DRAW_KEY_DEPTH_BITS);
+    }
+
+    inline uint64_t compile(const uint8_t pass_id,
+                            const eDrawLayer layer,
+                            const uint8_t shader_id,
+                            const uint8_t material_id,
+                            const uint8_t mesh_id,
+                            const float depth) {
+        const uint64_t state = ((uint64_t) shader_id << 16) | ((uint64_t) material_id << 8) | mesh_id;
+        const uint64_t depth_bits = quantize_depth(depth);
+
+        uint64_t key = ((uint64_t) pass_id << DRAW_KEY_PASS_SHIFT) | ((uint64_t) layer << DRAW_KEY_LAYER_SHIFT);
+        if (layer == DRAW_LAYER_OPAQUE) {
+            key |= (state << 31) | (depth_bits << 7);
+        } else {
+            key |= ((~depth_bits & DRAW_KEY_DEPTH_MASK) << 31) | (state << 7);
+        }
+        return key;
+    }
+
+    inline uint8_t get_pass(const uint64_t key) {
+        return (uint8_t) (key >> DRAW_KEY_PASS_SHIFT);
+    }
+
+    inline eDrawLayer get_layer(const uint64_t key) {
+        return (eDrawLayer) ((key >> DRAW_KEY_LAYER_SHIFT) & 1u);
+    }
+
+    // Shader, material & mesh: shader << 16 | material << 8 | mesh
+    inline uint32_t get_state(const uint64_t key) {
+        const uint32_t shift = (get_layer(key) == DRAW_LAYER_OPAQUE) ? 31 : 7;
+        return (uint32_t) ((key >> shift) & 0xFFFFFFu);
+    }
+
+    inline uint8_t get_shader(const uint64_t key) {
+        return (uint8_t) (get_state(key) >> 16);
+    }
+
+    inline uint8_t get_material(const uint64_t key) {
+        return (uint8_t) ((get_state(key) >> 8) & DRAW_KEY_ID_MASK);
+    }
+
+    inline uint8_t get_mesh(const uint64_t key) {
+        return (uint8_t) (get_state(key) & DRAW_KEY_ID_MASK);
+    }
+};
+
+struct sDrawList {
+    sDrawListItem *items = NULL;
+    sDrawListItem *sort_scratch = NULL;
+    uint32_t      capacity = 0;
+    uint32_t      count = 0;
+
+    // Bytes of the keys that the last sort skipped, being the same on all of them
+    uint32_t      skipped_radix_passes = 0;
+
+    void init(const uint32_t max_count);
+
+    inline void clear() {
+        count = 0;
+    }
+
+    inline void add(const uint64_t key,
+                    const uint16_t draw_id,
+                    const uint16_t uniforms_id) {
+        assert(count < capacity && "No more space on the draw list");
+        items[count++] = {key, draw_id, uniforms_id};
+    }
+
+    void sort();
+
+    void clean();
+};
+
+#endif // DRAW_LIST_H_
@@ -0,0 +1,232 @@
+#include "eac_codec.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "parallel_for.h"
+
+// Modifier tables of EAC, the same as the ETC2 alpha ones; the
+// negative modifiers go first, and the most negative is the 4th
+const int32_t EAC_MODIFIERS[16][8] = {
+    {-3, -6,  -9, -15, 2, 5, 8, 14},
+    {-3, -7, -10, -13, 2, 6, 9, 12},
+    {-2, -5,  -8, -13, 1, 4, 7, 12},
+    {-2, -4,  -6, -13, 1, 3, 5, 12},
+    {-3, -6,  -8, -12, 2, 5, 7, 11},
+    {-3, -7,  -9, -11, 2, 6, 8, 10},
+    {-4, -7,  -8, -11, 3, 6, 7, 10},
+    {-3, -5,  -8, -11, 2, 4, 7, 10},
+    {-2, -6,  -8, -10, 1, 5, 7,  9},
+    {-2, -5,  -8, -10, 1, 4, 7,  9},
+    {-2, -4,  -8, -10, 1, 3, 7,  9},
+    {-2, -5,  -7, -10, 1, 4, 6,  9},
+    {-3, -4,  -7, -10, 2, 3, 6,  9},
+    {-1, -2,  -3, -10, 0, 1, 2,  9},
+    {-4, -6,  -8,  -9, 3, 5, 7,  8},
+    {-3, -5,  -7,  -9, 2, 4, 6,  8}
+};
+
+#define EAC_MAX_MULTIPLIER 15
+
+inline int32_t clamp_11_bits(const int32_t value) {
+    return (value < 0) ? 0 : ((value > EAC_MAX_VALUE) ? EAC_MAX_VALUE : value);
+}
+
+// The value of a modifier, for a base codeword & a multiplier
+inline int32_t get_eac_value(const int32_t base,
+                             const int32_t multiplier,
+                             const int32_t modifier) {
+    // A multiplier of 0 steps by single units, for the flat blocks
+    return clamp_11_bits(base * 8 + 4 + ((multiplier == 0) ? modifier : modifier * multiplier * 8));
+}
+
+// The texels are stored on columns: index i of the block is texel (i / 4, i % 4)
+inline uint32_t get_texel_of_index(const uint32_t i) {
+    return (i % 4) * EAC_BLOCK_SIZE + (i / 4);
+}
+
+// Squared error of the best modifier of each texel; stops once it is over max_error
+inline uint32_t get_block_error(const int32_t targets[16],
+                                const int32_t base,
+                                const int32_t multiplier,
+                                const uint32_t table,
+                                const uint32_t max_error,
+                                uint8_t indices[16]) {
+    int32_t values[8];
+    for(uint32_t j = 0; j < 8; j++) {
+        values[j] = get_eac_value(base, multiplier, EAC_MODIFIERS[table][j]);
+    }
+
+    uint32_t error = 0;
+    for(uint32_t i = 0; i < 16 && error < max_error; i++) {
+        uint32_t best_error = UINT32_MAX;
+        for(uint32_t j = 0; j < 8; j++) {
+            const int32_t difference = values[j] - targets[i];
+            const uint32_t texel_error = (uint32_t) (difference * difference);
+            if (texel_error < best_error) {
+                best_error = texel_error;
+                indices[i] = (uint8_t) j;
+            }
+        }
+        error += best_error;
+    }
+    return error;
+}
+
+void EacCodec::encode_block(const uint8_t texels[16],
+                            const eEacQuality quality,
+                            uint8_t block[EAC_BLOCK_BYTES]) {
+    // On the order of the indices of the block
+    int32_t targets[16];
+    int32_t min_target = EAC_MAX_VALUE, max_target = 0;
+    for(uint32_t i = 0; i < 16; i++) {
+        targets[i] = (int32_t) to_11_bits(texels[get_texel_of_index(i)]);
+        min_target = (targets[i] < min_target) ? targets[i] : min_target;
+        max_target = (targets[i] > max_target) ? targets[i] : max_target;
+    }
+    const int32_t range = max_target - min_target;
+    const int32_t center = (min_target + max_target) / 2;
+
+    const int32_t multiplier_radius = (quality == EAC_QUALITY_HIGH) ? 2 : ((quality == EAC_QUALITY_NORMAL) ? 1 : 0);
+    const int32_t base_radius = (quality == EAC_QUALITY_HIGH) ? 2 : ((quality == EAC_QUALITY_NORMAL) ? 1 : 0);
+
+    uint32_t best_error = UINT32_MAX;
+    int32_t best_base = 0, best_multiplier = 0;
+    uint32_t best_table = 0;
+    uint8_t best_indices[16] = {}, indices[16];
+
+    for(uint32_t table = 0; table < 16 && best_error > 0; table++) {
+        const int32_t min_modifier = EAC_MODIFIERS[table][3], max_modifier = EAC_MODIFIERS[table][7];
+
+        // The smallest multiplier whose modifiers span the range of the block
+        const int32_t span = (max_modifier - min_modifier) * 8;
+        int32_t fit_multiplier = (range + span - 1) / span;
+        fit_multiplier = (fit_multiplier < 1) ? 1 : ((fit_multiplier > EAC_MAX_MULTIPLIER) ? EAC_MAX_MULTIPLIER : fit_multiplier);
+
+        // Multiplier 0 only reaches the blocks that are almost flat
+        const int32_t first_multiplier = (range <= max_modifier - min_modifier) ? 0 : ((fit_multiplier - multiplier_radius < 1) ? 1 : fit_multiplier - multiplier_radius);
+        const int32_t last_multiplier = (fit_multiplier + multiplier_radius > EAC_MAX_MULTIPLIER) ? EAC_MAX_MULTIPLIER : fit_multiplier + multiplier_radius;
+
+        for(int32_t multiplier = first_multiplier; multiplier <= last_multiplier; multiplier++) {
+            // The base that centers the modifiers on the range
+            const int32_t scale = (multiplier == 0) ? 1 : multiplier * 8;
+            const int32_t ideal_base = center - ((min_modifier + max_modifier) * scale) / 2 - 4;
+            int32_t fit_base = (ideal_base + 4) / 8;
+            fit_base = (fit_base < 0) ? 0 : ((fit_base > 255) ? 255 : fit_base);
+
+            for(int32_t base = fit_base - base_radius; base <= fit_base + base_radius; base++) {
+                if (base < 0 || base > 255) {
+                    continue;
+                }
+                const uint32_t error = get_block_error(targets,
+                                                       base,
+                                                       multiplier,
+                                                       table,
+                                                       best_error,
+                                                       indices);
+                if (error < best_error) {
+                    best_error = error;
+                    best_base = base;
+                    best_multiplier = multiplier;
+                    best_table = table;
+                    memcpy(best_indices, indices, sizeof(best_indices));
+                }
+            }
+        }
+    }
+
+    // 64 bits, big endian: base, multiplier, table, then 3 bits per index
+    uint64_t word = ((uint64_t) best_base << 56) | ((uint64_t) best_multiplier << 52) | ((uint64_t) best_table << 48);
+    for(uint32_t i = 0; i < 16; i++) {
+        word |= (uint64_t) best_indices[i] << (45 - 3 * i);
+    }
+    for(uint32_t i = 0; i < EAC_BLOCK_BYTES; i++) {
+        block[i] = (uint8_t) (word >> (56 - 8 * i));
+    }
+}
+
+void EacCodec::decode_block(const uint8_t block[EAC_BLOCK_BYTES],
+                            uint16_t texels[16]) {
+    uint64_t word = 0;
+    for(uint32_t i = 0; i < EAC_BLOCK_BYTES; i++) {
+        word = (word << 8) | block[i];
+    }
+
+    const int32_t base = (int32_t) (word >> 56);
+    const int32_t multiplier = (int32_t) ((word >> 52) & 0xF);
+    const uint32_t table = (uint32_t) ((word >> 48) & 0xF);
+    for(uint32_t i = 0; i < 16; i++) {
+        const uint32_t index = (uint32_t) ((word >> (45 - 3 * i)) & 0x7);
+        texels[get_texel_of_index(i)] = (uint16_t) get_eac_value(base,
+                                                                 multiplier,
+                                                                 EAC_MODIFIERS[table][index]);
+    }
+}
+
+void EacCodec::compress_volume(const uint8_t *volume,
+                               const uint32_t volume_dims[3],
+                               const eEacQuality quality,
+                               const uint32_t thread_count,
+                               sEacVolume *result) {
+    memcpy(result->dims, volume_dims, sizeof(result->dims));
+    result->block_counts[0] = (volume_dims[0] + EAC_BLOCK_SIZE - 1) / EAC_BLOCK_SIZE;
+    result->block_counts[1] = (volume_dims[1] + EAC_BLOCK_SIZE - 1) / EAC_BLOCK_SIZE;
+    result->blocks = (uint8_t*) malloc(result->get_size());
+
+    const size_t row = volume_dims[0];
+    const size_t slice = row * volume_dims[1];
+
+    Parallel::for_range(0, volume_dims[2], thread_count, [&](const uint32_t z_start, const uint32_t z_end) {
+        uint8_t texels[16];
+        for(uint32_t z = z_start; z < z_end; z++) {
+            uint8_t *slice_blocks = result->blocks + result->get_slice_size() * z;
+            for(uint32_t by = 0; by < result->block_counts[1]; by++) {
+                for(uint32_t bx = 0; bx < result->block_counts[0]; bx++) {
+                    // Clamped to the edge, on the partial blocks
+                    for(uint32_t y = 0; y < EAC_BLOCK_SIZE; y++) {
+                        const uint32_t vy = (by * EAC_BLOCK_SIZE + y < volume_dims[1]) ? by * EAC_BLOCK_SIZE + y : volume_dims[1] - 1;
+                        for(uint32_t x = 0; x < EAC_BLOCK_SIZE; x++) {
+                            const uint32_t vx = (bx * EAC_BLOCK_SIZE + x < volume_dims[0]) ? bx * EAC_BLOCK_SIZE + x : volume_dims[0] - 1;
+                            texels[y * EAC_BLOCK_SIZE + x] = volume[z * slice + vy * row + vx];
+                        }
+                    }
+
+                    encode_block(texels,
+                                 quality,
+                                 slice_blocks + ((size_t) by * result->block_counts[0] + bx) * EAC_BLOCK_BYTES);
+                }
+            }
+        }
+    });
+}
+
+void EacCodec::decompress_volume(const sEacVolume &compressed,
+                                 const uint32_t thread_count,
+                                 uint8_t *volume) {
+    const size_t row = compressed.dims[0];
+    const size_t slice = row * compressed.dims[1];
+
+    Parallel::for_range(0, compressed.dims[2], thread_count, [&](const uint32_t z_start, const uint32_t z_end) {
+        uint16_t texels[16];
+        for(uint32_t z = z_start; z < z_end; z++) {
+            const uint8_t *slice_blocks = compressed.get_slice(z);
+            for(uint32_t by = 0; by < compressed.block_counts[1]; by++) {
+                for(uint32_t bx = 0; bx < compressed.block_counts[0]; bx++) {
+                    decode_block(slice_blocks + ((size_t) by * compressed.block_counts[0] + bx) * EAC_BLOCK_BYTES,
+                                 texels);
+
+                    for(uint32_t y = 0; y < EAC_BLOCK_SIZE && by * EAC_BLOCK_SIZE + y < compressed.dims[1]; y++) {
+                        for(uint32_t x = 0; x < EAC_BLOCK_SIZE && bx * EAC_BLOCK_SIZE + x < compressed.dims[0]; x++) {
+                            volume[z * slice + (by * EAC_BLOCK_SIZE + y) * row + bx * EAC_BLOCK_SIZE + x] = to_8_bits(texels[y * EAC_BLOCK_SIZE + x]);
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+void sEacVolume::clean() {
+    free(blocks);
+    blocks = NULL;
+}
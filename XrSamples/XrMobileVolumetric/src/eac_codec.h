@@ -0,0 +1,83 @@
+#ifndef EAC_CODEC_H_
+#define EAC_CODEC_H_
+
+#include <cstdint>
+#include <cstddef>
+
+#define EAC_BLOCK_SIZE 4 // Texels per side
+#define EAC_BLOCK_BYTES 8
+#define EAC_MAX_VALUE 2047 // 11 bits
+
+/**
+ * EAC R11 (GL_COMPRESSED_R11_EAC) codec for single channel volumes
+ * Each z slice of the volume is compressed on its own, as a layer of a
+ * GL_TEXTURE_2D_ARRAY; 4x4 texels in 8 bytes, half the size of GL_R8, and
+ * guaranteed on every GLES3 device. The shaders interpolate between the
+ * slices by hand (see RawShaders::compressed_isosurface_shader).
+ * The decoder follows the spec, so the error of a compressed volume can be
+ * measured on the CPU, without a GPU (tools/eac_roundtrip.cpp).
+ * */
+
+enum eEacQuality : uint8_t {
+    EAC_QUALITY_FAST = 0,   // One multiplier per table
+    EAC_QUALITY_NORMAL,     // Neighbour multipliers & base codewords
+    EAC_QUALITY_HIGH        // Every multiplier, wider base search
+};
+
+struct sEacVolume {
+    uint32_t    dims[3] = {0, 0, 0};
+    uint32_t    block_counts[2] = {0, 0}; // Blocks per slice, on x & y
+    uint8_t     *blocks = NULL; // Slice by slice, x-major blocks
+
+    inline size_t get_slice_size() const {
+        return (size_t) block_counts[0] * block_counts[1] * EAC_BLOCK_BYTES;
+    }
+
+    inline size_t get_size() const {
+        return get_slice_size() * dims[2];
+    }
+
+    inline const uint8_t* get_slice(const uint32_t z) const {
+        return blocks + get_slice_size() * z;
+    }
+
+    void clean();
+};
+
+namespace EacCodec {
+    // 8 bit value to its 11 bit equivalent, and back, as the GPU normalizes them
+    inline uint32_t to_11_bits(const uint8_t value) {
+        return ((uint32_t) value * EAC_MAX_VALUE + 127) / 255;
+    }
+
+    inline uint8_t to_8_bits(const uint32_t value) {
+        return (uint8_t) ((value * 255 + EAC_MAX_VALUE / 2) / EAC_MAX_VALUE);
+    }
+
+    // texels are the 16 values of a block, x-major (texels[y * 4 + x])
+    void encode_block(const uint8_t texels[16],
+                      const eEacQuality quality,
+                      uint8_t block[EAC_BLOCK_BYTES]);
+
+    // To the 11 bit values, x-major
+    void decode_block(const uint8_t block[EAC_BLOCK_BYTES],
+                      uint16_t texels[16]);
+
+    /**
+     * Compresses a GL_R8 volume, slice by slice; the blocks on the edges are
+     * padded by repeating the last texel.
+     * thread_count == 0 uses all the cores.
+     * */
+    void compress_volume(const uint8_t *volume,
+                         const uint32_t volume_dims[3],
+                         const eEacQuality quality,
+                         const uint32_t thread_count,
+                         sEacVolume *result);
+
+    // Back to GL_R8, as the GPU would sample the texels
+    void decompress_volume(const sEacVolume &compressed,
+                           const uint32_t thread_count,
+                           uint8_t *volume);
+};
+
+#endif // EAC_CODEC_H_
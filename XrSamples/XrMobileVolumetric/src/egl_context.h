@@ -213,6 +213,22 @@ struct sEglContext {
 
     }
 
+    // The context is current on a single thread at a time: release it before
+    // making it current on another one (the render thread)
+    bool make_current() const {
+        return eglMakeCurrent(display,
+                              surface,
+                              surface,
+                              context) == EGL_TRUE;
+    }
+
+    void release_current() const {
+        eglMakeCurrent(display,
+                       EGL_NO_SURFACE,
+                       EGL_NO_SURFACE,
+                       EGL_NO_CONTEXT);
+    }
+
     void destroy() {
         //info("make EGL context no longer current");
         eglMakeCurrent(display,
@@ -0,0 +1,218 @@
+#ifndef FRAME_PIPELINE_H_
+#define FRAME_PIPELINE_H_
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+
+#define FRAME_PIPELINE_DEPTH 2 // Packets submitted & not yet taken
+
+/**
+ * Two stage frame loop
+ * The simulation thread (the one that waits for the XR frames and predicts
+ * the poses) hands a packet per frame to the render thread, that records &
+ * submits it; so the simulation of frame N+1 runs while frame N is being
+ * rendered, and the CPU time of a frame is the longest of the two stages,
+ * instead of their sum.
+ * The packets go through a ring of FRAME_PIPELINE_DEPTH slots, with a single
+ * producer & a single consumer: each slot is only written while the render
+ * thread is not reading it, so neither thread holds a lock while a packet is
+ * copied. No packet is ever skipped (every xrWaitFrame needs its
+ * xrBeginFrame), so submit() only waits when the ring is full, that is when
+ * the render thread is more than a frame behind.
+ * The mutex & condition are only there to sleep while the other stage catches
+ * up, never around the copies.
+ * The packets are copied, so they should be plain data: the poses, the
+ * times & the state of the frame, and never pointers to what the simulation
+ * keeps changing. The render thread owns everything GL.
+ * Without threading, submit() renders the packet right away, on the calling
+ * thread, as the serial loop did.
+ * */
+
+template<typename T>
+struct sFramePipeline {
+    typedef void (*fRenderFrame)(const T &packet,
+                                 void *user_data);
+    // On the render thread, before its first frame & after the last one
+    typedef void (*fRenderThreadEvent)(void *user_data);
+
+    bool                    is_threaded = false;
+    fRenderFrame            render_frame = NULL;
+    fRenderThreadEvent      on_thread_start = NULL;
+    fRenderThreadEvent      on_thread_end = NULL;
+    void                    *user_data = NULL;
+
+    // Frame N is on slots[(N - 1) % FRAME_PIPELINE_DEPTH]
+    T                       slots[FRAME_PIPELINE_DEPTH];
+
+    // Frame indices; the first frame is 1
+    std::atomic<uint64_t>   submitted_frames{0};
+    std::atomic<uint64_t>   taken_frames{0};
+    std::atomic<uint64_t>   rendered_frames{0};
+
+    // Only to sleep while the other stage catches up
+    std::thread             render_thread;
+    std::mutex              wait_mutex;
+    std::condition_variable wait_condition;
+    bool                    running = false;
+    bool                    thread_started = false;
+
+    // CPU time of the last frame of each stage, in ms; the simulation one
+    // does not count the waits on submit()
+    std::atomic<float>      last_render_ms{0.0f};
+    float                   last_submit_wait_ms = 0.0f;
+
+    /**
+     * With is_threaded, starts the render thread, and returns once
+     * thread_start has run on it
+     * */
+    void init(const bool threaded,
+              const fRenderFrame render_func,
+              const fRenderThreadEvent thread_start,
+              const fRenderThreadEvent thread_end,
+              void *user) {
+        is_threaded = threaded;
+        render_frame = render_func;
+        on_thread_start = thread_start;
+        on_thread_end = thread_end;
+        user_data = user;
+
+        submitted_frames.store(0);
+        taken_frames.store(0);
+        rendered_frames.store(0);
+
+        if (!is_threaded) {
+            return;
+        }
+
+        running = true;
+        thread_started = false;
+        render_thread = std::thread(&sFramePipeline<T>::_render_loop,
+                                    this);
+
+        std::unique_lock<std::mutex> lock(wait_mutex);
+        wait_condition.wait(lock, [this]{
+            return thread_started;
+        });
+    }
+
+    // From the simulation thread, once per frame
+    void submit(const T &packet) {
+        const uint64_t frame_index = submitted_frames.load(std::memory_order_relaxed) + 1;
+
+        if (!is_threaded) {
+            const auto render_start = std::chrono::steady_clock::now();
+            render_frame(packet,
+                         user_data);
+            last_render_ms.store(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - render_start).count(),
+                                 std::memory_order_relaxed);
+            last_submit_wait_ms = 0.0f;
+
+            submitted_frames.store(frame_index);
+            taken_frames.store(frame_index);
+            rendered_frames.store(frame_index);
+            return;
+        }
+
+        // Only when the ring is full: the slot is still to be taken
+        const auto wait_start = std::chrono::steady_clock::now();
+        if (taken_frames.load(std::memory_order_acquire) + FRAME_PIPELINE_DEPTH < frame_index) {
+            std::unique_lock<std::mutex> lock(wait_mutex);
+            wait_condition.wait(lock, [this, frame_index]{
+                return taken_frames.load(std::memory_order_acquire) + FRAME_PIPELINE_DEPTH >= frame_index;
+            });
+        }
+        last_submit_wait_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - wait_start).count();
+
+        slots[(frame_index - 1) % FRAME_PIPELINE_DEPTH] = packet;
+
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex);
+            submitted_frames.store(frame_index, std::memory_order_release);
+        }
+        wait_condition.notify_all();
+    }
+
+    // Waits until every submitted frame is rendered
+    void flush() {
+        if (!is_threaded) {
+            return;
+        }
+
+        const uint64_t frame_index = submitted_frames.load(std::memory_order_relaxed);
+        std::unique_lock<std::mutex> lock(wait_mutex);
+        wait_condition.wait(lock, [this, frame_index]{
+            return rendered_frames.load(std::memory_order_acquire) >= frame_index;
+        });
+    }
+
+    // Renders what was submitted, and stops the render thread
+    void destroy() {
+        if (!is_threaded || !running) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex);
+            running = false;
+        }
+        wait_condition.notify_all();
+        render_thread.join();
+    }
+
+    void _render_loop() {
+        if (on_thread_start != NULL) {
+            on_thread_start(user_data);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(wait_mutex);
+            thread_started = true;
+        }
+        wait_condition.notify_all();
+
+        T packet;
+        for(;;) {
+            {
+                std::unique_lock<std::mutex> lock(wait_mutex);
+                wait_condition.wait(lock, [this]{
+                    return submitted_frames.load(std::memory_order_acquire) > taken_frames.load(std::memory_order_relaxed) || !running;
+                });
+
+                if (submitted_frames.load(std::memory_order_acquire) == taken_frames.load(std::memory_order_relaxed)) {
+                    break; // Stopped, with nothing left
+                }
+            }
+
+            // The next one on the ring, copied before its slot is released
+            const uint64_t frame_index = taken_frames.load(std::memory_order_relaxed) + 1;
+            packet = slots[(frame_index - 1) % FRAME_PIPELINE_DEPTH];
+            {
+                std::lock_guard<std::mutex> lock(wait_mutex);
+                taken_frames.store(frame_index, std::memory_order_release);
+            }
+            wait_condition.notify_all();
+
+            const auto render_start = std::chrono::steady_clock::now();
+            render_frame(packet,
+                         user_data);
+            last_render_ms.store(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - render_start).count(),
+                                 std::memory_order_relaxed);
+
+            {
+                std::lock_guard<std::mutex> lock(wait_mutex);
+                rendered_frames.store(frame_index, std::memory_order_release);
+            }
+            wait_condition.notify_all();
+        }
+
+        if (on_thread_end != NULL) {
+            on_thread_end(user_data);
+        }
+    }
+};
+
+#endif // FRAME_PIPELINE_H_
@@ -0,0 +1,287 @@
+#include "gl_state_cache.h"
+
+#include <cassert>
+
+#include "gl_stats.h"
+
+static eGLStateTextureTarget get_texture_target_index(const uint32_t target) {
+    switch (target) {
+        case GL_TEXTURE_3D:
+            return GL_STATE_TEXTURE_3D;
+        case GL_TEXTURE_2D_ARRAY:
+            return GL_STATE_TEXTURE_2D_ARRAY;
+        case GL_TEXTURE_CUBE_MAP:
+            return GL_STATE_TEXTURE_CUBE_MAP;
+        default:
+            assert(target == GL_TEXTURE_2D && "Texture target not shadowed");
+            return GL_STATE_TEXTURE_2D;
+    }
+}
+
+void sGLStateCache::init() {
+    invalidate();
+    issued_calls = 0;
+    elided_calls = 0;
+    last_issued_calls = 0;
+    last_elided_calls = 0;
+}
+
+void sGLStateCache::begin_frame() {
+    invalidate_bindings();
+}
+
+void sGLStateCache::end_frame() {
+    last_issued_calls = issued_calls;
+    last_elided_calls = elided_calls;
+    issued_calls = 0;
+    elided_calls = 0;
+}
+
+void sGLStateCache::invalidate_bindings() {
+    program = GL_STATE_UNKNOWN;
+    vertex_array = GL_STATE_UNKNOWN;
+    framebuffer = GL_STATE_UNKNOWN;
+    for(uint32_t i = 0; i < 4; i++) {
+        viewport[i] = -1;
+        scissor[i] = -1;
+    }
+    active_texture_unit = GL_STATE_UNKNOWN;
+    for(uint32_t unit = 0; unit < GL_STATE_MAX_TEXTURE_UNITS; unit++) {
+        for(uint32_t target = 0; target < GL_STATE_TEXTURE_TARGET_COUNT; target++) {
+            textures[unit][target] = GL_STATE_UNKNOWN;
+        }
+    }
+    for(uint32_t i = 0; i < GL_STATE_MAX_UNIFORM_BUFFERS; i++) {
+        uniform_buffers[i] = {GL_STATE_UNKNOWN, GL_STATE_UNKNOWN, GL_STATE_UNKNOWN};
+    }
+}
+
+void sGLStateCache::invalidate() {
+    invalidate_bindings();
+
+    for(uint32_t i = 0; i < GL_STATE_CAPABILITY_COUNT; i++) {
+        capabilities[i] = GL_STATE_UNKNOWN;
+    }
+    depth_mask = GL_STATE_UNKNOWN;
+    depth_function = GL_STATE_UNKNOWN;
+    cull_face = GL_STATE_UNKNOWN;
+    front_face = GL_STATE_UNKNOWN;
+    blend_func_src = GL_STATE_UNKNOWN;
+    blend_func_dst = GL_STATE_UNKNOWN;
+    for(uint32_t i = 0; i < 4; i++) {
+        clear_color[i] = -1.0f;
+    }
+}
+
+void sGLStateCache::_issue(const uint32_t count) {
+    issued_calls += count;
+    GLStats::add_calls(count);
+}
+
+// Bindings ===========================================
+void sGLStateCache::use_program(const uint32_t program_id) {
+    if (program == program_id) {
+        _elide();
+        return;
+    }
+
+    glUseProgram(program_id);
+    _issue();
+    program = program_id;
+}
+
+void sGLStateCache::bind_vertex_array(const uint32_t vertex_array_id) {
+    if (vertex_array == vertex_array_id) {
+        _elide();
+        return;
+    }
+
+    glBindVertexArray(vertex_array_id);
+    _issue();
+    vertex_array = vertex_array_id;
+}
+
+void sGLStateCache::bind_framebuffer(const uint32_t framebuffer_id) {
+    if (framebuffer == framebuffer_id) {
+        _elide();
+        return;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER,
+                      framebuffer_id);
+    _issue();
+    framebuffer = framebuffer_id;
+}
+
+void sGLStateCache::set_viewport(const int32_t x,
+                                 const int32_t y,
+                                 const int32_t width,
+                                 const int32_t height) {
+    if (viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height) {
+        _elide();
+        return;
+    }
+
+    glViewport(x, y, width, height);
+    _issue();
+    viewport[0] = x;
+    viewport[1] = y;
+    viewport[2] = width;
+    viewport[3] = height;
+}
+
+void sGLStateCache::set_scissor(const int32_t x,
+                                const int32_t y,
+                                const int32_t width,
+                                const int32_t height) {
+    if (scissor[0] == x && scissor[1] == y && scissor[2] == width && scissor[3] == height) {
+        _elide();
+        return;
+    }
+
+    glScissor(x, y, width, height);
+    _issue();
+    scissor[0] = x;
+    scissor[1] = y;
+    scissor[2] = width;
+    scissor[3] = height;
+}
+
+void sGLStateCache::bind_texture(const uint32_t unit,
+                                 const uint32_t target,
+                                 const uint32_t texture_id) {
+    assert(unit < GL_STATE_MAX_TEXTURE_UNITS && "Texture unit not shadowed");
+    uint32_t &bound_texture = textures[unit][get_texture_target_index(target)];
+    if (bound_texture == texture_id) {
+        _elide();
+        return;
+    }
+
+    if (active_texture_unit != unit) {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        _issue();
+        active_texture_unit = unit;
+    }
+
+    glBindTexture(target,
+                  texture_id);
+    _issue();
+    bound_texture = texture_id;
+}
+
+void sGLStateCache::bind_uniform_buffer(const uint32_t index,
+                                        const uint32_t buffer,
+                                        const uint32_t offset,
+                                        const uint32_t size) {
+    assert(index < GL_STATE_MAX_UNIFORM_BUFFERS && "Uniform buffer binding not shadowed");
+    sGLUniformBufferBinding &binding = uniform_buffers[index];
+    if (binding.buffer == buffer && binding.offset == offset && binding.size == size) {
+        _elide();
+        return;
+    }
+
+    if (size == 0) {
+        glBindBufferBase(GL_UNIFORM_BUFFER,
+                         index,
+                         buffer);
+    } else {
+        glBindBufferRange(GL_UNIFORM_BUFFER,
+                          index,
+                          buffer,
+                          offset,
+                          size);
+    }
+    _issue();
+    binding = {buffer, offset, size};
+}
+
+// Fixed function ===========================================
+void sGLStateCache::set_capability(const eGLStateCapability capability,
+                                   const bool enabled) {
+    if (capabilities[capability] == (uint32_t) enabled) {
+        _elide();
+        return;
+    }
+
+    if (enabled) {
+        glEnable(gl_state_capabilities[capability]);
+    } else {
+        glDisable(gl_state_capabilities[capability]);
+    }
+    _issue();
+    capabilities[capability] = enabled;
+}
+
+void sGLStateCache::set_depth_mask(const bool write_depth) {
+    if (depth_mask == (uint32_t) write_depth) {
+        _elide();
+        return;
+    }
+
+    glDepthMask(write_depth);
+    _issue();
+    depth_mask = write_depth;
+}
+
+void sGLStateCache::set_depth_function(const uint32_t function) {
+    if (depth_function == function) {
+        _elide();
+        return;
+    }
+
+    glDepthFunc(function);
+    _issue();
+    depth_function = function;
+}
+
+void sGLStateCache::set_cull_face(const uint32_t mode) {
+    if (cull_face == mode) {
+        _elide();
+        return;
+    }
+
+    glCullFace(mode);
+    _issue();
+    cull_face = mode;
+}
+
+void sGLStateCache::set_front_face(const uint32_t mode) {
+    if (front_face == mode) {
+        _elide();
+        return;
+    }
+
+    glFrontFace(mode);
+    _issue();
+    front_face = mode;
+}
+
+void sGLStateCache::set_blend_func(const uint32_t src,
+                                   const uint32_t dst) {
+    if (blend_func_src == src && blend_func_dst == dst) {
+        _elide();
+        return;
+    }
+
+    glBlendFunc(src, dst);
+    _issue();
+    blend_func_src = src;
+    blend_func_dst = dst;
+}
+
+void sGLStateCache::set_clear_color(const float r,
+                                    const float g,
+                                    const float b,
+                                    const float a) {
+    if (clear_color[0] == r && clear_color[1] == g && clear_color[2] == b && clear_color[3] == a) {
+        _elide();
+        return;
+    }
+
+    glClearColor(r, g, b, a);
+    _issue();
+    clear_color[0] = r;
+    clear_color[1] = g;
+    clear_color[2] = b;
+    clear_color[3] = a;
+}
@@ -0,0 +1,140 @@
+#ifndef GL_STATE_CACHE_H_
+#define GL_STATE_CACHE_H_
+
+#include <cstdint>
+#include <GLES3/gl3.h>
+
+#define GL_STATE_MAX_TEXTURE_UNITS 16
+#define GL_STATE_MAX_UNIFORM_BUFFERS 4
+#define GL_STATE_UNKNOWN 0xFFFFFFFFu
+
+/**
+ * Shadow of the GL state that the renderer changes: the program, the VAO,
+ * the framebuffer with its viewport & scissor, the textures of each unit, the
+ * indexed uniform buffers, and the depth, culling & blending configuration.
+ * Every change of the render loop goes through it, and only the ones that
+ * change something reach GL; it counts, per frame, the calls issued & the
+ * ones elided (and adds the issued ones to GLStats).
+ * The texture uploads, the compute passes & the read backs bind on their
+ * own, so begin_frame forgets the bindings (not the fixed function state, only
+ * changed from here) and the first bind of each frame is always issued.
+ * Any unknown state is GL_STATE_UNKNOWN, that never matches a value.
+ * Only on the render thread; tools/gl_state_replay runs it against a
+ * recording stub of GL.
+ * */
+
+enum eGLStateCapability : uint8_t {
+    GL_STATE_DEPTH_TEST = 0,
+    GL_STATE_CULL_FACE,
+    GL_STATE_BLEND,
+    GL_STATE_SCISSOR_TEST,
+    GL_STATE_CAPABILITY_COUNT
+};
+
+enum eGLStateTextureTarget : uint8_t {
+    GL_STATE_TEXTURE_2D = 0,
+    GL_STATE_TEXTURE_3D,
+    GL_STATE_TEXTURE_2D_ARRAY,
+    GL_STATE_TEXTURE_CUBE_MAP,
+    GL_STATE_TEXTURE_TARGET_COUNT
+};
+
+const uint32_t gl_state_capabilities[GL_STATE_CAPABILITY_COUNT] = {
+    GL_DEPTH_TEST,
+    GL_CULL_FACE,
+    GL_BLEND,
+    GL_SCISSOR_TEST
+};
+
+const uint32_t gl_state_texture_targets[GL_STATE_TEXTURE_TARGET_COUNT] = {
+    GL_TEXTURE_2D,
+    GL_TEXTURE_3D,
+    GL_TEXTURE_2D_ARRAY,
+    GL_TEXTURE_CUBE_MAP
+};
+
+struct sGLUniformBufferBinding {
+    uint32_t buffer;
+    uint32_t offset;
+    uint32_t size; // 0 for the whole buffer
+};
+
+struct sGLStateCache {
+    // Bindings
+    uint32_t program = GL_STATE_UNKNOWN;
+    uint32_t vertex_array = GL_STATE_UNKNOWN;
+    uint32_t framebuffer = GL_STATE_UNKNOWN;
+    int32_t  viewport[4] = {-1, -1, -1, -1};
+    int32_t  scissor[4] = {-1, -1, -1, -1};
+    uint32_t active_texture_unit = GL_STATE_UNKNOWN;
+    uint32_t textures[GL_STATE_MAX_TEXTURE_UNITS][GL_STATE_TEXTURE_TARGET_COUNT];
+    sGLUniformBufferBinding uniform_buffers[GL_STATE_MAX_UNIFORM_BUFFERS];
+
+    // Fixed function
+    uint32_t capabilities[GL_STATE_CAPABILITY_COUNT];
+    uint32_t depth_mask = GL_STATE_UNKNOWN;
+    uint32_t depth_function = GL_STATE_UNKNOWN;
+    uint32_t cull_face = GL_STATE_UNKNOWN;
+    uint32_t front_face = GL_STATE_UNKNOWN;
+    uint32_t blend_func_src = GL_STATE_UNKNOWN;
+    uint32_t blend_func_dst = GL_STATE_UNKNOWN;
+    float    clear_color[4] = {-1.0f, -1.0f, -1.0f, -1.0f};
+
+    // Calls of the current frame, & of the last one
+    uint32_t issued_calls = 0;
+    uint32_t elided_calls = 0;
+    uint32_t last_issued_calls = 0;
+    uint32_t last_elided_calls = 0;
+
+    // Everything unknown
+    void init();
+
+    void begin_frame();
+    void end_frame();
+
+    void invalidate_bindings();
+    void invalidate();
+
+    void use_program(const uint32_t program_id);
+    void bind_vertex_array(const uint32_t vertex_array_id);
+    void bind_framebuffer(const uint32_t framebuffer_id);
+    void set_viewport(const int32_t x,
+                      const int32_t y,
+                      const int32_t width,
+                      const int32_t height);
+    void set_scissor(const int32_t x,
+                     const int32_t y,
+                     const int32_t width,
+                     const int32_t height);
+
+    // Activates the unit only if the binding changes
+    void bind_texture(const uint32_t unit,
+                      const uint32_t target,
+                      const uint32_t texture_id);
+
+    // size 0 binds the whole buffer (glBindBufferBase)
+    void bind_uniform_buffer(const uint32_t index,
+                             const uint32_t buffer,
+                             const uint32_t offset,
+                             const uint32_t size);
+
+    void set_capability(const eGLStateCapability capability,
+                        const bool enabled);
+    void set_depth_mask(const bool write_depth);
+    void set_depth_function(const uint32_t function);
+    void set_cull_face(const uint32_t mode);
+    void set_front_face(const uint32_t mode);
+    void set_blend_func(const uint32_t src,
+                        const uint32_t dst);
+    void set_clear_color(const float r,
+                         const float g,
+                         const float b,
+                         const float a);
+
+    void _issue(const uint32_t count = 1);
+    inline void _elide() {
+        elided_calls++;
+    }
+};
+
+#endif // GL_STATE_CACHE_H_
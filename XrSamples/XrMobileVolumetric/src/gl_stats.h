@@ -0,0 +1,27 @@
+#ifndef GL_STATS_H_
+#define GL_STATS_H_
+
+#include <cstdint>
+
+/**
+ * GL calls of the render loop, per frame: the draws, the state & binding
+ * changes, the uniform & buffer updates (and the uniform lookups, if any);
+ * each call site adds the calls it issues. Closed at the end of
+ * Render::sInstance::render_frame, and logged on the frame stats.
+ * Only on the render thread.
+ * */
+namespace GLStats {
+    inline uint32_t frame_calls = 0;
+    inline uint32_t last_frame_calls = 0;
+
+    inline void add_calls(const uint32_t count = 1) {
+        frame_calls += count;
+    }
+
+    inline void end_frame() {
+        last_frame_calls = frame_calls;
+        frame_calls = 0;
+    }
+};
+
+#endif // GL_STATS_H_
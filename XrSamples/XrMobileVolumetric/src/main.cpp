@@ -27,6 +27,7 @@ Copyright : Copyright (c) Facebook Technologies, LLC and its affiliates. All rig
 #include <android/log.h>
 #include <chrono>
 #include <thread>
+#include <algorithm>
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
@@ -40,6 +41,7 @@ Copyright : Copyright (c) Facebook Technologies, LLC and its affiliates. All rig
 #include "asset_locator.h"
 #include "egl_context.h"
 #include "openxr_instance.h"
+#include "frame_pipeline.h"
 
 PFNGLGENQUERIESEXTPROC glGenQueriesEXT_;
 PFNGLDELETEQUERIESEXTPROC glDeleteQueriesEXT_;
@@ -112,6 +114,91 @@ sOpenXR_Instance openxr_instance = {};
 
 Render::sInstance renderer = {};
 
+/**
+ *  RENDER THREAD
+ * */
+
+struct sFrameLoopState {
+    Application::sAndroidState *app_state = NULL;
+
+    // Startup time, to the first frame & to the volumes on screen
+    std::chrono::steady_clock::time_point startup_start;
+    bool first_frame_logged = false;
+    bool loads_logged = false;
+
+};
+
+// Records & submits the frame that the simulation predicted, on the render thread
+static void render_frame(const sFramePacket &packet,
+                         void *user_data) {
+    sFrameLoopState *loop_state = (sFrameLoopState*) user_data;
+
+    openxr_instance.begin_frame();
+
+    // Render (& timing, of the passes; the texture uploads are timed on their own)
+    renderer.render_frame(true,
+                          packet.transforms.view,
+                          packet.transforms.projection,
+                          packet.transforms.viewprojection);
+
+    openxr_instance.submit_frame(packet);
+
+    if (!loop_state->first_frame_logged || !loop_state->loads_logged) {
+        const double startup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loop_state->startup_start).count();
+        if (!loop_state->first_frame_logged) {
+            __android_log_print(ANDROID_LOG_INFO,
+                                "STARTUP",
+                                "Startup to first frame: %f ms",
+                                startup_ms);
+            loop_state->first_frame_logged = true;
+        }
+        if (renderer.material_man.volume_streamer.is_idle()) {
+            __android_log_print(ANDROID_LOG_INFO,
+                                "STARTUP",
+                                "Startup to the volumes loaded: %f ms",
+                                startup_ms);
+            loop_state->loads_logged = true;
+        }
+    }
+
+    // GPU time of the newest frame that finished; never waited on
+    if (renderer.is_render_time_valid) {
+        __android_log_print(ANDROID_LOG_VERBOSE,
+                            "FRAME_STATS",
+                            "Render time: %f; upload time: %f; GL calls: %u (state changes issued %u, elided %u)",
+                            ((double)renderer.last_render_time_ns) / 1000000.0,
+                            renderer.upload_scheduler.last_frame_upload_ms,
+                            GLStats::last_frame_calls,
+                            renderer.gl_state.last_issued_calls,
+                            renderer.gl_state.last_elided_calls);
+    } else {
+        __android_log_print(ANDROID_LOG_VERBOSE, "FRAME_STATS", "Render time: invalid");
+    }
+}
+
+static void render_thread_start(void *user_data) {
+    sFrameLoopState *loop_state = (sFrameLoopState*) user_data;
+
+    prctl(PR_SET_NAME, (long)"VRRender", 0, 0, 0);
+    loop_state->app_state->render_thread = gettid();
+
+    // Released by the main thread, once the renderer was initialized
+    if (!openxr_instance.egl.make_current()) {
+        __android_log_print(ANDROID_LOG_ERROR,
+                            "RenderThread",
+                            "Cannot make the EGL context current");
+    }
+}
+
+static void render_thread_end(void *user_data) {
+    openxr_instance.egl.release_current();
+}
+
+// The frames in flight have to be ended before the session is
+static void flush_frames(void *user_data) {
+    ((sFramePipeline<sFramePacket>*) user_data)->flush();
+}
+
 /**
  * This is the main entry point of a native application that is using
  * android_native_app_glue.  It runs in its own thread, with its own
@@ -121,6 +208,9 @@ Render::sInstance renderer = {};
 // https://github.com/QCraft-CC/OpenXR-Quest-sample/tree/main/app/src/main/cpp/hello_xr
 // https://github.com/JsMarq96/Understanding-Tiled-Volume-Rendering/blob/ee294f2407da501274c6abd301fbfd8eec5575fc/XrSamples/XrMobileVolumetric/src/main.cpp
 void android_main(struct android_app* app) {
+    sFrameLoopState loop_state = {};
+    loop_state.startup_start = std::chrono::steady_clock::now();
+
     JNIEnv* Env;
     (*app->activity->vm).AttachCurrentThread( &Env, NULL);
 
@@ -165,17 +255,28 @@ void android_main(struct android_app* app) {
     // Init renderer with the framebuffer data from OpenXR
     renderer.init(framebuffers);
 
-    sFrameTransforms frame_transforms = {};
-
     ApplicationLogic::config_render_pipeline(renderer);
 
-    uint64_t render_time;
-    uint32_t gl_time_queries[4];
-
-#define TIME_RENDER 0
-
-    glGenQueriesEXT_(2,
-                    gl_time_queries);
+    // From here on, GL only on the render thread
+    loop_state.app_state = &app_state;
+    sFramePipeline<sFramePacket> frame_pipeline;
+#ifdef USE_RENDER_THREAD
+    openxr_instance.egl.release_current();
+    frame_pipeline.init(true,
+                        render_frame,
+                        render_thread_start,
+                        render_thread_end,
+                        &loop_state);
+#else
+    app_state.render_thread = app_state.main_thread;
+    frame_pipeline.init(false,
+                        render_frame,
+                        NULL,
+                        NULL,
+                        &loop_state);
+#endif
+    openxr_instance.on_session_stopping = flush_frames;
+    openxr_instance.session_user_data = &frame_pipeline;
 
     // Game Loop
     while (app->destroyRequested == 0) {
@@ -207,64 +308,38 @@ void android_main(struct android_app* app) {
             continue;
         }
 
-        int disjoint_occurred = 0;
-        // (Timing) Clear, if disjoint erro ocurred
-        glGetIntegerv(GL_GPU_DISJOINT_EXT,
-                      &disjoint_occurred);
-
-
-        double delta_time = 0.0;
         __android_log_print(ANDROID_LOG_VERBOSE, "Openxr test", "starting frame");
 
-        auto update_method_start = std::chrono::steady_clock::now();
-        // Update and get position & events from the OpenXR runtime
-        openxr_instance.update(&app_state,
-                               &delta_time,
-                               &frame_transforms);
+        // Wait for the next frame & predict its views, while the render
+        // thread records the previous one
+        sFramePacket frame_packet = {};
+        openxr_instance.wait_frame(&frame_packet);
 
+        auto update_method_start = std::chrono::steady_clock::now();
         // Non-XR runtine Update
-        ApplicationLogic::update_logic(delta_time,
-                                       frame_transforms);
+        ApplicationLogic::update_logic(frame_packet.delta_time,
+                                       frame_packet.transforms);
         auto update_method_end = std::chrono::steady_clock::now();
-        double update_timing = std::chrono::duration_cast<std::chrono::nanoseconds>(update_method_end - update_method_start).count();
-
-        // Render (& timing)
-        glBeginQueryEXT_(GL_TIME_ELAPSED_EXT,
-                         gl_time_queries[TIME_RENDER]);
-
-        renderer.render_frame(true,
-                              frame_transforms.view,
-                              frame_transforms.projection,
-                              frame_transforms.viewprojection);
-
-        glEndQueryEXT_(GL_TIME_ELAPSED_EXT);
-
-        openxr_instance.submit_frame();
-
-        // Query processing ===========================================
-        int available = 0;
-        while (!available) {
-            glGetQueryObjectivEXT_(gl_time_queries[TIME_RENDER], GL_QUERY_RESULT_AVAILABLE, &available);
-        }
+        const float update_ms = std::chrono::duration<float, std::milli>(update_method_end - update_method_start).count();
 
+        frame_pipeline.submit(frame_packet);
 
-        glGetIntegerv(GL_GPU_DISJOINT_EXT,
-                      &disjoint_occurred);
-        if (!disjoint_occurred) {
-            glGetQueryObjectui64vEXT_(gl_time_queries[TIME_RENDER], GL_QUERY_RESULT, &render_time);
-
-            __android_log_print(ANDROID_LOG_VERBOSE,
-                                "FRAME_STATS",
-                                "Render time: %f; update time: %f",
-                                ((double)render_time) / 1000000.0,
-                                update_timing / 1000000.0);
-        } else {
-            __android_log_print(ANDROID_LOG_VERBOSE, "FRAME_STATS", "Render time: invalid");
-        }
+        // CPU time of the frame: the longest stage when they overlap, their sum if not
+        const float render_cpu_ms = frame_pipeline.last_render_ms.load(std::memory_order_relaxed);
+        __android_log_print(ANDROID_LOG_VERBOSE,
+                            "FRAME_STATS",
+                            "Update time: %f; render CPU time: %f; CPU frame time: %f (serial %f); submit wait: %f",
+                            update_ms,
+                            render_cpu_ms,
+                            (frame_pipeline.is_threaded) ? std::max(update_ms, render_cpu_ms) : update_ms + render_cpu_ms,
+                            update_ms + render_cpu_ms,
+                            frame_pipeline.last_submit_wait_ms);
 
         __android_log_print(ANDROID_LOG_VERBOSE, "FRAME", "==================");
     }
 
+    frame_pipeline.destroy();
+
     // Cleanup TODO
 
     (*app->activity->vm).DetachCurrentThread();
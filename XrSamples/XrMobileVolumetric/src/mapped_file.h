@@ -0,0 +1,94 @@
+#ifndef MAPPED_FILE_H_
+#define MAPPED_FILE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**
+ * Read-only memory mapping of a file on disk.
+ * Used as a source for the volume uploads, so the voxel data can be handed
+ * to the driver straight from the page cache, without an intermediate copy
+ * on the heap.
+ * */
+struct sMappedFile {
+    int         fd = -1;
+    size_t      size = 0;
+    const char *data = NULL;
+
+    // Returns false if the file cannot be opened or mapped
+    bool open(const char *file_dir) {
+        fd = ::open(file_dir,
+                    O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+            close();
+            return false;
+        }
+        size = (size_t) file_stat.st_size;
+
+        void *mapping = mmap(NULL,
+                             size,
+                             PROT_READ,
+                             MAP_PRIVATE,
+                             fd,
+                             0);
+        if (mapping == MAP_FAILED) {
+            close();
+            return false;
+        }
+        data = (const char*) mapping;
+
+        return true;
+    }
+
+    // Hint the kernel that the whole file is going to be read front to back,
+    // soon, so it can start the readahead before the upload touches the pages
+    void advise_sequential_read() const {
+        madvise((void*) data,
+                size,
+                MADV_SEQUENTIAL);
+        madvise((void*) data,
+                size,
+                MADV_WILLNEED);
+    }
+
+    // Hint that a region of the file is going to be needed soon
+    void advise_will_need(const size_t offset,
+                          const size_t length) const {
+        // madvise needs a page aligned start
+        const size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+        const size_t aligned_offset = offset - (offset % page_size);
+        const size_t clamped_length = (offset + length > size) ? size - offset : length;
+
+        madvise((void*) (data + aligned_offset),
+                clamped_length + (offset - aligned_offset),
+                MADV_WILLNEED);
+    }
+
+    inline bool is_open() const {
+        return data != NULL;
+    }
+
+    void close() {
+        if (data != NULL) {
+            munmap((void*) data,
+                   size);
+            data = NULL;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        size = 0;
+    }
+};
+
+#endif // MAPPED_FILE_H_
@@ -5,6 +5,7 @@
 #include <GLES3/gl3.h>
 #else
 #include <GLES3/gl3.h>
+#include "asset_locator.h"
 #endif
 
 #include "texture.h"
@@ -34,6 +35,43 @@ uint8_t sMaterialManager::add_shader(const char     *vertex_shader,
     return texture_count++;
 }
 
+uint8_t sMaterialManager::add_asset_texture(const char*   asset_name) {
+#ifdef __EMSCRIPTEN__
+    return add_texture(asset_name);
+#else
+    size_t asset_size = 0;
+    uint8_t *inflated_asset = NULL;
+    const uint8_t *asset = Assets::load_asset(asset_name,
+                                              &asset_size,
+                                              &inflated_asset);
+    assert(asset != NULL && "Cannot find the texture on the APK");
+
+    textures[texture_count].load_from_memory(eTextureType::STANDART_2D,
+                                             asset,
+                                             asset_size);
+    free(inflated_asset);
+
+    return texture_count++;
+#endif
+}
+
+uint8_t sMaterialManager::add_baked_texture(const char*   asset_name) {
+#ifdef __EMSCRIPTEN__
+    assert(false && "Baked bundles are only on the APK");
+    return 0;
+#else
+    size_t asset_size = 0;
+    sDerivedBlob blob = {};
+    const bool is_baked = blob.view(Assets::get_asset_view(asset_name, &asset_size),
+                                    asset_size);
+    assert(is_baked && "Cannot find the baked texture on the APK, or it is compressed");
+
+    textures[texture_count].load2D_baked(blob);
+
+    return texture_count++;
+#endif
+}
+
 // TODO: this is kinda messy... refactor to sTexture??
 void sMaterialManager::add_raw_texture(const char* raw_data,
                                 const size_t width,
@@ -85,6 +123,7 @@ uint8_t sMaterialManager::add_volume_texture(const char* text_dir,
                                    const uint16_t tile_depth) {
     uint8_t texture_id = texture_count++;
     //enabled_textures[VOLUME_MAP] = true;
+    textures[texture_id].distance_field_threshold = density_threshold;
     textures[texture_id].load3D_monochrome(text_dir,
                                            tile_width,
                                            tile_heigth,
@@ -93,12 +132,298 @@ uint8_t sMaterialManager::add_volume_texture(const char* text_dir,
 }
 
 
+uint8_t sMaterialManager::add_procedural_volume_texture(const sProceduralVolumeDesc &desc) {
+    uint8_t *volume = ProceduralVolume::generate(desc,
+                                                 0);
+    if (volume == NULL) {
+        assert(false && "Cannot allocate the procedural volume");
+        return 0;
+    }
+
+    uint8_t texture_id = texture_count++;
+    textures[texture_id].distance_field_threshold = density_threshold;
+    textures[texture_id].load3D_from_memory(volume,
+                                            desc.dims[0],
+                                            desc.dims[1],
+                                            desc.dims[2]);
+    free(volume);
+
+    return texture_id;
+}
+
+
+uint8_t sMaterialManager::add_volume_texture(const char* text_dir,
+                                             const float empty_threshold,
+                                             const sBrickRegion *region) {
+    sBrickedVolume volume = {};
+    if (!volume.open(text_dir)) {
+        assert(false && "Cannot open bricked volume");
+        return 0;
+    }
+
+    uint8_t texture_id = texture_count++;
+    textures[texture_id].distance_field_threshold = density_threshold;
+    textures[texture_id].load3D_bricked(volume,
+                                        (region != NULL) ? *region : volume.get_full_region(),
+                                        empty_threshold);
+    volume.close();
+
+    return texture_id;
+}
+
+
+uint8_t sMaterialManager::add_sparse_volume_texture(const char* text_dir,
+                                                    const uint16_t width,
+                                                    const uint16_t heigth,
+                                                    const uint16_t depth,
+                                                    const uint8_t empty_value) {
+    // The raw volume is only mapped, so it can be larger than the memory
+    sMappedFile volume_file = {};
+    if (!volume_file.open(text_dir) || volume_file.size < (size_t) width * heigth * depth) {
+        volume_file.close();
+        assert(false && "Cannot open sparse volume");
+        return 0;
+    }
+
+    int32_t max_texture_size = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_texture_size);
+
+    const uint32_t volume_dims[3] = {width, heigth, depth};
+    sBrickAtlas atlas = {};
+    const bool built = BrickAtlas::build((const uint8_t*) volume_file.data,
+                                         volume_dims,
+                                         BRICK_ATLAS_BRICK_SIZE,
+                                         empty_value,
+                                         0,
+                                         &atlas,
+                                         (uint32_t) max_texture_size);
+    volume_file.close();
+    assert(built && "Too many resident bricks for the atlas");
+
+    uint8_t texture_id = texture_count++;
+    textures[texture_id].load3D_sparse(atlas);
+    atlas.clean();
+
+    return texture_id;
+}
+
+
+uint8_t sMaterialManager::add_compressed_volume_texture(const char* text_dir,
+                                                        const uint16_t width,
+                                                        const uint16_t heigth,
+                                                        const uint16_t depth,
+                                                        const eEacQuality quality) {
+    sMappedFile volume_file = {};
+    if (!volume_file.open(text_dir) || volume_file.size < (size_t) width * heigth * depth) {
+        volume_file.close();
+        assert(false && "Cannot open volume to compress");
+        return 0;
+    }
+    volume_file.advise_sequential_read();
+
+    const uint32_t volume_dims[3] = {width, heigth, depth};
+    sEacVolume compressed = {};
+    EacCodec::compress_volume((const uint8_t*) volume_file.data,
+                              volume_dims,
+                              quality,
+                              0,
+                              &compressed);
+    volume_file.close();
+
+    uint8_t texture_id = texture_count++;
+    textures[texture_id].distance_field_threshold = density_threshold;
+    textures[texture_id].load3D_compressed(compressed);
+    compressed.clean();
+
+    return texture_id;
+}
+
+
+uint8_t sMaterialManager::add_quantized_volume_texture(const char* text_dir,
+                                                       const uint16_t width,
+                                                       const uint16_t heigth,
+                                                       const uint16_t depth,
+                                                       const eQuantizeSource source,
+                                                       const sQuantizeConfig &config) {
+    sMappedFile volume_file = {};
+    if (!volume_file.open(text_dir) || volume_file.size < (size_t) width * heigth * depth * get_quantize_source_size(source)) {
+        volume_file.close();
+        assert(false && "Cannot open volume to quantize");
+        return 0;
+    }
+    volume_file.advise_sequential_read();
+
+    const uint32_t volume_dims[3] = {width, heigth, depth};
+    sQuantizedVolume quantized = {};
+    VolumeQuantize::quantize_volume(volume_file.data,
+                                    source,
+                                    volume_dims,
+                                    config,
+                                    0,
+                                    &quantized);
+    volume_file.close();
+
+    uint8_t texture_id = texture_count++;
+    textures[texture_id].distance_field_threshold = density_threshold;
+    textures[texture_id].load3D_quantized(quantized);
+    quantized.clean();
+
+    return texture_id;
+}
+
+
+uint8_t sMaterialManager::add_streamed_volume_texture(const char* text_dir,
+                                                      const uint32_t cache_slot_count,
+                                                      const float empty_threshold) {
+    assert(streamed_volume_count < MAX_STREAMED_VOLUME_COUNT && "No more space for streamed volumes");
+    sVolumeResidency &residency = streamed_volumes[streamed_volume_count];
+    int32_t max_texture_size = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &max_texture_size);
+    if (!residency.init(text_dir,
+                        cache_slot_count,
+                        RESIDENCY_DEFAULT_WORKER_COUNT,
+                        empty_threshold,
+                        false,
+                        (uint32_t) max_texture_size)) {
+        assert(false && "Cannot open streamed volume");
+        return 0;
+    }
+    residency.init_gl();
+
+    uint8_t texture_id = texture_count++;
+    sTexture &texture = textures[texture_id];
+    texture.store_on_RAM = false;
+    texture.type = VOLUME;
+    texture.width = residency.lods[0].header->width;
+    texture.height = residency.lods[0].header->height;
+    texture.depth = residency.lods[0].header->depth;
+    texture.texture_id = residency.atlas_texture;
+    texture.page_table_id = residency.page_table_texture;
+    texture.is_streamed = true;
+    texture.residency_id = streamed_volume_count++;
+
+    return texture_id;
+}
+
+uint8_t sMaterialManager::add_volume_sequence_texture(const char* sequence_dir,
+                                                      const uint16_t width,
+                                                      const uint16_t heigth,
+                                                      const uint16_t depth,
+                                                      const uint32_t ring_size,
+                                                      const float timesteps_per_second) {
+    assert(volume_sequence_count < MAX_VOLUME_SEQUENCE_COUNT && "No more space for volume sequences");
+    sVolumeSequence &sequence = volume_sequences[volume_sequence_count];
+    if (!sequence.init(sequence_dir,
+                       width,
+                       heigth,
+                       depth,
+                       ring_size,
+                       timesteps_per_second,
+                       false)) {
+        assert(false && "Cannot open volume sequence");
+        return 0;
+    }
+    sequence.init_gl();
+
+    uint8_t texture_id = texture_count++;
+    sTexture &texture = textures[texture_id];
+    texture.store_on_RAM = false;
+    texture.type = VOLUME;
+    texture.width = width;
+    texture.height = heigth;
+    texture.depth = depth;
+    texture.texture_id = 0;
+    texture.is_loaded = false;
+    texture.load_progress = 0.0f;
+    texture.is_sequence = true;
+    texture.sequence_id = volume_sequence_count++;
+    sequence.texture_id = texture_id;
+
+    return texture_id;
+}
+
+void sMaterialManager::update_streamed_volume(const uint8_t material_id,
+                                              const glm::mat4x4 *view_projs,
+                                              const uint32_t view_count,
+                                              const glm::mat4x4 &model) {
+    const sMaterialInstance &material = materials[material_id];
+    if (!material.enabled_textures[VOLUME_MAP]) {
+        return;
+    }
+
+    const sTexture &volume = textures[material.texture_ids[VOLUME_MAP]];
+    if (!volume.is_streamed) {
+        return;
+    }
+
+    streamed_volumes[volume.residency_id].update(view_projs,
+                                                 view_count,
+                                                 model);
+}
+
+
+void sMaterialManager::enable_brick_feedback(const uint8_t texture_id,
+                                             const uint32_t width,
+                                             const uint32_t height) {
+    const sTexture &volume = textures[texture_id];
+    assert(volume.is_streamed && "Brick feedback is only for streamed volumes");
+
+    sBrickFeedback &feedback = brick_feedbacks[volume.residency_id];
+    if (!feedback.created) {
+        feedback.init(width,
+                      height);
+    }
+    streamed_volumes[volume.residency_id].use_feedback = true;
+}
+
+void sMaterialManager::read_back_brick_feedback(const uint8_t material_id,
+                                                const sFBO &fbo) {
+    const sMaterialInstance &material = materials[material_id];
+    if (!material.enabled_textures[VOLUME_MAP]) {
+        return;
+    }
+
+    const sTexture &volume = textures[material.texture_ids[VOLUME_MAP]];
+    if (volume.is_streamed && brick_feedbacks[volume.residency_id].created) {
+        brick_feedbacks[volume.residency_id].read_back(fbo);
+    }
+}
+
+void sMaterialManager::update_async_loads(sUploadScheduler *scheduler) {
+    volume_streamer.update(scheduler);
+
+    for(uint8_t i = 0; i < streamed_volume_count; i++) {
+        if (brick_feedbacks[i].created) {
+            const uint8_t *pages = brick_feedbacks[i].poll();
+            if (pages != NULL) {
+                streamed_volumes[i].set_feedback(pages,
+                                                 brick_feedbacks[i].get_page_count());
+            }
+        }
+        streamed_volumes[i].upload(scheduler);
+    }
+
+    // Swap the binding of each sequence to the timestep on screen
+    for(uint8_t i = 0; i < volume_sequence_count; i++) {
+        sVolumeSequence &sequence = volume_sequences[i];
+        sequence.update();
+        sequence.upload(scheduler);
+
+        sTexture &texture = textures[sequence.texture_id];
+        texture.texture_id = sequence.get_shown_texture();
+        texture.is_loaded = texture.texture_id != 0;
+        texture.load_progress = (texture.is_loaded) ? 1.0f : 0.0f;
+    }
+}
+
 
 #include <iostream>
  uint8_t sMaterialManager::load_async_texture3D(const char* dir,
                                       const uint16_t width,
                                       const uint16_t heigth,
-                                      const uint16_t depth) {
+                                      const uint16_t depth,
+                                      const fVolumeLoadedCallback on_loaded,
+                                      void *user_data) {
 #ifdef __EMSCRIPTEN__
     sTexture *text = &textures[texture_count];
     text->width = width;
@@ -140,11 +465,118 @@ uint8_t sMaterialManager::add_volume_texture(const char* text_dir,
     }, NULL);
 
 #else
-    //assert(false && "There is async loading of volumes on this platform yet");
+    sTexture *text = &textures[texture_count];
+    text->width = width;
+    text->height = heigth;
+    text->depth = depth;
+    text->distance_field_threshold = density_threshold;
+
+    volume_streamer.init();
+    const bool job_added = volume_streamer.add_job(texture_count,
+                                                   text,
+                                                   dir,
+                                                   on_loaded,
+                                                   user_data);
+    assert(job_added && "Cannot stream volume texture");
 #endif
     return texture_count++;
  }
 
+uint8_t sMaterialManager::load_async_asset_texture3D(const char* asset_name,
+                                                     const uint16_t width,
+                                                     const uint16_t heigth,
+                                                     const uint16_t depth,
+                                                     const fVolumeLoadedCallback on_loaded,
+                                                     void *user_data) {
+#ifdef __EMSCRIPTEN__
+    return load_async_texture3D(asset_name,
+                                width,
+                                heigth,
+                                depth,
+                                on_loaded,
+                                user_data);
+#else
+    sTexture *text = &textures[texture_count];
+    text->width = width;
+    text->height = heigth;
+    text->depth = depth;
+    text->distance_field_threshold = density_threshold;
+
+    sAccelerationParams params = {};
+    params.volume_dims[0] = width;
+    params.volume_dims[1] = heigth;
+    params.volume_dims[2] = depth;
+    params.distance_field_threshold = density_threshold;
+    const uint64_t asset_hash = Assets::get_asset_hash(asset_name);
+    const uint64_t cache_key = DerivedCache::make_key(asset_hash,
+                                                      &params,
+                                                      sizeof(params));
+
+    volume_streamer.init();
+
+    // Warm start: no preprocessing
+    sDerivedBlob blob = {};
+    if (asset_hash != 0 && derived_cache.open(cache_key, &blob)) {
+        if (volume_streamer.add_cached_job(texture_count,
+                                           text,
+                                           &blob,
+                                           on_loaded,
+                                           user_data)) {
+            return texture_count++;
+        }
+        blob.close();
+    }
+
+    // Straight from the APK
+    const sApkArchive &apk = Assets::fetch_asset_locator()->apk;
+    const uint32_t entry_id = apk.find_entry(asset_name);
+    assert(entry_id != ARCHIVE_NO_ENTRY && "Cannot find the volume on the APK");
+    const bool job_added = volume_streamer.add_archive_job(texture_count,
+                                                           text,
+                                                           apk,
+                                                           entry_id,
+                                                           on_loaded,
+                                                           user_data,
+                                                           &derived_cache,
+                                                           cache_key);
+    assert(job_added && "Cannot stream volume texture");
+
+    return texture_count++;
+#endif
+}
+
+uint8_t sMaterialManager::load_async_baked_texture3D(const char* asset_name,
+                                                     const fVolumeLoadedCallback on_loaded,
+                                                     void *user_data) {
+#ifdef __EMSCRIPTEN__
+    assert(false && "Baked bundles are only on the APK");
+    return 0;
+#else
+    size_t asset_size = 0;
+    sDerivedBlob blob = {};
+    const bool is_baked = blob.view(Assets::get_asset_view(asset_name, &asset_size),
+                                    asset_size);
+    const sDerivedSection *volume = (is_baked) ? blob.find_section(DERIVED_VOLUME) : NULL;
+    assert(volume != NULL && "Cannot find the baked volume on the APK, or it is compressed");
+
+    sTexture *text = &textures[texture_count];
+    text->width = volume->dims[0];
+    text->height = volume->dims[1];
+    text->depth = volume->dims[2];
+    text->distance_field_threshold = density_threshold;
+
+    volume_streamer.init();
+    const bool job_added = volume_streamer.add_cached_job(texture_count,
+                                                          text,
+                                                          &blob,
+                                                          on_loaded,
+                                                          user_data);
+    assert(job_added && "Cannot stream the baked volume");
+
+    return texture_count++;
+#endif
+}
+
 /**
  * Binds the textures on Opengl
  *  COLOR - Texture 0
@@ -152,28 +584,100 @@ uint8_t sMaterialManager::add_volume_texture(const char* text_dir,
  *  SPECULAR - TEXTURE 2
  *  VOLUME - Texture 3
  * */
-void sMaterialManager::enable(const uint8_t material_id) const {
+void sMaterialManager::enable(const uint8_t material_id,
+                              sGLStateCache *gl_state) const {
     const sMaterialInstance &material = materials[material_id];
-    shaders[material.shader_id].activate();
+    gl_state->use_program(shaders[material.shader_id].ID);
 
     int curr_texture_spot = 0;
     for (int texture = 0; texture < TEXTURE_MAP_TYPE_COUNT; texture++) {
         if (!material.enabled_textures[texture]) {
             continue;
         }
-        glActiveTexture(GL_TEXTURE0 + curr_texture_spot);
-
-        glBindTexture((texture == VOLUME_MAP) ? GL_TEXTURE_3D : GL_TEXTURE_2D,
-                      textures[material.texture_ids[texture]].texture_id);
-
-        shaders[material_id].set_uniform_texture(texture_uniform_LUT[texture],
-                                                 curr_texture_spot);
+        // While streaming, the volume is left unbound so it samples as empty,
+        // unless some of its levels are resident already
+        const sTexture &curr_texture = textures[material.texture_ids[texture]];
+        gl_state->bind_texture(curr_texture_spot,
+                               (texture == VOLUME_MAP) ? ((curr_texture.is_compressed) ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_3D) : GL_TEXTURE_2D,
+                               (curr_texture.is_sampleable()) ? curr_texture.texture_id : 0);
+
+        shaders[material.shader_id].set_uniform_texture(texture_uniform_LUT[texture],
+                                                        curr_texture_spot);
         curr_texture_spot++;
     }
 
     if (material.enabled_textures[VOLUME_MAP]) {
         shaders[material.shader_id].set_uniform("u_density_threshold",
                                                 density_threshold);
+
+        // Where the MRM traversal starts; it is also clamped to it
+        const sTexture &volume = textures[material.texture_ids[VOLUME_MAP]];
+        shaders[material.shader_id].set_uniform("u_max_mip_level",
+                                                (float) (volume.mip_count - 1));
+
+        // The min/max grid goes after the material textures
+        const bool use_grid = use_minmax_grid && volume.is_loaded && volume.minmax_grid_id != 0;
+        gl_state->bind_texture(curr_texture_spot,
+                               GL_TEXTURE_3D,
+                               (use_grid) ? volume.minmax_grid_id : 0);
+        shaders[material.shader_id].set_uniform_texture("u_minmax_grid_map",
+                                                        curr_texture_spot);
+        shaders[material.shader_id].set_uniform("u_use_minmax_grid",
+                                                use_grid);
+
+        // The distance field is only valid for thresholds over the one it was built with
+        const bool use_field = use_distance_field && volume.is_loaded && volume.distance_field_id != 0 && volume.distance_field_threshold <= density_threshold;
+        curr_texture_spot++;
+        gl_state->bind_texture(curr_texture_spot,
+                               GL_TEXTURE_3D,
+                               (use_field) ? volume.distance_field_id : 0);
+        shaders[material.shader_id].set_uniform_texture("u_distance_field_map",
+                                                        curr_texture_spot);
+        shaders[material.shader_id].set_uniform("u_use_distance_field",
+                                                use_field);
+
+        // Sparse & streamed volumes: u_volume_map is the atlas
+        if (volume.is_sparse || volume.is_streamed) {
+            curr_texture_spot++;
+            gl_state->bind_texture(curr_texture_spot,
+                                   GL_TEXTURE_3D,
+                                   volume.page_table_id);
+            shaders[material.shader_id].set_uniform_texture("u_page_table_map",
+                                                            curr_texture_spot);
+            shaders[material.shader_id].set_uniform_vector("u_volume_size",
+                                                           glm::vec3(volume.width, volume.height, volume.depth));
+        }
+
+        // Per brick quantized volumes: the range of each brick, to dequantize
+        if (volume.brick_range_id != 0) {
+            curr_texture_spot++;
+            gl_state->bind_texture(curr_texture_spot,
+                                   GL_TEXTURE_3D,
+                                   volume.brick_range_id);
+            shaders[material.shader_id].set_uniform_texture("u_brick_range_map",
+                                                            curr_texture_spot);
+            shaders[material.shader_id].set_uniform("u_brick_size",
+                                                    (float) volume.brick_range_size);
+        }
+
+        // The pages can point to any level of detail
+        if (volume.is_streamed) {
+            const sVolumeResidency &residency = streamed_volumes[volume.residency_id];
+            glm::vec3 lod_sizes[RESIDENCY_MAX_LODS];
+            for(uint32_t level = 0; level < residency.lod_count; level++) {
+                const sBrickedVolumeHeader *header = residency.lods[level].header;
+                lod_sizes[level] = glm::vec3(header->width, header->height, header->depth);
+            }
+            shaders[material.shader_id].set_uniform_vector_array("u_lod_sizes",
+                                                                 lod_sizes,
+                                                                 residency.lod_count);
+            shaders[material.shader_id].set_uniform("u_brick_size",
+                                                    (float) residency.brick_size);
+            shaders[material.shader_id].set_uniform("u_lod_count",
+                                                    (int) residency.lod_count);
+            shaders[material.shader_id].set_uniform("u_lod_bias",
+                                                    residency.lod_bias);
+        }
     }
 }
 
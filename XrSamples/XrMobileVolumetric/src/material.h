@@ -6,11 +6,19 @@
 #include "texture.h"
 #include "shader.h"
 #include "fbo.h"
+#include "volume_streamer.h"
+#include "volume_residency.h"
+#include "brick_feedback.h"
+#include "volume_sequence.h"
+#include "derived_cache.h"
+#include "gl_state_cache.h"
 
 #define MAX_TEXTURE_COUNT 15
 #define MAX_SHADER_COUNT 15
 #define MAX_MATERIAL_COUNT 15
 #define TEXTURE_SIZE 3
+#define MAX_STREAMED_VOLUME_COUNT 2
+#define MAX_VOLUME_SEQUENCE_COUNT 2
 
 enum eTextureMapType : int {
     COLOR_MAP = 0,
@@ -66,6 +74,11 @@ struct sMaterialInstance {
 struct sMaterialManager {
     // For isosurface rendering; a global setting.. ?
     float density_threshold = 0.15f;
+    // Skip the cells of the min/max grid that are under the threshold
+    bool  use_minmax_grid = true;
+    // Sphere trace with the distance field; it is built for the density_threshold
+    // at load time, and only valid while the threshold is not lowered
+    bool  use_distance_field = true;
 
     sTexture        textures[MAX_TEXTURE_COUNT];
     uint8_t         texture_count = 0;
@@ -75,6 +88,17 @@ struct sMaterialManager {
     sMaterialInstance  materials[MAX_MATERIAL_COUNT];
     uint8_t            materials_count = 0;
 
+    sVolumeStreamer    volume_streamer;
+    // Volumes & their structures from previous runs; disabled until init
+    sDerivedCache      derived_cache;
+
+    sVolumeResidency   streamed_volumes[MAX_STREAMED_VOLUME_COUNT];
+    sBrickFeedback     brick_feedbacks[MAX_STREAMED_VOLUME_COUNT];
+    uint8_t            streamed_volume_count = 0;
+
+    sVolumeSequence    volume_sequences[MAX_VOLUME_SEQUENCE_COUNT];
+    uint8_t            volume_sequence_count = 0;
+
     uint8_t add_shader(const char     *vertex_shader,
                        const char     *fragment_shader);
     uint8_t add_raw_shader(const char     *vertex_shader,
@@ -85,13 +109,130 @@ struct sMaterialManager {
                               const uint16_t tile_heigth,
                               const uint16_t tile_depth);
 
+    // Procedural volume (see sProceduralVolume), generated on load on all the cores
+    uint8_t add_procedural_volume_texture(const sProceduralVolumeDesc &desc);
+
+    // Bricked volume (.vbrk), the dimensions are read from the container.
+    // If no region is given, the whole volume is loaded
+    uint8_t add_volume_texture(const char* text_dir,
+                               const float empty_threshold = 0.0f,
+                               const sBrickRegion *region = NULL);
+
+    // Sparse volume from a raw file: only the bricks with voxels over
+    // empty_value are uploaded, to a brick atlas with a page table
+    uint8_t add_sparse_volume_texture(const char* text_dir,
+                                      const uint16_t width,
+                                      const uint16_t heigth,
+                                      const uint16_t depth,
+                                      const uint8_t empty_value = 0);
+
+    // Raw volume compressed to EAC R11 on load, half the memory of GL_R8; it
+    // needs a shader that samples it as slices (RawShaders::compressed_isosurface_shader)
+    uint8_t add_compressed_volume_texture(const char* text_dir,
+                                          const uint16_t width,
+                                          const uint16_t heigth,
+                                          const uint16_t depth,
+                                          const eEacQuality quality = EAC_QUALITY_NORMAL);
+
+    /**
+     * Raw 16 bit or float volume, quantized to GL_R8 on load (see VolumeQuantize);
+     * the per brick config needs a shader that dequantizes
+     * (RawShaders::quantized_isosurface_shader), the global one works with any
+     * */
+    uint8_t add_quantized_volume_texture(const char* text_dir,
+                                         const uint16_t width,
+                                         const uint16_t heigth,
+                                         const uint16_t depth,
+                                         const eQuantizeSource source,
+                                         const sQuantizeConfig &config = {});
+
+    // Out-of-core volume, from the levels of detail of a bricked volume (.vbrk);
+    // only the bricks that the views need are loaded, to a cache of cache_slot_count bricks
+    uint8_t add_streamed_volume_texture(const char* text_dir,
+                                        const uint32_t cache_slot_count = RESIDENCY_DEFAULT_SLOT_COUNT,
+                                        const float empty_threshold = 0.0f);
+
+    // Time-varying volume, from a folder of raw timesteps (see sVolumeSequence);
+    // it is played from a ring of ring_size textures, at timesteps_per_second
+    uint8_t add_volume_sequence_texture(const char* sequence_dir,
+                                        const uint16_t width,
+                                        const uint16_t heigth,
+                                        const uint16_t depth,
+                                        const uint32_t ring_size = SEQUENCE_DEFAULT_RING_SIZE,
+                                        const float timesteps_per_second = SEQUENCE_DEFAULT_FPS);
+
+    // For the playback controls & the stats
+    inline sVolumeSequence& get_volume_sequence(const uint8_t texture_id) {
+        assert(textures[texture_id].is_sequence && "The texture is not a volume sequence");
+        return volume_sequences[textures[texture_id].sequence_id];
+    }
+
+    // Requests the bricks of the volume of a material, for the views of this frame
+    void update_streamed_volume(const uint8_t material_id,
+                                const glm::mat4x4 *view_projs,
+                                const uint32_t view_count,
+                                const glm::mat4x4 &model);
+
+    // The finer bricks of the streamed volume are requested from the feedback
+    // of its rays (see Render::sInstance::add_brick_feedback_pass)
+    void enable_brick_feedback(const uint8_t texture_id,
+                               const uint32_t width,
+                               const uint32_t height);
+
+    // Right after the feedback pass, with the material of its draw call
+    void read_back_brick_feedback(const uint8_t material_id,
+                                  const sFBO &fbo);
+
+    // The texture is not bound until it has finished loading; on_loaded
+    // is called on the GL thread once it is
     uint8_t load_async_texture3D(const char* dir,
                               const uint16_t width,
                               const uint16_t heigth,
-                              const uint16_t depth);
+                              const uint16_t depth,
+                              const fVolumeLoadedCallback on_loaded = NULL,
+                              void *user_data = NULL);
+
+    /**
+     * Like load_async_texture3D, for a raw volume on the APK: if the derived
+     * cache has it (for these dimensions & density threshold), it is streamed
+     * from there, without building its structures; if not, it is streamed
+     * straight from the APK, and stored on the cache once its structures are built
+     * */
+    uint8_t load_async_asset_texture3D(const char* asset_name,
+                                       const uint16_t width,
+                                       const uint16_t heigth,
+                                       const uint16_t depth,
+                                       const fVolumeLoadedCallback on_loaded = NULL,
+                                       void *user_data = NULL);
+
+    /**
+     * Like load_async_asset_texture3D, for a volume of a baked bundle (see
+     * tools/bake_bundle.cpp): the dimensions, the mips & the structures come
+     * pre-built, and are uploaded straight from the view of the entry on the APK
+     * */
+    uint8_t load_async_baked_texture3D(const char* asset_name,
+                                       const fVolumeLoadedCallback on_loaded = NULL,
+                                       void *user_data = NULL);
+
+    // Streams the async loads & advances the sequences, call once per frame
+    void update_async_loads(sUploadScheduler *scheduler);
+
+    inline bool is_texture_loaded(const uint8_t texture_id) const {
+        return textures[texture_id].is_loaded;
+    }
+
+    inline float get_texture_load_progress(const uint8_t texture_id) const {
+        return textures[texture_id].load_progress;
+    }
 
     uint8_t add_texture(const char*          text_dir);
 
+    // Image on the APK, decoded from its view, without extracting it
+    uint8_t add_asset_texture(const char*   asset_name);
+
+    // Image of a baked bundle, with its mips; uploaded from its view on the APK
+    uint8_t add_baked_texture(const char*   asset_name);
+
     void add_raw_texture(const char* raw_data,
                          const size_t width,
                          const size_t height,
@@ -108,6 +249,14 @@ struct sMaterialManager {
         //textures[COLOR_ATTACHMENT] = fbo.color_attachment;
     }
 
+    // Samples a render target (i.e. of the render graph) on the material
+    inline void set_color_attachment_texture(const uint8_t material_id,
+                                             const int attachment_id,
+                                             const uint8_t texture_id) {
+        materials[material_id].texture_ids[COLOR_ATTACHMENT0 + attachment_id] = texture_id;
+        materials[material_id].enabled_textures[COLOR_ATTACHMENT0 + attachment_id] = true;
+    }
+
     inline uint8_t get_new_texture() {
         return texture_count++;
     }
@@ -127,8 +276,10 @@ struct sMaterialManager {
     *  COLOR - Texture 0
     *  NORMAL - Texture 1
     *  SPECULAR - TEXTURE 2
+    * The program & the textures are bound through gl_state
     * */
-    void enable(const uint8_t material_id) const;
+    void enable(const uint8_t material_id,
+                sGLStateCache *gl_state) const;
 
     void disable() const;
 };
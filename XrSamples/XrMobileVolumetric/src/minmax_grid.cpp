@@ -0,0 +1,60 @@
+#include "minmax_grid.h"
+
+#include <cstdlib>
+
+#include "parallel_for.h"
+
+void sMinMaxGrid::clean() {
+    free(cells);
+    cells = NULL;
+    dims[0] = dims[1] = dims[2] = 0;
+}
+
+void MinMaxGrid::build(const uint8_t *volume,
+                       const uint32_t volume_dims[3],
+                       const uint32_t cell_size,
+                       const uint32_t thread_count,
+                       sMinMaxGrid *grid) {
+    grid->clean();
+    grid->cell_size = cell_size;
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        grid->dims[axis] = (volume_dims[axis] + cell_size - 1) / cell_size;
+    }
+    grid->cells = (uint8_t*) malloc(grid->get_cell_count() * 2);
+
+    const size_t row = volume_dims[0];
+    const size_t slice = row * volume_dims[1];
+
+    Parallel::for_range(0, grid->dims[2], thread_count, [&](const uint32_t z_start, const uint32_t z_end) {
+        for(uint32_t cz = z_start; cz < z_end; cz++) {
+            // One voxel of overlap with the next cell, for the interpolation
+            const uint32_t vz_start = cz * cell_size;
+            const uint32_t vz_end = (vz_start + cell_size + 1 < volume_dims[2]) ? vz_start + cell_size + 1 : volume_dims[2];
+
+            for(uint32_t cy = 0; cy < grid->dims[1]; cy++) {
+                const uint32_t vy_start = cy * cell_size;
+                const uint32_t vy_end = (vy_start + cell_size + 1 < volume_dims[1]) ? vy_start + cell_size + 1 : volume_dims[1];
+
+                for(uint32_t cx = 0; cx < grid->dims[0]; cx++) {
+                    const uint32_t vx_start = cx * cell_size;
+                    const uint32_t vx_end = (vx_start + cell_size + 1 < volume_dims[0]) ? vx_start + cell_size + 1 : volume_dims[0];
+
+                    uint8_t cell_min = 255, cell_max = 0;
+                    for(uint32_t z = vz_start; z < vz_end; z++) {
+                        for(uint32_t y = vy_start; y < vy_end; y++) {
+                            const uint8_t *voxels = volume + z * slice + y * row;
+                            for(uint32_t x = vx_start; x < vx_end; x++) {
+                                cell_min = (voxels[x] < cell_min) ? voxels[x] : cell_min;
+                                cell_max = (voxels[x] > cell_max) ? voxels[x] : cell_max;
+                            }
+                        }
+                    }
+
+                    uint8_t *cell = grid->cells + (((size_t) cz * grid->dims[1] + cy) * grid->dims[0] + cx) * 2;
+                    cell[0] = cell_min;
+                    cell[1] = cell_max;
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,41 @@
+#ifndef MINMAX_GRID_H_
+#define MINMAX_GRID_H_
+
+#include <cstdint>
+#include <cstddef>
+
+#define MINMAX_GRID_CELL_SIZE 8 // Voxels per side; GRID_CELL_SIZE on the shaders
+
+/**
+ * Min/max acceleration grid for the empty space skipping
+ * Each cell stores the min & max density of its voxels, interleaved as RG8.
+ * The cells overlap one voxel with the next ones, so any trilinear sample
+ * inside a cell is between its min and max. Since it does not depend on the
+ * isovalue, the shaders compare against u_density_threshold, and changing
+ * the threshold does not need a rebuild.
+ * */
+struct sMinMaxGrid {
+    uint32_t    cell_size = MINMAX_GRID_CELL_SIZE;
+    uint32_t    dims[3] = {0, 0, 0};
+    uint8_t     *cells = NULL; // min, max per cell; x-major
+
+    inline size_t get_cell_count() const {
+        return (size_t) dims[0] * dims[1] * dims[2];
+    }
+
+    void clean();
+};
+
+namespace MinMaxGrid {
+    /**
+     * Builds the grid of a GL_R8 volume.
+     * thread_count == 0 uses all the cores.
+     * */
+    void build(const uint8_t *volume,
+               const uint32_t volume_dims[3],
+               const uint32_t cell_size,
+               const uint32_t thread_count,
+               sMinMaxGrid *grid);
+};
+
+#endif // MINMAX_GRID_H_
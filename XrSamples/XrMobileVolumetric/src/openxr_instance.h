@@ -33,6 +33,14 @@ struct sFrameTransforms {
     glm::mat4x4 viewprojection[MAX_EYE_NUMBER];
 };
 
+// What the simulation thread hands to the render thread each frame (see sFramePipeline)
+struct sFramePacket {
+    XrTime              predicted_display_time = 0;
+    double              delta_time = 0.0;
+    XrView              views[MAX_EYE_NUMBER] = {};
+    sFrameTransforms    transforms = {};
+};
+
 // Logging gunctions
 static XrInstance *global_xr_instance;
 #define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, "OpenXr", __VA_ARGS__)
@@ -248,6 +256,10 @@ struct sOpenXR_Instance {
     XrFrameState frame_state = {};
     sEglContext egl;
 
+    // Before the session ends, so the frames in flight can be finished
+    void (*on_session_stopping)(void *user_data) = NULL;
+    void *session_user_data = NULL;
+
     XrEventDataBuffer xr_event_buffer = {};
 
     sOpenXRFramebuffer *curr_framebuffers;
@@ -815,6 +827,9 @@ struct sOpenXR_Instance {
                                                   XR_ANDROID_THREAD_TYPE_RENDERER_MAIN_KHR,
                                                   android_state->render_thread));
         } else if (state == XR_SESSION_STATE_STOPPING) {
+            if (on_session_stopping != NULL) {
+                on_session_stopping(session_user_data);
+            }
             xrEndSession(xr_session);
             android_state->session_active = false;
         }
@@ -871,12 +886,11 @@ struct sOpenXR_Instance {
     }
 
 
-    void update(Application::sAndroidState *app_state,
-                double *delta_time,
-                sFrameTransforms *transforms) {
-        // Handle XR events
-        handle_events(app_state);
-
+    /**
+     * On the simulation thread: waits for the next frame, and predicts its
+     * views; the frame has to be begun, by begin_frame, before the next wait
+     * */
+    void wait_frame(sFramePacket *packet) {
         // get the predicted frametimes from OpenXR
         XrFrameWaitInfo waitFrameInfo = {};
         waitFrameInfo.type = XR_TYPE_FRAME_WAIT_INFO;
@@ -895,13 +909,6 @@ struct sOpenXR_Instance {
         // depends on the pipeline depth of the engine and the synthesis rate.
         // The better the prediction, the less black will be pulled in at the edges.
 
-        XrFrameBeginInfo begin_frame_desc = {
-                .type = XR_TYPE_FRAME_BEGIN_INFO,
-                .next = NULL
-        };
-        OXR(xrBeginFrame(xr_session,
-                         &begin_frame_desc));
-
         // Get space tracking ===
         XrSpaceLocation space_location = {
                 .type = XR_TYPE_SPACE_LOCATION,
@@ -935,7 +942,9 @@ struct sOpenXR_Instance {
                           &projection_capacity,
                           eye_projections));
 
-        *delta_time = FromXrTime(frame_state.predictedDisplayTime);
+        packet->predicted_display_time = frame_state.predictedDisplayTime;
+        packet->delta_time = FromXrTime(frame_state.predictedDisplayTime);
+        sFrameTransforms *transforms = &packet->transforms;
         ALOGE("VIEW COUNT %i", projection_capacity);
 
         // Generate view projections
@@ -969,10 +978,22 @@ struct sOpenXR_Instance {
             transforms->viewprojection[eye] = (transforms->projection[eye] * transforms->view[eye]);
             // https://github.com/maluoi/OpenXRSamples/blob/master/SingleFileExample/main.cpp
 
+            packet->views[eye] = eye_projections[eye];
         }
     }
 
-    void submit_frame() {
+    // On the render thread, before recording the frame of the last wait_frame
+    void begin_frame() {
+        XrFrameBeginInfo begin_frame_desc = {
+                .type = XR_TYPE_FRAME_BEGIN_INFO,
+                .next = NULL
+        };
+        OXR(xrBeginFrame(xr_session,
+                         &begin_frame_desc));
+    }
+
+    // On the render thread; with the views the frame was rendered with
+    void submit_frame(const sFramePacket &packet) {
         // Generate layers
         layers_count = 0;
         // Projection layer correction
@@ -1000,8 +1021,8 @@ struct sOpenXR_Instance {
             projection_views[i] = {
                     .type = XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW,
                     .next = NULL,
-                    .pose = eye_projections[i].pose,
-                    .fov = eye_projections[i].fov,
+                    .pose = packet.views[i].pose,
+                    .fov = packet.views[i].fov,
                     .subImage = {
                             .swapchain = curr_framebuffers[i].swapchain_handle,
                             .imageRect = {
@@ -1022,7 +1043,7 @@ struct sOpenXR_Instance {
         XrFrameEndInfo frame_end_info = {
                 .type = XR_TYPE_FRAME_END_INFO,
                 .next = NULL,
-                .displayTime = frame_state.predictedDisplayTime,
+                .displayTime = packet.predicted_display_time,
                 .environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE,
                 .layerCount = layers_count,
                 .layers = layers,
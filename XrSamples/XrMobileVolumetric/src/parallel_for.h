@@ -0,0 +1,180 @@
+#ifndef PARALLEL_FOR_H_
+#define PARALLEL_FOR_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+/**
+ * Splits [start, end) in contiguous chunks, one per thread, and runs
+ * func(chunk_start, chunk_end) on each; blocks until all are done.
+ * thread_count == 0 uses all the cores.
+ * The chunks run on a pool of worker threads (one less than the cores),
+ * created on the first call and kept until exit, so the calls only pay for
+ * waking them; the calling thread takes chunks too. Calls from several
+ * threads, and from inside func, are fine: each caller runs the chunks of
+ * its call that no worker has taken, so it never waits on an idle pool.
+ * */
+namespace Parallel {
+    inline uint32_t get_thread_count(const uint32_t requested) {
+        if (requested > 0) {
+            return requested;
+        }
+        const uint32_t cores = std::thread::hardware_concurrency();
+        return (cores > 0) ? cores : 1;
+    }
+
+    // A call of for_range, on the stack of its caller
+    struct sJob {
+        void        (*run_chunk)(const sJob *job, const uint32_t chunk_start, const uint32_t chunk_end) = NULL;
+        const void  *func = NULL;
+
+        uint32_t    start = 0;
+        uint32_t    chunk = 0;
+        uint32_t    remainder = 0;
+        uint32_t    chunk_count = 0;
+        std::atomic<uint32_t> next_chunk = {0};
+
+        // Guarded by the mutex of the pool
+        uint32_t    worker_count = 0; // Workers running its chunks
+        bool        is_queued = false;
+        sJob        *next = NULL;
+
+        // Until there are no chunks left to take
+        inline void run_chunks() {
+            for(uint32_t i = next_chunk.fetch_add(1); i < chunk_count; i = next_chunk.fetch_add(1)) {
+                const uint32_t chunk_start = start + i * chunk + ((i < remainder) ? i : remainder);
+                const uint32_t chunk_end = chunk_start + chunk + ((i < remainder) ? 1 : 0);
+                run_chunk(this, chunk_start, chunk_end);
+            }
+        }
+    };
+
+    struct sThreadPool {
+        std::mutex              mutex;
+        std::condition_variable work_available;
+        std::condition_variable job_released;
+        sJob                    *queue = NULL; // Newest first, so the nested calls end first
+        bool                    is_stopping = false;
+
+        std::thread             *workers = NULL;
+        uint32_t                worker_count = 0;
+
+        sThreadPool() {
+            worker_count = get_thread_count(0) - 1;
+            if (worker_count > 0) {
+                workers = new std::thread[worker_count];
+                for(uint32_t i = 0; i < worker_count; i++) {
+                    workers[i] = std::thread(&sThreadPool::_worker_loop, this);
+                }
+            }
+        }
+
+        ~sThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                is_stopping = true;
+            }
+            work_available.notify_all();
+            for(uint32_t i = 0; i < worker_count; i++) {
+                workers[i].join();
+            }
+            delete [] workers;
+        }
+
+        // Runs the job with the workers, and returns once they are done with it
+        void run(sJob *job) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                job->next = queue;
+                job->is_queued = true;
+                queue = job;
+            }
+            work_available.notify_all();
+
+            job->run_chunks();
+
+            std::unique_lock<std::mutex> lock(mutex);
+            _dequeue(job);
+            job_released.wait(lock, [job] { return job->worker_count == 0; });
+        }
+
+        // With the mutex locked
+        void _dequeue(sJob *job) {
+            if (!job->is_queued) {
+                return;
+            }
+            sJob **link = &queue;
+            while(*link != job) {
+                link = &(*link)->next;
+            }
+            *link = job->next;
+            job->is_queued = false;
+        }
+
+        void _worker_loop() {
+            std::unique_lock<std::mutex> lock(mutex);
+            while(true) {
+                work_available.wait(lock, [this] { return is_stopping || queue != NULL; });
+                if (is_stopping) {
+                    return;
+                }
+
+                sJob *job = queue;
+                job->worker_count++;
+                lock.unlock();
+
+                job->run_chunks();
+
+                // Every chunk is taken: no other worker needs to find it
+                lock.lock();
+                _dequeue(job);
+                job->worker_count--;
+                if (job->worker_count == 0) {
+                    job_released.notify_all();
+                }
+            }
+        }
+    };
+
+    inline sThreadPool& get_pool() {
+        static sThreadPool pool;
+        return pool;
+    }
+
+    template<typename F>
+    inline void for_range(const uint32_t start,
+                          const uint32_t end,
+                          const uint32_t requested_threads,
+                          const F &func) {
+        if (end <= start) {
+            return;
+        }
+
+        const uint32_t count = end - start;
+        uint32_t thread_count = get_thread_count(requested_threads);
+        thread_count = (thread_count > count) ? count : thread_count;
+
+        if (thread_count == 1) {
+            func(start, end);
+            return;
+        }
+
+        sJob job;
+        job.run_chunk = [](const sJob *curr_job, const uint32_t chunk_start, const uint32_t chunk_end) {
+            (*((const F*) curr_job->func))(chunk_start, chunk_end);
+        };
+        job.func = &func;
+        job.start = start;
+        job.chunk = count / thread_count;
+        job.remainder = count % thread_count;
+        job.chunk_count = thread_count;
+
+        get_pool().run(&job);
+    }
+};
+
+#endif // PARALLEL_FOR_H_
@@ -0,0 +1,451 @@
+#include "procedural_volume.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+
+#include "parallel_for.h"
+
+// RANDOM ===================
+inline float next_random(uint32_t *state) {
+    *state = *state * 1664525u + 1013904223u;
+    return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+inline uint32_t hash_lattice(const int32_t x,
+                             const int32_t y,
+                             const int32_t z,
+                             const uint32_t seed) {
+    uint32_t hash = seed ^ ((uint32_t) x * 73856093u) ^ ((uint32_t) y * 19349663u) ^ ((uint32_t) z * 83492791u);
+    hash ^= hash >> 16;
+    hash *= 0x7FEB352Du;
+    hash ^= hash >> 15;
+    hash *= 0x846CA68Bu;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+inline float get_lattice_value(const int32_t x,
+                               const int32_t y,
+                               const int32_t z,
+                               const uint32_t seed) {
+    return (hash_lattice(x, y, z, seed) >> 8) * (1.0f / 16777216.0f);
+}
+
+// NOISE ===================
+inline float smooth_step(const float t) {
+    return t * t * (3.0f - 2.0f * t);
+}
+
+inline float lerp(const float a,
+                  const float b,
+                  const float t) {
+    return a + (b - a) * t;
+}
+
+// Value noise on the lattice column x, interpolated on y & z
+inline float get_noise_yz(const int32_t x,
+                          const int32_t y,
+                          const int32_t z,
+                          const float sy,
+                          const float sz,
+                          const uint32_t seed) {
+    return lerp(lerp(get_lattice_value(x, y, z, seed), get_lattice_value(x, y + 1, z, seed), sy),
+                lerp(get_lattice_value(x, y, z + 1, seed), get_lattice_value(x, y + 1, z + 1, seed), sy),
+                sz);
+}
+
+inline uint32_t get_octave_seed(const uint32_t seed,
+                                const uint32_t octave) {
+    return seed + octave * 0x9E3779B9u;
+}
+
+// fBm on a single point, in lattice units of the first octave
+float get_fbm(const float x,
+              const float y,
+              const float z,
+              const uint32_t seed) {
+    float value = 0.0f, amplitude = 0.5f, total = 0.0f, scale = 1.0f;
+    for(uint32_t octave = 0; octave < PROCEDURAL_NOISE_OCTAVES; octave++) {
+        const float px = x * scale, py = y * scale, pz = z * scale;
+        const float fx = floorf(px), fy = floorf(py), fz = floorf(pz);
+        const float sy = smooth_step(py - fy), sz = smooth_step(pz - fz);
+        const uint32_t octave_seed = get_octave_seed(seed, octave);
+        const float n0 = get_noise_yz((int32_t) fx, (int32_t) fy, (int32_t) fz, sy, sz, octave_seed);
+        const float n1 = get_noise_yz((int32_t) fx + 1, (int32_t) fy, (int32_t) fz, sy, sz, octave_seed);
+        value += amplitude * lerp(n0, n1, smooth_step(px - fx));
+        total += amplitude;
+        amplitude *= 0.5f;
+        scale *= 2.0f;
+    }
+    return value / total;
+}
+
+/**
+ * The same fBm as get_fbm over a row of voxels; the y & z interpolation of
+ * each lattice column is only done once per cell, instead of per voxel
+ * */
+void get_fbm_row(const uint32_t count,
+                 const float lattice_scale,
+                 const float y,
+                 const float z,
+                 const uint32_t seed,
+                 float *values) {
+    memset(values, 0, sizeof(float) * count);
+    float amplitude = 0.5f, total = 0.0f, scale = 1.0f;
+    for(uint32_t octave = 0; octave < PROCEDURAL_NOISE_OCTAVES; octave++) {
+        const float py = y * scale, pz = z * scale;
+        const float fy = floorf(py), fz = floorf(pz);
+        const float sy = smooth_step(py - fy), sz = smooth_step(pz - fz);
+        const uint32_t octave_seed = get_octave_seed(seed, octave);
+
+        int32_t cell = INT32_MIN;
+        float n0 = 0.0f, n1 = 0.0f;
+        for(uint32_t x = 0; x < count; x++) {
+            const float px = (x * lattice_scale) * scale;
+            const float fx = floorf(px);
+            if ((int32_t) fx != cell) {
+                // Next cell: its first column is the last one of the previous
+                n0 = ((int32_t) fx == cell + 1) ? n1 : get_noise_yz((int32_t) fx, (int32_t) fy, (int32_t) fz, sy, sz, octave_seed);
+                n1 = get_noise_yz((int32_t) fx + 1, (int32_t) fy, (int32_t) fz, sy, sz, octave_seed);
+                cell = (int32_t) fx;
+            }
+            values[x] += amplitude * lerp(n0, n1, smooth_step(px - fx));
+        }
+        total += amplitude;
+        amplitude *= 0.5f;
+        scale *= 2.0f;
+    }
+    const float normalization = 1.0f / total;
+    for(uint32_t x = 0; x < count; x++) {
+        values[x] *= normalization;
+    }
+}
+
+// FEATURES ===================
+inline float get_max_side(const sProceduralVolumeDesc &desc) {
+    const uint32_t max_side = (desc.dims[0] > desc.dims[1]) ? desc.dims[0] : desc.dims[1];
+    return (float) ((max_side > desc.dims[2]) ? max_side : desc.dims[2]);
+}
+
+// Spheres of that radius for the occupancy, with overlaps: 1 - e^(-count * sphere / volume)
+inline uint32_t get_feature_count(const sProceduralVolumeDesc &desc,
+                                  const float radius) {
+    if (desc.occupancy <= 0.0f) {
+        return 0;
+    }
+    const double occupancy = (desc.occupancy < 0.999f) ? desc.occupancy : 0.999;
+    const double volume = (double) desc.dims[0] * desc.dims[1] * desc.dims[2];
+    const double sphere = 4.0 / 3.0 * M_PI * radius * radius * radius;
+    const double count = std::max(round(-log(1.0 - occupancy) * volume / sphere), 1.0);
+    return (count < PROCEDURAL_MAX_FEATURES) ? (uint32_t) count : PROCEDURAL_MAX_FEATURES;
+}
+
+/**
+ * Particles for the occupancy, when they are packed on clouds: the occupied
+ * volume of a normal cloud of sigma, integrated over its radius, and searched
+ * for the count that covers the occupancy
+ * */
+inline uint32_t get_cloud_particle_count(const sProceduralVolumeDesc &desc,
+                                         const uint32_t cloud_count,
+                                         const float sigma) {
+    if (desc.occupancy <= 0.0f) {
+        return 0;
+    }
+    const double target = (double) desc.occupancy * desc.dims[0] * desc.dims[1] * desc.dims[2];
+    const double particle = 4.0 / 3.0 * M_PI * pow(PROCEDURAL_PARTICLE_RADIUS, 3.0);
+    const double normalization = pow(2.0 * M_PI * sigma * sigma, -1.5);
+
+    auto get_occupied = [&](const double count) {
+        const double per_cloud = count / cloud_count;
+        double occupied = 0.0;
+        const double step = sigma / 16.0;
+        for(double radius = step * 0.5; radius < sigma * 8.0; radius += step) {
+            const double density = per_cloud * particle * normalization * exp(-radius * radius / (2.0 * sigma * sigma));
+            occupied += 4.0 * M_PI * radius * radius * (1.0 - exp(-density)) * step;
+        }
+        return occupied * cloud_count;
+    };
+
+    double low = 0.0, high = PROCEDURAL_MAX_FEATURES;
+    for(uint32_t i = 0; i < 48; i++) {
+        const double middle = (low + high) * 0.5;
+        if (get_occupied(middle) < target) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return std::max((uint32_t) high, 1u);
+}
+
+inline float clamp_to_side(const float value,
+                           const uint32_t side) {
+    return (value < 0.0f) ? 0.0f : ((value > (float) side) ? (float) side : value);
+}
+
+void place_spheres(sProceduralVolume *volume) {
+    const sProceduralVolumeDesc &desc = volume->desc;
+    const float radius = std::max(get_max_side(desc) / (2.0f * desc.frequency), 1.0f);
+    volume->feature_count = get_feature_count(desc, radius);
+    volume->features = (sProceduralFeature*) malloc(sizeof(sProceduralFeature) * volume->feature_count);
+    volume->max_radius = radius;
+
+    uint32_t state = desc.seed;
+    for(uint32_t i = 0; i < volume->feature_count; i++) {
+        sProceduralFeature &sphere = volume->features[i];
+        for(uint32_t axis = 0; axis < 3; axis++) {
+            sphere.center[axis] = (i == 0) ? desc.dims[axis] * 0.5f : next_random(&state) * desc.dims[axis];
+        }
+        sphere.radius = radius;
+    }
+}
+
+void place_particles(sProceduralVolume *volume) {
+    const sProceduralVolumeDesc &desc = volume->desc;
+    const float cloud_radius = get_max_side(desc) / (2.0f * desc.frequency);
+    const uint32_t cloud_count = std::max((uint32_t) desc.frequency, 1u);
+    volume->feature_count = get_cloud_particle_count(desc, cloud_count, cloud_radius * 0.5f);
+    volume->features = (sProceduralFeature*) malloc(sizeof(sProceduralFeature) * volume->feature_count);
+    volume->max_radius = PROCEDURAL_PARTICLE_RADIUS;
+
+    uint32_t state = desc.seed;
+    float *clouds = (float*) malloc(sizeof(float) * 3 * cloud_count);
+    for(uint32_t i = 0; i < cloud_count * 3; i++) {
+        clouds[i] = next_random(&state) * desc.dims[i % 3];
+    }
+
+    // Normal around the center of its cloud, with the radius as 2 sigmas
+    for(uint32_t i = 0; i < volume->feature_count; i++) {
+        const float *cloud = clouds + (i % cloud_count) * 3;
+        sProceduralFeature &particle = volume->features[i];
+        for(uint32_t axis = 0; axis < 3; axis++) {
+            // The ones that fall outside are drawn again, so they do not pile on the faces
+            float position = -1.0f;
+            for(uint32_t attempt = 0; attempt < 8 && (position < 0.0f || position >= (float) desc.dims[axis]); attempt++) {
+                const float u1 = std::max(next_random(&state), 1e-7f), u2 = next_random(&state);
+                const float normal = sqrtf(-2.0f * logf(u1)) * cosf(2.0f * (float) M_PI * u2);
+                position = cloud[axis] + normal * cloud_radius * 0.5f;
+            }
+            particle.center[axis] = clamp_to_side(position, desc.dims[axis]);
+        }
+        particle.radius = PROCEDURAL_PARTICLE_RADIUS;
+    }
+    free(clouds);
+}
+
+// Level of the noise that leaves the occupancy over it, from random samples
+void find_noise_cutoff(sProceduralVolume *volume) {
+    const sProceduralVolumeDesc &desc = volume->desc;
+    const float lattice_scale = desc.frequency / get_max_side(desc);
+    float *samples = (float*) malloc(sizeof(float) * PROCEDURAL_NOISE_SAMPLES);
+
+    uint32_t state = desc.seed;
+    for(uint32_t i = 0; i < PROCEDURAL_NOISE_SAMPLES; i++) {
+        const float x = floorf(next_random(&state) * desc.dims[0]);
+        const float y = floorf(next_random(&state) * desc.dims[1]);
+        const float z = floorf(next_random(&state) * desc.dims[2]);
+        samples[i] = get_fbm(x * lattice_scale, y * lattice_scale, z * lattice_scale, desc.seed);
+    }
+    std::sort(samples, samples + PROCEDURAL_NOISE_SAMPLES);
+
+    const float occupancy = (desc.occupancy < 0.0f) ? 0.0f : ((desc.occupancy > 1.0f) ? 1.0f : desc.occupancy);
+    const uint32_t cutoff_index = (uint32_t) ((1.0f - occupancy) * PROCEDURAL_NOISE_SAMPLES);
+    volume->noise_max = samples[PROCEDURAL_NOISE_SAMPLES - 1];
+    volume->noise_cutoff = (occupancy >= 1.0f) ? -1.0f : ((cutoff_index < PROCEDURAL_NOISE_SAMPLES) ? samples[cutoff_index] : 2.0f);
+    free(samples);
+}
+
+void sProceduralVolume::init(const sProceduralVolumeDesc &volume_desc) {
+    desc = volume_desc;
+    desc.frequency = (desc.frequency > 0.0f) ? desc.frequency : 1.0f;
+
+    if (desc.shape == PROCEDURAL_SPHERES) {
+        place_spheres(this);
+    } else if (desc.shape == PROCEDURAL_PARTICLES) {
+        place_particles(this);
+    } else if (desc.shape == PROCEDURAL_FRACTAL_NOISE) {
+        find_noise_cutoff(this);
+    }
+
+    if (features != NULL) {
+        std::sort(features,
+                  features + feature_count,
+                  [](const sProceduralFeature &a, const sProceduralFeature &b) {
+            return a.center[2] < b.center[2];
+        });
+    }
+}
+
+void sProceduralVolume::clean() {
+    free(features);
+    features = NULL;
+    feature_count = 0;
+}
+
+// SLICES ===================
+inline uint8_t get_density(const float distance) {
+    // distance is 0 on the core & 1 on the edge of the feature
+    return (uint8_t) (255.0f - (255.0f - PROCEDURAL_MIN_DENSITY) * distance);
+}
+
+// Rasterizes the features that cross the slices [z_start, z_end); slices starts at z_start
+void splat_features(const sProceduralVolume &volume,
+                    const uint32_t z_start,
+                    const uint32_t z_end,
+                    uint8_t *slices) {
+    const sProceduralVolumeDesc &desc = volume.desc;
+    const size_t row = desc.dims[0];
+    const size_t slice = row * desc.dims[1];
+
+    const sProceduralFeature *first = std::lower_bound(volume.features,
+                                                       volume.features + volume.feature_count,
+                                                       z_start - volume.max_radius,
+                                                       [](const sProceduralFeature &feature, const float z) {
+        return feature.center[2] < z;
+    });
+
+    for(const sProceduralFeature *feature = first; feature < volume.features + volume.feature_count; feature++) {
+        if (feature->center[2] - feature->radius >= (float) z_end) {
+            break;
+        }
+        const float radius = feature->radius;
+        const int32_t min_z = std::max((int32_t) ceilf(feature->center[2] - radius - 0.5f), (int32_t) z_start);
+        const int32_t max_z = std::min((int32_t) floorf(feature->center[2] + radius - 0.5f), (int32_t) z_end - 1);
+        for(int32_t z = min_z; z <= max_z; z++) {
+            const float dz = (z + 0.5f) - feature->center[2];
+            const float radius_yz = sqrtf(std::max(radius * radius - dz * dz, 0.0f));
+            const int32_t min_y = std::max((int32_t) ceilf(feature->center[1] - radius_yz - 0.5f), 0);
+            const int32_t max_y = std::min((int32_t) floorf(feature->center[1] + radius_yz - 0.5f), (int32_t) desc.dims[1] - 1);
+            for(int32_t y = min_y; y <= max_y; y++) {
+                const float dy = (y + 0.5f) - feature->center[1];
+                const float radius_x = sqrtf(std::max(radius_yz * radius_yz - dy * dy, 0.0f));
+                const int32_t min_x = std::max((int32_t) ceilf(feature->center[0] - radius_x - 0.5f), 0);
+                const int32_t max_x = std::min((int32_t) floorf(feature->center[0] + radius_x - 0.5f), (int32_t) desc.dims[0] - 1);
+                uint8_t *voxels = slices + (z - z_start) * slice + y * row;
+                for(int32_t x = min_x; x <= max_x; x++) {
+                    const float dx = (x + 0.5f) - feature->center[0];
+                    const float distance = std::min(sqrtf(dx * dx + dy * dy + dz * dz) / radius, 1.0f);
+                    const uint8_t density = get_density(distance);
+                    voxels[x] = (density > voxels[x]) ? density : voxels[x];
+                }
+            }
+        }
+    }
+}
+
+void fill_noise(const sProceduralVolume &volume,
+                const uint32_t z_start,
+                const uint32_t z_end,
+                uint8_t *slices) {
+    const sProceduralVolumeDesc &desc = volume.desc;
+    const size_t row = desc.dims[0];
+    const float lattice_scale = desc.frequency / get_max_side(desc);
+    const float range = (volume.noise_max > volume.noise_cutoff) ? volume.noise_max - volume.noise_cutoff : 1.0f;
+    float *values = (float*) malloc(sizeof(float) * row);
+
+    for(uint32_t z = z_start; z < z_end; z++) {
+        for(uint32_t y = 0; y < desc.dims[1]; y++) {
+            get_fbm_row(desc.dims[0], lattice_scale, y * lattice_scale, z * lattice_scale, desc.seed, values);
+            uint8_t *voxels = slices + ((size_t) (z - z_start) * desc.dims[1] + y) * row;
+            for(uint32_t x = 0; x < desc.dims[0]; x++) {
+                voxels[x] = (values[x] > volume.noise_cutoff) ? get_density(1.0f - std::min((values[x] - volume.noise_cutoff) / range, 1.0f)) : 0;
+            }
+        }
+    }
+    free(values);
+}
+
+void fill_shells(const sProceduralVolume &volume,
+                 const uint32_t z_start,
+                 const uint32_t z_end,
+                 uint8_t *slices) {
+    const sProceduralVolumeDesc &desc = volume.desc;
+    const size_t row = desc.dims[0];
+    const float half_side = get_max_side(desc) * 0.5f;
+    const float thickness = std::max(std::min(desc.occupancy, 1.0f), 0.0f);
+
+    for(uint32_t z = z_start; z < z_end; z++) {
+        const float dz = (z + 0.5f) - desc.dims[2] * 0.5f;
+        for(uint32_t y = 0; y < desc.dims[1]; y++) {
+            const float dy = (y + 0.5f) - desc.dims[1] * 0.5f;
+            uint8_t *voxels = slices + ((size_t) (z - z_start) * desc.dims[1] + y) * row;
+            for(uint32_t x = 0; x < desc.dims[0]; x++) {
+                const float dx = (x + 0.5f) - desc.dims[0] * 0.5f;
+                const float shell = sqrtf(dx * dx + dy * dy + dz * dz) / half_side * desc.frequency;
+                // Position across the shell, the fraction of each period that is occupied
+                const float phase = shell - floorf(shell);
+                voxels[x] = (phase < thickness) ? get_density(fabsf(2.0f * phase / thickness - 1.0f)) : 0;
+            }
+        }
+    }
+}
+
+void fill_dense(const sProceduralVolume &volume,
+                const uint32_t z_start,
+                const uint32_t z_end,
+                uint8_t *slices) {
+    const sProceduralVolumeDesc &desc = volume.desc;
+    const size_t row = desc.dims[0];
+    const float block_size = std::max(get_max_side(desc) / desc.frequency, 1.0f);
+
+    for(uint32_t z = z_start; z < z_end; z++) {
+        const int32_t block_z = (int32_t) (z / block_size);
+        for(uint32_t y = 0; y < desc.dims[1]; y++) {
+            const int32_t block_y = (int32_t) (y / block_size);
+            uint8_t *voxels = slices + ((size_t) (z - z_start) * desc.dims[1] + y) * row;
+            for(uint32_t x = 0; x < desc.dims[0]; x++) {
+                const uint32_t hash = hash_lattice((int32_t) (x / block_size), block_y, block_z, desc.seed);
+                const bool is_full = (hash >> 8) * (1.0f / 16777216.0f) < desc.occupancy;
+                voxels[x] = (is_full) ? get_density((hash & 0xFF) / 255.0f) : 0;
+            }
+        }
+    }
+}
+
+void sProceduralVolume::generate_slices(const uint32_t z_start,
+                                        const uint32_t z_end,
+                                        const uint32_t thread_count,
+                                        uint8_t *slices) const {
+    const size_t slice = get_slice_size();
+    Parallel::for_range(z_start, z_end, thread_count, [&](const uint32_t start, const uint32_t end) {
+        uint8_t *thread_slices = slices + (start - z_start) * slice;
+        if (desc.shape == PROCEDURAL_SPHERES || desc.shape == PROCEDURAL_PARTICLES) {
+            memset(thread_slices, 0, (end - start) * slice);
+            splat_features(*this, start, end, thread_slices);
+        } else if (desc.shape == PROCEDURAL_FRACTAL_NOISE) {
+            fill_noise(*this, start, end, thread_slices);
+        } else if (desc.shape == PROCEDURAL_SHELLS) {
+            fill_shells(*this, start, end, thread_slices);
+        } else {
+            fill_dense(*this, start, end, thread_slices);
+        }
+    });
+}
+
+// VOLUME ===================
+uint8_t* ProceduralVolume::generate(const sProceduralVolumeDesc &desc,
+                                    const uint32_t thread_count) {
+    sProceduralVolume volume = {};
+    volume.init(desc);
+
+    uint8_t *result = (uint8_t*) malloc(volume.get_size());
+    if (result != NULL) {
+        volume.generate_slices(0,
+                               desc.dims[2],
+                               thread_count,
+                               result);
+    }
+    volume.clean();
+    return result;
+}
+
+float ProceduralVolume::get_occupancy(const uint8_t *volume,
+                                      const size_t voxel_count) {
+    size_t occupied = 0;
+    for(size_t i = 0; i < voxel_count; i++) {
+        occupied += (volume[i] != 0) ? 1 : 0;
+    }
+    return (voxel_count > 0) ? (float) occupied / voxel_count : 0.0f;
+}
@@ -0,0 +1,108 @@
+#ifndef PROCEDURAL_VOLUME_H_
+#define PROCEDURAL_VOLUME_H_
+
+#include <cstdint>
+#include <cstddef>
+
+#define PROCEDURAL_NOISE_OCTAVES 4
+#define PROCEDURAL_NOISE_SAMPLES 65536 // To find the cutoff of the occupancy
+#define PROCEDURAL_PARTICLE_RADIUS 1.5f // In voxels
+#define PROCEDURAL_MAX_FEATURES (1 << 24)
+#define PROCEDURAL_MIN_DENSITY 128 // Of the occupied voxels, over any usual threshold
+
+/**
+ * Procedural volumes, to benchmark how the empty space skipping, the
+ * streaming & the compression scale with the size & the sparsity
+ * Every shape has an occupancy (the fraction of voxels that are not 0) and a
+ * frequency (features across the largest side of the volume):
+ *  - SPHERES: overlapping solid spheres of diameter side / frequency; the
+ *    first one is always at the center
+ *  - FRACTAL_NOISE: fBm of value noise, cut at the level that leaves the occupancy
+ *  - PARTICLES: clouds of tiny particles, frequency clouds of diameter side / frequency
+ *  - SHELLS: concentric thin shells around the center, frequency per half side
+ *  - DENSE: blocks of side / frequency, each one full at a random density, or empty
+ * The occupancy is met on average (the particles fall short when the clouds
+ * saturate); volume_gen reports the real one.
+ * The densities go from PROCEDURAL_MIN_DENSITY on the edges of a feature to
+ * 255 in its core, so the gradients are not flat.
+ * Any range of z slices can be generated on its own, so the volumes larger
+ * than the memory can be written by slabs (tools/volume_gen.cpp); the same
+ * seed always gives the same volume.
+ * */
+
+enum eProceduralShape : uint8_t {
+    PROCEDURAL_SPHERES = 0,
+    PROCEDURAL_FRACTAL_NOISE,
+    PROCEDURAL_PARTICLES,
+    PROCEDURAL_SHELLS,
+    PROCEDURAL_DENSE,
+    PROCEDURAL_SHAPE_COUNT
+};
+
+const char procedural_shape_names[PROCEDURAL_SHAPE_COUNT][10] = {
+    "spheres",
+    "noise",
+    "particles",
+    "shells",
+    "dense"
+};
+
+struct sProceduralVolumeDesc {
+    eProceduralShape shape = PROCEDURAL_SPHERES;
+    uint32_t         dims[3] = {256, 256, 256};
+    float            occupancy = 0.1f; // [0, 1]
+    float            frequency = 4.0f;
+    uint32_t         seed = 1234u;
+};
+
+// Solid sphere of the SPHERES & PARTICLES shapes, in voxels
+struct sProceduralFeature {
+    float center[3];
+    float radius;
+};
+
+struct sProceduralVolume {
+    sProceduralVolumeDesc desc = {};
+
+    // Sorted by the z of their center
+    sProceduralFeature    *features = NULL;
+    uint32_t              feature_count = 0;
+    float                 max_radius = 0.0f;
+
+    float                 noise_cutoff = 0.0f;
+    float                 noise_max = 1.0f;
+
+    // Places the features, or finds the noise cutoff
+    void init(const sProceduralVolumeDesc &volume_desc);
+
+    inline size_t get_slice_size() const {
+        return (size_t) desc.dims[0] * desc.dims[1];
+    }
+
+    inline size_t get_size() const {
+        return get_slice_size() * desc.dims[2];
+    }
+
+    /**
+     * Fills the z slices [z_start, z_end) to slices, that holds them x major.
+     * thread_count == 0 uses all the cores.
+     * */
+    void generate_slices(const uint32_t z_start,
+                         const uint32_t z_end,
+                         const uint32_t thread_count,
+                         uint8_t *slices) const;
+
+    void clean();
+};
+
+namespace ProceduralVolume {
+    // The whole volume, on a new buffer; NULL if it does not fit on memory
+    uint8_t* generate(const sProceduralVolumeDesc &desc,
+                      const uint32_t thread_count);
+
+    // Fraction of the voxels that are not 0
+    float get_occupancy(const uint8_t *volume,
+                        const size_t voxel_count);
+};
+
+#endif // PROCEDURAL_VOLUME_H_
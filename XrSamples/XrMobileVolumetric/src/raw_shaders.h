@@ -1,6 +1,29 @@
 #ifndef RAW_SHADERS_H_
 #define RAW_SHADERS_H_
 
+/**
+ * std140 uniform blocks, bound by sShader to their eUniformBlock binding
+ * point; they match sFrameUniforms, sViewUniforms & sDrawUniforms (render.h).
+ * Updated once per frame (frame & views) or per draw & eye, instead of the
+ * plain uniforms. Explicit precisions, the same block has to match on both stages
+ * */
+#define FRAME_UNIFORM_BLOCK "layout(std140) uniform FrameBlock {\n" \
+                            "    highp float u_time;\n" \
+                            "};\n"
+
+#define VIEW_UNIFORM_BLOCK "layout(std140) uniform ViewBlock {\n" \
+                           "    highp mat4 u_view_mats[2];\n" \
+                           "    highp mat4 u_proj_mats[2];\n" \
+                           "    highp mat4 u_vp_mats[2];\n" \
+                           "};\n"
+
+#define DRAW_UNIFORM_BLOCK "layout(std140) uniform DrawBlock {\n" \
+                           "    highp mat4 u_model_mat;\n" \
+                           "    highp vec3 u_camera_eye_local;\n" \
+                           "    highp float u_pixel_angle; // Radians per pixel of the target\n" \
+                           "    highp int u_view_id; // Eye, on ViewBlock\n" \
+                           "};\n"
+
 namespace RawShaders {
 
     /// Basic sahders
@@ -14,17 +37,13 @@ out vec3 v_world_position;
 out vec3 v_local_position;
 out vec2 v_screen_position;
 
-uniform mat4 u_vp_mat;
-uniform mat4 u_model_mat;
-uniform mat4 u_view_mat;
-uniform mat4 u_proj_mat;
-
+)" VIEW_UNIFORM_BLOCK DRAW_UNIFORM_BLOCK R"(
 void main() {
     vec4 world_pos = u_model_mat * vec4(a_pos, 1.0);
     v_world_position = world_pos.xyz;
     v_local_position = a_pos;
     v_uv = a_uv;
-    gl_Position = u_vp_mat * world_pos;
+    gl_Position = u_vp_mats[u_view_id] * world_pos;
     v_screen_position = ((gl_Position.xy / gl_Position.w) + 1.0) / 2.0;
 }
 )";
@@ -53,7 +72,7 @@ in vec2 v_screen_position;
 
 out vec4 o_frag_color;
 
-uniform vec3 u_camera_eye_local;
+)" DRAW_UNIFORM_BLOCK R"(
 uniform highp sampler3D u_volume_map;
 uniform highp sampler2D u_frame_color_attachment;
 
@@ -81,7 +100,7 @@ vec4 render_volume() {
          break;
       }
 
-      float depth = texture(u_volume_map, sample_pos).r;
+      float depth = textureLod(u_volume_map, sample_pos, 0.0).r;
       // Increase luminosity, only on the colors
       vec4 sample_color = vec4(04.6 * depth);
       sample_color.a = depth;
@@ -108,7 +127,7 @@ in vec3 v_world_position;
 in vec3 v_local_position;
 in vec2 v_screen_position;
 out vec4 o_frag_color;
-uniform vec3 u_camera_eye_local;
+)" DRAW_UNIFORM_BLOCK R"(
 uniform highp sampler3D u_volume_map;
 const int MAX_ITERATIONS = 200;
 const float STEP_SIZE = 0.005;
@@ -129,7 +148,7 @@ vec4 render_volume() {
         if (it_pos.x > 1.0 || it_pos.y > 1.0 || it_pos.z > 1.0) {
             break;
         }
-        float depth = texture(u_volume_map, it_pos).r;
+        float depth = textureLod(u_volume_map, it_pos, 0.0).r;
         if (0.15 <= depth) {
             return vec4(it_pos, 1.0);
         }
@@ -161,11 +180,12 @@ in vec3 v_local_position;
 in vec2 v_screen_position;
 out vec4 o_frag_color;
 
-uniform float u_time;
-uniform vec3 u_camera_eye_local;
+)" FRAME_UNIFORM_BLOCK DRAW_UNIFORM_BLOCK R"(
 uniform highp sampler3D u_volume_map;
 uniform highp sampler2D u_albedo_map; // Noise texture
 uniform highp float u_density_threshold;
+uniform highp sampler3D u_minmax_grid_map; // RG8: min, max density per cell
+uniform bool u_use_minmax_grid;
 
 const int MAX_ITERATIONS = 350;
 const float STEP_SIZE = 0.007; // 0.004 ideal for quality
@@ -177,13 +197,31 @@ const vec3 DELTA_Y = vec3(0.0, DELTA, 0.0);
 const vec3 DELTA_Z = vec3(0.0, 0.0, DELTA);
 
 vec3 gradient(in vec3 pos) {
-    float x = texture(u_volume_map, pos + DELTA_X).r - texture(u_volume_map, pos - DELTA_X).r;
-    float y = texture(u_volume_map, pos + DELTA_Y).r - texture(u_volume_map, pos - DELTA_Y).r;
-    float z = texture(u_volume_map, pos + DELTA_Z).r - texture(u_volume_map, pos - DELTA_Z).r;
+    float x = textureLod(u_volume_map, pos + DELTA_X, 0.0).r - textureLod(u_volume_map, pos - DELTA_X, 0.0).r;
+    float y = textureLod(u_volume_map, pos + DELTA_Y, 0.0).r - textureLod(u_volume_map, pos - DELTA_Y, 0.0).r;
+    float z = textureLod(u_volume_map, pos + DELTA_Z, 0.0).r - textureLod(u_volume_map, pos - DELTA_Z, 0.0).r;
 
     return normalize(vec3(x, y, z) / vec3(DELTA * 2.0));
 }
 
+const float GRID_CELL_SIZE = 8.0; // MINMAX_GRID_CELL_SIZE
+
+// Cell of the min/max grid that bounds the trilinear samples around pos
+ivec3 get_grid_cell(in vec3 pos, in vec3 volume_size) {
+    vec3 voxel_pos = pos * volume_size - 0.5;
+    ivec3 cell = ivec3(floor(voxel_pos / GRID_CELL_SIZE));
+    return clamp(cell, ivec3(0), textureSize(u_minmax_grid_map, 0) - 1);
+}
+
+// Distance along the ray until it leaves the cell
+float get_cell_exit_distance(in vec3 pos, in vec3 ray_dir, in ivec3 cell, in vec3 volume_size) {
+    vec3 cell_min = (vec3(cell) * GRID_CELL_SIZE + 0.5) / volume_size;
+    vec3 cell_max = cell_min + (GRID_CELL_SIZE / volume_size);
+    vec3 exit_planes = mix(cell_min, cell_max, step(0.0, ray_dir));
+    vec3 exit_dist = abs(exit_planes - pos) / max(abs(ray_dir), vec3(0.00001));
+    return min(exit_dist.x, min(exit_dist.y, exit_dist.z)) + 0.0001;
+}
+
 vec4 render_volume() {
     vec3 ray_dir = normalize(v_local_position - u_camera_eye_local);
     vec3 it_pos = v_local_position;
@@ -191,6 +229,7 @@ vec4 render_volume() {
     vec3 jitter_addition = ray_dir * (texture(u_albedo_map, gl_FragCoord.xy / vec2(NOISE_TEX_WIDTH)).rgb * STEP_SIZE);
     it_pos = it_pos + jitter_addition;
     vec4 final_color = vec4(0.0);
+    vec3 volume_size = vec3(textureSize(u_volume_map, 0));
 
     int i = 0;
     for(; i < MAX_ITERATIONS; i++) {
@@ -204,7 +243,17 @@ vec4 render_volume() {
         if (it_pos.x > 1.0 || it_pos.y > 1.0 || it_pos.z > 1.0) {
             break;
         }
-        float depth = texture(u_volume_map, it_pos).r;
+        if (u_use_minmax_grid) {
+            ivec3 cell = get_grid_cell(it_pos, volume_size);
+            vec2 cell_range = texelFetch(u_minmax_grid_map, cell, 0).rg;
+            if (cell_range.g < u_density_threshold) {
+                // Empty for this threshold: jump over the cell, on whole steps to keep the jitter pattern
+                float cell_exit = get_cell_exit_distance(it_pos, ray_dir, cell, volume_size);
+                it_pos = it_pos + (ceil(cell_exit / STEP_SIZE) * STEP_SIZE * ray_dir);
+                continue;
+            }
+        }
+        float depth = textureLod(u_volume_map, it_pos, 0.0).r;
         if (u_density_threshold <= depth) {
             return vec4(it_pos - jitter_addition,1.0);
             return vec4(gradient(it_pos - jitter_addition), 1.0);
@@ -220,6 +269,557 @@ void main() {
    //o_frag_color = vec4(v_local_position / 2.0 + 0.5, 1.0);
    //o_frag_color = texture(u_frame_color_attachment, v_screen_position);
 }
+)";
+
+const char distance_field_shader[] = R"(#version 300 es
+precision highp float;
+in vec2 v_uv;
+in vec3 v_world_position;
+in vec3 v_local_position;
+in vec2 v_screen_position;
+out vec4 o_frag_color;
+
+)" FRAME_UNIFORM_BLOCK DRAW_UNIFORM_BLOCK R"(
+uniform highp sampler3D u_volume_map;
+uniform highp sampler2D u_albedo_map; // Noise texture
+uniform highp sampler3D u_distance_field_map; // R8: voxels to the closest one over the threshold
+uniform bool u_use_distance_field;
+uniform highp float u_density_threshold;
+
+const int MAX_ITERATIONS = 350;
+const float STEP_SIZE = 0.007; // 0.004 ideal for quality
+const int NOISE_TEX_WIDTH = 100;
+// In voxels: the diagonal of the nearest sample, plus the trilinear footprint
+const float DISTANCE_MARGIN = 3.0;
+
+vec4 render_volume() {
+    vec3 ray_dir = normalize(v_local_position - u_camera_eye_local);
+    vec3 it_pos = v_local_position;
+    // Add jitter
+    vec3 jitter_addition = ray_dir * (texture(u_albedo_map, gl_FragCoord.xy / vec2(NOISE_TEX_WIDTH)).rgb * STEP_SIZE);
+    it_pos = it_pos + jitter_addition;
+
+    // Voxels crossed per unit along the ray
+    float voxels_per_unit = length(ray_dir * vec3(textureSize(u_volume_map, 0)));
+
+    int i = 0;
+    for(; i < MAX_ITERATIONS; i++) {
+        // Avoid going outside the texture
+        if (it_pos.x < 0.0 || it_pos.y < 0.0 || it_pos.z < 0.0) {
+            break;
+        }
+        if (it_pos.x > 1.0 || it_pos.y > 1.0 || it_pos.z > 1.0) {
+            break;
+        }
+        // Sphere tracing: nothing can be hit closer than the stored distance
+        if (u_use_distance_field) {
+            float safe_distance = textureLod(u_distance_field_map, it_pos, 0.0).r * 255.0 - DISTANCE_MARGIN;
+            if (safe_distance > 0.0) {
+                it_pos = it_pos + ((safe_distance / voxels_per_unit) * ray_dir);
+                continue;
+            }
+        }
+        float depth = textureLod(u_volume_map, it_pos, 0.0).r;
+        if (u_density_threshold <= depth) {
+            return vec4(it_pos - jitter_addition, 1.0);
+        }
+
+        it_pos = it_pos + (STEP_SIZE * ray_dir);
+    }
+    //return vec4(vec3(float(i) / float(MAX_ITERATIONS)), 1.0);
+    return vec4(vec3(0.0), 1.0);
+}
+void main() {
+   o_frag_color = render_volume();
+}
+)";
+
+const char compressed_isosurface_shader[] = R"(#version 300 es
+precision highp float;
+in vec2 v_uv;
+in vec3 v_world_position;
+in vec3 v_local_position;
+in vec2 v_screen_position;
+out vec4 o_frag_color;
+
+)" FRAME_UNIFORM_BLOCK DRAW_UNIFORM_BLOCK R"(
+uniform highp sampler2DArray u_volume_map; // EAC R11, a layer per z slice
+uniform highp sampler2D u_albedo_map; // Noise texture
+uniform highp float u_density_threshold;
+uniform highp sampler3D u_minmax_grid_map; // RG8: min, max density per cell
+uniform bool u_use_minmax_grid;
+
+const int MAX_ITERATIONS = 350;
+const float STEP_SIZE = 0.007; // 0.004 ideal for quality
+const int NOISE_TEX_WIDTH = 100;
+
+const float DELTA = 0.003;
+const vec3 DELTA_X = vec3(DELTA, 0.0, 0.0);
+const vec3 DELTA_Y = vec3(0.0, DELTA, 0.0);
+const vec3 DELTA_Z = vec3(0.0, 0.0, DELTA);
+
+// The hardware filters each slice on xy; the z is interpolated by hand,
+// between the two closest slices
+float sample_volume(in vec3 pos, in float depth) {
+    float slice = clamp(pos.z * depth - 0.5, 0.0, depth - 1.0);
+    float slice_below = floor(slice);
+    float slice_above = min(slice_below + 1.0, depth - 1.0);
+    float below = textureLod(u_volume_map, vec3(pos.xy, slice_below), 0.0).r;
+    float above = textureLod(u_volume_map, vec3(pos.xy, slice_above), 0.0).r;
+    return mix(below, above, slice - slice_below);
+}
+
+vec3 gradient(in vec3 pos, in float depth) {
+    float x = sample_volume(pos + DELTA_X, depth) - sample_volume(pos - DELTA_X, depth);
+    float y = sample_volume(pos + DELTA_Y, depth) - sample_volume(pos - DELTA_Y, depth);
+    float z = sample_volume(pos + DELTA_Z, depth) - sample_volume(pos - DELTA_Z, depth);
+
+    return normalize(vec3(x, y, z) / vec3(DELTA * 2.0));
+}
+
+const float GRID_CELL_SIZE = 8.0; // MINMAX_GRID_CELL_SIZE
+
+// Cell of the min/max grid that bounds the trilinear samples around pos
+ivec3 get_grid_cell(in vec3 pos, in vec3 volume_size) {
+    vec3 voxel_pos = pos * volume_size - 0.5;
+    ivec3 cell = ivec3(floor(voxel_pos / GRID_CELL_SIZE));
+    return clamp(cell, ivec3(0), textureSize(u_minmax_grid_map, 0) - 1);
+}
+
+// Distance along the ray until it leaves the cell
+float get_cell_exit_distance(in vec3 pos, in vec3 ray_dir, in ivec3 cell, in vec3 volume_size) {
+    vec3 cell_min = (vec3(cell) * GRID_CELL_SIZE + 0.5) / volume_size;
+    vec3 cell_max = cell_min + (GRID_CELL_SIZE / volume_size);
+    vec3 exit_planes = mix(cell_min, cell_max, step(0.0, ray_dir));
+    vec3 exit_dist = abs(exit_planes - pos) / max(abs(ray_dir), vec3(0.00001));
+    return min(exit_dist.x, min(exit_dist.y, exit_dist.z)) + 0.0001;
+}
+
+vec4 render_volume() {
+    vec3 ray_dir = normalize(v_local_position - u_camera_eye_local);
+    vec3 it_pos = v_local_position;
+    // Add jitter
+    vec3 jitter_addition = ray_dir * (texture(u_albedo_map, gl_FragCoord.xy / vec2(NOISE_TEX_WIDTH)).rgb * STEP_SIZE);
+    it_pos = it_pos + jitter_addition;
+    vec4 final_color = vec4(0.0);
+    // Width, height & the slice count
+    vec3 volume_size = vec3(textureSize(u_volume_map, 0));
+
+    int i = 0;
+    for(; i < MAX_ITERATIONS; i++) {
+        // Avoid going outside the texture
+        if (it_pos.x < 0.0 || it_pos.y < 0.0 || it_pos.z < 0.0) {
+            break;
+        }
+        if (it_pos.x > 1.0 || it_pos.y > 1.0 || it_pos.z > 1.0) {
+            break;
+        }
+        if (u_use_minmax_grid) {
+            ivec3 cell = get_grid_cell(it_pos, volume_size);
+            vec2 cell_range = texelFetch(u_minmax_grid_map, cell, 0).rg;
+            if (cell_range.g < u_density_threshold) {
+                // Empty for this threshold: jump over the cell, on whole steps to keep the jitter pattern
+                float cell_exit = get_cell_exit_distance(it_pos, ray_dir, cell, volume_size);
+                it_pos = it_pos + (ceil(cell_exit / STEP_SIZE) * STEP_SIZE * ray_dir);
+                continue;
+            }
+        }
+        float depth = sample_volume(it_pos, volume_size.z);
+        if (u_density_threshold <= depth) {
+            return vec4(gradient(it_pos - jitter_addition, volume_size.z) * 0.5 + 0.5, 1.0);
+        }
+
+        it_pos = it_pos + (STEP_SIZE * ray_dir);
+    }
+    return vec4(vec3(0.0), 1.0);
+}
+void main() {
+   o_frag_color = render_volume();
+}
+)";
+
+const char quantized_isosurface_shader[] = R"(#version 300 es
+precision highp float;
+in vec2 v_uv;
+in vec3 v_world_position;
+in vec3 v_local_position;
+in vec2 v_screen_position;
+out vec4 o_frag_color;
+
+)" FRAME_UNIFORM_BLOCK DRAW_UNIFORM_BLOCK R"(
+uniform highp sampler3D u_volume_map; // R8, each brick on its own range
+uniform highp sampler2D u_albedo_map; // Noise texture
+uniform highp float u_density_threshold;
+uniform highp sampler3D u_minmax_grid_map; // RG8: min, max density per cell, on the window
+uniform bool u_use_minmax_grid;
+uniform highp sampler3D u_brick_range_map; // RG32F: scale, offset per brick
+uniform float u_brick_size;
+
+const int MAX_ITERATIONS = 350;
+const float STEP_SIZE = 0.007; // 0.004 ideal for quality
+const int NOISE_TEX_WIDTH = 100;
+
+const float DELTA = 0.003;
+const vec3 DELTA_X = vec3(DELTA, 0.0, 0.0);
+const vec3 DELTA_Y = vec3(0.0, DELTA, 0.0);
+const vec3 DELTA_Z = vec3(0.0, 0.0, DELTA);
+
+float dequantize_voxel(in ivec3 voxel, in ivec3 last_brick) {
+    vec2 brick_range = texelFetch(u_brick_range_map, min(voxel / int(u_brick_size), last_brick), 0).rg;
+    return brick_range.g + texelFetch(u_volume_map, voxel, 0).r * brick_range.r;
+}
+
+// Back to the window: the codes of two bricks are on different ranges, so
+// across a brick face each voxel is dequantized before the trilinear, by
+// hand; inside of a brick, with its range & the filtering of the sampler
+float sample_volume(in vec3 pos, in vec3 volume_size) {
+    ivec3 last_voxel = ivec3(volume_size) - 1;
+    ivec3 last_brick = textureSize(u_brick_range_map, 0) - 1;
+    vec3 voxel_pos = clamp(pos, 0.0, 1.0) * volume_size - 0.5;
+    ivec3 voxel_min = clamp(ivec3(floor(voxel_pos)), ivec3(0), last_voxel);
+    ivec3 voxel_max = min(voxel_min + 1, last_voxel);
+    ivec3 brick_min = min(voxel_min / int(u_brick_size), last_brick);
+    ivec3 brick_max = min(voxel_max / int(u_brick_size), last_brick);
+
+    if (brick_min == brick_max) {
+        vec2 brick_range = texelFetch(u_brick_range_map, brick_min, 0).rg;
+        return brick_range.g + textureLod(u_volume_map, pos, 0.0).r * brick_range.r;
+    }
+
+    vec3 t = clamp(voxel_pos - vec3(voxel_min), 0.0, 1.0);
+    float x00 = mix(dequantize_voxel(voxel_min, last_brick), dequantize_voxel(ivec3(voxel_max.x, voxel_min.y, voxel_min.z), last_brick), t.x);
+    float x10 = mix(dequantize_voxel(ivec3(voxel_min.x, voxel_max.y, voxel_min.z), last_brick), dequantize_voxel(ivec3(voxel_max.x, voxel_max.y, voxel_min.z), last_brick), t.x);
+    float x01 = mix(dequantize_voxel(ivec3(voxel_min.x, voxel_min.y, voxel_max.z), last_brick), dequantize_voxel(ivec3(voxel_max.x, voxel_min.y, voxel_max.z), last_brick), t.x);
+    float x11 = mix(dequantize_voxel(ivec3(voxel_min.x, voxel_max.y, voxel_max.z), last_brick), dequantize_voxel(voxel_max, last_brick), t.x);
+    return mix(mix(x00, x10, t.y), mix(x01, x11, t.y), t.z);
+}
+
+vec3 gradient(in vec3 pos, in vec3 volume_size) {
+    float x = sample_volume(pos + DELTA_X, volume_size) - sample_volume(pos - DELTA_X, volume_size);
+    float y = sample_volume(pos + DELTA_Y, volume_size) - sample_volume(pos - DELTA_Y, volume_size);
+    float z = sample_volume(pos + DELTA_Z, volume_size) - sample_volume(pos - DELTA_Z, volume_size);
+
+    return normalize(vec3(x, y, z) / vec3(DELTA * 2.0));
+}
+
+const float GRID_CELL_SIZE = 8.0; // MINMAX_GRID_CELL_SIZE
+
+// Cell of the min/max grid that bounds the trilinear samples around pos
+ivec3 get_grid_cell(in vec3 pos, in vec3 volume_size) {
+    vec3 voxel_pos = pos * volume_size - 0.5;
+    ivec3 cell = ivec3(floor(voxel_pos / GRID_CELL_SIZE));
+    return clamp(cell, ivec3(0), textureSize(u_minmax_grid_map, 0) - 1);
+}
+
+// Distance along the ray until it leaves the cell
+float get_cell_exit_distance(in vec3 pos, in vec3 ray_dir, in ivec3 cell, in vec3 volume_size) {
+    vec3 cell_min = (vec3(cell) * GRID_CELL_SIZE + 0.5) / volume_size;
+    vec3 cell_max = cell_min + (GRID_CELL_SIZE / volume_size);
+    vec3 exit_planes = mix(cell_min, cell_max, step(0.0, ray_dir));
+    vec3 exit_dist = abs(exit_planes - pos) / max(abs(ray_dir), vec3(0.00001));
+    return min(exit_dist.x, min(exit_dist.y, exit_dist.z)) + 0.0001;
+}
+
+vec4 render_volume() {
+    vec3 ray_dir = normalize(v_local_position - u_camera_eye_local);
+    vec3 it_pos = v_local_position;
+    // Add jitter
+    vec3 jitter_addition = ray_dir * (texture(u_albedo_map, gl_FragCoord.xy / vec2(NOISE_TEX_WIDTH)).rgb * STEP_SIZE);
+    it_pos = it_pos + jitter_addition;
+    vec3 volume_size = vec3(textureSize(u_volume_map, 0));
+
+    int i = 0;
+    for(; i < MAX_ITERATIONS; i++) {
+        // Avoid going outside the texture
+        if (it_pos.x < 0.0 || it_pos.y < 0.0 || it_pos.z < 0.0) {
+            break;
+        }
+        if (it_pos.x > 1.0 || it_pos.y > 1.0 || it_pos.z > 1.0) {
+            break;
+        }
+        if (u_use_minmax_grid) {
+            ivec3 cell = get_grid_cell(it_pos, volume_size);
+            vec2 cell_range = texelFetch(u_minmax_grid_map, cell, 0).rg;
+            if (cell_range.g < u_density_threshold) {
+                // Empty for this threshold: jump over the cell, on whole steps to keep the jitter pattern
+                float cell_exit = get_cell_exit_distance(it_pos, ray_dir, cell, volume_size);
+                it_pos = it_pos + (ceil(cell_exit / STEP_SIZE) * STEP_SIZE * ray_dir);
+                continue;
+            }
+        }
+        float depth = sample_volume(it_pos, volume_size);
+        if (u_density_threshold <= depth) {
+            return vec4(gradient(it_pos - jitter_addition, volume_size) * 0.5 + 0.5, 1.0);
+        }
+
+        it_pos = it_pos + (STEP_SIZE * ray_dir);
+    }
+    return vec4(vec3(0.0), 1.0);
+}
+void main() {
+   o_frag_color = render_volume();
+}
+)";
+
+const char sparse_isosurface_shader[] = R"(#version 300 es
+precision highp float;
+in vec2 v_uv;
+in vec3 v_world_position;
+in vec3 v_local_position;
+in vec2 v_screen_position;
+out vec4 o_frag_color;
+
+)" FRAME_UNIFORM_BLOCK DRAW_UNIFORM_BLOCK R"(
+uniform highp sampler3D u_volume_map; // Brick atlas
+uniform highp sampler3D u_page_table_map; // RGBA8: atlas slot on xyz, a = resident
+uniform highp sampler2D u_albedo_map; // Noise texture
+uniform highp float u_density_threshold;
+uniform vec3 u_volume_size; // Voxels of the whole volume
+
+const int MAX_ITERATIONS = 350;
+const float STEP_SIZE = 0.007; // 0.004 ideal for quality
+const int NOISE_TEX_WIDTH = 100;
+const float BRICK_SIZE = 16.0; // BRICK_ATLAS_BRICK_SIZE
+const float SLOT_SIZE = BRICK_SIZE + 2.0; // With the border
+
+// Same as a trilinear sample of the dense volume; empty_brick is set when the brick is not resident
+float sample_sparse_volume(in vec3 pos, out bool empty_brick, out vec3 brick_min, out vec3 brick_max) {
+    vec3 voxel_pos = pos * u_volume_size;
+    vec3 brick = clamp(floor(voxel_pos / BRICK_SIZE), vec3(0.0), vec3(textureSize(u_page_table_map, 0) - 1));
+    brick_min = (brick * BRICK_SIZE) / u_volume_size;
+    brick_max = ((brick + 1.0) * BRICK_SIZE) / u_volume_size;
+
+    vec4 page = texelFetch(u_page_table_map, ivec3(brick), 0);
+    empty_brick = page.a < 0.5;
+    if (empty_brick) {
+        return 0.0;
+    }
+
+    vec3 atlas_pos = (page.xyz * 255.0) * SLOT_SIZE + 1.0 + (voxel_pos - brick * BRICK_SIZE);
+    return textureLod(u_volume_map, atlas_pos / vec3(textureSize(u_volume_map, 0)), 0.0).r;
+}
+
+vec4 render_volume() {
+    vec3 ray_dir = normalize(v_local_position - u_camera_eye_local);
+    vec3 it_pos = v_local_position;
+    // Add jitter
+    vec3 jitter_addition = ray_dir * (texture(u_albedo_map, gl_FragCoord.xy / vec2(NOISE_TEX_WIDTH)).rgb * STEP_SIZE);
+    it_pos = it_pos + jitter_addition;
+
+    int i = 0;
+    for(; i < MAX_ITERATIONS; i++) {
+        // Avoid going outside the texture
+        if (it_pos.x < 0.0 || it_pos.y < 0.0 || it_pos.z < 0.0) {
+            break;
+        }
+        if (it_pos.x > 1.0 || it_pos.y > 1.0 || it_pos.z > 1.0) {
+            break;
+        }
+
+        bool empty_brick;
+        vec3 brick_min, brick_max;
+        float depth = sample_sparse_volume(it_pos, empty_brick, brick_min, brick_max);
+        if (empty_brick) {
+            // Jump over the brick, on whole steps to keep the jitter pattern
+            vec3 exit_planes = mix(brick_min, brick_max, step(0.0, ray_dir));
+            vec3 exit_dist = abs(exit_planes - it_pos) / max(abs(ray_dir), vec3(0.00001));
+            float brick_exit = min(exit_dist.x, min(exit_dist.y, exit_dist.z));
+            it_pos = it_pos + (max(ceil(brick_exit / STEP_SIZE), 1.0) * STEP_SIZE * ray_dir);
+            continue;
+        }
+        if (u_density_threshold <= depth) {
+            return vec4(it_pos - jitter_addition, 1.0);
+        }
+
+        it_pos = it_pos + (STEP_SIZE * ray_dir);
+    }
+    return vec4(vec3(0.0), 1.0);
+}
+void main() {
+   o_frag_color = render_volume();
+}
+)";
+
+const char streamed_isosurface_shader[] = R"(#version 300 es
+precision highp float;
+in vec2 v_uv;
+in vec3 v_world_position;
+in vec3 v_local_position;
+in vec2 v_screen_position;
+out vec4 o_frag_color;
+
+)" FRAME_UNIFORM_BLOCK DRAW_UNIFORM_BLOCK R"(
+uniform highp sampler3D u_volume_map; // Brick cache
+uniform highp sampler3D u_page_table_map; // RGBA8, per level 0 brick: cache slot on xyz, a = level + 1
+uniform highp sampler2D u_albedo_map; // Noise texture
+uniform highp float u_density_threshold;
+uniform vec3 u_volume_size; // Voxels of level 0
+uniform vec3 u_lod_sizes[8]; // Voxels of each level of detail, RESIDENCY_MAX_LODS
+uniform float u_brick_size;
+
+const int MAX_ITERATIONS = 350;
+const float STEP_SIZE = 0.007; // 0.004 ideal for quality
+const int NOISE_TEX_WIDTH = 100;
+const int EMPTY_PAGE_LEVEL = 254; // RESIDENCY_EMPTY_PAGE - 1
+
+// Samples the finest level that is resident there; empty_brick is set when there is none
+float sample_streamed_volume(in vec3 pos, out bool empty_brick, out vec3 brick_min, out vec3 brick_max) {
+    vec3 voxel_pos = pos * u_volume_size;
+    vec3 page = clamp(floor(voxel_pos / u_brick_size), vec3(0.0), vec3(textureSize(u_page_table_map, 0) - 1));
+    brick_min = (page * u_brick_size) / u_volume_size;
+    brick_max = ((page + 1.0) * u_brick_size) / u_volume_size;
+
+    vec4 entry = texelFetch(u_page_table_map, ivec3(page), 0);
+    int level = int(entry.a * 255.0 + 0.5) - 1;
+    empty_brick = level < 0 || level == EMPTY_PAGE_LEVEL;
+    if (empty_brick) {
+        return 0.0;
+    }
+
+    // Brick of the level that covers the page, and the position inside it; the
+    // border of the slot covers the half voxels that the reduction rounds off
+    vec3 lod_size = u_lod_sizes[level];
+    vec3 brick = min(floor(page / exp2(float(level))), ceil(lod_size / u_brick_size) - 1.0);
+    vec3 local_pos = clamp(pos * lod_size - brick * u_brick_size, vec3(-0.5), vec3(u_brick_size + 0.5));
+
+    vec3 atlas_pos = (entry.xyz * 255.0) * (u_brick_size + 2.0) + 1.0 + local_pos;
+    return textureLod(u_volume_map, atlas_pos / vec3(textureSize(u_volume_map, 0)), 0.0).r;
+}
+
+vec4 render_volume() {
+    vec3 ray_dir = normalize(v_local_position - u_camera_eye_local);
+    vec3 it_pos = v_local_position;
+    // Add jitter
+    vec3 jitter_addition = ray_dir * (texture(u_albedo_map, gl_FragCoord.xy / vec2(NOISE_TEX_WIDTH)).rgb * STEP_SIZE);
+    it_pos = it_pos + jitter_addition;
+
+    int i = 0;
+    for(; i < MAX_ITERATIONS; i++) {
+        // Avoid going outside the texture
+        if (it_pos.x < 0.0 || it_pos.y < 0.0 || it_pos.z < 0.0) {
+            break;
+        }
+        if (it_pos.x > 1.0 || it_pos.y > 1.0 || it_pos.z > 1.0) {
+            break;
+        }
+
+        bool empty_brick;
+        vec3 brick_min, brick_max;
+        float depth = sample_streamed_volume(it_pos, empty_brick, brick_min, brick_max);
+        if (empty_brick) {
+            // Jump over the brick, on whole steps to keep the jitter pattern
+            vec3 exit_planes = mix(brick_min, brick_max, step(0.0, ray_dir));
+            vec3 exit_dist = abs(exit_planes - it_pos) / max(abs(ray_dir), vec3(0.00001));
+            float brick_exit = min(exit_dist.x, min(exit_dist.y, exit_dist.z));
+            it_pos = it_pos + (max(ceil(brick_exit / STEP_SIZE), 1.0) * STEP_SIZE * ray_dir);
+            continue;
+        }
+        if (u_density_threshold <= depth) {
+            return vec4(it_pos - jitter_addition, 1.0);
+        }
+
+        it_pos = it_pos + (STEP_SIZE * ray_dir);
+    }
+    return vec4(vec3(0.0), 1.0);
+}
+void main() {
+   o_frag_color = render_volume();
+}
+)";
+
+// Low resolution pass for the streamed volumes: instead of a color, each pixel
+// writes the first brick where its ray needed a finer level than the resident
+// one (or the brick it hit), as level 0 brick on rgb & level + 1 on a, / 255
+const char streamed_feedback_shader[] = R"(#version 300 es
+precision highp float;
+in vec2 v_uv;
+in vec3 v_world_position;
+in vec3 v_local_position;
+in vec2 v_screen_position;
+out vec4 o_frag_color;
+
+)" DRAW_UNIFORM_BLOCK R"(
+uniform highp sampler3D u_volume_map; // Brick cache
+uniform highp sampler3D u_page_table_map; // RGBA8, per level 0 brick: cache slot on xyz, a = level + 1
+uniform highp sampler2D u_albedo_map; // Noise texture
+uniform highp float u_density_threshold;
+uniform vec3 u_volume_size; // Voxels of level 0
+uniform vec3 u_lod_sizes[8]; // Voxels of each level of detail, RESIDENCY_MAX_LODS
+uniform int u_lod_count;
+uniform float u_lod_bias;
+uniform float u_brick_size;
+
+const int MAX_ITERATIONS = 350;
+const float STEP_SIZE = 0.007; // Same as streamed_isosurface_shader
+const int NOISE_TEX_WIDTH = 100;
+const int EMPTY_PAGE_LEVEL = 254; // RESIDENCY_EMPTY_PAGE - 1
+
+float sample_level(in vec3 pos, in vec3 page, in vec4 entry, in int level) {
+    vec3 lod_size = u_lod_sizes[level];
+    vec3 brick = min(floor(page / exp2(float(level))), ceil(lod_size / u_brick_size) - 1.0);
+    vec3 local_pos = clamp(pos * lod_size - brick * u_brick_size, vec3(-0.5), vec3(u_brick_size + 0.5));
+
+    vec3 atlas_pos = (entry.xyz * 255.0) * (u_brick_size + 2.0) + 1.0 + local_pos;
+    return textureLod(u_volume_map, atlas_pos / vec3(textureSize(u_volume_map, 0)), 0.0).r;
+}
+
+vec4 render_feedback() {
+    vec3 ray_dir = normalize(v_local_position - u_camera_eye_local);
+    vec3 it_pos = v_local_position;
+    // Add jitter
+    vec3 jitter_addition = ray_dir * (texture(u_albedo_map, gl_FragCoord.xy / vec2(NOISE_TEX_WIDTH)).rgb * STEP_SIZE);
+    it_pos = it_pos + jitter_addition;
+
+    float max_size = max(u_volume_size.x, max(u_volume_size.y, u_volume_size.z));
+    vec4 request = vec4(0.0);
+    bool has_request = false;
+
+    for(int i = 0; i < MAX_ITERATIONS; i++) {
+        // Avoid going outside the texture
+        if (it_pos.x < 0.0 || it_pos.y < 0.0 || it_pos.z < 0.0) {
+            break;
+        }
+        if (it_pos.x > 1.0 || it_pos.y > 1.0 || it_pos.z > 1.0) {
+            break;
+        }
+
+        vec3 page = clamp(floor((it_pos * u_volume_size) / u_brick_size), vec3(0.0), vec3(textureSize(u_page_table_map, 0) - 1));
+        vec4 entry = texelFetch(u_page_table_map, ivec3(page), 0);
+        int level = int(entry.a * 255.0 + 0.5) - 1;
+
+        if (level != EMPTY_PAGE_LEVEL) {
+            // Level whose voxels are about the size of a pixel here
+            float pixel_voxels = distance(it_pos, u_camera_eye_local) * u_pixel_angle * max_size;
+            int desired_level = clamp(int(floor(log2(max(pixel_voxels, 1.0)) + u_lod_bias)), 0, u_lod_count - 1);
+            if (!has_request && (level < 0 || level > desired_level)) {
+                request = vec4(page, float(desired_level + 1)) / 255.0;
+                has_request = true;
+            }
+
+            // Hit on what is resident, as the final image
+            if (level >= 0 && u_density_threshold <= sample_level(it_pos, page, entry, level)) {
+                return (has_request) ? request : vec4(page, float(level + 1)) / 255.0;
+            }
+        }
+
+        if (level < 0 || level == EMPTY_PAGE_LEVEL) {
+            // Jump over the brick, on whole steps to keep the jitter pattern
+            vec3 brick_min = (page * u_brick_size) / u_volume_size;
+            vec3 brick_max = ((page + 1.0) * u_brick_size) / u_volume_size;
+            vec3 exit_planes = mix(brick_min, brick_max, step(0.0, ray_dir));
+            vec3 exit_dist = abs(exit_planes - it_pos) / max(abs(ray_dir), vec3(0.00001));
+            float brick_exit = min(exit_dist.x, min(exit_dist.y, exit_dist.z));
+            it_pos = it_pos + (max(ceil(brick_exit / STEP_SIZE), 1.0) * STEP_SIZE * ray_dir);
+            continue;
+        }
+
+        it_pos = it_pos + (STEP_SIZE * ray_dir);
+    }
+    return request;
+}
+void main() {
+   o_frag_color = render_feedback();
+}
 )";
 
     const char mar_shader[] = R"(#version 300 es
@@ -231,29 +831,50 @@ in vec2 v_screen_position;
 
 out vec4 o_frag_color;
 
-uniform float u_time;
-uniform vec3 u_camera_eye_local;
+)" FRAME_UNIFORM_BLOCK DRAW_UNIFORM_BLOCK R"(
 uniform highp sampler3D u_volume_map;
 uniform highp sampler2D u_albedo_map; // Noise texture
-//uniform highp float u_density_threshold;
+uniform highp float u_density_threshold;
+uniform highp sampler3D u_minmax_grid_map; // RG8: min, max density per cell
+uniform bool u_use_minmax_grid;
 
 const int MAX_ITERATIONS = 200;
 const int NOISE_TEX_WIDTH = 100;
 const float STEP_SIZE = 0.250; // 0.004 ideal for quality
 const float DELTA = 0.001;
 const float SMALLEST_VOXEL = 0.0078125; // 2.0 / 256
+uniform float u_max_mip_level; // Coarsest level of u_volume_map, ES 3.00 has no textureQueryLevels
+const float TEXEL_EXIT_EPSILON = 0.0001;
 
 const vec3 DELTA_X = vec3(DELTA, 0.0, 0.0);
 const vec3 DELTA_Y = vec3(0.0, DELTA, 0.0);
 const vec3 DELTA_Z = vec3(0.0, 0.0, DELTA);
 
 vec3 gradient(in vec3 pos) {
-    float x = texture(u_volume_map, pos + DELTA_X).r - texture(u_volume_map, pos - DELTA_X).r;
-    float y = texture(u_volume_map, pos + DELTA_Y).r - texture(u_volume_map, pos - DELTA_Y).r;
-    float z = texture(u_volume_map, pos + DELTA_Z).r - texture(u_volume_map, pos - DELTA_Z).r;
+    float x = textureLod(u_volume_map, pos + DELTA_X, 0.0).r - textureLod(u_volume_map, pos - DELTA_X, 0.0).r;
+    float y = textureLod(u_volume_map, pos + DELTA_Y, 0.0).r - textureLod(u_volume_map, pos - DELTA_Y, 0.0).r;
+    float z = textureLod(u_volume_map, pos + DELTA_Z, 0.0).r - textureLod(u_volume_map, pos - DELTA_Z, 0.0).r;
     return normalize(vec3(x, y, z) / vec3(DELTA * 2.0));
 }
 
+const float GRID_CELL_SIZE = 8.0; // MINMAX_GRID_CELL_SIZE
+
+// Cell of the min/max grid that bounds the trilinear samples around pos
+ivec3 get_grid_cell(in vec3 pos, in vec3 volume_size) {
+    vec3 voxel_pos = pos * volume_size - 0.5;
+    ivec3 cell = ivec3(floor(voxel_pos / GRID_CELL_SIZE));
+    return clamp(cell, ivec3(0), textureSize(u_minmax_grid_map, 0) - 1);
+}
+
+// Distance along the ray until it leaves the cell
+float get_cell_exit_distance(in vec3 pos, in vec3 ray_dir, in ivec3 cell, in vec3 volume_size) {
+    vec3 cell_min = (vec3(cell) * GRID_CELL_SIZE + 0.5) / volume_size;
+    vec3 cell_max = cell_min + (GRID_CELL_SIZE / volume_size);
+    vec3 exit_planes = mix(cell_min, cell_max, step(0.0, ray_dir));
+    vec3 exit_dist = abs(exit_planes - pos) / max(abs(ray_dir), vec3(0.00001));
+    return min(exit_dist.x, min(exit_dist.y, exit_dist.z)) + 0.0001;
+}
+
 float get_int(in float f) {
     return float(int(f));
 }
@@ -262,46 +883,13 @@ float get_level_of_size(in float size) {
     return 1.0 + log2(size);
 }
 
-const float mip_size_LUT[8] = float[8]( // POW(2.0, LEVEL-1)
-    1.0, // 0
-    1.0, // 1
-    2.0, // 2
-    4.0, // 3
-    8.0, // 4
-    16.0, // 5
-    32.0,// 6
-    64.0 // 7
-);
-
-const float mip_size_LUT_half[8] = float[8]( // 1.0 / POW(2.0, LEVEL-1)
-    1.0, // 0
-    1.0 / mip_size_LUT[1], // 1
-    1.0 / mip_size_LUT[2], // 2
-    1.0 / mip_size_LUT[3], // 3
-    1.0 / mip_size_LUT[4], // 4
-    1.0 / mip_size_LUT[5], // 5
-    1.0 / mip_size_LUT[6],// 6
-    1.0 / mip_size_LUT[7] // 7
-);
-
-const float mip_size_LUT_half_step[8] = float[8]( // 1.0 / POW(2.0, LEVEL-1)
-    mip_size_LUT_half[0] * STEP_SIZE, // 0
-    mip_size_LUT_half[1] * STEP_SIZE, // 1
-    mip_size_LUT_half[2] * STEP_SIZE, // 2
-    mip_size_LUT_half[3] * STEP_SIZE, // 3
-    mip_size_LUT_half[4] * STEP_SIZE, // 4
-    mip_size_LUT_half[5] * STEP_SIZE, // 5
-    mip_size_LUT_half[6] * STEP_SIZE,// 6
-    mip_size_LUT_half[7] * STEP_SIZE // 7
-);
-
 float get_size_of_miplevel(in float level) {
-    //return get_int(pow(2.0, level - 1.0));
-    return mip_size_LUT[int(level)];
+    // POW(2.0, LEVEL-1), without LUTs so any level of the mips is valid
+    return exp2(max(level - 1.0, 0.0));
 }
 
 void get_voxel_of_point_in_level(in vec3 point, in float mip_level, out vec3 origin, out vec3 size) {
-    float voxel_proportions = mip_size_LUT_half[int(mip_level)];// The cube is sized 2,2,2 in world coords
+    float voxel_proportions = 1.0 / get_size_of_miplevel(mip_level);// The cube is sized 2,2,2 in world coords
     vec3 voxel_size = vec3(voxel_proportions);
 
     vec3 start_coords = point - mod(point, voxel_proportions);
@@ -323,10 +911,19 @@ bool is_inside_v2(in vec3 box_min, in vec3 box_max, in vec3 position) {
 
 
 float get_distance(in float level) {
-    return mip_size_LUT_half_step[int(level)];
+    return STEP_SIZE / get_size_of_miplevel(level);
     //return pow(2.0, level - 1.0) * SMALLEST_VOXEL * 0.025;
 }
 
+// Distance along the ray until it leaves the texel of the level that contains point
+float get_texel_exit_distance(in vec3 point, in vec3 ray_dir, in float level) {
+    vec3 texel_size = 1.0 / vec3(textureSize(u_volume_map, int(level)));
+    vec3 texel_min = floor(point / texel_size) * texel_size;
+    vec3 exit_planes = texel_min + step(0.0, ray_dir) * texel_size;
+    vec3 exit_dist = abs(exit_planes - point) / max(abs(ray_dir), vec3(0.00001));
+    return min(exit_dist.x, min(exit_dist.y, exit_dist.z)) + TEXEL_EXIT_EPSILON;
+}
+
 vec3 mrm() {
     // Raymarching conf
     vec3 ray_dir = normalize(v_local_position - u_camera_eye_local);
@@ -335,7 +932,8 @@ vec3 mrm() {
     pos += jitter_addition;
 
     // MRM
-    float curr_mipmap_level = 5.0;
+    // The mips are max-filtered, so it is safe to start on the coarsest one
+    float curr_mipmap_level = u_max_mip_level;
     float dist = 0.002; // Distance from start to sampling point
     float prev_dist = 0.0;
     vec3 prev_sample_pos = pos;
@@ -347,6 +945,7 @@ vec3 mrm() {
     vec3 prev_voxel_max = vec3(1.0);
 
     vec3 box_min = vec3(0.0), box_max = vec3(1.0);
+    vec3 volume_size = vec3(textureSize(u_volume_map, 0));
 
     int i = 0;
     for(; i < MAX_ITERATIONS; i++) {
@@ -358,19 +957,31 @@ vec3 mrm() {
         }
 
 
+        if (u_use_minmax_grid) {
+            ivec3 cell = get_grid_cell(sample_pos, volume_size);
+            vec2 cell_range = texelFetch(u_minmax_grid_map, cell, 0).rg;
+            if (cell_range.g < u_density_threshold) { // Empty cell for this threshold
+                dist += get_cell_exit_distance(sample_pos, ray_dir, cell, volume_size);
+                continue;
+            }
+            if (cell_range.r >= u_density_threshold) { // Solid cell, the surface is on its border
+                return sample_pos - jitter_addition;
+            }
+        }
+
         float depth = textureLod(u_volume_map, sample_pos, curr_mipmap_level).r;
-        if (depth > 0.15) { // There is a block
+        if (depth >= u_density_threshold) { // There is a block
             if (curr_mipmap_level == 0.0) {
                 return sample_pos - jitter_addition;
                 //break;
                 //return gradient(sample_pos) * 0.5 + 0.5;
             }
             get_voxel_of_point_in_level(sample_pos, curr_mipmap_level, prev_voxel_min, prev_voxel_max);
+            // Refine on the same point
             curr_mipmap_level = curr_mipmap_level - 1.0;
-            // go back  one step
-            dist = prev_dist;
-        } else { // Ray is unblocked
-            dist += get_distance(curr_mipmap_level);
+        } else { // Ray is unblocked: the whole texel is empty, so jump over it
+            dist += get_texel_exit_distance(sample_pos, ray_dir, curr_mipmap_level);
+            curr_mipmap_level = min(curr_mipmap_level + 1.0, u_max_mip_level);
         }
         prev_dist = dist;
     }
@@ -393,17 +1004,18 @@ in vec2 v_screen_position;
 
 out vec4 o_frag_color;
 
-uniform float u_time;
-uniform vec3 u_camera_eye_local;
+)" FRAME_UNIFORM_BLOCK DRAW_UNIFORM_BLOCK R"(
 uniform highp sampler3D u_volume_map;
 uniform highp sampler2D u_albedo_map; // Noise texture
-//uniform highp float u_density_threshold;
+uniform highp float u_density_threshold;
 
 const int MAX_ITERATIONS = 80;
 const int NOISE_TEX_WIDTH = 100;
 const float STEP_SIZE = 0.80; // 0.004 ideal for quality
 const float DELTA = 0.001;
 const float SMALLEST_VOXEL = 0.0078125; // 2.0 / 256
+uniform float u_max_mip_level; // Coarsest level of u_volume_map, ES 3.00 has no textureQueryLevels
+const float TEXEL_EXIT_EPSILON = 0.0001;
 const float RAY_STEP_SIZE = 0.007;
 
 const vec3 DELTA_X = vec3(DELTA, 0.0, 0.0);
@@ -411,9 +1023,9 @@ const vec3 DELTA_Y = vec3(0.0, DELTA, 0.0);
 const vec3 DELTA_Z = vec3(0.0, 0.0, DELTA);
 
 vec3 gradient(in vec3 pos) {
-    float x = texture(u_volume_map, pos + DELTA_X).r - texture(u_volume_map, pos - DELTA_X).r;
-    float y = texture(u_volume_map, pos + DELTA_Y).r - texture(u_volume_map, pos - DELTA_Y).r;
-    float z = texture(u_volume_map, pos + DELTA_Z).r - texture(u_volume_map, pos - DELTA_Z).r;
+    float x = textureLod(u_volume_map, pos + DELTA_X, 0.0).r - textureLod(u_volume_map, pos - DELTA_X, 0.0).r;
+    float y = textureLod(u_volume_map, pos + DELTA_Y, 0.0).r - textureLod(u_volume_map, pos - DELTA_Y, 0.0).r;
+    float z = textureLod(u_volume_map, pos + DELTA_Z, 0.0).r - textureLod(u_volume_map, pos - DELTA_Z, 0.0).r;
     return normalize(vec3(x, y, z) / vec3(DELTA * 2.0));
 }
 
@@ -425,46 +1037,13 @@ float get_level_of_size(in float size) {
     return 1.0 + log2(size);
 }
 
-const float mip_size_LUT[8] = float[8]( // POW(2.0, LEVEL-1)
-    1.0, // 0
-    1.0, // 1
-    2.0, // 2
-    4.0, // 3
-    8.0, // 4
-    16.0, // 5
-    32.0,// 6
-    64.0 // 7
-);
-
-const float mip_size_LUT_half[8] = float[8]( // 1.0 / POW(2.0, LEVEL-1)
-    1.0, // 0
-    1.0 / mip_size_LUT[1], // 1
-    1.0 / mip_size_LUT[2], // 2
-    1.0 / mip_size_LUT[3], // 3
-    1.0 / mip_size_LUT[4], // 4
-    1.0 / mip_size_LUT[5], // 5
-    1.0 / mip_size_LUT[6],// 6
-    1.0 / mip_size_LUT[7] // 7
-);
-
-const float mip_size_LUT_half_step[8] = float[8]( // 1.0 / POW(2.0, LEVEL-1)
-    mip_size_LUT_half[0] * STEP_SIZE, // 0
-    mip_size_LUT_half[1] * STEP_SIZE, // 1
-    mip_size_LUT_half[2] * STEP_SIZE, // 2
-    mip_size_LUT_half[3] * STEP_SIZE, // 3
-    mip_size_LUT_half[4] * STEP_SIZE, // 4
-    mip_size_LUT_half[5] * STEP_SIZE, // 5
-    mip_size_LUT_half[6] * STEP_SIZE,// 6
-    mip_size_LUT_half[7] * STEP_SIZE // 7
-);
-
 float get_size_of_miplevel(in float level) {
-    //return get_int(pow(2.0, level - 1.0));
-    return mip_size_LUT[int(level)];
+    // POW(2.0, LEVEL-1), without LUTs so any level of the mips is valid
+    return exp2(max(level - 1.0, 0.0));
 }
 
 void get_voxel_of_point_in_level(in vec3 point, in float mip_level, out vec3 origin, out vec3 size) {
-    float voxel_proportions = mip_size_LUT_half[int(mip_level)];// The cube is sized 2,2,2 in world coords
+    float voxel_proportions = 1.0 / get_size_of_miplevel(mip_level);// The cube is sized 2,2,2 in world coords
     vec3 voxel_size = vec3(voxel_proportions);
 
     vec3 start_coords = point - mod(point, voxel_proportions);
@@ -486,10 +1065,19 @@ bool is_inside_v2(in vec3 box_min, in vec3 box_max, in vec3 position) {
 
 
 float get_distance(in float level) {
-    return mip_size_LUT_half_step[int(level)];
+    return STEP_SIZE / get_size_of_miplevel(level);
     //return pow(2.0, level - 1.0) * SMALLEST_VOXEL * 0.025;
 }
 
+// Distance along the ray until it leaves the texel of the level that contains point
+float get_texel_exit_distance(in vec3 point, in vec3 ray_dir, in float level) {
+    vec3 texel_size = 1.0 / vec3(textureSize(u_volume_map, int(level)));
+    vec3 texel_min = floor(point / texel_size) * texel_size;
+    vec3 exit_planes = texel_min + step(0.0, ray_dir) * texel_size;
+    vec3 exit_dist = abs(exit_planes - point) / max(abs(ray_dir), vec3(0.00001));
+    return min(exit_dist.x, min(exit_dist.y, exit_dist.z)) + TEXEL_EXIT_EPSILON;
+}
+
 vec3 mrm() {
     // Raymarching conf
     vec3 ray_dir = normalize(v_local_position - u_camera_eye_local);
@@ -498,7 +1086,8 @@ vec3 mrm() {
     pos += jitter_addition;
 
     // MRM
-    float curr_mipmap_level = 6.0;
+    // The mips are max-filtered, so it is safe to start on the coarsest one
+    float curr_mipmap_level = u_max_mip_level;
     float dist = 0.002; // Distance from start to sampling point
     float prev_dist = 0.0;
     vec3 prev_sample_pos = pos;
@@ -523,12 +1112,14 @@ vec3 mrm() {
 
 
         float depth = textureLod(u_volume_map, sample_pos, curr_mipmap_level).r;
-        if (depth > 0.15) { // There is a block
+        if (depth >= u_density_threshold) { // There is a block
+            if (curr_mipmap_level <= 1.0) {
+                break; // Raymarch the rest
+            }
+            // Refine on the same point
             curr_mipmap_level = curr_mipmap_level - 1.0;
-            // go back  one step
-            dist = ((dist - prev_dist) / 2.0) + prev_dist;
-        } else { // Ray is unblocked
-            dist += get_distance(curr_mipmap_level);
+        } else { // Ray is unblocked: the whole texel is empty, so jump over it
+            dist += get_texel_exit_distance(sample_pos, ray_dir, curr_mipmap_level);
         }
         prev_dist = dist;
     }
@@ -543,8 +1134,8 @@ vec3 mrm() {
             return vec3(0.0);
         }
 
-        float depth = texture(u_volume_map, sample_pos).r;
-        if (depth >= 0.15) {
+        float depth = textureLod(u_volume_map, sample_pos, 0.0).r;
+        if (depth >= u_density_threshold) {
             return sample_pos;
         }
         dist += RAY_STEP_SIZE;
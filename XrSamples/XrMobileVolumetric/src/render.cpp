@@ -2,6 +2,7 @@
 #include "raw_meshes.h"
 #include "texture.h"
 #include <cstdint>
+#include <cstring>
 
 #include <android/log.h>
 
@@ -105,20 +106,60 @@ void Render::sInstance::init(sOpenXRFramebuffer *openxr_framebuffer) {
         framebuffer.openxr_framebufffs = openxr_framebuffer;
     }
 
+    // The swapchain color is presented; the depth is only needed while rendering
+    swapchain_color_resource = render_graph.import_resource("swapchain_color",
+                                                            {openxr_framebuffer[0].width, openxr_framebuffer[0].height, GRAPH_COLOR_TARGET},
+                                                            true);
+    swapchain_depth_resource = render_graph.import_resource("swapchain_depth",
+                                                            {openxr_framebuffer[0].width, openxr_framebuffer[0].height, GRAPH_DEPTH_TARGET},
+                                                            false);
+
 
     // Set default render config
+    gl_state.init();
+    sGLState default_state;
+    default_state.set_default();
+    change_graphic_state(default_state);
 
-    current_state.depth_test_enabled = true;
-    glEnable(GL_DEPTH_TEST);
-    glDepthMask(current_state.write_to_depth_buffer);
-    glDepthFunc(current_state.depth_function);
+    // GPU timings
+    upload_scheduler.init();
+    glGenQueriesEXT_(RENDER_QUERY_COUNT,
+                     render_time_queries);
 
-    current_state.culling_enabled = true;
-    glEnable(GL_CULL_FACE);
-    glCullFace(current_state.culling_mode);
-    glFrontFace(current_state.front_face);
+    for(uint16_t eye = 0; eye < MAX_EYE_NUMBER; eye++) {
+        draw_lists[eye].init(RENDER_PASS_COUNT * DRAW_CALL_STACK_SIZE);
+    }
 
-    current_state.set_default();
+    // Uniform buffers
+    int offset_alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT,
+                  &offset_alignment);
+    offset_alignment = (offset_alignment > 0) ? offset_alignment : 256;
+    draw_uniforms_stride = (uint32_t) (((sizeof(sDrawUniforms) + offset_alignment - 1) / offset_alignment) * offset_alignment);
+    draw_uniforms = (uint8_t*) malloc(DRAW_UNIFORMS_COUNT * draw_uniforms_stride);
+    memset(draw_uniforms,
+           0,
+           DRAW_UNIFORMS_COUNT * draw_uniforms_stride);
+
+    glGenBuffers(1, &frame_ubo);
+    glGenBuffers(1, &view_ubo);
+    glGenBuffers(1, &draw_ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo);
+    glBufferData(GL_UNIFORM_BUFFER,
+                 sizeof(sFrameUniforms),
+                 NULL,
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, view_ubo);
+    glBufferData(GL_UNIFORM_BUFFER,
+                 sizeof(sViewUniforms),
+                 NULL,
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, draw_ubo);
+    glBufferData(GL_UNIFORM_BUFFER,
+                 DRAW_UNIFORMS_COUNT * draw_uniforms_stride,
+                 NULL,
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
     // Init quad mesh
     quad_mesh_id = meshes_count++;
@@ -130,64 +171,22 @@ void Render::sInstance::init(sOpenXRFramebuffer *openxr_framebuffer) {
 
 void Render::sInstance::change_graphic_state(const sGLState &new_state) {
     // Depth
-    if (current_state.depth_test_enabled != new_state.depth_test_enabled) {
-        if (new_state.depth_test_enabled) {
-            glEnable(GL_DEPTH_TEST);
-        } else {
-            glDisable(GL_DEPTH_TEST);
-        }
-       current_state.depth_test_enabled = new_state.depth_test_enabled;
-    }
-
-    if (current_state.write_to_depth_buffer != new_state.write_to_depth_buffer) {
-        glDepthMask(new_state.write_to_depth_buffer);
-        current_state.write_to_depth_buffer = new_state.write_to_depth_buffer;
-    }
-
-    if (current_state.depth_function != new_state.depth_function) {
-        glDepthFunc(new_state.depth_function);
-        current_state.depth_function = new_state.depth_function;
-    }
+    gl_state.set_capability(GL_STATE_DEPTH_TEST,
+                            new_state.depth_test_enabled);
+    gl_state.set_depth_mask(new_state.write_to_depth_buffer);
+    gl_state.set_depth_function(new_state.depth_function);
 
     // Face Culling
-    if (current_state.culling_enabled != new_state.culling_enabled) {
-        if (current_state.culling_enabled) {
-            glEnable(GL_CULL_FACE);
-        } else {
-            glDisable(GL_CULL_FACE);
-        }
-
-        current_state.culling_enabled = new_state.culling_enabled;
-    }
-
-    if (current_state.culling_mode != new_state.culling_mode) {
-        glCullFace(new_state.culling_mode);
-        current_state.culling_mode = new_state.culling_mode;
-    }
-
-    if (current_state.front_face != new_state.front_face) {
-        glFrontFace(new_state.front_face);
-        current_state.front_face = new_state.front_face;
-    }
+    gl_state.set_capability(GL_STATE_CULL_FACE,
+                            new_state.culling_enabled);
+    gl_state.set_cull_face(new_state.culling_mode);
+    gl_state.set_front_face(new_state.front_face);
 
     // Blending
-    if (current_state.blending_enabled != new_state.blending_enabled) {
-        if (new_state.blending_enabled) {
-            glEnable(GL_BLEND);
-        } else {
-            glDisable(GL_BLEND);
-        }
-
-        current_state.blending_enabled = new_state.blending_enabled;
-
-        if (current_state.blend_func_x != new_state.blend_func_x ||
-            current_state.blend_func_y != new_state.blend_func_y) {
-            glBlendFunc(new_state.blend_func_x, new_state.blend_func_y);
-        }
-
-        current_state.blend_func_x = new_state.blend_func_x;
-        current_state.blend_func_y = new_state.blend_func_y;
-    }
+    gl_state.set_capability(GL_STATE_BLEND,
+                            new_state.blending_enabled);
+    gl_state.set_blend_func(new_state.blend_func_x,
+                            new_state.blend_func_y);
 }
 
 double get_time() {
@@ -197,16 +196,167 @@ double get_time() {
 
 }
 
+// For glInvalidateFramebuffer; the ones that the bound framebuffer does not
+// have are ignored
+static uint8_t get_discarded_attachments(const bool discard_color,
+                                         const bool discard_depth,
+                                         uint32_t *attachments) {
+    uint8_t count = 0;
+    if (discard_color) {
+        attachments[count++] = GL_COLOR_ATTACHMENT0;
+        attachments[count++] = GL_COLOR_ATTACHMENT1;
+    }
+    if (discard_depth) {
+        attachments[count++] = GL_DEPTH_ATTACHMENT;
+    }
+    return count;
+}
+
 // https://gitlab.freedesktop.org/monado/demos/xrgears/-/blob/master/src/pipeline_equirect.cpp#L282
 void Render::sInstance::render_frame(const bool clean_frame,
                                      const glm::mat4x4 *view_mats,
                                      const glm::mat4x4 *proj_mats,
                                      const glm::mat4x4 *viewproj_mats) {
     __android_log_print(ANDROID_LOG_VERBOSE, "View", "-------------------------------");
+
+    const uint16_t pass_count = get_pass_count();
+
+    // Bricks of the out-of-core volumes that the views of this frame need
+    for(uint16_t k = 0; k < pass_count; k++) {
+        const sRenderPass &pass = render_passes[get_pass_in_order(k)];
+        for(uint16_t i = 0; i < pass.draw_stack_size; i++) {
+            const sDrawCall &draw_call = pass.draw_stack[i];
+            if (draw_call.enabled && draw_call.use_transform) {
+                material_man.update_streamed_volume(draw_call.material_id,
+                                                    viewproj_mats,
+                                                    MAX_EYE_NUMBER,
+                                                    draw_call.transform.get_model());
+            }
+        }
+    }
+
+    // Reading the flag clears it, so it is read once for both query rings
+    int disjoint_occurred = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT,
+                  &disjoint_occurred);
+
+    // Stream the volumes that are being loaded, as much as fits on the frame budget
+    upload_scheduler.begin_frame(disjoint_occurred != 0);
+    material_man.update_async_loads(&upload_scheduler);
+    upload_scheduler.end_frame();
+
+    // The uploads & compute passes bound on their own
+    gl_state.begin_frame();
+
+    // If the oldest query is still in flight, this frame is not timed
+    _read_finished_render_queries(disjoint_occurred != 0);
+    const bool is_timed = !render_query_pending[curr_render_query];
+    if (is_timed) {
+        glBeginQueryEXT_(GL_TIME_ELAPSED_EXT,
+                         render_time_queries[curr_render_query]);
+    }
+
+    // Uniform blocks: the frame & the views, and a record per draw call &
+    // eye; each one uploaded once
+    sFrameUniforms frame_uniforms = {};
+    frame_uniforms.time = (float) get_time();
+
+    sViewUniforms view_uniforms;
+    for(uint16_t eye = 0; eye < MAX_EYE_NUMBER; eye++) {
+        view_uniforms.view[eye] = view_mats[eye];
+        view_uniforms.projection[eye] = proj_mats[eye];
+        view_uniforms.viewprojection[eye] = viewproj_mats[eye];
+    }
+
+    // The draw list of each eye, sorted by their keys (see sDrawList)
+    uint32_t draw_uniforms_count = 0;
     for(uint16_t eye = 0; eye < MAX_EYE_NUMBER; eye++) {
+        sDrawList &draw_list = draw_lists[eye];
+        draw_list.clear();
 
-        for(uint16_t j = 0; j < render_pass_size; j++) {
-            sRenderPass &pass = render_passes[j];
+        for(uint16_t k = 0; k < pass_count; k++) {
+            const sRenderPass &pass = render_passes[get_pass_in_order(k)];
+            const uint32_t target_height = (pass.target == FBO_TARGET) ? fbos[pass.fbo_id].height : framebuffer.openxr_framebufffs[eye].height;
+
+            for(uint16_t i = 0; i < pass.draw_stack_size; i++) {
+                const sDrawCall &draw_call = pass.draw_stack[i];
+                if (!draw_call.enabled) {
+                    continue;
+                }
+
+                const sMaterialInstance &material = material_man.materials[draw_call.material_id];
+                sDrawUniforms *uniforms = (sDrawUniforms*) (draw_uniforms + draw_uniforms_count * draw_uniforms_stride);
+
+                uniforms->model = draw_call.transform.get_model();
+                uniforms->view_id = eye;
+                float depth = 0.0f;
+                if (draw_call.use_transform) {
+                    const glm::vec3 camera_local = glm::vec3(glm::inverse(uniforms->model) * glm::inverse(view_mats[eye]) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+                    __android_log_print(ANDROID_LOG_VERBOSE,
+                                        "View",
+                                        "x: %f %f %f",
+                                        camera_local.x,
+                                        camera_local.y,
+                                        camera_local.z);
+                    uniforms->camera_eye_local[0] = camera_local.x;
+                    uniforms->camera_eye_local[1] = camera_local.y;
+                    uniforms->camera_eye_local[2] = camera_local.z;
+                    // Angle of a pixel of the target, for the level of detail selection
+                    uniforms->pixel_angle = 2.0f / (proj_mats[eye][1][1] * target_height);
+                    // Of the origin of the model, along the view direction
+                    depth = -(view_mats[eye] * uniforms->model[3]).z;
+                }
+
+                draw_list.add(DrawKey::compile((uint8_t) k,
+                                               (draw_call.call_state.blending_enabled) ? DRAW_LAYER_TRANSPARENT : DRAW_LAYER_OPAQUE,
+                                               material.shader_id,
+                                               draw_call.material_id,
+                                               draw_call.mesh_id,
+                                               depth),
+                              i,
+                              (uint16_t) draw_uniforms_count);
+                draw_uniforms_count++;
+            }
+        }
+
+        draw_list.sort();
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, frame_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER,
+                    0,
+                    sizeof(sFrameUniforms),
+                    &frame_uniforms);
+    glBindBuffer(GL_UNIFORM_BUFFER, view_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER,
+                    0,
+                    sizeof(sViewUniforms),
+                    &view_uniforms);
+    glBindBuffer(GL_UNIFORM_BUFFER, draw_ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER,
+                    0,
+                    draw_uniforms_count * draw_uniforms_stride,
+                    draw_uniforms);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    GLStats::add_calls(7);
+    gl_state.bind_uniform_buffer(UNIFORM_BLOCK_FRAME,
+                                 frame_ubo,
+                                 0,
+                                 0);
+    gl_state.bind_uniform_buffer(UNIFORM_BLOCK_VIEW,
+                                 view_ubo,
+                                 0,
+                                 0);
+
+    // The material of the last draw: its textures & uniforms are only set again
+    // when the key changes it; gl_state skips the rest of the rebinds
+    int32_t bound_material = -1;
+    for(uint16_t eye = 0; eye < MAX_EYE_NUMBER; eye++) {
+        const sDrawList &draw_list = draw_lists[eye];
+        uint32_t item_id = 0;
+
+        for(uint16_t k = 0; k < pass_count; k++) {
+            sRenderPass &pass = render_passes[get_pass_in_order(k)];
 
             if (pass.target == FBO_TARGET) {
                 // Bind an FBO target
@@ -217,61 +367,83 @@ void Render::sInstance::render_frame(const bool clean_frame,
                 FBO_bind(framebuffer.fbos[eye][curr_swapchain_index]);
             }
 
-            // Clear the curent buffer
-            if (pass.clean_viewport && clean_frame) {
-                glClearColor(pass.rgba_clear_values[0],
-                             pass.rgba_clear_values[1],
-                             pass.rgba_clear_values[2],
-                             pass.rgba_clear_values[3]);
-                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            // Each eye on its part of the FBO, that the first one loads & the
+            // last one stores
+            bool is_first_eye = true;
+            bool is_last_eye = true;
+            if (pass.eyes_side_by_side) {
+                const uint32_t eye_width = fbos[pass.fbo_id].width / MAX_EYE_NUMBER;
+                gl_state.set_viewport(eye * eye_width,
+                                      0,
+                                      eye_width,
+                                      fbos[pass.fbo_id].height);
+                gl_state.set_scissor(eye * eye_width,
+                                     0,
+                                     eye_width,
+                                     fbos[pass.fbo_id].height);
+                is_first_eye = eye == 0;
+                is_last_eye = eye == MAX_EYE_NUMBER - 1;
             }
 
-            // Run the render calls
-            glm::mat4x4 model, model_invert;
-            for(uint16_t i = 0; i < pass.draw_stack_size; i++) {
-                sDrawCall &draw_call = pass.draw_stack[i];
+            // Load actions: cleared or invalidated, so the tiler does not
+            // read the attachments back from memory
+            uint32_t discarded_attachments[GRAPH_ATTACHMENT_COUNT];
+            const uint8_t discarded_count = get_discarded_attachments(is_first_eye && pass.color_load == LOAD_DONT_CARE,
+                                                                      is_first_eye && pass.depth_load == LOAD_DONT_CARE,
+                                                                      discarded_attachments);
+            if (discarded_count > 0) {
+                glInvalidateFramebuffer(GL_FRAMEBUFFER,
+                                        discarded_count,
+                                        discarded_attachments);
+                GLStats::add_calls();
+            }
 
-                if (!draw_call.enabled) {
-                    continue;
-                }
+            uint32_t clear_mask = 0;
+            if (clean_frame && is_first_eye && pass.color_load == LOAD_CLEAR) {
+                gl_state.set_clear_color(pass.rgba_clear_values[0],
+                                         pass.rgba_clear_values[1],
+                                         pass.rgba_clear_values[2],
+                                         pass.rgba_clear_values[3]);
+                clear_mask |= GL_COLOR_BUFFER_BIT;
+            }
+            if (clean_frame && is_first_eye && pass.depth_load == LOAD_CLEAR) {
+                // Masked clears do not clear
+                gl_state.set_depth_mask(true);
+                clear_mask |= GL_DEPTH_BUFFER_BIT;
+            }
+            if (clear_mask != 0) {
+                glClear(clear_mask);
+                GLStats::add_calls();
+            }
 
-                sMaterialInstance &material = material_man.materials[draw_call.material_id];
-                sShader &shader = material_man.shaders[material.shader_id];
-                sMeshBuffers &mesh = meshes[draw_call.mesh_id];
+            // Run the render calls, on the order of their keys
+            for(; item_id < draw_list.count && DrawKey::get_pass(draw_list.items[item_id].key) == k; item_id++) {
+                const sDrawListItem &item = draw_list.items[item_id];
+                const sDrawCall &draw_call = pass.draw_stack[item.draw_id];
+                const uint8_t shader_id = DrawKey::get_shader(item.key);
+                const uint8_t material_id = DrawKey::get_material(item.key);
+                const uint8_t mesh_id = DrawKey::get_mesh(item.key);
 
-                model = draw_call.transform.get_model();
-                model_invert = glm::inverse(model);
+                sShader &shader = material_man.shaders[shader_id];
+                sMeshBuffers &mesh = meshes[mesh_id];
 
                 change_graphic_state(draw_call.call_state);
 
-                material_man.enable(draw_call.material_id);
+                if (material_id != bound_material) {
+                    material_man.enable(material_id,
+                                        &gl_state);
+                    bound_material = material_id;
+                }
 
-                glBindVertexArray(mesh.VAO);
+                gl_state.bind_vertex_array(mesh.VAO);
 
-                if (draw_call.use_transform) {
-                    shader.set_uniform_matrix4("u_model_mat",
-                                               model);
-                    shader.set_uniform_matrix4("u_vp_mat",
-                                               viewproj_mats[eye]);
-                    shader.set_uniform_matrix4("u_view_mat",
-                                               view_mats[eye]);
-                    shader.set_uniform_matrix4("u_proj_mat",
-                                               proj_mats[eye]);
-
-                    glm::vec3 camera_local = glm::vec3( model_invert * glm::inverse(view_mats[eye]) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-                    __android_log_print(ANDROID_LOG_VERBOSE,
-                                        "View",
-                                        "x: %f %f %f",
-                                        camera_local.x,
-                                        camera_local.y,
-                                        camera_local.z);
-                    shader.set_uniform_vector("u_camera_eye_local",
-                                              camera_local);
+                if (shader.uses_uniform_block(UNIFORM_BLOCK_DRAW)) {
+                    gl_state.bind_uniform_buffer(UNIFORM_BLOCK_DRAW,
+                                                 draw_ubo,
+                                                 item.uniforms_id * draw_uniforms_stride,
+                                                 sizeof(sDrawUniforms));
                 }
 
-                shader.set_uniform("u_time",
-                                   (float) get_time());
-
 
                 if (mesh.is_indexed) {
                     glDrawElements(mesh.primitive,
@@ -283,8 +455,18 @@ void Render::sInstance::render_frame(const bool clean_frame,
                                  0,
                                  mesh.primitive_count);
                 }
+                GLStats::add_calls();
+            }
 
-                material_man.disable();
+            // Store actions: the discarded attachments are not written back
+            const uint8_t stored_discarded_count = get_discarded_attachments(is_last_eye && pass.color_store == STORE_DISCARD,
+                                                                             is_last_eye && pass.depth_store == STORE_DISCARD,
+                                                                             discarded_attachments);
+            if (stored_discarded_count > 0) {
+                glInvalidateFramebuffer(GL_FRAMEBUFFER,
+                                        stored_discarded_count,
+                                        discarded_attachments);
+                GLStats::add_calls();
             }
 
             if (pass.target != FBO_TARGET) {
@@ -292,7 +474,280 @@ void Render::sInstance::render_frame(const bool clean_frame,
             }
         }
     }
+    material_man.disable();
     FBO_unbind();
+
+    // Brick feedback of the streamed volumes, read some frames later
+    for(uint16_t k = 0; k < pass_count; k++) {
+        const sRenderPass &pass = render_passes[get_pass_in_order(k)];
+        if (!pass.read_back_feedback) {
+            continue;
+        }
+        for(uint16_t i = 0; i < pass.draw_stack_size; i++) {
+            if (pass.draw_stack[i].enabled) {
+                material_man.read_back_brick_feedback(pass.draw_stack[i].material_id,
+                                                      fbos[pass.fbo_id]);
+            }
+        }
+    }
+
+    if (is_timed) {
+        glEndQueryEXT_(GL_TIME_ELAPSED_EXT);
+        render_query_pending[curr_render_query] = true;
+        curr_render_query = (curr_render_query + 1) % RENDER_QUERY_COUNT;
+    }
+
+    gl_state.end_frame();
+    GLStats::end_frame();
+}
+
+void Render::sInstance::_read_finished_render_queries(const bool disjoint_occurred) {
+    // The results in flight during a disjoint are not reliable; they are dropped
+    if (disjoint_occurred) {
+        memset(render_query_pending, 0, sizeof(render_query_pending));
+        is_render_time_valid = false;
+        return;
+    }
+
+    // From the oldest, so the newest finished one is the last read
+    for(uint8_t i = 0; i < RENDER_QUERY_COUNT; i++) {
+        const uint8_t query = (curr_render_query + i) % RENDER_QUERY_COUNT;
+        if (!render_query_pending[query]) {
+            continue;
+        }
+
+        int available = 0;
+        glGetQueryObjectivEXT_(render_time_queries[query],
+                               GL_QUERY_RESULT_AVAILABLE,
+                               &available);
+        if (!available) {
+            break;
+        }
+
+        glGetQueryObjectui64vEXT_(render_time_queries[query],
+                                  GL_QUERY_RESULT,
+                                  &last_render_time_ns);
+        render_query_pending[query] = false;
+        is_render_time_valid = true;
+    }
+}
+
+// Render graph ===================
+static const uint32_t graph_gl_attachments[GRAPH_ATTACHMENT_COUNT] = {
+    GL_COLOR_ATTACHMENT0,
+    GL_COLOR_ATTACHMENT1,
+    GL_DEPTH_ATTACHMENT
+};
+
+bool Render::sInstance::compile_render_graph() {
+    if (!render_graph.compile()) {
+        __android_log_print(ANDROID_LOG_ERROR, "Render graph", "The render graph does not compile");
+        return false;
+    }
+
+    // The targets & framebuffers that are new on the pools; the rest are reused
+    for(uint8_t t = 0; t < render_graph.physical_target_count; t++) {
+        sGraphPhysicalTarget &target = render_graph.physical_targets[t];
+        if (target.is_allocated) {
+            continue;
+        }
+
+        if (target.desc.type == GRAPH_COLOR_TARGET) {
+            target.handle = material_man.get_new_texture();
+            material_man.textures[target.handle].create_empty2D_with_size(target.desc.width,
+                                                                          target.desc.height,
+                                                                          target.desc.format);
+        } else {
+            assert(rbo_count < RBO_TOTAL_COUNT && "No more space for RBOs");
+            target.handle = rbo_count++;
+            RBO_init(target.handle,
+                     target.desc.width,
+                     target.desc.height,
+                     GL_DEPTH_COMPONENT24);
+        }
+        target.is_allocated = true;
+    }
+
+    for(uint8_t f = 0; f < render_graph.framebuffer_count; f++) {
+        sGraphFramebuffer &graph_framebuffer = render_graph.framebuffers[f];
+        if (graph_framebuffer.is_allocated) {
+            continue;
+        }
+
+        const uint8_t fbo_id = get_new_fbo_id();
+        sFBO &fbo = fbos[fbo_id];
+        bool has_color = false, has_dual_color = false, has_depth = false;
+
+        glGenFramebuffers(1, &fbo.id);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo.id);
+        for(uint8_t a = 0; a < GRAPH_ATTACHMENT_COUNT; a++) {
+            if (graph_framebuffer.attachments[a] == GRAPH_NONE) {
+                continue;
+            }
+            const sGraphPhysicalTarget &target = render_graph.physical_targets[graph_framebuffer.attachments[a]];
+            fbo.width = target.desc.width;
+            fbo.height = target.desc.height;
+
+            if (a == GRAPH_ATTACHMENT_DEPTH) {
+                fbo.depth_attachment = (uint8_t) target.handle;
+                glFramebufferRenderbuffer(GL_FRAMEBUFFER,
+                                          GL_DEPTH_ATTACHMENT,
+                                          GL_RENDERBUFFER,
+                                          rbos[target.handle].id);
+                has_depth = true;
+                continue;
+            }
+
+            if (a == GRAPH_ATTACHMENT_COLOR0) {
+                fbo.color_attachment0 = (uint8_t) target.handle;
+                has_color = true;
+            } else {
+                fbo.color_attachment1 = (uint8_t) target.handle;
+                has_dual_color = true;
+            }
+            glFramebufferTexture2D(GL_FRAMEBUFFER,
+                                   graph_gl_attachments[a],
+                                   GL_TEXTURE_2D,
+                                   material_man.textures[target.handle].texture_id,
+                                   0);
+        }
+        if (has_dual_color) {
+            const uint32_t draw_buffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+            glDrawBuffers(2, draw_buffers);
+        }
+
+        assert(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE && "Failed render graph FBO creation");
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if (has_dual_color) {
+            fbo.attachment_use = JUST_DUAL_COLOR;
+        } else if (has_color) {
+            fbo.attachment_use = (has_depth) ? COLOR_AND_DEPTH : JUST_COLOR;
+        } else {
+            fbo.attachment_use = JUST_DEPTH;
+        }
+
+        graph_framebuffer.handle = fbo_id;
+        graph_framebuffer.is_allocated = true;
+    }
+
+    // The passes outside of the graph run first, on the order they were added
+    bool is_on_graph[RENDER_PASS_COUNT] = {};
+    for(uint8_t p = 0; p < render_graph.pass_count; p++) {
+        assert(render_graph.passes[p].render_pass_id < render_pass_size && "Graph pass without a render pass");
+        is_on_graph[render_graph.passes[p].render_pass_id] = true;
+    }
+
+    pass_order_size = 0;
+    for(uint16_t j = 0; j < render_pass_size; j++) {
+        if (!is_on_graph[j]) {
+            pass_order[pass_order_size++] = (uint8_t) j;
+        }
+    }
+
+    for(uint8_t k = 0; k < render_graph.order_count; k++) {
+        const sGraphPass &graph_pass = render_graph.passes[render_graph.order[k]];
+        sRenderPass &pass = render_passes[graph_pass.render_pass_id];
+
+        if (graph_pass.writes_imported) {
+            pass.target = SCREEN_TARGET;
+        } else {
+            pass.target = FBO_TARGET;
+            pass.fbo_id = (uint8_t) render_graph.framebuffers[graph_pass.framebuffer_id].handle;
+        }
+
+        // Discarded when no later pass reads them; the colors only if all are
+        uint8_t color_mask = 0;
+        for(uint8_t a = GRAPH_ATTACHMENT_COLOR0; a <= GRAPH_ATTACHMENT_COLOR1; a++) {
+            if (graph_pass.writes[a] != GRAPH_NONE) {
+                color_mask |= 1u << a;
+            }
+        }
+        const bool colors_dead = color_mask != 0 && (graph_pass.invalidate_mask & color_mask) == color_mask;
+        pass.color_store = (colors_dead) ? STORE_DISCARD : STORE_KEEP;
+        pass.depth_store = (graph_pass.invalidate_mask & (1u << GRAPH_ATTACHMENT_DEPTH)) ? STORE_DISCARD : STORE_KEEP;
+
+        pass_order[pass_order_size++] = graph_pass.render_pass_id;
+    }
+
+    // What the passes read, on the materials of their draw calls; the targets
+    // can alias on other ones after each compile, so they are set every time
+    uint8_t reader_of_material[MAX_MATERIAL_COUNT];
+    memset(reader_of_material, GRAPH_NONE, sizeof(reader_of_material));
+    for(uint8_t k = 0; k < render_graph.order_count; k++) {
+        const sGraphPass &graph_pass = render_graph.passes[render_graph.order[k]];
+        const sRenderPass &pass = render_passes[graph_pass.render_pass_id];
+
+        uint8_t input_textures[GRAPH_MAX_PASS_READS];
+        uint8_t input_count = 0;
+        for(uint8_t i = 0; i < graph_pass.read_count; i++) {
+            if (render_graph.resources[graph_pass.reads[i]].desc.type == GRAPH_COLOR_TARGET) {
+                input_textures[input_count++] = (uint8_t) render_graph.get_texture(graph_pass.reads[i]);
+            }
+        }
+        if (input_count == 0) {
+            continue;
+        }
+        assert(input_count <= 2 && "Only two color attachment slots on the materials");
+
+        for(uint16_t i = 0; i < pass.draw_stack_size; i++) {
+            const uint8_t material_id = pass.draw_stack[i].material_id;
+            assert((reader_of_material[material_id] == GRAPH_NONE || reader_of_material[material_id] == k) && "A material is shared by two passes that read targets");
+            reader_of_material[material_id] = k;
+
+            for(uint8_t j = 0; j < input_count; j++) {
+                material_man.set_color_attachment_texture(material_id,
+                                                          j,
+                                                          input_textures[j]);
+            }
+        }
+    }
+
+    use_render_graph = true;
+
+    return true;
+}
+
+uint8_t Render::sInstance::add_brick_feedback_pass(const sDrawCall &volume_draw_call,
+                                                   const uint32_t size) {
+    const sMaterialInstance &volume_material = material_man.materials[volume_draw_call.material_id];
+    assert(volume_material.enabled_textures[VOLUME_MAP] && "The feedback pass needs a volume");
+    const uint8_t volume_texture = volume_material.texture_ids[VOLUME_MAP];
+
+    // Same textures, the feedback shader instead
+    sMaterialTexConstructor mat_constructor = {};
+    memcpy(mat_constructor.texture_ids, volume_material.texture_ids, sizeof(mat_constructor.texture_ids));
+    memcpy(mat_constructor.enabled_textures, volume_material.enabled_textures, sizeof(mat_constructor.enabled_textures));
+    const uint8_t feedback_material = material_man.add_material(material_man.add_raw_shader(RawShaders::basic_vertex,
+                                                                                            RawShaders::streamed_feedback_shader),
+                                                                mat_constructor);
+
+    // The eyes side by side, size x size each; the shader writes 8 bit values
+    const uint8_t fbo_id = get_new_fbo_id();
+    FBO_init_with_single_color(fbo_id,
+                               size * MAX_EYE_NUMBER,
+                               size,
+                               TARGET_RGBA8);
+
+    const uint8_t pass_id = add_render_pass(FBO_TARGET,
+                                            fbo_id);
+    sRenderPass &pass = render_passes[pass_id];
+    pass.read_back_feedback = true;
+    pass.eyes_side_by_side = true;
+    // Nothing is requested where no ray lands
+    memset(pass.rgba_clear_values, 0, sizeof(pass.rgba_clear_values));
+
+    sDrawCall feedback_draw_call = volume_draw_call;
+    feedback_draw_call.material_id = feedback_material;
+    feedback_draw_call.call_state.blending_enabled = false;
+    add_drawcall_to_pass(pass_id,
+                         feedback_draw_call);
+
+    material_man.enable_brick_feedback(volume_texture,
+                                       size * MAX_EYE_NUMBER,
+                                       size);
+
+    return pass_id;
 }
 
 
@@ -309,7 +764,8 @@ void Render::sInstance::FBO_init(const uint8_t fbo_id,
 
 void Render::sInstance::FBO_init_with_single_color(const uint8_t fbo_id,
                                                    const uint32_t width_i,
-                                                   const uint32_t height_i) {
+                                                   const uint32_t height_i,
+                                                   const eRenderTargetFormat format) {
     sFBO *fbo = &fbos[fbo_id];
     fbo->attachment_use = JUST_COLOR;
 
@@ -323,7 +779,8 @@ void Render::sInstance::FBO_init_with_single_color(const uint8_t fbo_id,
     sTexture *color_attachment0 = &material_man.textures[fbo->color_attachment0];
 
     color_attachment0->create_empty2D_with_size(fbo->width,
-                                                fbo->height);
+                                                fbo->height,
+                                                format);
 
     glFramebufferTexture2D(GL_FRAMEBUFFER,
                            GL_COLOR_ATTACHMENT0,
@@ -337,9 +794,11 @@ void Render::sInstance::FBO_init_with_single_color(const uint8_t fbo_id,
 
 void Render::sInstance::FBO_init_with_dual_color(const uint8_t fbo_id,
                                                  const uint32_t width_i,
-                                                 const uint32_t height_i) {
+                                                 const uint32_t height_i,
+                                                 const eRenderTargetFormat format0,
+                                                 const eRenderTargetFormat format1) {
     sFBO *fbo = &fbos[fbo_id];
-    fbo->attachment_use = JUST_COLOR;
+    fbo->attachment_use = JUST_DUAL_COLOR;
 
     fbo->width = width_i;
     fbo->height = height_i;
@@ -353,10 +812,12 @@ void Render::sInstance::FBO_init_with_dual_color(const uint8_t fbo_id,
     sTexture *color_attachment1 = &material_man.textures[fbo->color_attachment1];
 
     color_attachment0->create_empty2D_with_size(fbo->width,
-                                                fbo->height);
+                                                fbo->height,
+                                                format0);
 
    color_attachment1->create_empty2D_with_size(fbo->width,
-                                                fbo->height);
+                                                fbo->height,
+                                                format1);
 
 
     glFramebufferTexture2D(GL_FRAMEBUFFER,
@@ -376,26 +837,57 @@ void Render::sInstance::FBO_init_with_dual_color(const uint8_t fbo_id,
 
 void Render::sInstance::FBO_clean(const uint8_t fbo_id) {
     sFBO &fbo = fbos[fbo_id];
-    glDeleteTextures(1, &(material_man.textures[fbo.color_attachment0].texture_id));
-    glDeleteTextures(1, &(material_man.textures[fbo.color_attachment1].texture_id));
+    if (fbo.attachment_use == JUST_COLOR || fbo.attachment_use == JUST_DUAL_COLOR) {
+        glDeleteTextures(1, &(material_man.textures[fbo.color_attachment0].texture_id));
+    }
+    if (fbo.attachment_use == JUST_DUAL_COLOR) {
+        glDeleteTextures(1, &(material_man.textures[fbo.color_attachment1].texture_id));
+    }
     glDeleteFramebuffers(1, &fbo.id);
 }
 
+// New storage of the size & same format, on the same texture spot, so the
+// materials that sample it follow
+static void resize_color_attachment(sTexture *texture,
+                                    const uint32_t attachment,
+                                    const uint32_t width,
+                                    const uint32_t height) {
+    glDeleteTextures(1, &texture->texture_id);
+    texture->create_empty2D_with_size(width,
+                                      height,
+                                      texture->target_format);
+    glFramebufferTexture2D(GL_FRAMEBUFFER,
+                           attachment,
+                           GL_TEXTURE_2D,
+                           texture->texture_id,
+                           0);
+}
+
+// Keeps the FBO & its texture spots; only the storage is recreated
 uint8_t Render::sInstance::FBO_reinit(const uint8_t fbo_id,
                                       const uint32_t width_i,
                                       const uint32_t height_i) {
-    FBO_clean(fbo_id);
+    sFBO &fbo = fbos[fbo_id];
+    fbo.width = width_i;
+    fbo.height = height_i;
 
-    switch (fbos[fbo_id].attachment_use) {
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo.id);
+    switch (fbo.attachment_use) {
         case JUST_COLOR:
-            FBO_init_with_single_color(fbo_id,
-                                       width_i,
-                                       height_i);
+            resize_color_attachment(&material_man.textures[fbo.color_attachment0],
+                                    GL_COLOR_ATTACHMENT0,
+                                    width_i,
+                                    height_i);
             break;
         case JUST_DUAL_COLOR:
-            FBO_init_with_dual_color(fbo_id,
-                                     width_i,
-                                     height_i);
+            resize_color_attachment(&material_man.textures[fbo.color_attachment0],
+                                    GL_COLOR_ATTACHMENT0,
+                                    width_i,
+                                    height_i);
+            resize_color_attachment(&material_man.textures[fbo.color_attachment1],
+                                    GL_COLOR_ATTACHMENT1,
+                                    width_i,
+                                    height_i);
             break;
         case JUST_DEPTH:
             // TODO
@@ -404,8 +896,9 @@ uint8_t Render::sInstance::FBO_reinit(const uint8_t fbo_id,
             // TODO
             break;
     }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    return 0;
+    return fbo_id;
 }
 
 
@@ -15,12 +15,19 @@
 #include "rbo.h"
 #include "raw_shaders.h"
 #include "openxr_instance.h"
+#include "upload_scheduler.h"
+#include "gl_stats.h"
+#include "draw_list.h"
+#include "gl_state_cache.h"
+#include "render_graph.h"
 #define MAX_SWAPCHAIN_SIZE 5
 #define MESH_TOTAL_COUNT 20
 #define FBO_TOTAL_COUNT 15
 #define RBO_TOTAL_COUNT 15
 #define DRAW_CALL_STACK_SIZE 30
 #define RENDER_PASS_COUNT 5
+#define RENDER_QUERY_COUNT 4 // Frames of latency for the GPU time of the passes
+#define DRAW_UNIFORMS_COUNT (MAX_EYE_NUMBER * RENDER_PASS_COUNT * DRAW_CALL_STACK_SIZE)
 /**
  * A Wrapper for the rendering backend, for now with webgl
  * TODO:
@@ -31,7 +38,6 @@
  *  4) Scene representation
  *  4) GLTF import
  *  5) Culling (VR culling??)
- *  5) Render graph..?
  *
  *  Try an "stateless" API?
  *  Keep on instance state of the OpenGL flags
@@ -44,6 +50,19 @@ namespace Render {
         FBO_TARGET
     };
 
+    // What is done with the contents of the attachments on the tile memory,
+    // at the start (load) & at the end (store) of a pass
+    enum eLoadAction : uint8_t {
+        LOAD_CLEAR = 0,  // glClear, to the clear values
+        LOAD_KEEP,       // What the previous passes left
+        LOAD_DONT_CARE   // Invalidated; the pass writes all of it
+    };
+
+    enum eStoreAction : uint8_t {
+        STORE_KEEP = 0,
+        STORE_DISCARD    // Invalidated, never written back to memory
+    };
+
     struct sGLState {
         // Depth test config
         bool depth_test_enabled = true;
@@ -114,9 +133,37 @@ namespace Render {
                                  const uint32_t indices_size);
     };
 
+    // std140 layouts of RawShaders' FRAME_, VIEW_ & DRAW_UNIFORM_BLOCK
+    struct sFrameUniforms {
+        float       time;
+        float       padding[3];
+    };
+
+    struct sViewUniforms {
+        glm::mat4x4 view[MAX_EYE_NUMBER];
+        glm::mat4x4 projection[MAX_EYE_NUMBER];
+        glm::mat4x4 viewprojection[MAX_EYE_NUMBER];
+    };
+
+    struct sDrawUniforms {
+        glm::mat4x4 model;
+        float       camera_eye_local[3];
+        float       pixel_angle;
+        int32_t     view_id;
+        int32_t     padding[3];
+    };
+
+    static_assert(sizeof(sFrameUniforms) == 16, "sFrameUniforms does not match FrameBlock");
+    static_assert(sizeof(sViewUniforms) == 384, "sViewUniforms does not match ViewBlock");
+    static_assert(sizeof(sDrawUniforms) == 96, "sDrawUniforms does not match DrawBlock");
+
     struct sRenderPass {
-        bool clean_viewport = true;
-        uint32_t clean_config;
+        // The color ones are of all the color attachments; on the passes of
+        // the render graph, compile_render_graph sets the stores
+        eLoadAction color_load = LOAD_CLEAR;
+        eLoadAction depth_load = LOAD_CLEAR;
+        eStoreAction color_store = STORE_KEEP;
+        eStoreAction depth_store = STORE_KEEP;
         float rgba_clear_values[4] = {0.0f, 0.0f, 0.0f, 1.0f};
 
         eRenderPassTarget target = SCREEN_TARGET;
@@ -129,6 +176,12 @@ namespace Render {
 
         uint8_t fbo_id;
 
+        // Brick feedback of the streamed volumes, see add_brick_feedback_pass
+        bool read_back_feedback = false;
+        // FBO passes: the eyes draw on their own columns of the FBO, instead
+        // of over each other
+        bool eyes_side_by_side = false;
+
         uint8_t draw_stack_size = 0;
         sDrawCall draw_stack[DRAW_CALL_STACK_SIZE];
     };
@@ -136,7 +189,8 @@ namespace Render {
     struct sInstance {
         sFramebuffer framebuffer = {};
 
-        sGLState current_state;
+        // Every GL state change of the render loop goes through it
+        sGLStateCache gl_state;
 
         uint32_t base_framebuffer = 0;
 
@@ -151,9 +205,43 @@ namespace Render {
 
         sMaterialManager material_man = {};
 
+        // Texture streaming, with a per frame time budget
+        sUploadScheduler upload_scheduler;
+
+        // GPU time of the render passes; read some frames later, without
+        // waiting on them. last_render_time_ns is the newest that finished,
+        // and it is not valid until one has (or after a disjoint)
+        uint32_t render_time_queries[RENDER_QUERY_COUNT] = {};
+        bool render_query_pending[RENDER_QUERY_COUNT] = {};
+        uint8_t curr_render_query = 0;
+        uint64_t last_render_time_ns = 0;
+        bool is_render_time_valid = false;
+
+        // Uniform buffers, updated once per frame; the draw one holds a
+        // sDrawUniforms per draw call & eye, draw_uniforms_stride apart (the
+        // offset alignment of the GPU), each bound by range on its draw
+        uint32_t frame_ubo = 0;
+        uint32_t view_ubo = 0;
+        uint32_t draw_ubo = 0;
+        uint32_t draw_uniforms_stride = 0;
+        uint8_t  *draw_uniforms = NULL;
+
         uint16_t render_pass_size = 0;
         sRenderPass render_passes[RENDER_PASS_COUNT];
 
+        // Of each eye, compiled & sorted every frame
+        sDrawList draw_lists[MAX_EYE_NUMBER];
+
+        // Optional; the passes added to it are ordered, culled & get their
+        // targets on compile_render_graph. The swapchain is imported on init
+        sRenderGraph render_graph;
+        uint8_t swapchain_color_resource = GRAPH_NONE;
+        uint8_t swapchain_depth_resource = GRAPH_NONE;
+        bool use_render_graph = false;
+        // The passes that are not on the graph first, then the graph order
+        uint8_t pass_order[RENDER_PASS_COUNT];
+        uint16_t pass_order_size = 0;
+
         void init(sOpenXRFramebuffer *openxr_framebuffer);
         void change_graphic_state(const sGLState &new_state);
         void render_frame(const bool clean_frame,
@@ -161,6 +249,16 @@ namespace Render {
                           const glm::mat4x4 *proj_mats,
                           const glm::mat4x4 *viewproj_mats);
 
+        /**
+         * Compiles render_graph, and creates the targets & FBOs of its pools
+         * that are new; false if it does not compile. Call it again after
+         * changing the graph. The color resources that a pass reads are bound
+         * on the COLOR_ATTACHMENT0 & 1 slots of the materials of its draw calls.
+         * */
+        bool compile_render_graph();
+
+        void _read_finished_render_queries(const bool disjoint_occurred);
+
         // Inlines
         inline uint8_t add_drawcall_to_pass(const uint8_t pass_id,
                                             const sDrawCall &draw_call) {
@@ -222,6 +320,29 @@ namespace Render {
             return render_pass_size++;
         }
 
+        /**
+         * Optional low resolution pass, where the streamed volume of the draw
+         * call writes the bricks that its rays need, each eye on its half of
+         * the target; they are read back asynchronously, and requested by its
+         * residency instead of the ones of the frusta.
+         * */
+        uint8_t add_brick_feedback_pass(const sDrawCall &volume_draw_call,
+                                        const uint32_t size = FEEDBACK_DEFAULT_SIZE);
+
+        // Render passes, on the order that they run
+        inline uint16_t get_pass_count() const {
+            return (use_render_graph) ? pass_order_size : render_pass_size;
+        }
+
+        inline uint8_t get_pass_in_order(const uint16_t position) const {
+            return (use_render_graph) ? pass_order[position] : (uint8_t) position;
+        }
+
+        // Texture of a color resource of the graph, after compiling it
+        inline uint8_t get_texture_of_graph_resource(const uint8_t resource_id) const {
+            return (uint8_t) render_graph.get_texture(resource_id);
+        }
+
         inline uint8_t get_new_fbo_id() {
             assert(fbo_count < FBO_TOTAL_COUNT && "No more space for FBOs");
             return fbo_count++;
@@ -261,30 +382,33 @@ namespace Render {
 
         void FBO_init_with_single_color(const uint8_t fbo_id,
                                         const uint32_t width_i,
-                                        const uint32_t height_i);
+                                        const uint32_t height_i,
+                                        const eRenderTargetFormat format);
         void FBO_init_with_dual_color(const uint8_t fbo_id,
                                       const uint32_t width_i,
-                                      const uint32_t height_i);
+                                      const uint32_t height_i,
+                                      const eRenderTargetFormat format0,
+                                      const eRenderTargetFormat format1);
         void FBO_clean(const uint8_t fbo_id);
 
         uint8_t FBO_reinit(const uint8_t fbo_id,
                            const uint32_t width_i,
                            const uint32_t height_i);
 
-        inline void FBO_bind(const uint8_t fbo_id) const {
-            glBindFramebuffer(GL_FRAMEBUFFER, fbos[fbo_id].id);
-            glViewport(0,
-                       0,
-                       fbos[fbo_id].width,
-                       fbos[fbo_id].width);
-            glScissor(0,
-                       0,
-                       fbos[fbo_id].width,
-                       fbos[fbo_id].width);
+        inline void FBO_bind(const uint8_t fbo_id) {
+            gl_state.bind_framebuffer(fbos[fbo_id].id);
+            gl_state.set_viewport(0,
+                                  0,
+                                  fbos[fbo_id].width,
+                                  fbos[fbo_id].height);
+            gl_state.set_scissor(0,
+                                 0,
+                                 fbos[fbo_id].width,
+                                 fbos[fbo_id].height);
             //glEnable(GL_SCISSOR_TEST);
         }
-        inline void FBO_unbind() const {
-            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        inline void FBO_unbind() {
+            gl_state.bind_framebuffer(0);
         }
 
         // RBO Functions
@@ -0,0 +1,360 @@
+#include "render_graph.h"
+
+#include <cstring>
+#include <cassert>
+
+// Declaration ===========================================
+uint8_t sRenderGraph::add_resource(const char *name,
+                                   const sGraphResourceDesc &desc,
+                                   const bool keep_contents) {
+    assert(resource_count < GRAPH_MAX_RESOURCES && "No more space for graph resources");
+    assert(find_resource(name) == GRAPH_NONE && "Graph resource already declared");
+
+    sGraphResource &resource = resources[resource_count];
+    resource = {};
+    strncpy(resource.name, name, GRAPH_NAME_SIZE - 1);
+    resource.name[GRAPH_NAME_SIZE - 1] = '\0';
+    resource.desc = desc;
+    resource.keep_contents = keep_contents;
+
+    is_compiled = false;
+    return resource_count++;
+}
+
+uint8_t sRenderGraph::import_resource(const char *name,
+                                      const sGraphResourceDesc &desc,
+                                      const bool keep_contents) {
+    const uint8_t resource_id = add_resource(name,
+                                             desc,
+                                             keep_contents);
+    resources[resource_id].is_imported = true;
+    return resource_id;
+}
+
+uint8_t sRenderGraph::add_pass(const char *name,
+                               const uint8_t render_pass_id,
+                               const bool has_side_effects) {
+    assert(pass_count < GRAPH_MAX_PASSES && "No more space for graph passes");
+
+    sGraphPass &pass = passes[pass_count];
+    pass = {};
+    strncpy(pass.name, name, GRAPH_NAME_SIZE - 1);
+    pass.name[GRAPH_NAME_SIZE - 1] = '\0';
+    pass.render_pass_id = render_pass_id;
+    pass.has_side_effects = has_side_effects;
+
+    is_compiled = false;
+    return pass_count++;
+}
+
+void sRenderGraph::read(const uint8_t pass_id,
+                        const uint8_t resource_id) {
+    sGraphPass &pass = passes[pass_id];
+    assert(pass.read_count < GRAPH_MAX_PASS_READS && "No more reads on the graph pass");
+    assert(resource_id < resource_count && "Unknown graph resource");
+
+    pass.reads[pass.read_count++] = resource_id;
+    is_compiled = false;
+}
+
+void sRenderGraph::write(const uint8_t pass_id,
+                         const uint8_t resource_id,
+                         const eGraphAttachment attachment) {
+    assert(resource_id < resource_count && "Unknown graph resource");
+    assert((attachment == GRAPH_ATTACHMENT_DEPTH) == (resources[resource_id].desc.type == GRAPH_DEPTH_TARGET) && "Depth resources only go on the depth attachment");
+
+    passes[pass_id].writes[attachment] = resource_id;
+    is_compiled = false;
+}
+
+uint8_t sRenderGraph::find_resource(const char *name) const {
+    for(uint8_t i = 0; i < resource_count; i++) {
+        if (strncmp(resources[i].name, name, GRAPH_NAME_SIZE) == 0) {
+            return i;
+        }
+    }
+    return GRAPH_NONE;
+}
+
+void sRenderGraph::clear() {
+    resource_count = 0;
+    pass_count = 0;
+    order_count = 0;
+    is_compiled = false;
+}
+
+// Compilation ===========================================
+static bool pass_writes(const sGraphPass &pass,
+                        const uint8_t resource_id) {
+    for(uint8_t a = 0; a < GRAPH_ATTACHMENT_COUNT; a++) {
+        if (pass.writes[a] == resource_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool pass_reads(const sGraphPass &pass,
+                       const uint8_t resource_id) {
+    for(uint8_t i = 0; i < pass.read_count; i++) {
+        if (pass.reads[i] == resource_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool sRenderGraph::compile() {
+    is_compiled = false;
+    order_count = 0;
+
+    // Dependencies, as bitmasks of passes; a read depends on the writers
+    // added before it (or on all of them, if there are none), the writers of
+    // a resource keep their order, and the readers of a version go before
+    // the pass that overwrites it
+    uint32_t dependencies[GRAPH_MAX_PASSES] = {};
+    for(uint8_t p = 0; p < pass_count; p++) {
+        const sGraphPass &pass = passes[p];
+
+        for(uint8_t i = 0; i < pass.read_count; i++) {
+            const uint8_t resource_id = pass.reads[i];
+            uint32_t previous_writers = 0;
+            uint32_t all_writers = 0;
+            for(uint8_t q = 0; q < pass_count; q++) {
+                if (q != p && pass_writes(passes[q], resource_id)) {
+                    all_writers |= 1u << q;
+                    previous_writers |= (q < p) ? 1u << q : 0u;
+                }
+            }
+            dependencies[p] |= (previous_writers != 0) ? previous_writers : all_writers;
+        }
+
+        for(uint8_t a = 0; a < GRAPH_ATTACHMENT_COUNT; a++) {
+            const uint8_t resource_id = pass.writes[a];
+            if (resource_id == GRAPH_NONE) {
+                continue;
+            }
+            for(uint8_t q = 0; q < p; q++) {
+                if (pass_writes(passes[q], resource_id)) {
+                    dependencies[p] |= 1u << q;
+                }
+                // A reader of the previous version, if there is one
+                if (pass_reads(passes[q], resource_id)) {
+                    for(uint8_t w = 0; w < q; w++) {
+                        if (pass_writes(passes[w], resource_id)) {
+                            dependencies[p] |= 1u << q;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Topological order, the first added pass among the ready ones
+    uint32_t placed = 0;
+    uint8_t all_order[GRAPH_MAX_PASSES];
+    for(uint8_t k = 0; k < pass_count; k++) {
+        uint8_t next = GRAPH_NONE;
+        for(uint8_t p = 0; p < pass_count; p++) {
+            if (!(placed & (1u << p)) && (dependencies[p] & ~placed) == 0) {
+                next = p;
+                break;
+            }
+        }
+        if (next == GRAPH_NONE) {
+            return false; // A cycle
+        }
+        placed |= 1u << next;
+        all_order[k] = next;
+    }
+
+    // Culling, from the last pass: needed if it has side effects, or writes
+    // what is kept, or what a needed pass reads
+    uint32_t needed_resources = 0;
+    for(int16_t k = pass_count - 1; k >= 0; k--) {
+        sGraphPass &pass = passes[all_order[k]];
+
+        bool is_needed = pass.has_side_effects;
+        for(uint8_t a = 0; a < GRAPH_ATTACHMENT_COUNT; a++) {
+            const uint8_t resource_id = pass.writes[a];
+            if (resource_id != GRAPH_NONE) {
+                is_needed = is_needed || resources[resource_id].keep_contents || (needed_resources & (1u << resource_id));
+            }
+        }
+
+        pass.is_culled = !is_needed;
+        if (is_needed) {
+            for(uint8_t i = 0; i < pass.read_count; i++) {
+                needed_resources |= 1u << pass.reads[i];
+            }
+        }
+    }
+
+    for(uint8_t k = 0; k < pass_count; k++) {
+        if (!passes[all_order[k]].is_culled) {
+            order[order_count++] = all_order[k];
+        }
+    }
+
+    // Lifetimes, on the positions of the order
+    for(uint8_t r = 0; r < resource_count; r++) {
+        resources[r].first_use = GRAPH_NONE;
+        resources[r].last_use = GRAPH_NONE;
+        resources[r].physical_id = GRAPH_NONE;
+    }
+    for(uint8_t k = 0; k < order_count; k++) {
+        const sGraphPass &pass = passes[order[k]];
+        uint8_t used[GRAPH_MAX_PASS_READS + GRAPH_ATTACHMENT_COUNT];
+        uint8_t used_count = 0;
+        for(uint8_t i = 0; i < pass.read_count; i++) {
+            used[used_count++] = pass.reads[i];
+        }
+        for(uint8_t a = 0; a < GRAPH_ATTACHMENT_COUNT; a++) {
+            if (pass.writes[a] != GRAPH_NONE) {
+                used[used_count++] = pass.writes[a];
+            }
+        }
+
+        for(uint8_t i = 0; i < used_count; i++) {
+            sGraphResource &resource = resources[used[i]];
+            resource.first_use = (resource.first_use == GRAPH_NONE) ? k : resource.first_use;
+            resource.last_use = k;
+        }
+    }
+
+    _alias_resources();
+
+    // Framebuffers & invalidations
+    for(uint8_t k = 0; k < order_count; k++) {
+        sGraphPass &pass = passes[order[k]];
+        pass.writes_imported = false;
+        pass.framebuffer_id = GRAPH_NONE;
+        pass.invalidate_mask = 0;
+
+        bool writes_transient = false;
+        for(uint8_t a = 0; a < GRAPH_ATTACHMENT_COUNT; a++) {
+            const uint8_t resource_id = pass.writes[a];
+            if (resource_id == GRAPH_NONE) {
+                continue;
+            }
+
+            const sGraphResource &resource = resources[resource_id];
+            pass.writes_imported = pass.writes_imported || resource.is_imported;
+            writes_transient = writes_transient || !resource.is_imported;
+
+            // Nobody reads it after this pass
+            if (!resource.keep_contents && resource.last_use == k) {
+                pass.invalidate_mask |= 1u << a;
+            }
+        }
+
+        if (pass.writes_imported && writes_transient) {
+            return false;
+        }
+    }
+
+    _assign_framebuffers();
+
+    is_compiled = true;
+    return true;
+}
+
+uint32_t sRenderGraph::get_texture(const uint8_t resource_id) const {
+    assert(is_compiled && "The graph is not compiled");
+    assert(resource_id < resource_count && "Unknown graph resource");
+    const uint8_t target_id = resources[resource_id].physical_id;
+    assert(target_id != GRAPH_NONE && "Resource without a target, it is imported or unused");
+    assert(physical_targets[target_id].desc.type == GRAPH_COLOR_TARGET && "Only the color targets are textures");
+
+    return physical_targets[target_id].handle;
+}
+
+void sRenderGraph::_alias_resources() {
+    for(uint8_t t = 0; t < physical_target_count; t++) {
+        physical_targets[t].busy_until = GRAPH_NONE;
+        physical_targets[t].resource_count = 0;
+    }
+
+    // The transient resources that are used, by their first use
+    uint8_t sorted[GRAPH_MAX_RESOURCES];
+    uint8_t sorted_count = 0;
+    for(uint8_t r = 0; r < resource_count; r++) {
+        if (resources[r].is_imported || resources[r].first_use == GRAPH_NONE) {
+            continue;
+        }
+        uint8_t position = sorted_count++;
+        while (position > 0 && resources[sorted[position - 1]].first_use > resources[r].first_use) {
+            sorted[position] = sorted[position - 1];
+            position--;
+        }
+        sorted[position] = r;
+    }
+
+    for(uint8_t i = 0; i < sorted_count; i++) {
+        sGraphResource &resource = resources[sorted[i]];
+
+        // The first compatible target that is free by then; the kept
+        // resources get one for the whole frame
+        uint8_t target_id = GRAPH_NONE;
+        for(uint8_t t = 0; t < physical_target_count && !resource.keep_contents; t++) {
+            const sGraphPhysicalTarget &target = physical_targets[t];
+            if (target.desc.is_compatible(resource.desc) && (target.busy_until == GRAPH_NONE || target.busy_until < resource.first_use)) {
+                target_id = t;
+                break;
+            }
+        }
+        for(uint8_t t = 0; t < physical_target_count && target_id == GRAPH_NONE; t++) {
+            const sGraphPhysicalTarget &target = physical_targets[t];
+            if (target.desc.is_compatible(resource.desc) && target.busy_until == GRAPH_NONE) {
+                target_id = t;
+            }
+        }
+
+        if (target_id == GRAPH_NONE) {
+            assert(physical_target_count < GRAPH_MAX_PHYSICAL_TARGETS && "No more space for physical targets");
+            target_id = physical_target_count++;
+            physical_targets[target_id] = {};
+            physical_targets[target_id].desc = resource.desc;
+        }
+
+        sGraphPhysicalTarget &target = physical_targets[target_id];
+        target.busy_until = (resource.keep_contents) ? GRAPH_MAX_PASSES : resource.last_use;
+        target.resource_count++;
+        resource.physical_id = target_id;
+    }
+}
+
+void sRenderGraph::_assign_framebuffers() {
+    for(uint8_t k = 0; k < order_count; k++) {
+        sGraphPass &pass = passes[order[k]];
+        if (pass.writes_imported) {
+            continue;
+        }
+
+        uint8_t attachments[GRAPH_ATTACHMENT_COUNT];
+        bool has_attachments = false;
+        for(uint8_t a = 0; a < GRAPH_ATTACHMENT_COUNT; a++) {
+            attachments[a] = (pass.writes[a] != GRAPH_NONE) ? resources[pass.writes[a]].physical_id : GRAPH_NONE;
+            has_attachments = has_attachments || attachments[a] != GRAPH_NONE;
+        }
+        if (!has_attachments) {
+            continue;
+        }
+
+        uint8_t framebuffer_id = GRAPH_NONE;
+        for(uint8_t f = 0; f < framebuffer_count; f++) {
+            if (memcmp(framebuffers[f].attachments, attachments, sizeof(attachments)) == 0) {
+                framebuffer_id = f;
+                break;
+            }
+        }
+        if (framebuffer_id == GRAPH_NONE) {
+            assert(framebuffer_count < GRAPH_MAX_FRAMEBUFFERS && "No more space for graph framebuffers");
+            framebuffer_id = framebuffer_count++;
+            framebuffers[framebuffer_id] = {};
+            memcpy(framebuffers[framebuffer_id].attachments, attachments, sizeof(attachments));
+        }
+        pass.framebuffer_id = framebuffer_id;
+    }
+}
@@ -0,0 +1,175 @@
+#ifndef RENDER_GRAPH_H_
+#define RENDER_GRAPH_H_
+
+#include <cstdint>
+
+#include "render_target_format.h"
+
+#define GRAPH_MAX_RESOURCES 16
+#define GRAPH_MAX_PASSES 16
+#define GRAPH_MAX_PASS_READS 4
+#define GRAPH_MAX_PHYSICAL_TARGETS 12
+#define GRAPH_MAX_FRAMEBUFFERS 12
+#define GRAPH_NAME_SIZE 24
+#define GRAPH_NONE 0xFF
+
+/**
+ * Render graph: the passes declare the virtual resources (render targets)
+ * that they read (sample) & write (attach), and compile() works out the rest:
+ *  - the order: every pass after the writers of what it reads, and the
+ *    writers of a resource on the order they were added; otherwise as added
+ *  - the culling: only the passes with side effects (read backs), the ones
+ *    writing to resources that outlive the frame (the swapchain) and the ones
+ *    they depend on are run
+ *  - the lifetimes of the resources, from their first to their last use on
+ *    the order, & the physical targets from the pool: the transient resources
+ *    with the same description (size, type & format) whose lifetimes do not
+ *    overlap share a target
+ *  - the framebuffers, one per set of physical attachments, from a pool too
+ *  - the invalidations: the attachments that no later pass reads, and are
+ *    not kept, are invalidated after the pass that wrote them, so a tiler
+ *    never stores them to memory (i.e. the depth)
+ * The pools outlive the compiles: the targets & framebuffers are allocated
+ * the first time that they are needed (Render::sInstance::compile_render_graph
+ * creates them on GL, & sets their handles), and reused on the next compiles.
+ * After compiling, get_texture resolves what each pass reads.
+ * Compiling is CPU only (see tools/render_graph_dump.cpp).
+ * */
+
+enum eGraphResourceType : uint8_t {
+    GRAPH_COLOR_TARGET = 0,
+    GRAPH_DEPTH_TARGET
+};
+
+enum eGraphAttachment : uint8_t {
+    GRAPH_ATTACHMENT_COLOR0 = 0,
+    GRAPH_ATTACHMENT_COLOR1,
+    GRAPH_ATTACHMENT_DEPTH,
+    GRAPH_ATTACHMENT_COUNT
+};
+
+const char graph_attachment_names[GRAPH_ATTACHMENT_COUNT][7] = {
+    "color0",
+    "color1",
+    "depth"
+};
+
+struct sGraphResourceDesc {
+    uint32_t            width = 0;
+    uint32_t            height = 0;
+    eGraphResourceType  type = GRAPH_COLOR_TARGET;
+    eRenderTargetFormat format = TARGET_RGBA8; // Of the color targets
+
+    inline bool is_compatible(const sGraphResourceDesc &other) const {
+        return width == other.width && height == other.height && type == other.type
+            && (type == GRAPH_DEPTH_TARGET || format == other.format);
+    }
+};
+
+struct sGraphResource {
+    char               name[GRAPH_NAME_SIZE];
+    sGraphResourceDesc desc;
+    // Not from the pool (the swapchain)
+    bool               is_imported = false;
+    // Read after the frame, never invalidated nor aliased
+    bool               keep_contents = false;
+
+    // Compiled; positions on the order, GRAPH_NONE if unused
+    uint8_t            first_use = GRAPH_NONE;
+    uint8_t            last_use = GRAPH_NONE;
+    uint8_t            physical_id = GRAPH_NONE;
+};
+
+struct sGraphPass {
+    char     name[GRAPH_NAME_SIZE];
+    uint8_t  render_pass_id = 0; // Of Render::sInstance
+    bool     has_side_effects = false;
+
+    uint8_t  reads[GRAPH_MAX_PASS_READS];
+    uint8_t  read_count = 0;
+    uint8_t  writes[GRAPH_ATTACHMENT_COUNT] = {GRAPH_NONE, GRAPH_NONE, GRAPH_NONE};
+
+    // Compiled
+    bool     is_culled = false;
+    bool     writes_imported = false;
+    uint8_t  framebuffer_id = GRAPH_NONE; // Not on imported targets
+    uint8_t  invalidate_mask = 0; // 1 << eGraphAttachment
+};
+
+struct sGraphPhysicalTarget {
+    sGraphResourceDesc desc;
+    uint32_t           handle = 0; // Texture or renderbuffer
+    bool               is_allocated = false;
+
+    // Compiled; the last position that uses it, & the resources on it
+    uint8_t            busy_until = GRAPH_NONE;
+    uint8_t            resource_count = 0;
+};
+
+struct sGraphFramebuffer {
+    uint8_t  attachments[GRAPH_ATTACHMENT_COUNT] = {GRAPH_NONE, GRAPH_NONE, GRAPH_NONE}; // Physical targets
+    uint32_t handle = 0; // Render::sInstance FBO
+    bool     is_allocated = false;
+};
+
+struct sRenderGraph {
+    sGraphResource       resources[GRAPH_MAX_RESOURCES];
+    uint8_t              resource_count = 0;
+    sGraphPass           passes[GRAPH_MAX_PASSES];
+    uint8_t              pass_count = 0;
+
+    // Pools
+    sGraphPhysicalTarget physical_targets[GRAPH_MAX_PHYSICAL_TARGETS];
+    uint8_t              physical_target_count = 0;
+    sGraphFramebuffer    framebuffers[GRAPH_MAX_FRAMEBUFFERS];
+    uint8_t              framebuffer_count = 0;
+
+    // Compiled: the passes that run, in order
+    uint8_t              order[GRAPH_MAX_PASSES];
+    uint8_t              order_count = 0;
+    bool                 is_compiled = false;
+
+    // Declaration ===========================================
+    uint8_t add_resource(const char *name,
+                         const sGraphResourceDesc &desc,
+                         const bool keep_contents = false);
+    uint8_t import_resource(const char *name,
+                            const sGraphResourceDesc &desc,
+                            const bool keep_contents);
+    uint8_t add_pass(const char *name,
+                     const uint8_t render_pass_id,
+                     const bool has_side_effects = false);
+    void read(const uint8_t pass_id,
+              const uint8_t resource_id);
+    void write(const uint8_t pass_id,
+               const uint8_t resource_id,
+               const eGraphAttachment attachment);
+
+    uint8_t find_resource(const char *name) const;
+
+    // Drops the passes & resources, keeps the pools
+    void clear();
+
+    /**
+     * Orders, culls & allocates; false if the passes depend on each other
+     * (a cycle), or if a pass mixes imported & transient attachments
+     * */
+    bool compile();
+
+    inline uint8_t get_physical_target(const uint8_t resource_id) const {
+        return resources[resource_id].physical_id;
+    }
+
+    /**
+     * Handle of the physical target of a color resource, after compiling;
+     * the texture that the passes that read it sample. The targets can
+     * change between compiles, so the readers are bound again each time.
+     * The depth targets are renderbuffers: reading them only orders passes
+     * */
+    uint32_t get_texture(const uint8_t resource_id) const;
+
+    void _alias_resources();
+    void _assign_framebuffers();
+};
+
+#endif // RENDER_GRAPH_H_
@@ -0,0 +1,42 @@
+#ifndef RENDER_TARGET_FORMAT_H_
+#define RENDER_TARGET_FORMAT_H_
+
+#include <cstdint>
+
+/**
+ * Formats of the color targets (FBO attachments & render graph resources),
+ * smallest first; each pixel is written to & read from memory by the passes
+ * that use it, so on a tiler the format is most of their bandwidth.
+ * The float ones need EXT_color_buffer_float to be rendered to (it is on
+ * the Quest); R32F is not filtered, and only blends with EXT_float_blend.
+ * The GL formats are on texture.cpp
+ * */
+enum eRenderTargetFormat : uint8_t {
+    TARGET_RGBA8 = 0,
+    TARGET_RGB10_A2,    // 2 bits of alpha
+    TARGET_R11G11B10F,  // HDR color, no alpha
+    TARGET_RG16F,
+    TARGET_R32F,        // Depths, distances
+    TARGET_RGBA16F,     // HDR color & alpha
+    TARGET_FORMAT_COUNT
+};
+
+const uint8_t render_target_format_sizes[TARGET_FORMAT_COUNT] = {
+    4, // RGBA8
+    4, // RGB10_A2
+    4, // R11G11B10F
+    4, // RG16F
+    4, // R32F
+    8  // RGBA16F
+};
+
+const char render_target_format_names[TARGET_FORMAT_COUNT][11] = {
+    "RGBA8",
+    "RGB10_A2",
+    "R11G11B10F",
+    "RG16F",
+    "R32F",
+    "RGBA16F"
+};
+
+#endif // RENDER_TARGET_FORMAT_H_
@@ -13,6 +13,17 @@
 #include <cstring>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "gl_stats.h"
+
+// FNV-1a
+static uint32_t hash_uniform_name(const char* name) {
+    uint32_t hash = 2166136261u;
+    for(; *name != '\0'; name++) {
+        hash = (hash ^ (uint8_t) *name) * 16777619u;
+    }
+    return hash;
+}
+
 // To do: Show programming errors
 sShader::sShader(const char* vertex_shader_raw,
                const char* fragment_shader_raw) {
@@ -66,6 +77,8 @@ sShader::sShader(const char* vertex_shader_raw,
         assert(">>>>>Shader Linking error" && false);
     }
 
+    _reflect();
+
     // Cleanup
     glDeleteShader(vertex_id);
     glDeleteShader(fragment_id);
@@ -164,6 +177,8 @@ void sShader::load_graphic_shaders(const char*   vertex_shader_raw,
         assert(">>>>>Shader Linking error" && false);
     }
 
+    _reflect();
+
     // Cleanup
     glDeleteShader(vertex_id);
     glDeleteShader(fragment_id);
@@ -215,14 +230,100 @@ void sShader::load_compute_shader(const char* raw_compute) {
         assert(">>>>>Shader Linking error" && false);
     }
 
+    _reflect();
+
     // Cleanup
     glDeleteShader(compute_id);
 }
 
 
 
+void sShader::_reflect() {
+    uniform_count = 0;
+
+    int active_uniforms = 0;
+    glGetProgramiv(ID,
+                   GL_ACTIVE_UNIFORMS,
+                   &active_uniforms);
+    for(int i = 0; i < active_uniforms; i++) {
+        char name[SHADER_UNIFORM_NAME_SIZE];
+        GLsizei name_length = 0;
+        GLint size = 0;
+        GLenum type = 0;
+        glGetActiveUniform(ID,
+                           i,
+                           SHADER_UNIFORM_NAME_SIZE,
+                           &name_length,
+                           &size,
+                           &type,
+                           name);
+        assert(name_length < SHADER_UNIFORM_NAME_SIZE - 1 && "Uniform name too long for the cache");
+
+        // The members of the blocks have no location
+        const int32_t location = glGetUniformLocation(ID,
+                                                      name);
+        if (location < 0) {
+            continue;
+        }
+
+        // The arrays are named name[0]
+        char *array_start = strchr(name, '[');
+        if (array_start != NULL) {
+            *array_start = '\0';
+        }
+
+        assert(uniform_count < SHADER_MAX_UNIFORMS && "No more space for the uniforms of the shader");
+        sShaderUniform &uniform = uniforms[uniform_count++];
+        memcpy(uniform.name,
+               name,
+               SHADER_UNIFORM_NAME_SIZE);
+        uniform.name_hash = hash_uniform_name(uniform.name);
+        uniform.location = location;
+        uniform.has_int_value = false;
+    }
+
+    for(uint8_t block = 0; block < UNIFORM_BLOCK_COUNT; block++) {
+        block_indices[block] = glGetUniformBlockIndex(ID,
+                                                      uniform_block_names[block]);
+        if (block_indices[block] != GL_INVALID_INDEX) {
+            glUniformBlockBinding(ID,
+                                  block_indices[block],
+                                  block);
+        }
+    }
+}
+
+sShaderUniform* sShader::_find_uniform(const char* name) const {
+    const uint32_t name_hash = hash_uniform_name(name);
+    for(uint8_t i = 0; i < uniform_count; i++) {
+        if (uniforms[i].name_hash == name_hash && strcmp(uniforms[i].name, name) == 0) {
+            return &uniforms[i];
+        }
+    }
+    return NULL;
+}
+
+int32_t sShader::get_uniform_location(const char* name) const {
+    const sShaderUniform *uniform = _find_uniform(name);
+    return (uniform != NULL) ? uniform->location : -1;
+}
+
+void sShader::_set_int(const char* name,
+                       const int value) const {
+    sShaderUniform *uniform = _find_uniform(name);
+    if (uniform == NULL || (uniform->has_int_value && uniform->int_value == value)) {
+        return;
+    }
+
+    uniform->has_int_value = true;
+    uniform->int_value = value;
+    glUniform1i(uniform->location, value);
+    GLStats::add_calls();
+}
+
 void sShader::activate() const {
     glUseProgram(ID);
+    GLStats::add_calls();
 }
 
 void sShader::deactivate() const {
@@ -243,53 +344,101 @@ void sShader::dispatch(const uint32_t dispatch_x,
 
 void sShader::set_uniform(const char* name,
                         const float value) const {
-    glUniform1f(glGetUniformLocation(ID, name), value);
-
+    const int32_t location = get_uniform_location(name);
+    if (location < 0) {
+        return;
+    }
+    glUniform1f(location, value);
+    GLStats::add_calls();
 }
+
 void sShader::set_uniform(const char* name,
                         const int value) const {
-    glUniform1i(glGetUniformLocation(ID, name), value);
+    _set_int(name, value);
 }
 
 void sShader::set_uniform(const char* name,
                         const bool value) const {
-    glUniform1i(glGetUniformLocation(ID, name), (int) value);
+    _set_int(name, (int) value);
 }
 
 void sShader::set_uniform_vector2D(const char*     name,
                                    const float     value[2]) const {
-    glUniform4fv(glGetUniformLocation(ID, name), 1, value);
+    const int32_t location = get_uniform_location(name);
+    if (location < 0) {
+        return;
+    }
+    glUniform4fv(location, 1, value);
+    GLStats::add_calls();
 }
 
 void sShader::set_uniform_vector(const char* name,
                         const float value[4]) const {
-    glUniform4fv(glGetUniformLocation(ID, name), 1, value);
+    const int32_t location = get_uniform_location(name);
+    if (location < 0) {
+        return;
+    }
+    glUniform4fv(location, 1, value);
+    GLStats::add_calls();
 }
 
 void sShader::set_uniform_vector(const char* name, const glm::vec4 &value) const {
-    glUniform4fv(glGetUniformLocation(ID, name), 1, &value.x);
+    const int32_t location = get_uniform_location(name);
+    if (location < 0) {
+        return;
+    }
+    glUniform4fv(location, 1, &value.x);
+    GLStats::add_calls();
 }
 
 void sShader::set_uniform_vector(const char* name, const glm::vec3 &value) const {
-    glUniform3fv(glGetUniformLocation(ID, name), 1, &value.x);
+    const int32_t location = get_uniform_location(name);
+    if (location < 0) {
+        return;
+    }
+    glUniform3fv(location, 1, &value.x);
+    GLStats::add_calls();
+}
+
+void sShader::set_uniform_vector_array(const char* name, const glm::vec3 *values, const uint32_t count) const {
+    const int32_t location = get_uniform_location(name);
+    if (location < 0) {
+        return;
+    }
+    glUniform3fv(location, count, &values[0].x);
+    GLStats::add_calls();
 }
 
 
 void sShader::set_uniform_matrix3(const char* name,
                                   const glm::mat3x3 &matrix) const {
-    glUniformMatrix3fv(glGetUniformLocation(ID, name), 1, false, (float*) &matrix);
+    const int32_t location = get_uniform_location(name);
+    if (location < 0) {
+        return;
+    }
+    glUniformMatrix3fv(location, 1, false, (float*) &matrix);
+    GLStats::add_calls();
 }
 
 void sShader::set_uniform_matrix4(const char* name, const glm::mat4x4 &matrix) const {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, false, glm::value_ptr(matrix));
+    const int32_t location = get_uniform_location(name);
+    if (location < 0) {
+        return;
+    }
+    glUniformMatrix4fv(location, 1, false, glm::value_ptr(matrix));
+    GLStats::add_calls();
 }
 
 void sShader::set_uniform_matrix4(const char* name, const float* matrix) const {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, false, matrix);
+    const int32_t location = get_uniform_location(name);
+    if (location < 0) {
+        return;
+    }
+    glUniformMatrix4fv(location, 1, false, matrix);
+    GLStats::add_calls();
 }
 
-#include <iostream>
 void sShader::set_uniform_texture(const char* name,
                                   const int tex_spot) const {
-    glUniform1i(glGetUniformLocation(ID, name), tex_spot);
+    _set_int(name, tex_spot);
 }
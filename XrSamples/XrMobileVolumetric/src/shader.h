@@ -15,10 +15,41 @@
 #include <stddef.h>
 #include <cassert>
 #include <stdio.h>
+#include <cstdint>
 
+#define SHADER_MAX_UNIFORMS 32
+#define SHADER_UNIFORM_NAME_SIZE 32
+
+// std140 blocks that every shader can declare (see RawShaders), on fixed binding points
+enum eUniformBlock : uint8_t {
+    UNIFORM_BLOCK_FRAME = 0,
+    UNIFORM_BLOCK_VIEW,
+    UNIFORM_BLOCK_DRAW,
+    UNIFORM_BLOCK_COUNT
+};
+
+const char uniform_block_names[UNIFORM_BLOCK_COUNT][11] = {
+    "FrameBlock",
+    "ViewBlock",
+    "DrawBlock"
+};
+
+struct sShaderUniform {
+    char     name[SHADER_UNIFORM_NAME_SIZE];
+    uint32_t name_hash;
+    int32_t  location;
+
+    // Last int (or sampler unit) set, the program keeps it between draws
+    bool     has_int_value;
+    int32_t  int_value;
+};
 
 /**
  * Basic OpenGL Shader Class, for shader's IO boilerplate
+ * On link, the locations of the active uniforms are cached, and the uniform
+ * blocks are bound to their eUniformBlock binding point; so the setters never
+ * query GL, and skip the uniforms that the program does not use, and the ints
+ * & samplers that did not change.
  * Juan S. Marquerie
 */
 struct sShader {
@@ -26,6 +57,10 @@ struct sShader {
 
     bool is_compute = false;
 
+    uint8_t         uniform_count = 0;
+    mutable sShaderUniform uniforms[SHADER_MAX_UNIFORMS];
+    uint32_t        block_indices[UNIFORM_BLOCK_COUNT] = {GL_INVALID_INDEX, GL_INVALID_INDEX, GL_INVALID_INDEX}; // GL_INVALID_INDEX if not used
+
     sShader() {};
     sShader(const char* vertex_shader, const char* fragment_shader);
 
@@ -48,11 +83,26 @@ struct sShader {
     void set_uniform_vector(const char* name, const float value[4]) const;
     void set_uniform_vector(const char* name, const glm::vec4 &value) const;
     void set_uniform_vector(const char* name, const glm::vec3 &value) const;
+    void set_uniform_vector_array(const char* name, const glm::vec3 *values, const uint32_t count) const;
     void set_uniform_matrix3(const char* name, const glm::mat3x3 &matrix) const;
     void set_uniform_matrix4(const char* name, const glm::mat4x4 &matrix) const;
     void set_uniform_matrix4(const char* name, const float* matrix) const;
     // Samplers / textures
     void set_uniform_texture(const char* name, const int tex_name) const;
+
+    inline bool uses_uniform_block(const eUniformBlock block) const {
+        return block_indices[block] != GL_INVALID_INDEX;
+    }
+
+    // -1 if the program does not use it
+    int32_t get_uniform_location(const char* name) const;
+
+    // Caches the uniforms & binds the blocks, after linking
+    void _reflect();
+    // NULL if the program does not use it
+    sShaderUniform* _find_uniform(const char* name) const;
+    // Ints, bools & samplers; only if the value changed
+    void _set_int(const char* name, const int value) const;
 };
 
 
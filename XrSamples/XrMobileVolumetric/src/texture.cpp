@@ -10,6 +10,14 @@
 
 #include <stb_image.h>
 #include <cstdlib>
+#include <atomic>
+
+#include "parallel_for.h"
+
+#ifndef __EMSCRIPTEN__
+#include <android/log.h>
+#include "mapped_file.h"
+#endif
 
 void upload_simple_texture_to_GPU(sTexture *text);
 
@@ -105,6 +113,30 @@ void sTexture::load(const eTextureType text_type,
     width = w;
     height = h;
 
+    _upload_decoded(text_type);
+}
+
+void sTexture::load_from_memory(const eTextureType text_type,
+                                const uint8_t *encoded_data,
+                                const size_t encoded_size) {
+    store_on_RAM = false;
+    type = text_type;
+
+    int w = 0, h = 0, l = 0;
+    raw_data = (char*) stbi_load_from_memory(encoded_data,
+                                             (int) encoded_size,
+                                             &w,
+                                             &h,
+                                             &l,
+                                             0);
+    width = w;
+    height = h;
+
+    _upload_decoded(text_type);
+}
+
+void sTexture::_upload_decoded(const eTextureType text_type) {
+    const int w = width, h = height;
     assert(raw_data != NULL && "Uploading empty texture to GPU");
 
     glGenTextures(1, &texture_id);
@@ -149,6 +181,48 @@ void sTexture::load(const eTextureType text_type,
     //stbi_image_free(text->raw_data);
 }
 
+void sTexture::load2D_baked(const sDerivedBlob &blob) {
+    const uint32_t level_count = blob.count_sections(DERIVED_TEXTURE_2D);
+    const sDerivedSection *base_level = blob.find_section(DERIVED_TEXTURE_2D, 0);
+    assert(base_level != NULL && base_level->gl_format == GL_RGBA8 && "The baked entry is not an RGBA8 texture");
+
+    store_on_RAM = false;
+    type = STANDART_2D;
+    width = base_level->dims[0];
+    height = base_level->dims[1];
+
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D, texture_id);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, (level_count > 1) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glTexStorage2D(GL_TEXTURE_2D,
+                   level_count,
+                   GL_RGBA8,
+                   width,
+                   height);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for(uint32_t level = 0; level < level_count; level++) {
+        const sDerivedSection *section = blob.find_section(DERIVED_TEXTURE_2D, level);
+        assert(section != NULL && "The baked texture is missing a level");
+        glTexSubImage2D(GL_TEXTURE_2D,
+                        level,
+                        0,
+                        0,
+                        section->dims[0],
+                        section->dims[1],
+                        GL_RGBA,
+                        GL_UNSIGNED_BYTE,
+                        blob.get_section_data(section));
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
 
 void sTexture::load3D_monochrome(const char* texture_name,
                                  const uint16_t width_i,
@@ -162,82 +236,618 @@ void sTexture::load3D_monochrome(const char* texture_name,
     //text->raw_data = stbi_load(texture_name, &w, &h, &l, 0);
 
 #ifndef __EMSCRIPTEN__
-    FILE *file = fopen(texture_name,
-                            "rb");
-
-    // Get total filesize
-    fseek(file,
-          0,
-          SEEK_END);
-    uint32_t file_size = ftell(file);
-    fseek(file,
-          0,
-          SEEK_SET);
-
-    raw_data = (char*) malloc(file_size + 1);
-    //raw_data[file_size] = '\0';
-
-    fread(raw_data,
-          file_size,
-          1,
-          file);
-    fclose(file);
+    // Map the volume instead of reading it to the heap: the driver copies
+    // directly from the page cache on the upload
+    sMappedFile volume_file = {};
+    if (!volume_file.open(texture_name)) {
+        __android_log_print(ANDROID_LOG_ERROR,
+                            "Texture",
+                            "Cannot map volume %s",
+                            texture_name);
+        assert(false && "Cannot open volume file");
+        return;
+    }
+
+    const size_t volume_size = (size_t) width * height * depth * VOLUME_BYTES_PER_VOXEL;
+    if (volume_file.size < volume_size) {
+        __android_log_print(ANDROID_LOG_ERROR,
+                            "Texture",
+                            "Volume %s is %zu bytes, expected %zu (%ix%ix%i)",
+                            texture_name,
+                            volume_file.size,
+                            volume_size,
+                            width,
+                            height,
+                            depth);
+        volume_file.close();
+        assert(false && "Volume file is smaller than its dimensions");
+        return;
+    }
+
+    volume_file.advise_sequential_read();
+
+    const char *volume_data = volume_file.data;
 #else
     raw_data = emscripten_get_preloaded_image_data(texture_name, &w, &h);
     l = 4;
+    const char *volume_data = raw_data;
 #endif
 
+    load3D_from_memory((const uint8_t*) volume_data,
+                       width,
+                       height,
+                       depth);
 
+#ifndef __EMSCRIPTEN__
+    // The driver has its own copy now
+    volume_file.close();
+#endif
 
-    assert(raw_data != NULL && "Uploading empty texture to GPU");
+    //stbi_image_free(text->raw_data);
+}
+
+void sTexture::load3D_from_memory(const uint8_t *volume_data,
+                                  const uint32_t width_i,
+                                  const uint32_t heigth_i,
+                                  const uint32_t depth_i) {
+    assert(volume_data != NULL && "Uploading empty texture to GPU");
 
+    create_empty_volume_storage(width_i,
+                                heigth_i,
+                                depth_i);
+
+    glBindTexture(GL_TEXTURE_3D, texture_id);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    glTexSubImage3D(GL_TEXTURE_3D,
+                    0,
+                    0,
+                    0,
+                    0,
+                    width,
+                    height,
+                    depth,
+                    GL_RED,
+                    GL_UNSIGNED_BYTE,
+                    volume_data);
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    // Empty space skipping structures
+    sVolumeAcceleration acceleration = {};
+    const uint32_t volume_dims[3] = {(uint32_t) width, (uint32_t) height, (uint32_t) depth};
+    acceleration.build(volume_data,
+                       volume_dims,
+                       distance_field_threshold,
+                       0);
+    upload_acceleration(acceleration);
+    acceleration.clean();
+}
+
+void sTexture::load3D_bricked(const sBrickedVolume &volume,
+                              const sBrickRegion &region,
+                              const float empty_threshold) {
+    assert(volume.header->voxel_type == VOXEL_UINT8 && "Only 8 bit bricked volumes can be uploaded");
+
+    const sBrickedVolumeHeader &header = *volume.header;
+    const uint32_t volume_dims[3] = {header.width, header.height, header.depth};
+
+    // Size in voxels of the region
+    uint32_t region_origin[3], region_size[3];
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        assert(region.min[axis] < region.max[axis] && region.max[axis] <= header.brick_count[axis] && "Invalid brick region");
+        region_origin[axis] = region.min[axis] * header.brick_size;
+        uint32_t region_end = region.max[axis] * header.brick_size;
+        region_end = (region_end > volume_dims[axis]) ? volume_dims[axis] : region_end;
+        region_size[axis] = region_end - region_origin[axis];
+    }
+
+    // The region is the staging area of the upload: the bricks are decoded
+    // straight into it, in parallel, and the skipped ones stay as zeroes
+    const size_t region_row = region_size[0];
+    const size_t region_slice = region_row * region_size[1];
+    uint8_t *region_data = (uint8_t*) calloc(region_slice * region_size[2],
+                                             1);
+
+    const uint32_t region_bricks[3] = {region.max[0] - region.min[0],
+                                       region.max[1] - region.min[1],
+                                       region.max[2] - region.min[2]};
+    const uint32_t region_brick_count = region_bricks[0] * region_bricks[1] * region_bricks[2];
+    std::atomic<uint32_t> loaded_bricks{0}, skipped_bricks{0}, corrupt_bricks{0};
+
+    Parallel::for_range(0, region_brick_count, 0, [&](const uint32_t start, const uint32_t end) {
+        // The compressed bricks are decoded here, and then copied row by row
+        uint8_t *decoded = (uint8_t*) malloc((size_t) header.brick_size * header.brick_size * header.brick_size);
+
+        for(uint32_t i = start; i < end; i++) {
+            const uint32_t brick_index = volume.get_brick_index(region.min[0] + i % region_bricks[0],
+                                                                region.min[1] + (i / region_bricks[0]) % region_bricks[1],
+                                                                region.min[2] + i / (region_bricks[0] * region_bricks[1]));
+            if (volume.is_brick_empty(brick_index, empty_threshold)) {
+                skipped_bricks.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            uint32_t origin[3], size[3];
+            volume.get_brick_extent(brick_index,
+                                    origin,
+                                    size);
+
+            const uint8_t *brick_data = (const uint8_t*) volume.get_brick_data(brick_index);
+            if (brick_data == NULL) {
+                if (!volume.decode_brick(brick_index, decoded)) {
+                    corrupt_bricks.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+                brick_data = decoded;
+            }
+
+            for(uint32_t z = 0; z < size[2]; z++) {
+                for(uint32_t y = 0; y < size[1]; y++) {
+                    memcpy(region_data + (origin[2] - region_origin[2] + z) * region_slice + (origin[1] - region_origin[1] + y) * region_row + (origin[0] - region_origin[0]),
+                           brick_data + ((size_t) z * size[1] + y) * size[0],
+                           size[0]);
+                }
+            }
+            loaded_bricks.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        free(decoded);
+    });
+
+    create_empty_volume_storage(region_size[0],
+                                region_size[1],
+                                region_size[2]);
+
+    glBindTexture(GL_TEXTURE_3D, texture_id);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    glTexSubImage3D(GL_TEXTURE_3D,
+                    0,
+                    0,
+                    0,
+                    0,
+                    region_size[0],
+                    region_size[1],
+                    region_size[2],
+                    GL_RED,
+                    GL_UNSIGNED_BYTE,
+                    region_data);
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    __android_log_print((corrupt_bricks.load() > 0) ? ANDROID_LOG_ERROR : ANDROID_LOG_VERBOSE,
+                        "Texture",
+                        "Bricked volume %ix%ix%i: %u bricks loaded, %u empty, %u corrupt",
+                        width,
+                        height,
+                        depth,
+                        loaded_bricks.load(),
+                        skipped_bricks.load(),
+                        corrupt_bricks.load());
+
+    sVolumeAcceleration acceleration = {};
+    acceleration.build(region_data,
+                       region_size,
+                       distance_field_threshold,
+                       0);
+    upload_acceleration(acceleration);
+    acceleration.clean();
+
+    free(region_data);
+}
+
+void sTexture::load3D_sparse(const sBrickAtlas &atlas) {
+    store_on_RAM = false;
+    type = VOLUME;
+    is_sparse = true;
+    width = atlas.volume_dims[0];
+    height = atlas.volume_dims[1];
+    depth = atlas.volume_dims[2];
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Atlas: no mips, the bricks would bleed into each other
     glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_3D, texture_id);
+
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glTexStorage3D(GL_TEXTURE_3D,
+                   1,
+                   GL_R8,
+                   atlas.atlas_dims[0],
+                   atlas.atlas_dims[1],
+                   atlas.atlas_dims[2]);
+    glTexSubImage3D(GL_TEXTURE_3D,
+                    0,
+                    0,
+                    0,
+                    0,
+                    atlas.atlas_dims[0],
+                    atlas.atlas_dims[1],
+                    atlas.atlas_dims[2],
+                    GL_RED,
+                    GL_UNSIGNED_BYTE,
+                    atlas.atlas);
+
+    // Page table
+    glGenTextures(1, &page_table_id);
+    glBindTexture(GL_TEXTURE_3D, page_table_id);
 
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glTexStorage3D(GL_TEXTURE_3D,
+                   1,
+                   GL_RGBA8,
+                   atlas.brick_count[0],
+                   atlas.brick_count[1],
+                   atlas.brick_count[2]);
+    glTexSubImage3D(GL_TEXTURE_3D,
+                    0,
+                    0,
+                    0,
+                    0,
+                    atlas.brick_count[0],
+                    atlas.brick_count[1],
+                    atlas.brick_count[2],
+                    GL_RGBA,
+                    GL_UNSIGNED_BYTE,
+                    atlas.page_table);
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    const size_t dense_size = (size_t) width * height * depth;
+    const size_t sparse_size = atlas.get_atlas_size() + (size_t) atlas.get_total_bricks() * 4;
+    __android_log_print(ANDROID_LOG_VERBOSE,
+                        "Texture",
+                        "Sparse volume %ix%ix%i: %u of %u bricks resident, %zu bytes instead of %zu (%.1fx)",
+                        width,
+                        height,
+                        depth,
+                        atlas.resident_bricks,
+                        atlas.get_total_bricks(),
+                        sparse_size,
+                        dense_size,
+                        (double) dense_size / sparse_size);
+}
+
+void sTexture::load3D_compressed(const sEacVolume &volume) {
+    store_on_RAM = false;
+    type = VOLUME;
+    is_compressed = true;
+    width = volume.dims[0];
+    height = volume.dims[1];
+    depth = volume.dims[2];
+
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture_id);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY,
+                   1,
+                   GL_COMPRESSED_R11_EAC,
+                   width,
+                   height,
+                   depth);
+
+    // All the slices are contiguous, on a single call
+    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY,
+                              0,
+                              0,
+                              0,
+                              0,
+                              width,
+                              height,
+                              depth,
+                              GL_COMPRESSED_R11_EAC,
+                              (GLsizei) volume.get_size(),
+                              volume.blocks);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // The structures have to bound the decoded voxels, not the source ones
+    uint8_t *decoded = (uint8_t*) malloc((size_t) width * height * depth);
+    EacCodec::decompress_volume(volume,
+                                0,
+                                decoded);
+
+    sMinMaxGrid grid = {};
+    MinMaxGrid::build(decoded,
+                      volume.dims,
+                      MINMAX_GRID_CELL_SIZE,
+                      0,
+                      &grid);
+    upload_minmax_grid(grid);
+    grid.clean();
+
+    sDistanceField field = {};
+    DistanceField::build(decoded,
+                         volume.dims,
+                         distance_field_threshold,
+                         0,
+                         &field);
+    upload_distance_field(field);
+    field.clean();
+
+    free(decoded);
+
+    const size_t dense_size = (size_t) width * height * depth;
+    __android_log_print(ANDROID_LOG_VERBOSE,
+                        "Texture",
+                        "EAC R11 volume %ix%ix%i: %zu bytes instead of %zu",
+                        width,
+                        height,
+                        depth,
+                        volume.get_size(),
+                        dense_size);
+}
+
+void sTexture::load3D_quantized(const sQuantizedVolume &volume) {
+    create_empty_volume_storage(volume.dims[0],
+                                volume.dims[1],
+                                volume.dims[2]);
 
     glBindTexture(GL_TEXTURE_3D, texture_id);
 
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    glTexSubImage3D(GL_TEXTURE_3D,
+                    0,
+                    0,
+                    0,
+                    0,
+                    width,
+                    height,
+                    depth,
+                    GL_RED,
+                    GL_UNSIGNED_BYTE,
+                    volume.voxels);
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    // The mips & the structures are on the window, as the shaders see the
+    // densities after dequantizing
+    const uint8_t *windowed = volume.voxels;
+    uint8_t *dequantized = NULL;
+    if (volume.brick_ranges != NULL) {
+        dequantized = (uint8_t*) malloc(volume.get_voxel_count());
+        VolumeQuantize::dequantize_to_window(volume,
+                                             0,
+                                             dequantized);
+        windowed = dequantized;
+
+        glGenTextures(1, &brick_range_id);
+        glBindTexture(GL_TEXTURE_3D, brick_range_id);
+
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        glTexStorage3D(GL_TEXTURE_3D,
+                       1,
+                       GL_RG32F,
+                       volume.brick_counts[0],
+                       volume.brick_counts[1],
+                       volume.brick_counts[2]);
+        glTexSubImage3D(GL_TEXTURE_3D,
+                        0,
+                        0,
+                        0,
+                        0,
+                        volume.brick_counts[0],
+                        volume.brick_counts[1],
+                        volume.brick_counts[2],
+                        GL_RG,
+                        GL_FLOAT,
+                        volume.brick_ranges);
+
+        glBindTexture(GL_TEXTURE_3D, 0);
+        brick_range_size = volume.brick_size;
+    }
+
+    sVolumeAcceleration acceleration = {};
+    acceleration.build(windowed,
+                       volume.dims,
+                       distance_field_threshold,
+                       0);
+    upload_acceleration(acceleration);
+    acceleration.clean();
+
+    free(dequantized);
+
+    __android_log_print(ANDROID_LOG_VERBOSE,
+                        "Texture",
+                        "Quantized volume %ix%ix%i, window [%f, %f], %u bricks with their own range",
+                        width,
+                        height,
+                        depth,
+                        volume.window[0],
+                        volume.window[1],
+                        (volume.brick_ranges != NULL) ? volume.get_brick_count() : 0);
+}
+
+void sTexture::create_empty_volume_storage(const uint32_t w,
+                                           const uint32_t h,
+                                           const uint32_t d) {
+    store_on_RAM = false;
+    type = VOLUME;
+    width = w;
+    height = h;
+    depth = d;
+
+    glGenTextures(1, &texture_id);
+    glBindTexture(GL_TEXTURE_3D, texture_id);
+
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_MIRRORED_REPEAT);
 
+    mip_count = VolumeMips::get_mip_count(width, height, depth);
+    glTexStorage3D(GL_TEXTURE_3D,
+                   mip_count,
+                   GL_R8,
+                   width,
+                   height,
+                   depth);
+
+    // The mips are sampled with explicit levels, on the empty space skipping
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void sTexture::set_resident_level(const uint8_t level) {
+    resident_level = level;
+
+    glBindTexture(GL_TEXTURE_3D, texture_id);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, level);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void sTexture::upload_volume_mips(const sVolumeMipChain &chain) {
+    glBindTexture(GL_TEXTURE_3D, texture_id);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for(uint32_t i = 0; i < chain.level_count; i++) {
+        glTexSubImage3D(GL_TEXTURE_3D,
+                        chain.first_level + i,
+                        0,
+                        0,
+                        0,
+                        chain.dims[i][0],
+                        chain.dims[i][1],
+                        chain.dims[i][2],
+                        GL_RED,
+                        GL_UNSIGNED_BYTE,
+                        chain.levels[i]);
+    }
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void sTexture::upload_minmax_grid(const sMinMaxGrid &grid) {
+    if (minmax_grid_id == 0) {
+        glGenTextures(1, &minmax_grid_id);
+    }
+    glBindTexture(GL_TEXTURE_3D, minmax_grid_id);
+
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // Read with texelFetch, a cell at a time
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
     glTexImage3D(GL_TEXTURE_3D,
                  0,
-                 GL_R8,
-                 width,
-                 height,
-                 depth,
+                 GL_RG8,
+                 grid.dims[0],
+                 grid.dims[1],
+                 grid.dims[2],
                  0,
-                 GL_RED,
+                 GL_RG,
                  GL_UNSIGNED_BYTE,
-                 raw_data);
+                 grid.cells);
 
-    glGenerateMipmap(GL_TEXTURE_3D);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
 
+void sTexture::upload_distance_field(const sDistanceField &field) {
+    if (distance_field_id == 0) {
+        glGenTextures(1, &distance_field_id);
+    }
+    glBindTexture(GL_TEXTURE_3D, distance_field_id);
 
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // Interpolated distances are not safe to step by
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    glTexImage3D(GL_TEXTURE_3D,
+                 0,
+                 GL_R8,
+                 field.dims[0],
+                 field.dims[1],
+                 field.dims[2],
+                 0,
+                 GL_RED,
+                 GL_UNSIGNED_BYTE,
+                 field.distances);
 
     glBindTexture(GL_TEXTURE_3D, 0);
 
-    //stbi_image_free(text->raw_data);
+    distance_field_threshold = field.threshold;
+}
+
+void sTexture::upload_acceleration(const sVolumeAcceleration &acceleration) {
+    upload_volume_mips(acceleration.mip_chain);
+    upload_minmax_grid(acceleration.minmax_grid);
+    upload_distance_field(acceleration.distance_field);
 }
 
+struct sTargetGLFormat {
+    uint32_t internal_format;
+    uint32_t format;
+    uint32_t type;
+    bool     is_filterable;
+};
+
+// Of eRenderTargetFormat
+static const sTargetGLFormat target_gl_formats[TARGET_FORMAT_COUNT] = {
+    {GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, true},
+    {GL_RGB10_A2, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, true},
+    {GL_R11F_G11F_B10F, GL_RGB, GL_UNSIGNED_INT_10F_11F_11F_REV, true},
+    {GL_RG16F, GL_RG, GL_HALF_FLOAT, true},
+    {GL_R32F, GL_RED, GL_FLOAT, false},
+    {GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, true}
+};
+
 void sTexture::create_empty2D_with_size(const uint32_t w,
-                                      const uint32_t h) {
+                                        const uint32_t h,
+                                        const eRenderTargetFormat format) {
+    const sTargetGLFormat &gl_format = target_gl_formats[format];
+    target_format = format;
+
     glGenTextures(1, &texture_id);
     glBindTexture(GL_TEXTURE_2D, texture_id);
 
     glTexImage2D(GL_TEXTURE_2D,
                  0,
-                 GL_RGBA32F,
+                 gl_format.internal_format,
                  w, h,
                  0,
-                 GL_RGBA,
-                 GL_FLOAT,
+                 gl_format.format,
+                 gl_format.type,
                  NULL);
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    const uint32_t filter = (gl_format.is_filterable) ? GL_LINEAR : GL_NEAREST;
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
@@ -245,7 +855,21 @@ void sTexture::create_empty2D_with_size(const uint32_t w,
 }
 
 void sTexture::load_sphere_volume(const uint16_t size) {
-        //free(raw_data);
+    // A single sphere on the center, of half the volume
+    sProceduralVolumeDesc desc = {};
+    desc.shape = PROCEDURAL_SPHERES;
+    desc.dims[0] = desc.dims[1] = desc.dims[2] = size;
+    desc.occupancy = 0.5f;
+    desc.frequency = 1.0f;
+
+    uint8_t *volume = ProceduralVolume::generate(desc,
+                                                 0);
+    assert(volume != NULL && "Cannot allocate the sphere volume");
+    load3D_from_memory(volume,
+                       size,
+                       size,
+                       size);
+    free(volume);
 }
 
 void sTexture::clean() {
@@ -254,6 +878,22 @@ void sTexture::clean() {
     }
 
     glDeleteTextures(1, &texture_id);
+    if (minmax_grid_id != 0) {
+        glDeleteTextures(1, &minmax_grid_id);
+        minmax_grid_id = 0;
+    }
+    if (distance_field_id != 0) {
+        glDeleteTextures(1, &distance_field_id);
+        distance_field_id = 0;
+    }
+    if (page_table_id != 0) {
+        glDeleteTextures(1, &page_table_id);
+        page_table_id = 0;
+    }
+    if (brick_range_id != 0) {
+        glDeleteTextures(1, &brick_range_id);
+        brick_range_id = 0;
+    }
 }
 
 void sTexture::load_empty_volume() {
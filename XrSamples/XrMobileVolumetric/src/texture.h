@@ -8,7 +8,17 @@
 #include <cstdlib>
 //#include <stb_image.h>
 
+#include "bricked_volume.h"
+#include "volume_acceleration.h"
+#include "brick_atlas.h"
+#include "eac_codec.h"
+#include "volume_quantize.h"
+#include "procedural_volume.h"
+#include "render_target_format.h"
+
 #define DEFAULT_TEXT_FIDELITY 0
+#define VOLUME_BYTES_PER_VOXEL 1 // GL_R8 volumes
+#define VOLUME_NO_RESIDENT_LEVEL 0xFF
 
 enum eTextureType : uint8_t {
    STANDART_2D = 0,
@@ -27,21 +37,122 @@ struct sTexture {
     int             layers    = 0;
     char            *raw_data = NULL;
 
+    // False while the texture is being streamed
+    bool            is_loaded = true;
+    float           load_progress = 1.0f; // [0, 1]
+
+    // Progressive loads: the finest mip level uploaded so far; the base level
+    // of the texture is clamped to it, so the shaders sample what is resident
+    // while the finer ones stream. VOLUME_NO_RESIDENT_LEVEL while there is
+    // none, or when the texture is not loaded progressively
+    uint8_t         resident_level = VOLUME_NO_RESIDENT_LEVEL;
+    uint8_t         mip_count = 1; // Levels allocated on texture_id
+
     // OpenGL id
     unsigned int     texture_id;
+    unsigned int     minmax_grid_id = 0; // RG8 3D texture, only on volumes
+    unsigned int     distance_field_id = 0; // R8 3D texture, only on volumes
+    float            distance_field_threshold = DISTANCE_FIELD_DEFAULT_THRESHOLD;
+
+    // Sparse volumes: texture_id is the brick atlas, and width, height & depth
+    // are the ones of the whole volume
+    bool             is_sparse = false;
+    unsigned int     page_table_id = 0; // RGBA8 3D texture
+
+    // EAC R11 volumes: texture_id is a GL_TEXTURE_2D_ARRAY of the z slices,
+    // that the shaders interpolate between by hand
+    bool             is_compressed = false;
+
+    // Per brick quantized volumes: texture_id holds each brick on its own
+    // range, that the shaders take back to the window with its scale & offset
+    unsigned int     brick_range_id = 0; // RG32F 3D texture: scale, offset per brick
+    uint32_t         brick_range_size = 0; // Voxels per brick side
+
+    // Out-of-core volumes: texture_id is the brick cache of the residency,
+    // and the page table points to the finest level resident of each brick
+    bool             is_streamed = false;
+    uint8_t          residency_id = 0;
+
+    // Time-varying volumes: texture_id is swapped each frame to the texture of
+    // the timestep on screen, and is_loaded is false until the first one
+    bool             is_sequence = false;
+    uint8_t          sequence_id = 0;
+
+    // Render targets: the format of create_empty2D_with_size
+    eRenderTargetFormat target_format = TARGET_RGBA8;
 
     void create_empty2D_with_size(const uint32_t width,
-                                const uint32_t height);
+                                  const uint32_t height,
+                                  const eRenderTargetFormat format);
 
     void load(const eTextureType text_type,
               const bool store_on_RAM,
               const char *texture_name);
 
+    // Decodes an image file (png, jpg...) that is already on memory
+    void load_from_memory(const eTextureType text_type,
+                          const uint8_t *encoded_data,
+                          const size_t encoded_size);
+
+    // RGBA8 2D texture with all its levels pre-built, from a baked entry
+    // (DERIVED_TEXTURE_2D sections); no decoding, nor mip generation
+    void load2D_baked(const sDerivedBlob &blob);
+
     void load3D_monochrome(const char *texture_name,
                            const uint16_t width,
                            const uint16_t heigth,
                            const uint16_t depth);
 
+    // GL_R8 volume that is already on memory (generated, decoded...), with its structures
+    void load3D_from_memory(const uint8_t *volume_data,
+                            const uint32_t width,
+                            const uint32_t heigth,
+                            const uint32_t depth);
+
+    // Uploads a region of a bricked volume; the bricks that are empty, or whose
+    // max is under empty_threshold, are not read from disk
+    void load3D_bricked(const sBrickedVolume &volume,
+                        const sBrickRegion &region,
+                        const float empty_threshold);
+
+    // Uploads the atlas & the page table of a sparse volume
+    void load3D_sparse(const sBrickAtlas &atlas);
+
+    /**
+     * Uploads the slices of an EAC R11 volume, as the layers of a 2D array,
+     * without mips; the min/max grid & the distance field are built from
+     * decoded, the voxels that the GPU samples
+     * */
+    void load3D_compressed(const sEacVolume &volume);
+
+    /**
+     * Uploads a volume quantized from 16 bits or floats; the per brick ones
+     * also upload their ranges, and their structures are built on the window
+     * */
+    void load3D_quantized(const sQuantizedVolume &volume);
+
+    // Immutable GL_R8 storage with the full mip chain, without data
+    void create_empty_volume_storage(const uint32_t width,
+                                     const uint32_t height,
+                                     const uint32_t depth);
+
+    inline bool is_sampleable() const {
+        return is_loaded || resident_level != VOLUME_NO_RESIDENT_LEVEL;
+    }
+
+    // Clamps the base level of the volume to level, that has to be complete
+    void set_resident_level(const uint8_t level);
+
+    // Uploads the max-filtered levels over level 0, instead of glGenerateMipmap
+    void upload_volume_mips(const sVolumeMipChain &chain);
+
+    void upload_minmax_grid(const sMinMaxGrid &grid);
+
+    void upload_distance_field(const sDistanceField &field);
+
+    // Mips, min/max grid & distance field
+    void upload_acceleration(const sVolumeAcceleration &acceleration);
+
     // Loads the texture configuration to opengl
     void config(const uint32_t texture_type,
                 const bool generate_mipmaps);
@@ -53,6 +164,9 @@ struct sTexture {
     void load_empty_2D();
 
     void clean();
+
+    // Uploads the image on raw_data, of width x height
+    void _upload_decoded(const eTextureType text_type);
 };
 
 
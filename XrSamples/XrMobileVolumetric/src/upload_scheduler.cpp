@@ -0,0 +1,113 @@
+#include "upload_scheduler.h"
+
+#include <GLES3/gl3.h>
+#include <cstdlib>
+#include <cstring>
+
+#include "egl_context.h"
+
+#define MIN_SAMPLE_BYTES (64 * 1024) // Smaller uploads are dominated by the overhead
+#define ESTIMATE_SMOOTHING 0.2
+
+void sUploadScheduler::init() {
+    glGenQueriesEXT_(UPLOAD_QUERY_COUNT,
+                     time_queries);
+    queries_created = true;
+}
+
+void sUploadScheduler::destroy() {
+    if (queries_created) {
+        glDeleteQueriesEXT_(UPLOAD_QUERY_COUNT,
+                            time_queries);
+        queries_created = false;
+    }
+}
+
+void sUploadScheduler::begin_frame(const bool disjoint_occurred) {
+    frame_bytes = 0;
+    frame_uploads = 0;
+    frame_untimed = false;
+    frame_start = std::chrono::steady_clock::now();
+
+    if (!queries_created) {
+        return;
+    }
+
+    _read_finished_queries(disjoint_occurred);
+
+    // If the oldest query is still in flight, this frame is not timed
+    if (!query_pending[curr_query]) {
+        glBeginQueryEXT_(GL_TIME_ELAPSED_EXT,
+                         time_queries[curr_query]);
+    }
+}
+
+void sUploadScheduler::end_frame() {
+    last_frame_upload_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+    total_uploaded_bytes += frame_bytes;
+
+    if (!queries_created || query_pending[curr_query]) {
+        return;
+    }
+
+    glEndQueryEXT_(GL_TIME_ELAPSED_EXT);
+
+    query_bytes[curr_query] = frame_bytes;
+    query_untimed[curr_query] = frame_untimed;
+    query_pending[curr_query] = true;
+    curr_query = (curr_query + 1) % UPLOAD_QUERY_COUNT;
+}
+
+bool sUploadScheduler::can_upload(const size_t bytes) const {
+    if (frame_uploads == 0) {
+        return true;
+    }
+
+    const double predicted_ms = ((frame_bytes + bytes) * ns_per_byte) / 1000000.0;
+    const double cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_start).count();
+
+    return predicted_ms <= frame_budget_ms && cpu_ms <= frame_budget_ms;
+}
+
+void sUploadScheduler::add_upload(const size_t bytes) {
+    frame_bytes += bytes;
+    frame_uploads++;
+}
+
+void sUploadScheduler::add_untimed_work() {
+    frame_untimed = true;
+}
+
+void sUploadScheduler::_read_finished_queries(const bool disjoint_occurred) {
+    if (disjoint_occurred) {
+        memset(query_pending, 0, sizeof(query_pending));
+        return;
+    }
+
+    for(uint8_t i = 0; i < UPLOAD_QUERY_COUNT; i++) {
+        if (!query_pending[i]) {
+            continue;
+        }
+
+        int available = 0;
+        glGetQueryObjectivEXT_(time_queries[i],
+                               GL_QUERY_RESULT_AVAILABLE,
+                               &available);
+        if (!available) {
+            continue;
+        }
+
+        uint64_t elapsed_ns = 0;
+        glGetQueryObjectui64vEXT_(time_queries[i],
+                                  GL_QUERY_RESULT,
+                                  &elapsed_ns);
+        query_pending[i] = false;
+
+        if (query_untimed[i] || query_bytes[i] < MIN_SAMPLE_BYTES) {
+            continue;
+        }
+
+        const double sample = (double) elapsed_ns / query_bytes[i];
+        ns_per_byte = (1.0 - ESTIMATE_SMOOTHING) * ns_per_byte + ESTIMATE_SMOOTHING * sample;
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef UPLOAD_SCHEDULER_H_
+#define UPLOAD_SCHEDULER_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+
+#define UPLOAD_QUERY_COUNT 4 // Frames of latency for the GPU timings
+#define UPLOAD_DEFAULT_BUDGET_MS 2.0
+#define UPLOAD_DEFAULT_NS_PER_BYTE 0.5 // ~2 GB/s, until there are measures
+
+/**
+ * Per frame budget for the texture uploads
+ * Each frame, the uploads are wrapped on a GL_TIME_ELAPSED_EXT query; when the
+ * results come back (some frames later, without waiting on them) they update
+ * the estimated cost per byte. Before each upload, the uploaders ask if it
+ * fits on what is left of the frame budget.
+ * At least one upload is allowed each frame, so the loads always progress.
+ * Frames that also do other GPU work on the window (like building the
+ * acceleration structures of a finished volume) are not used as samples.
+ * */
+struct sUploadScheduler {
+    double      frame_budget_ms = UPLOAD_DEFAULT_BUDGET_MS;
+    double      ns_per_byte = UPLOAD_DEFAULT_NS_PER_BYTE;
+
+    // GPU time queries
+    bool        queries_created = false;
+    uint32_t    time_queries[UPLOAD_QUERY_COUNT];
+    size_t      query_bytes[UPLOAD_QUERY_COUNT];
+    bool        query_pending[UPLOAD_QUERY_COUNT] = {};
+    bool        query_untimed[UPLOAD_QUERY_COUNT] = {};
+    uint8_t     curr_query = 0;
+
+    // Current frame
+    size_t      frame_bytes = 0;
+    uint32_t    frame_uploads = 0;
+    bool        frame_untimed = false;
+    std::chrono::steady_clock::time_point frame_start;
+
+    // Stats
+    double      last_frame_upload_ms = 0.0;
+    uint64_t    total_uploaded_bytes = 0;
+
+    void init();
+    void destroy();
+
+    // Starts the upload window of the frame, on the GL thread; on a GPU
+    // disjoint (GL_GPU_DISJOINT_EXT, read once per frame by the caller) the
+    // results in flight are dropped
+    void begin_frame(const bool disjoint_occurred);
+    void end_frame();
+
+    // If an upload of that size fits on the remaining budget of the frame
+    bool can_upload(const size_t bytes) const;
+    void add_upload(const size_t bytes);
+    // GPU work on the window that is not a texture upload; the frame is
+    // left out of the estimate
+    void add_untimed_work();
+
+    inline void set_budget(const double budget_ms) {
+        frame_budget_ms = budget_ms;
+    }
+
+    void _read_finished_queries(const bool disjoint_occurred);
+};
+
+#endif // UPLOAD_SCHEDULER_H_
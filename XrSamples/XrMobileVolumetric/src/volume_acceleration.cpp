@@ -0,0 +1,99 @@
+#include "volume_acceleration.h"
+
+#include <cstring>
+
+// The internal formats of the uploads, without the GL headers
+#define FORMAT_R8 0x8229
+#define FORMAT_RG8 0x822B
+
+void sVolumeAcceleration::build(const uint8_t *volume,
+                                const uint32_t volume_dims[3],
+                                const float distance_field_threshold,
+                                const uint32_t thread_count) {
+    VolumeMips::build_max_chain(volume,
+                                volume_dims,
+                                false,
+                                thread_count,
+                                &mip_chain);
+    MinMaxGrid::build(volume,
+                      volume_dims,
+                      MINMAX_GRID_CELL_SIZE,
+                      thread_count,
+                      &minmax_grid);
+    DistanceField::build(volume,
+                         volume_dims,
+                         distance_field_threshold,
+                         thread_count,
+                         &distance_field);
+}
+
+void sVolumeAcceleration::add_to_blob(sDerivedBlobWriter *writer) const {
+    for(uint32_t i = 0; i < mip_chain.level_count; i++) {
+        writer->add_section(DERIVED_MAX_MIP,
+                            mip_chain.first_level + i,
+                            mip_chain.dims[i],
+                            FORMAT_R8,
+                            mip_chain.levels[i],
+                            mip_chain.get_level_size(i));
+    }
+    writer->add_section(DERIVED_MINMAX_GRID,
+                        0,
+                        minmax_grid.dims,
+                        FORMAT_RG8,
+                        minmax_grid.cells,
+                        minmax_grid.get_cell_count() * 2,
+                        (float) minmax_grid.cell_size);
+    writer->add_section(DERIVED_DISTANCE_FIELD,
+                        0,
+                        distance_field.dims,
+                        FORMAT_R8,
+                        distance_field.distances,
+                        distance_field.get_voxel_count(),
+                        distance_field.threshold);
+}
+
+bool sVolumeAcceleration::load_from_blob(const sDerivedBlob &blob) {
+    clean();
+
+    const sDerivedSection *section = NULL;
+    for(uint32_t i = 0; i < blob.header.section_count; i++) {
+        section = &blob.header.sections[i];
+        if (section->type == DERIVED_MINMAX_GRID) {
+            minmax_grid.cell_size = (uint32_t) section->value;
+            memcpy(minmax_grid.dims, section->dims, sizeof(minmax_grid.dims));
+            minmax_grid.cells = (uint8_t*) blob.get_section_data(section);
+        } else if (section->type == DERIVED_DISTANCE_FIELD) {
+            distance_field.threshold = section->value;
+            memcpy(distance_field.dims, section->dims, sizeof(distance_field.dims));
+            distance_field.distances = (uint8_t*) blob.get_section_data(section);
+        } else if (section->type == DERIVED_MAX_MIP && mip_chain.level_count < VOLUME_MAX_MIP_LEVELS) {
+            // Stored in order, from the finest
+            const uint32_t level = mip_chain.level_count++;
+            mip_chain.first_level = (level == 0) ? section->level : mip_chain.first_level;
+            memcpy(mip_chain.dims[level], section->dims, sizeof(mip_chain.dims[level]));
+            mip_chain.levels[level] = (uint8_t*) blob.get_section_data(section);
+        }
+    }
+    is_mapped = true;
+
+    if (minmax_grid.cells == NULL || distance_field.distances == NULL || mip_chain.level_count == 0) {
+        clean();
+        return false;
+    }
+    return true;
+}
+
+void sVolumeAcceleration::clean() {
+    if (is_mapped) {
+        // The entry is closed by its owner
+        mip_chain = {};
+        minmax_grid = {};
+        distance_field = {};
+        is_mapped = false;
+        return;
+    }
+
+    mip_chain.clean();
+    minmax_grid.clean();
+    distance_field.clean();
+}
@@ -0,0 +1,49 @@
+#ifndef VOLUME_ACCELERATION_H_
+#define VOLUME_ACCELERATION_H_
+
+#include <cstdint>
+
+#include "volume_mips.h"
+#include "minmax_grid.h"
+#include "distance_field.h"
+#include "derived_cache.h"
+
+/**
+ * CPU side of the empty space skipping structures of a volume: the max mips,
+ * the min/max grid and the distance field. The build does not touch GL, so
+ * it can run on a loader thread, and be uploaded later with
+ * sTexture::upload_acceleration.
+ * They can also be stored on the derived cache, and loaded back from it
+ * without building them; then they point into the mapped entry.
+ * */
+
+// What the structures depend on, besides the volume; part of the cache key
+struct sAccelerationParams {
+    uint32_t    volume_dims[3] = {0, 0, 0};
+    uint32_t    minmax_cell_size = MINMAX_GRID_CELL_SIZE;
+    float       distance_field_threshold = DISTANCE_FIELD_DEFAULT_THRESHOLD;
+};
+
+struct sVolumeAcceleration {
+    sVolumeMipChain mip_chain = {};
+    sMinMaxGrid     minmax_grid = {};
+    sDistanceField  distance_field = {};
+
+    // Points into a derived cache entry, that owns the data
+    bool            is_mapped = false;
+
+    void build(const uint8_t *volume,
+               const uint32_t volume_dims[3],
+               const float distance_field_threshold,
+               const uint32_t thread_count);
+
+    // Adds the structures as sections of a cache entry
+    void add_to_blob(sDerivedBlobWriter *writer) const;
+
+    // Points the structures to the sections of an entry; false if any is missing
+    bool load_from_blob(const sDerivedBlob &blob);
+
+    void clean();
+};
+
+#endif // VOLUME_ACCELERATION_H_
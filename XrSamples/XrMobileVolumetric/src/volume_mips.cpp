@@ -0,0 +1,294 @@
+#include "volume_mips.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "parallel_for.h"
+
+#if defined(__ARM_NEON) && !defined(VOLUME_MIPS_NO_SIMD)
+#include <arm_neon.h>
+#define VOLUME_MIPS_NEON 1
+#elif defined(__SSE2__) && !defined(VOLUME_MIPS_NO_SIMD)
+#include <emmintrin.h>
+#define VOLUME_MIPS_SSE2 1
+#endif
+
+// SIMD KERNELS ===================
+// out[i] = max(a[i], b[i]), out can be a or b
+inline void max_rows(const uint8_t *a,
+                     const uint8_t *b,
+                     uint8_t *out,
+                     const size_t count) {
+    size_t i = 0;
+#if defined(VOLUME_MIPS_NEON)
+    for(; i + 16 <= count; i += 16) {
+        vst1q_u8(out + i, vmaxq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+    }
+#elif defined(VOLUME_MIPS_SSE2)
+    for(; i + 16 <= count; i += 16) {
+        const __m128i va = _mm_loadu_si128((const __m128i*) (a + i));
+        const __m128i vb = _mm_loadu_si128((const __m128i*) (b + i));
+        _mm_storeu_si128((__m128i*) (out + i), _mm_max_epu8(va, vb));
+    }
+#endif
+    for(; i < count; i++) {
+        out[i] = (a[i] > b[i]) ? a[i] : b[i];
+    }
+}
+
+// out[i] = max(in[2i], in[2i + 1]); the last one also takes in[2i + 2] if in_count is odd
+inline void max_pairs(const uint8_t *in,
+                      const size_t in_count,
+                      uint8_t *out,
+                      const size_t out_count) {
+    size_t i = 0;
+    if (in_count > 1) {
+        // Only the full pairs, the tail is done by hand
+        const size_t pair_count = (in_count / 2 < out_count) ? in_count / 2 : out_count;
+#if defined(VOLUME_MIPS_NEON)
+        for(; i + 16 <= pair_count; i += 16) {
+            const uint8x16x2_t pairs = vld2q_u8(in + i * 2);
+            vst1q_u8(out + i, vmaxq_u8(pairs.val[0], pairs.val[1]));
+        }
+#elif defined(VOLUME_MIPS_SSE2)
+        const __m128i low_mask = _mm_set1_epi16(0x00FF);
+        for(; i + 16 <= pair_count; i += 16) {
+            const __m128i v0 = _mm_loadu_si128((const __m128i*) (in + i * 2));
+            const __m128i v1 = _mm_loadu_si128((const __m128i*) (in + i * 2 + 16));
+            // Max of each byte with its odd neighbour, on the low byte of each 16 bit lane
+            const __m128i m0 = _mm_and_si128(_mm_max_epu8(v0, _mm_srli_epi16(v0, 8)), low_mask);
+            const __m128i m1 = _mm_and_si128(_mm_max_epu8(v1, _mm_srli_epi16(v1, 8)), low_mask);
+            _mm_storeu_si128((__m128i*) (out + i), _mm_packus_epi16(m0, m1));
+        }
+#endif
+        for(; i < pair_count; i++) {
+            out[i] = (in[i * 2] > in[i * 2 + 1]) ? in[i * 2] : in[i * 2 + 1];
+        }
+    } else {
+        out[0] = in[0];
+    }
+
+    if (in_count > 1 && (in_count % 2) == 1) {
+        const uint8_t last = in[in_count - 1];
+        out[out_count - 1] = (out[out_count - 1] > last) ? out[out_count - 1] : last;
+    }
+}
+
+// CHAIN ===================
+void sVolumeMipChain::clean() {
+    for(uint32_t i = 0; i < level_count; i++) {
+        free(levels[i]);
+        levels[i] = NULL;
+    }
+    level_count = 0;
+}
+
+uint32_t VolumeMips::get_mip_count(const uint32_t width,
+                                   const uint32_t height,
+                                   const uint32_t depth) {
+    uint32_t max_side = (width > height) ? width : height;
+    max_side = (max_side > depth) ? max_side : depth;
+
+    uint32_t count = 1;
+    while (max_side > 1) {
+        max_side >>= 1;
+        count++;
+    }
+    return count;
+}
+
+// Source rows (or slices) that are reduced into the out index i
+inline uint32_t get_source_indices(const uint32_t i,
+                                   const uint32_t src_size,
+                                   const uint32_t dst_size,
+                                   uint32_t indices[3]) {
+    if (src_size == 1) {
+        indices[0] = 0;
+        return 1;
+    }
+
+    uint32_t count = 0;
+    indices[count++] = i * 2;
+    indices[count++] = i * 2 + 1;
+    // The odd one at the end goes to the last texel
+    if (i == dst_size - 1 && (src_size % 2) == 1) {
+        indices[count++] = i * 2 + 2;
+    }
+    return count;
+}
+
+void VolumeMips::reduce_max(const uint8_t *src,
+                            const uint32_t src_dims[3],
+                            uint8_t *dst,
+                            const uint32_t dst_z_start,
+                            const uint32_t dst_z_end,
+                            const uint32_t thread_count) {
+    const uint32_t dst_dims[3] = {
+        get_next_level_size(src_dims[0]),
+        get_next_level_size(src_dims[1]),
+        get_next_level_size(src_dims[2])
+    };
+    const size_t src_row = src_dims[0];
+    const size_t src_slice = src_row * src_dims[1];
+    const size_t dst_row = dst_dims[0];
+    const size_t dst_slice = dst_row * dst_dims[1];
+
+    Parallel::for_range(dst_z_start,
+                        dst_z_end,
+                        thread_count,
+                        [&](const uint32_t z_start, const uint32_t z_end) {
+        uint8_t *row_max = (uint8_t*) malloc(src_row);
+
+        for(uint32_t z = z_start; z < z_end; z++) {
+            uint32_t src_z[3];
+            const uint32_t src_z_count = get_source_indices(z, src_dims[2], dst_dims[2], src_z);
+
+            for(uint32_t y = 0; y < dst_dims[1]; y++) {
+                uint32_t src_y[3];
+                const uint32_t src_y_count = get_source_indices(y, src_dims[1], dst_dims[1], src_y);
+
+                // Max of all the source rows, then of the pairs on x
+                memcpy(row_max,
+                       src + src_z[0] * src_slice + src_y[0] * src_row,
+                       src_row);
+                for(uint32_t iz = 0; iz < src_z_count; iz++) {
+                    for(uint32_t iy = 0; iy < src_y_count; iy++) {
+                        if (iz == 0 && iy == 0) {
+                            continue;
+                        }
+                        max_rows(row_max,
+                                 src + src_z[iz] * src_slice + src_y[iy] * src_row,
+                                 row_max,
+                                 src_row);
+                    }
+                }
+
+                max_pairs(row_max,
+                          src_row,
+                          dst + z * dst_slice + y * dst_row,
+                          dst_row);
+            }
+        }
+
+        free(row_max);
+    });
+}
+
+void VolumeMips::dilate_max(const uint8_t *src,
+                            const uint32_t dims[3],
+                            uint8_t *dst,
+                            const uint32_t thread_count) {
+    const size_t row = dims[0];
+    const size_t slice = row * dims[1];
+    uint8_t *tmp_x = (uint8_t*) malloc(slice * dims[2]);
+    uint8_t *tmp_y = (uint8_t*) malloc(slice * dims[2]);
+
+    // X: on each row, max with the left and right neighbours
+    Parallel::for_range(0, dims[2], thread_count, [&](const uint32_t z_start, const uint32_t z_end) {
+        for(uint32_t z = z_start; z < z_end; z++) {
+            for(uint32_t y = 0; y < dims[1]; y++) {
+                const uint8_t *in = src + z * slice + y * row;
+                uint8_t *out = tmp_x + z * slice + y * row;
+                if (row == 1) {
+                    out[0] = in[0];
+                    continue;
+                }
+                out[0] = (in[0] > in[1]) ? in[0] : in[1];
+                out[row - 1] = (in[row - 1] > in[row - 2]) ? in[row - 1] : in[row - 2];
+                max_rows(in, in + 1, out + 1, row - 2);
+                max_rows(out + 1, in + 2, out + 1, row - 2);
+            }
+        }
+    });
+
+    // Y: max of each row with the previous and next
+    Parallel::for_range(0, dims[2], thread_count, [&](const uint32_t z_start, const uint32_t z_end) {
+        for(uint32_t z = z_start; z < z_end; z++) {
+            for(uint32_t y = 0; y < dims[1]; y++) {
+                const uint8_t *in = tmp_x + z * slice;
+                uint8_t *out = tmp_y + z * slice + y * row;
+                memcpy(out, in + y * row, row);
+                if (y > 0) {
+                    max_rows(out, in + (y - 1) * row, out, row);
+                }
+                if (y + 1 < dims[1]) {
+                    max_rows(out, in + (y + 1) * row, out, row);
+                }
+            }
+        }
+    });
+
+    // Z: max of each slice with the previous and next
+    Parallel::for_range(0, dims[2], thread_count, [&](const uint32_t z_start, const uint32_t z_end) {
+        for(uint32_t z = z_start; z < z_end; z++) {
+            uint8_t *out = dst + z * slice;
+            memcpy(out, tmp_y + z * slice, slice);
+            if (z > 0) {
+                max_rows(out, tmp_y + (z - 1) * slice, out, slice);
+            }
+            if (z + 1 < dims[2]) {
+                max_rows(out, tmp_y + (z + 1) * slice, out, slice);
+            }
+        }
+    });
+
+    free(tmp_x);
+    free(tmp_y);
+}
+
+void VolumeMips::build_max_chain(const uint8_t *base,
+                                 const uint32_t base_dims[3],
+                                 const bool base_is_mip,
+                                 const uint32_t thread_count,
+                                 sVolumeMipChain *chain) {
+    chain->clean();
+    chain->first_level = 1;
+
+    // The reductions are done over the non dilated levels
+    const uint8_t *prev_level = base;
+    uint32_t prev_dims[3] = {base_dims[0], base_dims[1], base_dims[2]};
+    uint8_t *reduced = NULL;
+
+    if (base_is_mip) {
+        chain->dims[0][0] = base_dims[0];
+        chain->dims[0][1] = base_dims[1];
+        chain->dims[0][2] = base_dims[2];
+        chain->levels[0] = (uint8_t*) malloc(chain->get_level_size(0));
+        dilate_max(base,
+                   base_dims,
+                   chain->levels[0],
+                   thread_count);
+        chain->level_count = 1;
+    }
+
+    while ((prev_dims[0] > 1 || prev_dims[1] > 1 || prev_dims[2] > 1) &&
+           chain->level_count < VOLUME_MAX_MIP_LEVELS) {
+        const uint32_t level = chain->level_count;
+        uint32_t *dims = chain->dims[level];
+        dims[0] = get_next_level_size(prev_dims[0]);
+        dims[1] = get_next_level_size(prev_dims[1]);
+        dims[2] = get_next_level_size(prev_dims[2]);
+
+        uint8_t *next_reduced = (uint8_t*) malloc(chain->get_level_size(level));
+        reduce_max(prev_level,
+                   prev_dims,
+                   next_reduced,
+                   0,
+                   dims[2],
+                   thread_count);
+
+        chain->levels[level] = (uint8_t*) malloc(chain->get_level_size(level));
+        dilate_max(next_reduced,
+                   dims,
+                   chain->levels[level],
+                   thread_count);
+        chain->level_count++;
+
+        free(reduced);
+        reduced = next_reduced;
+        prev_level = reduced;
+        memcpy(prev_dims, dims, sizeof(prev_dims));
+    }
+
+    free(reduced);
+}
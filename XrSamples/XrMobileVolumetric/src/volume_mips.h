@@ -0,0 +1,74 @@
+#ifndef VOLUME_MIPS_H_
+#define VOLUME_MIPS_H_
+
+#include <cstdint>
+#include <cstddef>
+
+#define VOLUME_MAX_MIP_LEVELS 16
+
+/**
+ * Conservative mip pyramid for empty space skipping
+ * Each texel of level L+1 is the max of the 2x2x2 texels of level L that it
+ * covers (3 on the last one, when the size is odd), instead of the average
+ * that glGenerateMipmap does; so thin features never fade away on the coarse
+ * levels.
+ * After the reduction each level is dilated by one texel (3x3x3 max), so a
+ * trilinear sample anywhere inside a texel is still >= the max of the voxels
+ * under it. That way the skipper can start on the coarsest level, and trust
+ * any sample under the threshold as empty.
+ * */
+struct sVolumeMipChain {
+    uint32_t    level_count = 0;
+    uint32_t    first_level = 1; // GL mip level of levels[0]
+    uint32_t    dims[VOLUME_MAX_MIP_LEVELS][3] = {};
+    uint8_t     *levels[VOLUME_MAX_MIP_LEVELS] = {};
+
+    inline size_t get_level_size(const uint32_t level) const {
+        return (size_t) dims[level][0] * dims[level][1] * dims[level][2];
+    }
+
+    void clean();
+};
+
+namespace VolumeMips {
+    inline uint32_t get_next_level_size(const uint32_t size) {
+        return (size > 1) ? size / 2 : 1;
+    }
+
+    // Number of levels of a full chain, level 0 included
+    uint32_t get_mip_count(const uint32_t width,
+                           const uint32_t height,
+                           const uint32_t depth);
+
+    /**
+     * Max-reduces the z slices [dst_z_start, dst_z_end) of the next level of src.
+     * dst holds the whole next level.
+     * */
+    void reduce_max(const uint8_t *src,
+                    const uint32_t src_dims[3],
+                    uint8_t *dst,
+                    const uint32_t dst_z_start,
+                    const uint32_t dst_z_end,
+                    const uint32_t thread_count);
+
+    // One texel 3x3x3 max dilation, src and dst must not overlap
+    void dilate_max(const uint8_t *src,
+                    const uint32_t dims[3],
+                    uint8_t *dst,
+                    const uint32_t thread_count);
+
+    /**
+     * Builds the chain of max levels over base, until 1x1x1.
+     * If base_is_mip, base is an already reduced (and not dilated) level 1,
+     * and it is included on the chain; else its level 0 and the chain starts
+     * on level 1.
+     * thread_count == 0 uses all the cores.
+     * */
+    void build_max_chain(const uint8_t *base,
+                         const uint32_t base_dims[3],
+                         const bool base_is_mip,
+                         const uint32_t thread_count,
+                         sVolumeMipChain *chain);
+};
+
+#endif // VOLUME_MIPS_H_
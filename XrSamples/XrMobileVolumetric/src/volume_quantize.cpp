@@ -0,0 +1,446 @@
+#include "volume_quantize.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <cfloat>
+#include <mutex>
+
+#include "parallel_for.h"
+
+#if defined(__ARM_NEON) && !defined(VOLUME_QUANTIZE_NO_SIMD)
+#include <arm_neon.h>
+#define VOLUME_QUANTIZE_NEON 1
+#elif defined(__SSE2__) && !defined(VOLUME_QUANTIZE_NO_SIMD)
+#include <emmintrin.h>
+#define VOLUME_QUANTIZE_SSE2 1
+#endif
+
+// Voxels per job of the histogram
+#define QUANTIZE_HISTOGRAM_CHUNK (1 << 18)
+
+// SIMD KERNELS ===================
+// Widens the min & max of the count values of row to range
+inline void get_row_range_u16(const uint16_t *row,
+                              const size_t count,
+                              float range[2]) {
+    uint32_t min_value = UINT16_MAX, max_value = 0;
+    size_t i = 0;
+#if defined(VOLUME_QUANTIZE_NEON)
+    if (count >= 8) {
+        uint16x8_t v_min = vdupq_n_u16(UINT16_MAX), v_max = vdupq_n_u16(0);
+        for(; i + 8 <= count; i += 8) {
+            const uint16x8_t values = vld1q_u16(row + i);
+            v_min = vminq_u16(v_min, values);
+            v_max = vmaxq_u16(v_max, values);
+        }
+        min_value = vminvq_u16(v_min);
+        max_value = vmaxvq_u16(v_max);
+    }
+#elif defined(VOLUME_QUANTIZE_SSE2)
+    if (count >= 8) {
+        // SSE2 only has signed 16 bit min & max: flip the sign bit, and back
+        const __m128i sign = _mm_set1_epi16((int16_t) 0x8000);
+        __m128i v_min = _mm_set1_epi16(INT16_MAX), v_max = _mm_set1_epi16(INT16_MIN);
+        for(; i + 8 <= count; i += 8) {
+            const __m128i values = _mm_xor_si128(_mm_loadu_si128((const __m128i*) (row + i)), sign);
+            v_min = _mm_min_epi16(v_min, values);
+            v_max = _mm_max_epi16(v_max, values);
+        }
+        uint16_t mins[8], maxs[8];
+        _mm_storeu_si128((__m128i*) mins, _mm_xor_si128(v_min, sign));
+        _mm_storeu_si128((__m128i*) maxs, _mm_xor_si128(v_max, sign));
+        for(uint32_t j = 0; j < 8; j++) {
+            min_value = (mins[j] < min_value) ? mins[j] : min_value;
+            max_value = (maxs[j] > max_value) ? maxs[j] : max_value;
+        }
+    }
+#endif
+    for(; i < count; i++) {
+        min_value = (row[i] < min_value) ? row[i] : min_value;
+        max_value = (row[i] > max_value) ? row[i] : max_value;
+    }
+    if (count > 0) {
+        range[0] = ((float) min_value < range[0]) ? (float) min_value : range[0];
+        range[1] = ((float) max_value > range[1]) ? (float) max_value : range[1];
+    }
+}
+
+inline void get_row_range_f32(const float *row,
+                              const size_t count,
+                              float range[2]) {
+    float min_value = range[0], max_value = range[1];
+    size_t i = 0;
+#if defined(VOLUME_QUANTIZE_NEON)
+    if (count >= 4) {
+        float32x4_t v_min = vdupq_n_f32(min_value), v_max = vdupq_n_f32(max_value);
+        for(; i + 4 <= count; i += 4) {
+            const float32x4_t values = vld1q_f32(row + i);
+            v_min = vminq_f32(v_min, values);
+            v_max = vmaxq_f32(v_max, values);
+        }
+        min_value = vminvq_f32(v_min);
+        max_value = vmaxvq_f32(v_max);
+    }
+#elif defined(VOLUME_QUANTIZE_SSE2)
+    if (count >= 4) {
+        __m128 v_min = _mm_set1_ps(min_value), v_max = _mm_set1_ps(max_value);
+        for(; i + 4 <= count; i += 4) {
+            const __m128 values = _mm_loadu_ps(row + i);
+            v_min = _mm_min_ps(v_min, values);
+            v_max = _mm_max_ps(v_max, values);
+        }
+        float mins[4], maxs[4];
+        _mm_storeu_ps(mins, v_min);
+        _mm_storeu_ps(maxs, v_max);
+        for(uint32_t j = 0; j < 4; j++) {
+            min_value = (mins[j] < min_value) ? mins[j] : min_value;
+            max_value = (maxs[j] > max_value) ? maxs[j] : max_value;
+        }
+    }
+#endif
+    for(; i < count; i++) {
+        min_value = (row[i] < min_value) ? row[i] : min_value;
+        max_value = (row[i] > max_value) ? row[i] : max_value;
+    }
+    range[0] = min_value;
+    range[1] = max_value;
+}
+
+inline void get_row_range(const void *row,
+                          const eQuantizeSource source,
+                          const size_t count,
+                          float range[2]) {
+    if (source == QUANTIZE_SOURCE_UINT16) {
+        get_row_range_u16((const uint16_t*) row, count, range);
+    } else {
+        get_row_range_f32((const float*) row, count, range);
+    }
+}
+
+// result[i] = clamp(row[i] * scale + bias, 0.5, 255.5), truncated; so it rounds
+// to the nearest after the clamp
+inline void quantize_row_u16(const uint16_t *row,
+                             const size_t count,
+                             const float scale,
+                             const float bias,
+                             uint8_t *result) {
+    size_t i = 0;
+#if defined(VOLUME_QUANTIZE_NEON)
+    const float32x4_t v_scale = vdupq_n_f32(scale), v_bias = vdupq_n_f32(bias);
+    const float32x4_t v_low = vdupq_n_f32(0.5f), v_high = vdupq_n_f32(255.5f);
+    for(; i + 8 <= count; i += 8) {
+        const uint16x8_t values = vld1q_u16(row + i);
+        float32x4_t low = vcvtq_f32_u32(vmovl_u16(vget_low_u16(values)));
+        float32x4_t high = vcvtq_f32_u32(vmovl_u16(vget_high_u16(values)));
+        low = vminq_f32(vmaxq_f32(vmlaq_f32(v_bias, low, v_scale), v_low), v_high);
+        high = vminq_f32(vmaxq_f32(vmlaq_f32(v_bias, high, v_scale), v_low), v_high);
+        const uint16x8_t narrow = vcombine_u16(vmovn_u32(vcvtq_u32_f32(low)), vmovn_u32(vcvtq_u32_f32(high)));
+        vst1_u8(result + i, vmovn_u16(narrow));
+    }
+#elif defined(VOLUME_QUANTIZE_SSE2)
+    const __m128 v_scale = _mm_set1_ps(scale), v_bias = _mm_set1_ps(bias);
+    const __m128 v_low = _mm_set1_ps(0.5f), v_high = _mm_set1_ps(255.5f);
+    const __m128i zero = _mm_setzero_si128();
+    for(; i + 8 <= count; i += 8) {
+        const __m128i values = _mm_loadu_si128((const __m128i*) (row + i));
+        __m128 low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(values, zero));
+        __m128 high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(values, zero));
+        low = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(low, v_scale), v_bias), v_low), v_high);
+        high = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(high, v_scale), v_bias), v_low), v_high);
+        const __m128i narrow = _mm_packs_epi32(_mm_cvttps_epi32(low), _mm_cvttps_epi32(high));
+        _mm_storel_epi64((__m128i*) (result + i), _mm_packus_epi16(narrow, narrow));
+    }
+#endif
+    for(; i < count; i++) {
+        float value = row[i] * scale + bias;
+        value = (value < 0.5f) ? 0.5f : ((value > 255.5f) ? 255.5f : value);
+        result[i] = (uint8_t) value;
+    }
+}
+
+inline void quantize_row_f32(const float *row,
+                             const size_t count,
+                             const float scale,
+                             const float bias,
+                             uint8_t *result) {
+    size_t i = 0;
+#if defined(VOLUME_QUANTIZE_NEON)
+    const float32x4_t v_scale = vdupq_n_f32(scale), v_bias = vdupq_n_f32(bias);
+    const float32x4_t v_low = vdupq_n_f32(0.5f), v_high = vdupq_n_f32(255.5f);
+    for(; i + 8 <= count; i += 8) {
+        float32x4_t low = vld1q_f32(row + i);
+        float32x4_t high = vld1q_f32(row + i + 4);
+        low = vminq_f32(vmaxq_f32(vmlaq_f32(v_bias, low, v_scale), v_low), v_high);
+        high = vminq_f32(vmaxq_f32(vmlaq_f32(v_bias, high, v_scale), v_low), v_high);
+        const uint16x8_t narrow = vcombine_u16(vmovn_u32(vcvtq_u32_f32(low)), vmovn_u32(vcvtq_u32_f32(high)));
+        vst1_u8(result + i, vmovn_u16(narrow));
+    }
+#elif defined(VOLUME_QUANTIZE_SSE2)
+    const __m128 v_scale = _mm_set1_ps(scale), v_bias = _mm_set1_ps(bias);
+    const __m128 v_low = _mm_set1_ps(0.5f), v_high = _mm_set1_ps(255.5f);
+    for(; i + 8 <= count; i += 8) {
+        __m128 low = _mm_loadu_ps(row + i);
+        __m128 high = _mm_loadu_ps(row + i + 4);
+        low = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(low, v_scale), v_bias), v_low), v_high);
+        high = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(high, v_scale), v_bias), v_low), v_high);
+        const __m128i narrow = _mm_packs_epi32(_mm_cvttps_epi32(low), _mm_cvttps_epi32(high));
+        _mm_storel_epi64((__m128i*) (result + i), _mm_packus_epi16(narrow, narrow));
+    }
+#endif
+    for(; i < count; i++) {
+        float value = row[i] * scale + bias;
+        value = (value < 0.5f) ? 0.5f : ((value > 255.5f) ? 255.5f : value);
+        result[i] = (uint8_t) value;
+    }
+}
+
+// HISTOGRAM ===================
+void VolumeQuantize::build_histogram(const void *data,
+                                     const eQuantizeSource source,
+                                     const size_t voxel_count,
+                                     const uint32_t thread_count,
+                                     sVolumeHistogram *histogram) {
+    const uint32_t source_size = get_quantize_source_size(source);
+    const uint8_t *voxels = (const uint8_t*) data;
+    const uint32_t chunk_count = (uint32_t) ((voxel_count + QUANTIZE_HISTOGRAM_CHUNK - 1) / QUANTIZE_HISTOGRAM_CHUNK);
+    std::mutex merge_mutex;
+
+    // Range first, so the bins can span it
+    float range[2] = {FLT_MAX, -FLT_MAX};
+    Parallel::for_range(0, chunk_count, thread_count, [&](const uint32_t chunk_start, const uint32_t chunk_end) {
+        const size_t start = (size_t) chunk_start * QUANTIZE_HISTOGRAM_CHUNK;
+        const size_t end = ((size_t) chunk_end * QUANTIZE_HISTOGRAM_CHUNK < voxel_count) ? (size_t) chunk_end * QUANTIZE_HISTOGRAM_CHUNK : voxel_count;
+        float local_range[2] = {FLT_MAX, -FLT_MAX};
+        get_row_range(voxels + start * source_size, source, end - start, local_range);
+
+        std::lock_guard<std::mutex> lock(merge_mutex);
+        range[0] = (local_range[0] < range[0]) ? local_range[0] : range[0];
+        range[1] = (local_range[1] > range[1]) ? local_range[1] : range[1];
+    });
+
+    memset(histogram->bins, 0, sizeof(histogram->bins));
+    histogram->voxel_count = voxel_count;
+    histogram->min_value = (voxel_count > 0) ? range[0] : 0.0f;
+    histogram->max_value = (voxel_count > 0) ? range[1] : 0.0f;
+
+    const float bin_scale = (histogram->max_value > histogram->min_value) ? QUANTIZE_HISTOGRAM_BINS / (histogram->max_value - histogram->min_value) : 0.0f;
+    const float min_value = histogram->min_value;
+
+    Parallel::for_range(0, chunk_count, thread_count, [&](const uint32_t chunk_start, const uint32_t chunk_end) {
+        uint64_t *bins = (uint64_t*) calloc(QUANTIZE_HISTOGRAM_BINS, sizeof(uint64_t));
+        const size_t start = (size_t) chunk_start * QUANTIZE_HISTOGRAM_CHUNK;
+        const size_t end = ((size_t) chunk_end * QUANTIZE_HISTOGRAM_CHUNK < voxel_count) ? (size_t) chunk_end * QUANTIZE_HISTOGRAM_CHUNK : voxel_count;
+
+        for(size_t i = start; i < end; i++) {
+            const float value = (source == QUANTIZE_SOURCE_UINT16) ? (float) ((const uint16_t*) data)[i] : ((const float*) data)[i];
+            const uint32_t bin = (uint32_t) ((value - min_value) * bin_scale);
+            bins[(bin < QUANTIZE_HISTOGRAM_BINS) ? bin : QUANTIZE_HISTOGRAM_BINS - 1]++;
+        }
+
+        std::lock_guard<std::mutex> lock(merge_mutex);
+        for(uint32_t bin = 0; bin < QUANTIZE_HISTOGRAM_BINS; bin++) {
+            histogram->bins[bin] += bins[bin];
+        }
+        free(bins);
+    });
+}
+
+void VolumeQuantize::get_auto_window(const sVolumeHistogram &histogram,
+                                     const float low_percentile,
+                                     const float high_percentile,
+                                     float window[2]) {
+    const uint64_t low_count = (uint64_t) (low_percentile * histogram.voxel_count);
+    const uint64_t high_count = (uint64_t) (high_percentile * histogram.voxel_count);
+
+    uint32_t low_bin = 0, high_bin = QUANTIZE_HISTOGRAM_BINS - 1;
+    uint64_t accumulated = 0;
+    bool low_found = false;
+    for(uint32_t bin = 0; bin < QUANTIZE_HISTOGRAM_BINS; bin++) {
+        accumulated += histogram.bins[bin];
+        if (!low_found && accumulated > low_count) {
+            low_bin = bin;
+            low_found = true;
+        }
+        if (accumulated >= high_count) {
+            high_bin = bin;
+            break;
+        }
+    }
+
+    window[0] = histogram.get_bin_value(low_bin);
+    window[1] = (high_bin + 1 < QUANTIZE_HISTOGRAM_BINS) ? histogram.get_bin_value(high_bin + 1) : histogram.max_value;
+
+    // Everything on a few bins: keep the whole range
+    if (window[1] <= window[0]) {
+        window[0] = histogram.min_value;
+        window[1] = histogram.max_value;
+    }
+}
+
+// QUANTIZATION ===================
+void VolumeQuantize::quantize_row(const void *data,
+                                  const eQuantizeSource source,
+                                  const size_t count,
+                                  const float window_min,
+                                  const float window_max,
+                                  uint8_t *result) {
+    // An empty window takes everything to 0, its min
+    const float scale = (window_max > window_min) ? 255.0f / (window_max - window_min) : 0.0f;
+    const float bias = 0.5f - window_min * scale;
+    if (source == QUANTIZE_SOURCE_UINT16) {
+        quantize_row_u16((const uint16_t*) data, count, scale, bias, result);
+    } else {
+        quantize_row_f32((const float*) data, count, scale, bias, result);
+    }
+}
+
+void VolumeQuantize::quantize_volume(const void *data,
+                                     const eQuantizeSource source,
+                                     const uint32_t dims[3],
+                                     const sQuantizeConfig &config,
+                                     const uint32_t thread_count,
+                                     sQuantizedVolume *result) {
+    memcpy(result->dims, dims, sizeof(result->dims));
+    const size_t row = dims[0];
+    const size_t slice = row * dims[1];
+    const uint32_t source_size = get_quantize_source_size(source);
+    const uint8_t *voxels = (const uint8_t*) data;
+
+    if (config.auto_window) {
+        sVolumeHistogram *histogram = (sVolumeHistogram*) malloc(sizeof(sVolumeHistogram));
+        build_histogram(data,
+                        source,
+                        result->get_voxel_count(),
+                        thread_count,
+                        histogram);
+        get_auto_window(*histogram,
+                        config.low_percentile,
+                        config.high_percentile,
+                        result->window);
+        free(histogram);
+    } else {
+        memcpy(result->window, config.window, sizeof(result->window));
+    }
+    const float window_min = result->window[0], window_max = result->window[1];
+
+    result->voxels = (uint8_t*) malloc(result->get_voxel_count());
+
+    if (!config.per_brick) {
+        result->brick_size = 0;
+        Parallel::for_range(0, dims[2], thread_count, [&](const uint32_t z_start, const uint32_t z_end) {
+            quantize_row(voxels + z_start * slice * source_size,
+                         source,
+                         (z_end - z_start) * slice,
+                         window_min,
+                         window_max,
+                         result->voxels + z_start * slice);
+        });
+        return;
+    }
+
+    const uint32_t brick_size = config.brick_size;
+    result->brick_size = brick_size;
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        result->brick_counts[axis] = (dims[axis] + brick_size - 1) / brick_size;
+    }
+    result->brick_ranges = (float*) malloc(sizeof(float) * 2 * result->get_brick_count());
+    const float window_size = (window_max > window_min) ? window_max - window_min : 1.0f;
+
+    Parallel::for_range(0, result->get_brick_count(), thread_count, [&](const uint32_t brick_start, const uint32_t brick_end) {
+        for(uint32_t brick = brick_start; brick < brick_end; brick++) {
+            const uint32_t coords[3] = {
+                brick % result->brick_counts[0],
+                (brick / result->brick_counts[0]) % result->brick_counts[1],
+                brick / (result->brick_counts[0] * result->brick_counts[1])
+            };
+            uint32_t start[3], end[3], apron_start[3], apron_end[3];
+            for(uint32_t axis = 0; axis < 3; axis++) {
+                start[axis] = coords[axis] * brick_size;
+                end[axis] = (start[axis] + brick_size < dims[axis]) ? start[axis] + brick_size : dims[axis];
+                apron_start[axis] = (start[axis] > 0) ? start[axis] - 1 : 0;
+                apron_end[axis] = (end[axis] < dims[axis]) ? end[axis] + 1 : dims[axis];
+            }
+
+            // Range of the brick & its apron, inside the window
+            float range[2] = {FLT_MAX, -FLT_MAX};
+            for(uint32_t z = apron_start[2]; z < apron_end[2]; z++) {
+                for(uint32_t y = apron_start[1]; y < apron_end[1]; y++) {
+                    get_row_range(voxels + (z * slice + y * row + apron_start[0]) * source_size,
+                                  source,
+                                  apron_end[0] - apron_start[0],
+                                  range);
+                }
+            }
+            const float brick_min = (range[0] < window_min) ? window_min : ((range[0] > window_max) ? window_max : range[0]);
+            const float brick_max = (range[1] < window_min) ? window_min : ((range[1] > window_max) ? window_max : range[1]);
+
+            for(uint32_t z = start[2]; z < end[2]; z++) {
+                for(uint32_t y = start[1]; y < end[1]; y++) {
+                    const size_t index = z * slice + y * row + start[0];
+                    quantize_row(voxels + index * source_size,
+                                 source,
+                                 end[0] - start[0],
+                                 brick_min,
+                                 brick_max,
+                                 result->voxels + index);
+                }
+            }
+
+            // The shader gets the window on [0, 1]: offset + sampled * scale
+            result->brick_ranges[brick * 2] = (brick_max - brick_min) / window_size;
+            result->brick_ranges[brick * 2 + 1] = (brick_min - window_min) / window_size;
+        }
+    });
+}
+
+void VolumeQuantize::dequantize_to_window(const sQuantizedVolume &volume,
+                                          const uint32_t thread_count,
+                                          uint8_t *result) {
+    if (volume.brick_ranges == NULL) {
+        memcpy(result, volume.voxels, volume.get_voxel_count());
+        return;
+    }
+
+    const size_t row = volume.dims[0];
+    const size_t slice = row * volume.dims[1];
+    const uint32_t brick_size = volume.brick_size;
+
+    Parallel::for_range(0, volume.get_brick_count(), thread_count, [&](const uint32_t brick_start, const uint32_t brick_end) {
+        uint8_t table[256];
+        for(uint32_t brick = brick_start; brick < brick_end; brick++) {
+            const float scale = volume.brick_ranges[brick * 2];
+            const float offset = volume.brick_ranges[brick * 2 + 1];
+            for(uint32_t value = 0; value < 256; value++) {
+                const float windowed = offset * 255.0f + value * scale + 0.5f;
+                table[value] = (uint8_t) ((windowed > 255.0f) ? 255.0f : windowed);
+            }
+
+            const uint32_t coords[3] = {
+                brick % volume.brick_counts[0],
+                (brick / volume.brick_counts[0]) % volume.brick_counts[1],
+                brick / (volume.brick_counts[0] * volume.brick_counts[1])
+            };
+            uint32_t start[3], end[3];
+            for(uint32_t axis = 0; axis < 3; axis++) {
+                start[axis] = coords[axis] * brick_size;
+                end[axis] = (start[axis] + brick_size < volume.dims[axis]) ? start[axis] + brick_size : volume.dims[axis];
+            }
+
+            for(uint32_t z = start[2]; z < end[2]; z++) {
+                for(uint32_t y = start[1]; y < end[1]; y++) {
+                    const size_t index = z * slice + y * row + start[0];
+                    for(uint32_t x = 0; x < end[0] - start[0]; x++) {
+                        result[index + x] = table[volume.voxels[index + x]];
+                    }
+                }
+            }
+        }
+    });
+}
+
+void sQuantizedVolume::clean() {
+    free(voxels);
+    free(brick_ranges);
+    voxels = NULL;
+    brick_ranges = NULL;
+}
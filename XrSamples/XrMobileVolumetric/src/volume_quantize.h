@@ -0,0 +1,129 @@
+#ifndef VOLUME_QUANTIZE_H_
+#define VOLUME_QUANTIZE_H_
+
+#include <cstdint>
+#include <cstddef>
+
+#define QUANTIZE_HISTOGRAM_BINS 4096
+#define QUANTIZE_DEFAULT_LOW_PERCENTILE 0.005f
+#define QUANTIZE_DEFAULT_HIGH_PERCENTILE 0.995f
+#define QUANTIZE_DEFAULT_BRICK_SIZE 32
+
+/**
+ * Ingestion of 16 bit & float volumes (CT, MR...) as GL_R8
+ * A histogram of the source picks the window of values that is kept (the
+ * percentiles, or a fixed one from the config), and the window is mapped to
+ * [0, 255]; half the memory & bandwidth of GL_R16F, and the volume works
+ * with every 8 bit path (mips, min/max grid, distance field).
+ * With per_brick, each brick gets the whole 8 bits for its own range inside
+ * the window, and stores the scale & offset that take it back to the window:
+ * density = offset + sampled * scale, on the shader (see
+ * RawShaders::quantized_isosurface_shader). The codes of two bricks are on
+ * different ranges, so the shader dequantizes each voxel before filtering
+ * across a brick face (volume_bench quantize checks those samples).
+ * The kernels are NEON / SSE2, and the volume is split by slices or bricks
+ * over the threads.
+ * */
+
+enum eQuantizeSource : uint8_t {
+    QUANTIZE_SOURCE_UINT16 = 0,
+    QUANTIZE_SOURCE_FLOAT32,
+    QUANTIZE_SOURCE_COUNT
+};
+
+inline uint32_t get_quantize_source_size(const eQuantizeSource source) {
+    return (source == QUANTIZE_SOURCE_FLOAT32) ? 4 : 2;
+}
+
+struct sQuantizeConfig {
+    // From the percentiles of the histogram, or the fixed window
+    bool     auto_window = true;
+    float    low_percentile = QUANTIZE_DEFAULT_LOW_PERCENTILE;
+    float    high_percentile = QUANTIZE_DEFAULT_HIGH_PERCENTILE;
+    float    window[2] = {0.0f, 1.0f}; // min, max; in the units of the source
+
+    bool     per_brick = false;
+    uint32_t brick_size = QUANTIZE_DEFAULT_BRICK_SIZE;
+};
+
+struct sVolumeHistogram {
+    float    min_value = 0.0f;
+    float    max_value = 0.0f;
+    uint64_t voxel_count = 0;
+    uint64_t bins[QUANTIZE_HISTOGRAM_BINS] = {};
+
+    // Lowest value that falls on the bin
+    inline float get_bin_value(const uint32_t bin) const {
+        return min_value + (max_value - min_value) * ((float) bin / QUANTIZE_HISTOGRAM_BINS);
+    }
+};
+
+struct sQuantizedVolume {
+    uint32_t    dims[3] = {0, 0, 0};
+    uint8_t     *voxels = NULL; // x major, as the source
+    float       window[2] = {0.0f, 0.0f}; // The source values of 0 & 255
+
+    // Only per brick: scale & offset of each brick, x major, to the window on [0, 1]
+    uint32_t    brick_size = 0;
+    uint32_t    brick_counts[3] = {0, 0, 0};
+    float       *brick_ranges = NULL;
+
+    inline size_t get_voxel_count() const {
+        return (size_t) dims[0] * dims[1] * dims[2];
+    }
+
+    inline uint32_t get_brick_count() const {
+        return brick_counts[0] * brick_counts[1] * brick_counts[2];
+    }
+
+    void clean();
+};
+
+namespace VolumeQuantize {
+    /**
+     * Min, max & the histogram of the source, in QUANTIZE_HISTOGRAM_BINS
+     * bins between them. The values are expected to be finite.
+     * thread_count == 0 uses all the cores.
+     * */
+    void build_histogram(const void *data,
+                         const eQuantizeSource source,
+                         const size_t voxel_count,
+                         const uint32_t thread_count,
+                         sVolumeHistogram *histogram);
+
+    // Window between the values at the low & high percentiles ([0, 1]) of the histogram
+    void get_auto_window(const sVolumeHistogram &histogram,
+                         const float low_percentile,
+                         const float high_percentile,
+                         float window[2]);
+
+    // Maps the window of count values to [0, 255], clamping the rest
+    void quantize_row(const void *data,
+                      const eQuantizeSource source,
+                      const size_t count,
+                      const float window_min,
+                      const float window_max,
+                      uint8_t *result);
+
+    /**
+     * Quantizes the whole volume with the config: a window for all of it, or
+     * a range per brick inside the window
+     * */
+    void quantize_volume(const void *data,
+                         const eQuantizeSource source,
+                         const uint32_t dims[3],
+                         const sQuantizeConfig &config,
+                         const uint32_t thread_count,
+                         sQuantizedVolume *result);
+
+    /**
+     * Per brick volumes back to a single window, what the shaders see after
+     * dequantizing; for the structures that are built on the CPU (the mips,
+     * the min/max grid & the distance field). A copy for the global ones.
+     * */
+    void dequantize_to_window(const sQuantizedVolume &volume,
+                              const uint32_t thread_count,
+                              uint8_t *result);
+};
+
+#endif // VOLUME_QUANTIZE_H_
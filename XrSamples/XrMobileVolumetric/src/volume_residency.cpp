@@ -0,0 +1,746 @@
+#include "volume_residency.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+
+#define MIN_CLIP_W 0.0001f // Closer than this to the eye, the finest level is used
+
+void sResidencyStats::add(const sResidencyStats &other) {
+    needed_bricks += other.needed_bricks;
+    hits += other.hits;
+    misses += other.misses;
+    requested_bricks += other.requested_bricks;
+    loaded_bricks += other.loaded_bricks;
+    evictions += other.evictions;
+    dropped_requests += other.dropped_requests;
+    bytes_read += other.bytes_read;
+}
+
+// INIT ===================
+bool sVolumeResidency::init(const char *base_dir,
+                            const uint32_t cache_slot_count,
+                            const uint32_t thread_count,
+                            const float brick_empty_threshold,
+                            const bool is_headless,
+                            const uint32_t max_texture_size) {
+    headless = is_headless;
+    empty_threshold = brick_empty_threshold;
+
+    // Open all the levels there are, until one is missing
+    char lod_dir[512];
+    lod_count = 0;
+    for(uint32_t level = 0; level < RESIDENCY_MAX_LODS; level++) {
+        BrickedVolume::get_lod_dir(base_dir,
+                                   level,
+                                   lod_dir,
+                                   sizeof(lod_dir));
+        if (!lods[level].open(lod_dir)) {
+            break;
+        }
+        lod_count++;
+
+        const sBrickedVolumeHeader *header = lods[level].header;
+        if (header->voxel_type != VOXEL_UINT8 ||
+            header->brick_size != lods[0].header->brick_size) {
+            destroy();
+            return false;
+        }
+    }
+
+    if (lod_count == 0) {
+        return false;
+    }
+
+    brick_size = lods[0].header->brick_size;
+    slot_side = brick_size + 2;
+
+    // Page table over the bricks of level 0
+    memcpy(page_table_dims, lods[0].header->brick_count, sizeof(page_table_dims));
+    const size_t page_count = (size_t) page_table_dims[0] * page_table_dims[1] * page_table_dims[2];
+    page_table = (uint8_t*) calloc(page_count * 4, 1);
+    // The empty bricks stay empty on every level, so the rays skip them without asking for them
+    for(uint32_t i = 0; i < page_count; i++) {
+        if (lods[0].is_brick_empty(i, empty_threshold)) {
+            page_table[(size_t) i * 4 + 3] = RESIDENCY_EMPTY_PAGE;
+        }
+    }
+    page_table_dirty = true;
+    memset(dirty_min, 0, sizeof(dirty_min));
+    memcpy(dirty_max, page_table_dims, sizeof(dirty_max));
+
+    // Roughly cubic atlas; the slot coordinates have to fit on a byte, and the
+    // atlas on a 3D texture. Up to max_slots^3 slots, the cubic layout keeps
+    // every axis under max_slots
+    const uint32_t max_slots = BrickAtlas::get_max_slots_per_axis(slot_side,
+                                                                  max_texture_size);
+    requested_slot_count = cache_slot_count;
+    const uint32_t fitting_slot_count = (cache_slot_count > max_slots * max_slots * max_slots) ? max_slots * max_slots * max_slots : cache_slot_count;
+    slots_per_axis[0] = (uint32_t) ceil(cbrt((double) fitting_slot_count));
+    slots_per_axis[1] = (uint32_t) ceil(sqrt((double) fitting_slot_count / slots_per_axis[0]));
+    slots_per_axis[2] = (fitting_slot_count + slots_per_axis[0] * slots_per_axis[1] - 1) / (slots_per_axis[0] * slots_per_axis[1]);
+    slot_count = slots_per_axis[0] * slots_per_axis[1] * slots_per_axis[2];
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        atlas_dims[axis] = slots_per_axis[axis] * slot_side;
+    }
+    assert(slots_per_axis[0] <= max_slots && slots_per_axis[1] <= max_slots && slots_per_axis[2] <= max_slots && "Too many slots for the page table or the atlas");
+
+    slots = (sResidencySlot*) malloc(sizeof(sResidencySlot) * slot_count);
+    lru_head = RESIDENCY_NO_SLOT;
+    lru_tail = RESIDENCY_NO_SLOT;
+    for(uint32_t i = 0; i < slot_count; i++) {
+        slots[i] = {};
+        _lru_push_front(i);
+    }
+    slot_of_brick.clear();
+    slot_of_brick.reserve(slot_count * 2);
+
+    // At worst, every brick of every level is missing
+    request_capacity = 0;
+    for(uint32_t level = 0; level < lod_count; level++) {
+        request_capacity += lods[level].get_brick_count();
+    }
+    requests = (sResidencyRequest*) malloc(sizeof(sResidencyRequest) * request_capacity);
+    request_count = 0;
+    feedback_requests = (sResidencyRequest*) malloc(sizeof(sResidencyRequest) * request_capacity);
+    feedback_request_count = 0;
+    feedback_pixels.clear();
+
+    for(uint32_t i = 0; i < RESIDENCY_MAX_LOADS; i++) {
+        loads[i].state = LOAD_FREE;
+        loads[i].voxels = (uint8_t*) malloc(get_slot_size());
+    }
+
+    frame = 0;
+    frame_stats = {};
+    total_stats = {};
+
+    // Worker threads
+    queue_start = 0;
+    queue_size = 0;
+    running = true;
+    worker_count = (thread_count == 0) ? 1 : thread_count;
+    worker_count = (worker_count > RESIDENCY_MAX_WORKERS) ? RESIDENCY_MAX_WORKERS : worker_count;
+    for(uint32_t i = 0; i < worker_count; i++) {
+        workers[i] = std::thread(&sVolumeResidency::_worker_loop, this);
+    }
+
+    return true;
+}
+
+void sVolumeResidency::destroy() {
+    if (running) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            running = false;
+        }
+        queue_condition.notify_all();
+        for(uint32_t i = 0; i < worker_count; i++) {
+            workers[i].join();
+        }
+        worker_count = 0;
+    }
+
+    for(uint32_t i = 0; i < RESIDENCY_MAX_LOADS; i++) {
+        free(loads[i].voxels);
+        loads[i].voxels = NULL;
+        loads[i].state = LOAD_FREE;
+    }
+
+    free(slots);
+    slots = NULL;
+    free(page_table);
+    page_table = NULL;
+    free(requests);
+    requests = NULL;
+    free(feedback_requests);
+    feedback_requests = NULL;
+    feedback_request_count = 0;
+    feedback_pixels.clear();
+    slot_of_brick.clear();
+
+    for(uint32_t level = 0; level < lod_count; level++) {
+        lods[level].close();
+    }
+    lod_count = 0;
+}
+
+// PER FRAME ===================
+void sVolumeResidency::update(const glm::mat4x4 *view_projs,
+                              const uint32_t views,
+                              const glm::mat4x4 &model) {
+    total_stats.add(frame_stats);
+    frame_stats = {};
+    frame++;
+
+    if (headless) {
+        _commit_ready_loads();
+    }
+
+    // Frustum planes & eyes on the local space of the volume
+    view_count = (views > RESIDENCY_MAX_VIEWS) ? RESIDENCY_MAX_VIEWS : views;
+    for(uint32_t v = 0; v < view_count; v++) {
+        local_viewprojs[v] = view_projs[v] * model;
+        const glm::mat4x4 &m = local_viewprojs[v];
+
+        const glm::vec4 row_x = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+        const glm::vec4 row_y = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+        const glm::vec4 row_z = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+        const glm::vec4 row_w = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+        planes[v][0] = row_w + row_x;
+        planes[v][1] = row_w - row_x;
+        planes[v][2] = row_w + row_y;
+        planes[v][3] = row_w - row_y;
+        planes[v][4] = row_w + row_z;
+        planes[v][5] = row_w - row_z;
+
+        // The eye is the point that projects to w = 0, with x = y = 0
+        const glm::vec4 eye = glm::inverse(m) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+        eyes[v] = glm::vec3(eye) / eye.w;
+    }
+
+    // Walk from the coarsest level
+    request_count = 0;
+    const uint32_t top_level = lod_count - 1;
+    const uint32_t *top_count = lods[top_level].header->brick_count;
+    for(uint32_t z = 0; z < top_count[2]; z++) {
+        for(uint32_t y = 0; y < top_count[1]; y++) {
+            for(uint32_t x = 0; x < top_count[0]; x++) {
+                _visit_brick(top_level, x, y, z);
+            }
+        }
+    }
+
+    // The finer levels that the rays asked for
+    if (use_feedback) {
+        for(uint32_t i = 0; i < feedback_request_count; i++) {
+            const sResidencyRequest &request = feedback_requests[i];
+            _need_brick(request.level,
+                        (uint32_t) (request.key & 0xFFFFFFFF),
+                        request.order);
+        }
+    }
+
+    // Coarse levels first, so there is something to draw everywhere; then the closest
+    std::sort(requests,
+              requests + request_count,
+              [](const sResidencyRequest &a, const sResidencyRequest &b) {
+        if (a.level != b.level) {
+            return a.level > b.level;
+        }
+        return a.order < b.order;
+    });
+
+    uint32_t load_id = 0;
+    for(uint32_t i = 0; i < request_count; i++) {
+        while (load_id < RESIDENCY_MAX_LOADS && loads[load_id].state != LOAD_FREE) {
+            load_id++;
+        }
+        const uint32_t slot = (load_id < RESIDENCY_MAX_LOADS) ? _allocate_slot() : RESIDENCY_NO_SLOT;
+        if (slot == RESIDENCY_NO_SLOT) {
+            // They are requested again next frame, if they are still needed
+            frame_stats.dropped_requests += request_count - i;
+            break;
+        }
+
+        const uint64_t key = requests[i].key;
+        slots[slot].key = key;
+        slots[slot].in_use = true;
+        slots[slot].loading = true;
+        slots[slot].last_used_frame = frame;
+        slot_of_brick[key] = slot;
+
+        sBrickLoad &load = loads[load_id];
+        load.key = key;
+        load.slot = slot;
+        load.bytes_read = 0;
+        load.state = LOAD_QUEUED;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            queue[(queue_start + queue_size) % RESIDENCY_MAX_LOADS] = (uint8_t) load_id;
+            queue_size++;
+        }
+        queue_condition.notify_one();
+
+        frame_stats.requested_bricks++;
+    }
+}
+
+void sVolumeResidency::_visit_brick(const uint32_t level,
+                                    const uint32_t brick_x,
+                                    const uint32_t brick_y,
+                                    const uint32_t brick_z) {
+    const sBrickedVolume &lod = lods[level];
+    const uint32_t brick_index = lod.get_brick_index(brick_x, brick_y, brick_z);
+    if (lod.is_brick_empty(brick_index, empty_threshold)) {
+        return;
+    }
+
+    uint32_t origin[3], size[3];
+    lod.get_brick_extent(brick_index, origin, size);
+    const glm::vec3 dims = glm::vec3(lod.header->width, lod.header->height, lod.header->depth);
+    const glm::vec3 box_min = glm::vec3(origin[0], origin[1], origin[2]) / dims;
+    const glm::vec3 box_max = glm::vec3(origin[0] + size[0], origin[1] + size[1], origin[2] + size[2]) / dims;
+
+    if (!_is_box_visible(box_min, box_max)) {
+        return;
+    }
+
+    float closest_depth = 0.0f;
+    const uint32_t desired_level = _get_desired_level(box_min, box_max, &closest_depth);
+
+    // Every level on the way is needed, as the fallback of the finer ones;
+    // with feedback, only the coarsest one
+    if (!use_feedback || level == lod_count - 1) {
+        _need_brick(level, brick_index, closest_depth);
+    }
+
+    if (desired_level >= level || level == 0) {
+        return;
+    }
+
+    // Children on the next finer level; the last brick of each axis also takes
+    // the odd ones left by the reduction
+    const uint32_t brick_coords[3] = {brick_x, brick_y, brick_z};
+    const uint32_t *count = lod.header->brick_count;
+    const uint32_t *child_count = lods[level - 1].header->brick_count;
+    uint32_t child_start[3], child_end[3];
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        child_start[axis] = brick_coords[axis] * 2;
+        child_end[axis] = (brick_coords[axis] == count[axis] - 1) ? child_count[axis] : child_start[axis] + 2;
+        child_end[axis] = (child_end[axis] > child_count[axis]) ? child_count[axis] : child_end[axis];
+    }
+
+    for(uint32_t z = child_start[2]; z < child_end[2]; z++) {
+        for(uint32_t y = child_start[1]; y < child_end[1]; y++) {
+            for(uint32_t x = child_start[0]; x < child_end[0]; x++) {
+                _visit_brick(level - 1, x, y, z);
+            }
+        }
+    }
+}
+
+void sVolumeResidency::_need_brick(const uint32_t level,
+                                   const uint32_t brick_index,
+                                   const float order) {
+    frame_stats.needed_bricks++;
+    const uint64_t key = get_brick_key(level, brick_index);
+    const auto it = slot_of_brick.find(key);
+    if (it == slot_of_brick.end()) {
+        frame_stats.misses++;
+        requests[request_count++] = {key, level, order};
+        return;
+    }
+
+    const uint32_t slot = it->second;
+    slots[slot].last_used_frame = frame;
+    _lru_remove(slot);
+    _lru_push_front(slot);
+    if (slots[slot].loading) {
+        frame_stats.misses++;
+    } else {
+        frame_stats.hits++;
+    }
+}
+
+bool sVolumeResidency::_is_box_visible(const glm::vec3 &box_min,
+                                       const glm::vec3 &box_max) const {
+    if (view_count == 0) {
+        return true;
+    }
+
+    // Visible if its inside any of the frusta
+    for(uint32_t v = 0; v < view_count; v++) {
+        bool inside = true;
+        for(uint32_t p = 0; p < 6 && inside; p++) {
+            const glm::vec4 &plane = planes[v][p];
+            // Corner of the box furthest along the normal
+            const glm::vec3 corner = glm::vec3((plane.x > 0.0f) ? box_max.x : box_min.x,
+                                               (plane.y > 0.0f) ? box_max.y : box_min.y,
+                                               (plane.z > 0.0f) ? box_max.z : box_min.z);
+            inside = glm::dot(glm::vec3(plane), corner) + plane.w >= 0.0f;
+        }
+        if (inside) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t sVolumeResidency::_get_desired_level(const glm::vec3 &box_min,
+                                              const glm::vec3 &box_max,
+                                              float *closest_depth) const {
+    const sBrickedVolumeHeader *header = lods[0].header;
+    const glm::vec3 voxel_size = 1.0f / glm::vec3(header->width, header->height, header->depth);
+
+    uint32_t desired_level = lod_count - 1;
+    *closest_depth = 1e30f;
+    for(uint32_t v = 0; v < view_count; v++) {
+        const glm::mat4x4 &m = local_viewprojs[v];
+
+        // The point of the box closest to the eye has the largest voxels on screen
+        const glm::vec3 closest = glm::clamp(eyes[v], box_min, box_max);
+        const glm::vec4 clip = m * glm::vec4(closest, 1.0f);
+        *closest_depth = (clip.w < *closest_depth) ? clip.w : *closest_depth;
+        if (clip.w < MIN_CLIP_W) {
+            return 0;
+        }
+
+        // Screen size of a level 0 voxel there, on its largest axis
+        float voxel_pixels = 0.0f;
+        for(uint32_t axis = 0; axis < 3; axis++) {
+            glm::vec3 offset = glm::vec3(0.0f);
+            offset[axis] = voxel_size[axis];
+            const glm::vec4 offset_clip = m * glm::vec4(closest + offset, 1.0f);
+            if (offset_clip.w < MIN_CLIP_W) {
+                return 0;
+            }
+            const float ndc_distance = glm::length(glm::vec2(offset_clip) / offset_clip.w - glm::vec2(clip) / clip.w);
+            voxel_pixels = std::max(voxel_pixels, ndc_distance * 0.5f * pixel_height);
+        }
+
+        // Each level doubles the voxel size
+        const float level = (voxel_pixels > 0.0f) ? log2f(1.0f / voxel_pixels) + lod_bias : (float) lod_count;
+        const uint32_t view_level = (level <= 0.0f) ? 0 : (uint32_t) level;
+        desired_level = (view_level < desired_level) ? view_level : desired_level;
+    }
+
+    return desired_level;
+}
+
+// LRU ===================
+void sVolumeResidency::_lru_remove(const uint32_t slot) {
+    sResidencySlot &curr = slots[slot];
+    if (curr.prev != RESIDENCY_NO_SLOT) {
+        slots[curr.prev].next = curr.next;
+    } else {
+        lru_head = curr.next;
+    }
+    if (curr.next != RESIDENCY_NO_SLOT) {
+        slots[curr.next].prev = curr.prev;
+    } else {
+        lru_tail = curr.prev;
+    }
+    curr.prev = RESIDENCY_NO_SLOT;
+    curr.next = RESIDENCY_NO_SLOT;
+}
+
+void sVolumeResidency::_lru_push_front(const uint32_t slot) {
+    slots[slot].prev = RESIDENCY_NO_SLOT;
+    slots[slot].next = lru_head;
+    if (lru_head != RESIDENCY_NO_SLOT) {
+        slots[lru_head].prev = slot;
+    }
+    lru_head = slot;
+    if (lru_tail == RESIDENCY_NO_SLOT) {
+        lru_tail = slot;
+    }
+}
+
+uint32_t sVolumeResidency::_allocate_slot() {
+    // From the least recently used; the slots of this frame are never recycled
+    for(uint32_t slot = lru_tail; slot != RESIDENCY_NO_SLOT; slot = slots[slot].prev) {
+        sResidencySlot &curr = slots[slot];
+        if (curr.in_use && curr.last_used_frame == frame) {
+            return RESIDENCY_NO_SLOT;
+        }
+        if (curr.loading) {
+            continue;
+        }
+
+        if (curr.in_use) {
+            _evict_slot(slot);
+        }
+        _lru_remove(slot);
+        _lru_push_front(slot);
+        return slot;
+    }
+    return RESIDENCY_NO_SLOT;
+}
+
+void sVolumeResidency::_evict_slot(const uint32_t slot) {
+    const uint64_t key = slots[slot].key;
+    slot_of_brick.erase(key);
+    slots[slot].in_use = false;
+    _unmap_brick((uint32_t) (key >> 32),
+                 (uint32_t) (key & 0xFFFFFFFF),
+                 slot);
+    frame_stats.evictions++;
+}
+
+// PAGE TABLE ===================
+void sVolumeResidency::_get_covered_region(const uint32_t level,
+                                           const uint32_t brick_index,
+                                           uint32_t region_min[3],
+                                           uint32_t region_max[3]) const {
+    const uint32_t *count = lods[level].header->brick_count;
+    const uint32_t brick_coords[3] = {
+        brick_index % count[0],
+        (brick_index / count[0]) % count[1],
+        brick_index / (count[0] * count[1])
+    };
+
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        region_min[axis] = brick_coords[axis] << level;
+        region_max[axis] = (brick_coords[axis] == count[axis] - 1) ? page_table_dims[axis] : (brick_coords[axis] + 1) << level;
+        region_min[axis] = (region_min[axis] > page_table_dims[axis]) ? page_table_dims[axis] : region_min[axis];
+        region_max[axis] = (region_max[axis] > page_table_dims[axis]) ? page_table_dims[axis] : region_max[axis];
+    }
+}
+
+void sVolumeResidency::_encode_page(const uint32_t slot,
+                                    const uint32_t level,
+                                    uint8_t page[4]) const {
+    page[0] = (uint8_t) (slot % slots_per_axis[0]);
+    page[1] = (uint8_t) ((slot / slots_per_axis[0]) % slots_per_axis[1]);
+    page[2] = (uint8_t) (slot / (slots_per_axis[0] * slots_per_axis[1]));
+    page[3] = (uint8_t) (level + 1);
+}
+
+void sVolumeResidency::_map_brick(const uint32_t level,
+                                  const uint32_t brick_index,
+                                  const uint32_t slot) {
+    uint32_t region_min[3], region_max[3];
+    _get_covered_region(level, brick_index, region_min, region_max);
+
+    // Only over coarser levels
+    for(uint32_t z = region_min[2]; z < region_max[2]; z++) {
+        for(uint32_t y = region_min[1]; y < region_max[1]; y++) {
+            for(uint32_t x = region_min[0]; x < region_max[0]; x++) {
+                const uint32_t page_index = x + (y + z * page_table_dims[1]) * page_table_dims[0];
+                const uint8_t page_level = page_table[(size_t) page_index * 4 + 3];
+                if (page_level != RESIDENCY_EMPTY_PAGE && (page_level == 0 || page_level > level + 1)) {
+                    _encode_page(slot, level, &page_table[(size_t) page_index * 4]);
+                }
+            }
+        }
+    }
+    _mark_dirty(region_min, region_max);
+}
+
+void sVolumeResidency::_unmap_brick(const uint32_t level,
+                                    const uint32_t brick_index,
+                                    const uint32_t slot) {
+    uint32_t region_min[3], region_max[3];
+    _get_covered_region(level, brick_index, region_min, region_max);
+
+    // Only the pages that point to this slot; the rest have a finer brick
+    uint8_t slot_page[4];
+    _encode_page(slot, level, slot_page);
+
+    for(uint32_t z = region_min[2]; z < region_max[2]; z++) {
+        for(uint32_t y = region_min[1]; y < region_max[1]; y++) {
+            for(uint32_t x = region_min[0]; x < region_max[0]; x++) {
+                const uint32_t page_index = x + (y + z * page_table_dims[1]) * page_table_dims[0];
+                uint8_t *page = &page_table[(size_t) page_index * 4];
+                if (memcmp(page, slot_page, 4) != 0) {
+                    continue;
+                }
+
+                // Fall back to the finest coarser level that is resident
+                memset(page, 0, 4);
+                const uint32_t coords[3] = {x, y, z};
+                for(uint32_t coarse_level = level + 1; coarse_level < lod_count; coarse_level++) {
+                    const sBrickedVolume &lod = lods[coarse_level];
+                    uint32_t brick_coords[3];
+                    for(uint32_t axis = 0; axis < 3; axis++) {
+                        brick_coords[axis] = coords[axis] >> coarse_level;
+                        brick_coords[axis] = (brick_coords[axis] >= lod.header->brick_count[axis]) ? lod.header->brick_count[axis] - 1 : brick_coords[axis];
+                    }
+                    const auto it = slot_of_brick.find(get_brick_key(coarse_level, lod.get_brick_index(brick_coords[0], brick_coords[1], brick_coords[2])));
+                    if (it != slot_of_brick.end() && !slots[it->second].loading) {
+                        _encode_page(it->second, coarse_level, page);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    _mark_dirty(region_min, region_max);
+}
+
+void sVolumeResidency::_mark_dirty(const uint32_t region_min[3],
+                                   const uint32_t region_max[3]) {
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        if (!page_table_dirty) {
+            dirty_min[axis] = region_min[axis];
+            dirty_max[axis] = region_max[axis];
+        } else {
+            dirty_min[axis] = (region_min[axis] < dirty_min[axis]) ? region_min[axis] : dirty_min[axis];
+            dirty_max[axis] = (region_max[axis] > dirty_max[axis]) ? region_max[axis] : dirty_max[axis];
+        }
+    }
+    page_table_dirty = true;
+}
+
+// FEEDBACK ===================
+void sVolumeResidency::set_feedback(const uint8_t *pages,
+                                    const uint32_t page_count) {
+    // Pixels per brick; the coarsest level is already requested by the frusta
+    feedback_pixels.clear();
+    for(uint32_t i = 0; i < page_count; i++) {
+        const uint8_t *page = &pages[(size_t) i * 4];
+        if (page[3] == 0 || page[3] == RESIDENCY_EMPTY_PAGE || (uint32_t) page[3] >= lod_count) {
+            continue;
+        }
+        if (page[0] >= page_table_dims[0] || page[1] >= page_table_dims[1] || page[2] >= page_table_dims[2]) {
+            continue;
+        }
+
+        const uint32_t level = page[3] - 1;
+        const sBrickedVolume &lod = lods[level];
+        uint32_t brick_coords[3];
+        for(uint32_t axis = 0; axis < 3; axis++) {
+            brick_coords[axis] = (uint32_t) page[axis] >> level;
+            brick_coords[axis] = (brick_coords[axis] >= lod.header->brick_count[axis]) ? lod.header->brick_count[axis] - 1 : brick_coords[axis];
+        }
+        const uint32_t brick_index = lod.get_brick_index(brick_coords[0], brick_coords[1], brick_coords[2]);
+        if (lod.is_brick_empty(brick_index, empty_threshold)) {
+            continue;
+        }
+        feedback_pixels[get_brick_key(level, brick_index)]++;
+    }
+
+    // The bricks that more pixels need go first
+    feedback_request_count = 0;
+    for(const auto &it : feedback_pixels) {
+        feedback_requests[feedback_request_count++] = {it.first, (uint32_t) (it.first >> 32), -(float) it.second};
+    }
+}
+
+// LOADS ===================
+void sVolumeResidency::commit_load(const uint32_t load_id) {
+    sBrickLoad &load = loads[load_id];
+    const uint32_t level = (uint32_t) (load.key >> 32);
+    const uint32_t brick_index = (uint32_t) (load.key & 0xFFFFFFFF);
+
+    slots[load.slot].loading = false;
+    _map_brick(level, brick_index, load.slot);
+
+    frame_stats.loaded_bricks++;
+    frame_stats.bytes_read += load.bytes_read;
+    load.state = LOAD_FREE;
+}
+
+void sVolumeResidency::_commit_ready_loads() {
+    for(uint32_t i = 0; i < RESIDENCY_MAX_LOADS; i++) {
+        if (loads[i].state == LOAD_READY) {
+            commit_load(i);
+        }
+    }
+}
+
+void sVolumeResidency::wait_for_loads() {
+    bool pending = true;
+    while (pending) {
+        pending = false;
+        for(uint32_t i = 0; i < RESIDENCY_MAX_LOADS; i++) {
+            pending = pending || loads[i].state == LOAD_QUEUED;
+        }
+        if (pending) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    if (headless) {
+        _commit_ready_loads();
+    }
+}
+
+void sVolumeResidency::_fill_slot(const uint64_t key,
+                                  uint8_t *voxels,
+                                  size_t *bytes_read) const {
+    const sBrickedVolume &lod = lods[(uint32_t) (key >> 32)];
+    const uint32_t brick_index = (uint32_t) (key & 0xFFFFFFFF);
+    const int32_t dims[3] = {(int32_t) lod.header->width, (int32_t) lod.header->height, (int32_t) lod.header->depth};
+
+    uint32_t origin[3], size[3];
+    lod.get_brick_extent(brick_index, origin, size);
+
+    // The voxels of the border come from the neighbour bricks, clamped to the volume
+    uint32_t cached_brick = UINT32_MAX;
+    const uint8_t *brick_data = NULL;
+    uint32_t brick_origin[3] = {0, 0, 0}, brick_extent[3] = {0, 0, 0};
+    size_t read = 0;
+
+    // The compressed bricks that the slot touches (itself & the neighbours
+    // of its border) are decoded once each
+    const size_t brick_bytes = (size_t) brick_size * brick_size * brick_size;
+    uint8_t *decoded = NULL;
+    uint32_t decoded_ids[RESIDENCY_MAX_DECODED_BRICKS];
+    uint32_t decoded_count = 0;
+    auto get_brick_voxels = [&](const uint32_t curr_brick) -> const uint8_t* {
+        if (!lod.is_brick_compressed(curr_brick) || (lod.bricks[curr_brick].flags & BRICK_EMPTY)) {
+            return (const uint8_t*) lod.get_brick_data(curr_brick);
+        }
+        for(uint32_t i = 0; i < decoded_count; i++) {
+            if (decoded_ids[i] == curr_brick) {
+                return decoded + brick_bytes * i;
+            }
+        }
+        assert(decoded_count < RESIDENCY_MAX_DECODED_BRICKS && "A slot touches more bricks than its neighbours");
+        if (decoded == NULL) {
+            decoded = (uint8_t*) malloc(brick_bytes * RESIDENCY_MAX_DECODED_BRICKS);
+        }
+        uint8_t *brick_voxels = decoded + brick_bytes * decoded_count;
+        if (!lod.decode_brick(curr_brick, brick_voxels)) {
+            // Corrupt, sampled as empty
+            return NULL;
+        }
+        decoded_ids[decoded_count++] = curr_brick;
+        return brick_voxels;
+    };
+
+    for(uint32_t z = 0; z < slot_side; z++) {
+        const int32_t vz = std::min(std::max((int32_t) origin[2] + (int32_t) z - 1, 0), dims[2] - 1);
+        for(uint32_t y = 0; y < slot_side; y++) {
+            const int32_t vy = std::min(std::max((int32_t) origin[1] + (int32_t) y - 1, 0), dims[1] - 1);
+            uint8_t *row = voxels + ((size_t) z * slot_side + y) * slot_side;
+            for(uint32_t x = 0; x < slot_side; x++) {
+                const int32_t vx = std::min(std::max((int32_t) origin[0] + (int32_t) x - 1, 0), dims[0] - 1);
+
+                const uint32_t curr_brick = lod.get_brick_index(vx / brick_size, vy / brick_size, vz / brick_size);
+                if (curr_brick != cached_brick) {
+                    cached_brick = curr_brick;
+                    brick_data = get_brick_voxels(curr_brick);
+                    lod.get_brick_extent(curr_brick, brick_origin, brick_extent);
+                }
+
+                if (brick_data == NULL) {
+                    row[x] = 0;
+                    continue;
+                }
+                row[x] = brick_data[((size_t) (vz - brick_origin[2]) * brick_extent[1] + (vy - brick_origin[1])) * brick_extent[0] + (vx - brick_origin[0])];
+                read++;
+            }
+        }
+    }
+
+    free(decoded);
+    *bytes_read = read;
+}
+
+void sVolumeResidency::_worker_loop() {
+    while (true) {
+        uint8_t load_id = 0;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_condition.wait(lock, [this] { return queue_size > 0 || !running; });
+            if (!running) {
+                return;
+            }
+            load_id = queue[queue_start];
+            queue_start = (queue_start + 1) % RESIDENCY_MAX_LOADS;
+            queue_size--;
+        }
+
+        sBrickLoad &load = loads[load_id];
+        _fill_slot(load.key,
+                   load.voxels,
+                   &load.bytes_read);
+        load.state = LOAD_READY;
+    }
+}
@@ -0,0 +1,278 @@
+#ifndef VOLUME_RESIDENCY_H_
+#define VOLUME_RESIDENCY_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <glm/glm.hpp>
+
+#include "bricked_volume.h"
+#include "brick_atlas.h"
+#include "upload_scheduler.h"
+
+#define RESIDENCY_MAX_LODS 8
+#define RESIDENCY_MAX_VIEWS 2
+#define RESIDENCY_MAX_WORKERS 4
+#define RESIDENCY_MAX_LOADS 64 // Bricks in flight
+#define RESIDENCY_DEFAULT_SLOT_COUNT 256
+#define RESIDENCY_DEFAULT_WORKER_COUNT 2
+#define RESIDENCY_DEFAULT_PIXEL_HEIGHT 1024.0f
+#define RESIDENCY_NO_SLOT 0xFFFFFFFFu
+#define RESIDENCY_EMPTY_PAGE 255 // Page alpha of the empty bricks of level 0
+#define RESIDENCY_MAX_DECODED_BRICKS 27 // A slot & the neighbours of its border, on compressed levels
+
+/**
+ * Out-of-core volumes, with a view driven brick cache
+ * The volume is stored as a chain of bricked levels of detail (.vbrk, level
+ * 0 the finest, see BrickedVolume::get_lod_dir), that are only mapped; and
+ * the GPU holds a fixed size atlas of brick slots, with a 1 voxel border.
+ * Each frame, the bricks that the view frusta see are walked from the
+ * coarsest level, refining while a voxel of the level covers less than a
+ * pixel; the ones that are not on the cache are read by worker threads, coarse
+ * levels first, and the least recently used slots are recycled.
+ * The page table has one texel per brick of level 0, pointing to the finest
+ * resident brick that covers it; so while a brick is on its way, the coarser
+ * level that is already there is drawn instead.
+ * With use_feedback, the finer levels are only requested when the rays of the
+ * feedback pass needed them (see set_feedback); the frusta only keep the
+ * coarsest level resident, so the bricks hidden behind others, or skipped
+ * by the rays, are never read.
+ * This file has no GL: the uploads are on volume_residency_gl.cpp, and in
+ * headless mode the loads are applied straight away to the page table, so the
+ * cache can be replayed on the host.
+ * */
+
+struct sResidencyStats {
+    uint32_t    needed_bricks = 0; // Visible & not empty, all levels
+    uint32_t    hits = 0; // Needed & resident
+    uint32_t    misses = 0; // Needed & not resident, loading included
+    uint32_t    requested_bricks = 0; // Sent to the workers
+    uint32_t    loaded_bricks = 0; // Made resident
+    uint32_t    evictions = 0;
+    uint32_t    dropped_requests = 0; // No slot or load left for them
+    uint64_t    bytes_read = 0;
+
+    inline float get_hit_rate() const {
+        return (needed_bricks > 0) ? (float) hits / needed_bricks : 1.0f;
+    }
+
+    void add(const sResidencyStats &other);
+};
+
+struct sResidencySlot {
+    uint64_t    key = 0; // Brick on the slot, see get_brick_key
+    bool        in_use = false;
+    bool        loading = false;
+    uint32_t    last_used_frame = 0;
+
+    // LRU list, the head is the most recently used
+    uint32_t    prev = RESIDENCY_NO_SLOT;
+    uint32_t    next = RESIDENCY_NO_SLOT;
+};
+
+enum eBrickLoadState : uint8_t {
+    LOAD_FREE = 0,
+    LOAD_QUEUED, // Waiting for a worker
+    LOAD_READY   // Filled, waiting to be uploaded
+};
+
+struct sBrickLoad {
+    std::atomic<uint8_t>    state{LOAD_FREE};
+    uint64_t                key = 0;
+    uint32_t                slot = 0;
+    uint8_t                 *voxels = NULL; // slot_side^3, with the border
+    size_t                  bytes_read = 0;
+};
+
+struct sResidencyRequest {
+    uint64_t    key = 0;
+    uint32_t    level = 0;
+    float       order = 0.0f; // Inside a level, lower first: view depth, or minus the feedback pixels
+};
+
+struct sVolumeResidency {
+    // Levels of detail, 0 is the finest; all with the same brick size
+    sBrickedVolume  lods[RESIDENCY_MAX_LODS];
+    uint32_t        lod_count = 0;
+    uint32_t        brick_size = 0;
+    uint32_t        slot_side = 0; // brick_size + the 2 border voxels
+    float           empty_threshold = 0.0f;
+
+    // Level selection: a level is used while its voxels cover at most a pixel,
+    // on a view of pixel_height pixels; lod_bias > 0 goes to coarser levels
+    float           pixel_height = RESIDENCY_DEFAULT_PIXEL_HEIGHT;
+    float           lod_bias = 0.0f;
+
+    // Headless: the loads are applied on update, without GL
+    bool            headless = false;
+
+    // Request the finer levels from the feedback of the rays, not the frusta
+    bool            use_feedback = false;
+
+    // Slots of the atlas & the LRU
+    uint32_t        slot_count = 0;
+    uint32_t        requested_slot_count = 0; // Over slot_count if the atlas did not fit
+    uint32_t        slots_per_axis[3] = {0, 0, 0};
+    uint32_t        atlas_dims[3] = {0, 0, 0};
+    sResidencySlot  *slots = NULL;
+    uint32_t        lru_head = RESIDENCY_NO_SLOT;
+    uint32_t        lru_tail = RESIDENCY_NO_SLOT;
+    std::unordered_map<uint64_t, uint32_t> slot_of_brick;
+
+    // RGBA8, one texel per brick of level 0: slot on xyz, a = level + 1 (0 not resident)
+    uint32_t        page_table_dims[3] = {0, 0, 0};
+    uint8_t         *page_table = NULL;
+    bool            page_table_dirty = false;
+    uint32_t        dirty_min[3] = {0, 0, 0};
+    uint32_t        dirty_max[3] = {0, 0, 0}; // Exclusive
+
+    // Worker threads & the loads in flight
+    sBrickLoad              loads[RESIDENCY_MAX_LOADS];
+    std::thread             workers[RESIDENCY_MAX_WORKERS];
+    uint32_t                worker_count = 0;
+    std::mutex              queue_mutex;
+    std::condition_variable queue_condition;
+    uint8_t                 queue[RESIDENCY_MAX_LOADS];
+    uint32_t                queue_start = 0;
+    uint32_t                queue_size = 0;
+    bool                    running = false;
+
+    // Bricks missing on the current frame
+    sResidencyRequest       *requests = NULL;
+    uint32_t                request_count = 0;
+    uint32_t                request_capacity = 0;
+
+    // Bricks of the last feedback, kept until the next one arrives
+    std::unordered_map<uint64_t, uint32_t> feedback_pixels;
+    sResidencyRequest       *feedback_requests = NULL;
+    uint32_t                feedback_request_count = 0;
+
+    // Frustum planes of the views, on the local space of the volume
+    glm::vec4               planes[RESIDENCY_MAX_VIEWS][6];
+    glm::mat4x4             local_viewprojs[RESIDENCY_MAX_VIEWS];
+    glm::vec3               eyes[RESIDENCY_MAX_VIEWS];
+    uint32_t                view_count = 0;
+
+    uint32_t                frame = 0;
+    sResidencyStats         frame_stats = {};
+    sResidencyStats         total_stats = {};
+
+    // GL, only if not headless
+    unsigned int            atlas_texture = 0; // R8
+    unsigned int            page_table_texture = 0; // RGBA8
+
+    /**
+     * Opens the levels of detail of base_dir, and allocates a cache of
+     * slot_count bricks; less if their atlas is over max_texture_size
+     * (GL_MAX_3D_TEXTURE_SIZE) on an axis.
+     * Returns false if level 0 cannot be opened, or if the levels do not match
+     * */
+    bool init(const char *base_dir,
+              const uint32_t cache_slot_count,
+              const uint32_t thread_count,
+              const float brick_empty_threshold,
+              const bool is_headless,
+              const uint32_t max_texture_size = BRICK_ATLAS_MAX_TEXTURE_SIZE);
+    void destroy();
+
+    /**
+     * Walks the bricks seen by the views, marks them as used, and requests the
+     * missing ones; view_projs are the view-projection matrices of each eye,
+     * and model the transform of the volume box ([0, 1]^3 on local space).
+     * When headless, it also applies the loads finished since the last call.
+     * */
+    void update(const glm::mat4x4 *view_projs,
+                const uint32_t views,
+                const glm::mat4x4 &model);
+
+    /**
+     * Feedback of the rays, as RGBA8 pages (level 0 brick on xyz, a = level + 1
+     * that they needed there, 0 if none), from the feedback pass some frames ago.
+     * Replaces the previous one, and is requested on the next updates.
+     * */
+    void set_feedback(const uint8_t *pages,
+                      const uint32_t page_count);
+
+    // Blocks until there are no loads in flight, and applies them if headless
+    void wait_for_loads();
+
+    // Makes the brick of a ready load resident, and frees the load
+    void commit_load(const uint32_t load_id);
+
+    // GL side, on volume_residency_gl.cpp
+    void init_gl();
+    void destroy_gl();
+    // Uploads the ready loads while they fit on the budget, and then the page table
+    void upload(sUploadScheduler *scheduler);
+
+    inline static uint64_t get_brick_key(const uint32_t level,
+                                         const uint32_t brick_index) {
+        return ((uint64_t) level << 32) | brick_index;
+    }
+
+    // Stats of the current frame added to the ones before
+    inline sResidencyStats get_total_stats() const {
+        sResidencyStats stats = total_stats;
+        stats.add(frame_stats);
+        return stats;
+    }
+
+    inline size_t get_slot_size() const {
+        return (size_t) slot_side * slot_side * slot_side;
+    }
+
+    // Origin of a slot on the atlas, in voxels
+    inline void get_slot_origin(const uint32_t slot,
+                                uint32_t origin[3]) const {
+        origin[0] = (slot % slots_per_axis[0]) * slot_side;
+        origin[1] = ((slot / slots_per_axis[0]) % slots_per_axis[1]) * slot_side;
+        origin[2] = (slot / (slots_per_axis[0] * slots_per_axis[1])) * slot_side;
+    }
+
+    void _need_brick(const uint32_t level,
+                     const uint32_t brick_index,
+                     const float order);
+    void _visit_brick(const uint32_t level,
+                      const uint32_t brick_x,
+                      const uint32_t brick_y,
+                      const uint32_t brick_z);
+    bool _is_box_visible(const glm::vec3 &box_min,
+                         const glm::vec3 &box_max) const;
+    uint32_t _get_desired_level(const glm::vec3 &box_min,
+                                const glm::vec3 &box_max,
+                                float *closest_depth) const;
+
+    uint32_t _allocate_slot();
+    void _evict_slot(const uint32_t slot);
+    void _lru_remove(const uint32_t slot);
+    void _lru_push_front(const uint32_t slot);
+
+    // Range of level 0 bricks that a brick covers, max is exclusive
+    void _get_covered_region(const uint32_t level,
+                             const uint32_t brick_index,
+                             uint32_t region_min[3],
+                             uint32_t region_max[3]) const;
+    void _map_brick(const uint32_t level,
+                    const uint32_t brick_index,
+                    const uint32_t slot);
+    void _unmap_brick(const uint32_t level,
+                      const uint32_t brick_index,
+                      const uint32_t slot);
+    void _encode_page(const uint32_t slot,
+                      const uint32_t level,
+                      uint8_t page[4]) const;
+    void _mark_dirty(const uint32_t region_min[3],
+                     const uint32_t region_max[3]);
+
+    void _fill_slot(const uint64_t key,
+                    uint8_t *voxels,
+                    size_t *bytes_read) const;
+    void _commit_ready_loads();
+    void _worker_loop();
+};
+
+#endif // VOLUME_RESIDENCY_H_
@@ -0,0 +1,140 @@
+#include "volume_residency.h"
+
+#include <GLES3/gl3.h>
+#include <android/log.h>
+
+// GL side of the residency: the atlas, the page table & their uploads
+
+void sVolumeResidency::init_gl() {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Atlas: no mips, the slots would bleed into each other
+    glGenTextures(1, &atlas_texture);
+    glBindTexture(GL_TEXTURE_3D, atlas_texture);
+
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glTexStorage3D(GL_TEXTURE_3D,
+                   1,
+                   GL_R8,
+                   atlas_dims[0],
+                   atlas_dims[1],
+                   atlas_dims[2]);
+
+    // Page table, starts empty
+    glGenTextures(1, &page_table_texture);
+    glBindTexture(GL_TEXTURE_3D, page_table_texture);
+
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    glTexStorage3D(GL_TEXTURE_3D,
+                   1,
+                   GL_RGBA8,
+                   page_table_dims[0],
+                   page_table_dims[1],
+                   page_table_dims[2]);
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    if (slot_count < requested_slot_count) {
+        __android_log_print(ANDROID_LOG_WARN,
+                            "Residency",
+                            "%u brick slots requested, only %u fit on the atlas",
+                            requested_slot_count,
+                            slot_count);
+    }
+
+    __android_log_print(ANDROID_LOG_VERBOSE,
+                        "Residency",
+                        "Brick cache of %u slots, atlas of %ux%ux%u, %u levels of detail",
+                        slot_count,
+                        atlas_dims[0],
+                        atlas_dims[1],
+                        atlas_dims[2],
+                        lod_count);
+}
+
+void sVolumeResidency::destroy_gl() {
+    if (atlas_texture != 0) {
+        glDeleteTextures(1, &atlas_texture);
+        atlas_texture = 0;
+    }
+    if (page_table_texture != 0) {
+        glDeleteTextures(1, &page_table_texture);
+        page_table_texture = 0;
+    }
+}
+
+void sVolumeResidency::upload(sUploadScheduler *scheduler) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // The finished bricks, while they fit on the frame budget
+    glBindTexture(GL_TEXTURE_3D, atlas_texture);
+    const size_t slot_size = get_slot_size();
+    for(uint32_t i = 0; i < RESIDENCY_MAX_LOADS; i++) {
+        if (loads[i].state != LOAD_READY) {
+            continue;
+        }
+        if (!scheduler->can_upload(slot_size)) {
+            break;
+        }
+
+        uint32_t slot_origin[3];
+        get_slot_origin(loads[i].slot, slot_origin);
+        glTexSubImage3D(GL_TEXTURE_3D,
+                        0,
+                        slot_origin[0],
+                        slot_origin[1],
+                        slot_origin[2],
+                        slot_side,
+                        slot_side,
+                        slot_side,
+                        GL_RED,
+                        GL_UNSIGNED_BYTE,
+                        loads[i].voxels);
+        scheduler->add_upload(slot_size);
+
+        commit_load(i);
+    }
+
+    if (!page_table_dirty) {
+        glBindTexture(GL_TEXTURE_3D, 0);
+        return;
+    }
+
+    // Only the box of pages that changed, straight from the full table
+    glBindTexture(GL_TEXTURE_3D, page_table_texture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, page_table_dims[0]);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, page_table_dims[1]);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, dirty_min[0]);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, dirty_min[1]);
+    glPixelStorei(GL_UNPACK_SKIP_IMAGES, dirty_min[2]);
+    glTexSubImage3D(GL_TEXTURE_3D,
+                    0,
+                    dirty_min[0],
+                    dirty_min[1],
+                    dirty_min[2],
+                    dirty_max[0] - dirty_min[0],
+                    dirty_max[1] - dirty_min[1],
+                    dirty_max[2] - dirty_min[2],
+                    GL_RGBA,
+                    GL_UNSIGNED_BYTE,
+                    page_table);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+    glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+    glPixelStorei(GL_UNPACK_SKIP_IMAGES, 0);
+    scheduler->add_upload((size_t) (dirty_max[0] - dirty_min[0]) * (dirty_max[1] - dirty_min[1]) * (dirty_max[2] - dirty_min[2]) * 4);
+    page_table_dirty = false;
+
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
@@ -0,0 +1,346 @@
+#include "volume_sequence.h"
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <sys/stat.h>
+
+#include "mapped_file.h"
+
+// INIT ===================
+bool sVolumeSequence::init(const char *sequence_dir,
+                           const uint32_t width,
+                           const uint32_t height,
+                           const uint32_t depth,
+                           const uint32_t ring_entry_count,
+                           const float timesteps_per_second,
+                           const bool is_headless) {
+    strncpy(base_dir, sequence_dir, sizeof(base_dir) - 1);
+    base_dir[sizeof(base_dir) - 1] = '\0';
+    dims[0] = width;
+    dims[1] = height;
+    dims[2] = depth;
+    timestep_size = (size_t) width * height * depth;
+    fps = timesteps_per_second;
+    headless = is_headless;
+
+    // All the timesteps there are, until one is missing
+    char timestep_dir[512];
+    timestep_count = 0;
+    for(uint32_t timestep = 0; timestep < SEQUENCE_MAX_TIMESTEPS; timestep++) {
+        get_timestep_dir(base_dir,
+                         timestep,
+                         timestep_dir,
+                         sizeof(timestep_dir));
+        struct stat file_stat;
+        if (stat(timestep_dir, &file_stat) != 0) {
+            break;
+        }
+        if ((size_t) file_stat.st_size < timestep_size) {
+            return false;
+        }
+        timestep_count++;
+    }
+
+    if (timestep_count == 0) {
+        return false;
+    }
+
+    // One entry is on screen, the rest ahead
+    ring_size = (ring_entry_count < 2) ? 2 : ring_entry_count;
+    ring_size = (ring_size > SEQUENCE_MAX_RING_SIZE) ? SEQUENCE_MAX_RING_SIZE : ring_size;
+    for(uint32_t i = 0; i < ring_size; i++) {
+        entries[i].staging = (uint8_t*) malloc(timestep_size);
+        entries[i].state.store(ENTRY_FREE);
+        entries[i].timestep = SEQUENCE_NO_TIMESTEP;
+    }
+
+    position = 0.0;
+    shown_entry = SEQUENCE_NO_TIMESTEP;
+    shown_timestep = SEQUENCE_NO_TIMESTEP;
+    stats = {};
+    clock_started = false;
+
+    queue_start = 0;
+    queue_size = 0;
+    running = true;
+    prefetch_thread = std::thread(&sVolumeSequence::_prefetch_loop,
+                                  this);
+
+    // The first timesteps start loading before the first frame
+    _prefetch(0);
+
+    return true;
+}
+
+void sVolumeSequence::destroy() {
+    if (running) {
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            running = false;
+        }
+        queue_condition.notify_all();
+        prefetch_thread.join();
+    }
+
+    for(uint32_t i = 0; i < ring_size; i++) {
+        free(entries[i].staging);
+        entries[i].staging = NULL;
+        entries[i].state.store(ENTRY_FREE);
+        entries[i].timestep = SEQUENCE_NO_TIMESTEP;
+    }
+    ring_size = 0;
+    timestep_count = 0;
+}
+
+// PLAYBACK ===================
+void sVolumeSequence::update() {
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    const double delta_time = (clock_started) ? std::chrono::duration<double>(now - last_update).count() : 0.0;
+    last_update = now;
+    clock_started = true;
+
+    advance(delta_time);
+}
+
+void sVolumeSequence::advance(const double delta_time) {
+    if (headless) {
+        for(uint32_t i = 0; i < ring_size; i++) {
+            if (entries[i].state.load(std::memory_order_acquire) == ENTRY_LOADED) {
+                entries[i].state.store(ENTRY_RESIDENT, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    stats.elapsed_seconds += delta_time;
+
+    if (shown_entry == SEQUENCE_NO_TIMESTEP) {
+        // The clock does not start until there is something on screen
+        const uint32_t target = _get_target_timestep();
+        const uint32_t entry_id = _find_entry(target);
+        if (entry_id != SEQUENCE_NO_TIMESTEP && entries[entry_id].state.load(std::memory_order_relaxed) == ENTRY_RESIDENT) {
+            _show_entry(entry_id);
+        }
+        _prefetch(target);
+        return;
+    }
+
+    position += delta_time * fps * playback_rate;
+    if (position >= (double) timestep_count) {
+        if (loop) {
+            position = fmod(position, (double) timestep_count);
+            stats_log_pending = true;
+        } else {
+            position = (double) (timestep_count - 1);
+        }
+    }
+
+    uint32_t target = _get_target_timestep();
+    if (target != shown_timestep) {
+        uint32_t distance = _get_distance(shown_timestep, target);
+
+        // Holding never skips: the clock waits on the next timestep
+        if (rate_mode == SEQUENCE_HOLD_LATE && distance > 1) {
+            target = (shown_timestep + 1) % timestep_count;
+            position = (double) target;
+            distance = 1;
+        }
+
+        // The latest resident timestep up to the target
+        uint32_t step = distance;
+        uint32_t entry_id = SEQUENCE_NO_TIMESTEP;
+        for(; step > 0; step--) {
+            entry_id = _find_entry((shown_timestep + step) % timestep_count);
+            if (entry_id != SEQUENCE_NO_TIMESTEP && entries[entry_id].state.load(std::memory_order_relaxed) == ENTRY_RESIDENT) {
+                break;
+            }
+        }
+
+        if (step > 0) {
+            stats.dropped_timesteps += step - 1;
+            _show_entry(entry_id);
+        }
+
+        if (step < distance) {
+            stats.held_frames++;
+            if (rate_mode == SEQUENCE_HOLD_LATE) {
+                position = (double) target;
+            }
+        }
+    }
+
+    _prefetch(target);
+}
+
+sSequenceStats sVolumeSequence::get_stats() const {
+    sSequenceStats result = stats;
+    result.loaded_timesteps = read_count.load(std::memory_order_relaxed);
+    result.bytes_read = read_bytes.load(std::memory_order_relaxed);
+    result.read_seconds = read_ns.load(std::memory_order_relaxed) / 1e9;
+    return result;
+}
+
+uint32_t sVolumeSequence::_get_target_timestep() const {
+    const uint32_t timestep = (uint32_t) position;
+    return (timestep < timestep_count) ? timestep : timestep_count - 1;
+}
+
+uint32_t sVolumeSequence::_get_distance(const uint32_t from,
+                                        const uint32_t to) const {
+    if (loop) {
+        return (to + timestep_count - from) % timestep_count;
+    }
+    return (to > from) ? to - from : 0;
+}
+
+uint32_t sVolumeSequence::_find_entry(const uint32_t timestep) const {
+    for(uint32_t i = 0; i < ring_size; i++) {
+        if (entries[i].timestep == timestep && entries[i].state.load(std::memory_order_relaxed) != ENTRY_FREE) {
+            return i;
+        }
+    }
+    return SEQUENCE_NO_TIMESTEP;
+}
+
+void sVolumeSequence::_show_entry(const uint32_t entry_id) {
+    shown_entry = entry_id;
+    shown_timestep = entries[entry_id].timestep;
+    entries[entry_id].was_shown = true;
+    stats.shown_timesteps++;
+}
+
+// PREFETCH ===================
+void sVolumeSequence::_prefetch(const uint32_t first_timestep) {
+    // When dropping, the timesteps that a read would not bring in time are skipped
+    uint32_t lead = 0;
+    const uint32_t read_timesteps = read_count.load(std::memory_order_relaxed);
+    if (rate_mode == SEQUENCE_DROP_LATE && read_timesteps > 0 && shown_entry != SEQUENCE_NO_TIMESTEP) {
+        const double read_seconds = (read_ns.load(std::memory_order_relaxed) / 1e9) / read_timesteps;
+        lead = (uint32_t) ceil(read_seconds * fps * playback_rate);
+    }
+
+    // Window of timesteps to keep, besides the one on screen
+    uint32_t window[SEQUENCE_MAX_RING_SIZE];
+    uint32_t window_size = 0;
+    for(uint32_t step = 0; step < timestep_count && window_size < ring_size - 1; step++) {
+        const uint32_t timestep = first_timestep + step;
+        if (!loop && timestep >= timestep_count) {
+            break;
+        }
+        if (timestep % timestep_count == shown_timestep) {
+            continue;
+        }
+        if (step < lead && _find_entry(timestep % timestep_count) == SEQUENCE_NO_TIMESTEP) {
+            continue;
+        }
+        window[window_size++] = timestep % timestep_count;
+    }
+
+    // Free the entries out of the window; the ones on the thread are freed once they are done
+    for(uint32_t i = 0; i < ring_size; i++) {
+        sSequenceEntry &entry = entries[i];
+        const uint8_t state = entry.state.load(std::memory_order_acquire);
+        if (i == shown_entry || state == ENTRY_FREE || state == ENTRY_LOADING) {
+            continue;
+        }
+
+        bool in_window = false;
+        for(uint32_t w = 0; w < window_size && !in_window; w++) {
+            in_window = window[w] == entry.timestep;
+        }
+        if (in_window) {
+            continue;
+        }
+
+        if (!entry.was_shown) {
+            stats.wasted_loads++;
+        }
+        entry.timestep = SEQUENCE_NO_TIMESTEP;
+        entry.uploaded_slices = 0;
+        entry.was_shown = false;
+        entry.state.store(ENTRY_FREE, std::memory_order_relaxed);
+    }
+
+    // And load the missing ones, in playback order
+    uint32_t queued_entries = 0;
+    uint32_t entry_id = 0;
+    for(uint32_t w = 0; w < window_size; w++) {
+        if (_find_entry(window[w]) != SEQUENCE_NO_TIMESTEP) {
+            continue;
+        }
+
+        for(; entry_id < ring_size; entry_id++) {
+            if (entry_id != shown_entry && entries[entry_id].state.load(std::memory_order_relaxed) == ENTRY_FREE) {
+                break;
+            }
+        }
+        if (entry_id == ring_size) {
+            break;
+        }
+
+        sSequenceEntry &entry = entries[entry_id];
+        entry.timestep = window[w];
+        entry.uploaded_slices = 0;
+        entry.was_shown = false;
+        entry.state.store(ENTRY_LOADING, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue[(queue_start + queue_size) % SEQUENCE_MAX_RING_SIZE] = (uint8_t) entry_id;
+        queue_size++;
+        queued_entries++;
+    }
+
+    if (queued_entries > 0) {
+        queue_condition.notify_one();
+    }
+}
+
+void sVolumeSequence::_prefetch_loop() {
+    char timestep_dir[512];
+    for(;;) {
+        uint8_t entry_id;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_condition.wait(lock, [this]{
+                return queue_size > 0 || !running;
+            });
+
+            if (!running) {
+                return;
+            }
+
+            entry_id = queue[queue_start];
+            queue_start = (queue_start + 1) % SEQUENCE_MAX_RING_SIZE;
+            queue_size--;
+        }
+
+        sSequenceEntry &entry = entries[entry_id];
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+        // The raw timestep is copied as is; this is where a compressed one would be decoded
+        get_timestep_dir(base_dir,
+                         entry.timestep,
+                         timestep_dir,
+                         sizeof(timestep_dir));
+        sMappedFile file = {};
+        if (file.open(timestep_dir) && file.size >= timestep_size) {
+            file.advise_sequential_read();
+            memcpy(entry.staging,
+                   file.data,
+                   timestep_size);
+            read_bytes.fetch_add(timestep_size, std::memory_order_relaxed);
+        } else {
+            memset(entry.staging,
+                   0,
+                   timestep_size);
+        }
+        file.close();
+
+        read_ns.fetch_add((uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count(),
+                          std::memory_order_relaxed);
+        read_count.fetch_add(1, std::memory_order_relaxed);
+
+        entry.state.store(ENTRY_LOADED, std::memory_order_release);
+    }
+}
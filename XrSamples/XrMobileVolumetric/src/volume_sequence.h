@@ -0,0 +1,197 @@
+#ifndef VOLUME_SEQUENCE_H_
+#define VOLUME_SEQUENCE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+
+#include "upload_scheduler.h"
+
+#define SEQUENCE_MAX_RING_SIZE 8
+#define SEQUENCE_DEFAULT_RING_SIZE 4
+#define SEQUENCE_DEFAULT_FPS 10.0f
+#define SEQUENCE_MAX_TIMESTEPS 4096
+#define SEQUENCE_UPLOAD_SLAB_SIZE (2 * 1024 * 1024) // Target bytes per upload
+#define SEQUENCE_NO_TIMESTEP 0xFFFFFFFFu
+
+/**
+ * Time-varying (4D) volumes
+ * A sequence is a folder of raw R8 timesteps of the same size, named 0000.raw,
+ * 0001.raw... (see get_timestep_dir); it is played from a ring of ring_size
+ * entries, each with a staging copy on RAM and a 3D texture.
+ * A prefetch thread reads the timesteps ahead of the playback into the
+ * staging of the free entries; the GL thread uploads them in slabs, within
+ * the frame budget of the upload scheduler, and swaps the texture that the
+ * material binds once the timestep that the clock wants is resident.
+ * The render loop never waits: if a timestep is late, the previous one is
+ * held on screen, and the playback either skips the late timesteps
+ * (SEQUENCE_DROP_LATE, the clock keeps real time, and the prefetch aims ahead
+ * by the time that a read takes) or slows down to wait for them
+ * (SEQUENCE_HOLD_LATE, every timestep is shown).
+ * This file has no GL: the textures & uploads are on volume_sequence_gl.cpp,
+ * and in headless mode the loaded timesteps are resident straight away, so
+ * the ring can be sized on the host.
+ * */
+
+enum eSequenceRateMode : uint8_t {
+    SEQUENCE_DROP_LATE = 0,
+    SEQUENCE_HOLD_LATE
+};
+
+enum eSequenceEntryState : uint8_t {
+    ENTRY_FREE = 0,
+    ENTRY_LOADING,  // On the prefetch thread
+    ENTRY_LOADED,   // On staging, waiting for the upload
+    ENTRY_RESIDENT  // On its texture
+};
+
+struct sSequenceEntry {
+    std::atomic<uint8_t>    state{ENTRY_FREE};
+    uint32_t                timestep = SEQUENCE_NO_TIMESTEP;
+    uint8_t                 *staging = NULL;
+    uint32_t                uploaded_slices = 0; // Of the upload in progress
+    bool                    was_shown = false;
+    unsigned int            texture = 0; // R8 3D texture
+};
+
+struct sSequenceStats {
+    uint32_t    shown_timesteps = 0;
+    uint32_t    dropped_timesteps = 0; // Skipped because they were late
+    uint32_t    held_frames = 0; // Render frames that kept a timestep the clock had left
+    uint32_t    loaded_timesteps = 0;
+    uint32_t    wasted_loads = 0; // Loaded, and out of the window before being shown
+    uint64_t    bytes_read = 0;
+    double      read_seconds = 0.0; // Busy time of the prefetch thread
+    double      elapsed_seconds = 0.0; // Of playback
+
+    // What the playback got from the disk, over its whole time
+    inline double get_sustained_mb_s() const {
+        return (elapsed_seconds > 0.0) ? (bytes_read / (1024.0 * 1024.0)) / elapsed_seconds : 0.0;
+    }
+
+    // What the disk gives while it is being read
+    inline double get_read_mb_s() const {
+        return (read_seconds > 0.0) ? (bytes_read / (1024.0 * 1024.0)) / read_seconds : 0.0;
+    }
+};
+
+struct sVolumeSequence {
+    char            base_dir[256] = "";
+    uint32_t        dims[3] = {0, 0, 0};
+    uint32_t        timestep_count = 0;
+    size_t          timestep_size = 0;
+
+    // Playback, in timesteps per second; rate scales it (0 pauses)
+    float               fps = SEQUENCE_DEFAULT_FPS;
+    float               playback_rate = 1.0f;
+    eSequenceRateMode   rate_mode = SEQUENCE_DROP_LATE;
+    bool                loop = true;
+    double              position = 0.0; // In timesteps
+
+    bool            headless = false;
+    uint8_t         texture_id = 0; // On the material manager
+
+    sSequenceEntry  entries[SEQUENCE_MAX_RING_SIZE];
+    uint32_t        ring_size = 0;
+    uint32_t        shown_entry = SEQUENCE_NO_TIMESTEP;
+    uint32_t        shown_timestep = SEQUENCE_NO_TIMESTEP;
+
+    // Prefetch thread & its queue of entries to fill
+    std::thread             prefetch_thread;
+    std::mutex              queue_mutex;
+    std::condition_variable queue_condition;
+    uint8_t                 queue[SEQUENCE_MAX_RING_SIZE];
+    uint32_t                queue_start = 0;
+    uint32_t                queue_size = 0;
+    bool                    running = false;
+
+    // Written by the prefetch thread
+    std::atomic<uint64_t>   read_bytes{0};
+    std::atomic<uint64_t>   read_ns{0};
+    std::atomic<uint32_t>   read_count{0};
+
+    sSequenceStats          stats = {};
+    bool                    stats_log_pending = false; // On each loop of the playback
+    std::chrono::steady_clock::time_point last_update;
+    bool                    clock_started = false;
+
+    /**
+     * Counts the timesteps of base_dir, all of width x height x depth voxels,
+     * and allocates the staging of a ring of ring_size entries.
+     * Returns false if there are no timesteps, or they are too small
+     * */
+    bool init(const char *sequence_dir,
+              const uint32_t width,
+              const uint32_t height,
+              const uint32_t depth,
+              const uint32_t ring_entry_count,
+              const float timesteps_per_second,
+              const bool is_headless);
+    void destroy();
+
+    // Advances the playback with the time since the last call, on the GL thread
+    void update();
+
+    /**
+     * Advances the clock by delta_time seconds, picks the timestep to show
+     * from the resident ones, and queues the reads of the ones ahead.
+     * When headless, the loaded timesteps are made resident here.
+     * */
+    void advance(const double delta_time);
+
+    // GL side, on volume_sequence_gl.cpp
+    void init_gl();
+    void destroy_gl();
+    // Uploads the loaded timesteps, the next to show first, while they fit on the budget
+    void upload(sUploadScheduler *scheduler);
+
+    // Texture of the timestep on screen, 0 until the first one is resident
+    inline unsigned int get_shown_texture() const {
+        return (shown_entry != SEQUENCE_NO_TIMESTEP) ? entries[shown_entry].texture : 0;
+    }
+
+    inline void set_playback_rate(const float rate) {
+        playback_rate = rate;
+    }
+
+    inline void seek(const uint32_t timestep) {
+        position = (double) ((timestep < timestep_count) ? timestep : timestep_count - 1);
+    }
+
+    sSequenceStats get_stats() const;
+
+    // Of the staging; the textures take as much on the GPU
+    inline size_t get_memory_size() const {
+        return timestep_size * ring_size;
+    }
+
+    inline static void get_timestep_dir(const char *base_dir,
+                                        const uint32_t timestep,
+                                        char *result,
+                                        const size_t result_size) {
+        snprintf(result,
+                 result_size,
+                 "%s/%04u.raw",
+                 base_dir,
+                 timestep);
+    }
+
+    // Timestep the clock wants now
+    uint32_t _get_target_timestep() const;
+    // Steps forward from one timestep to another, counting the loop
+    uint32_t _get_distance(const uint32_t from,
+                           const uint32_t to) const;
+    // Entry that holds or is loading a timestep
+    uint32_t _find_entry(const uint32_t timestep) const;
+    void _show_entry(const uint32_t entry_id);
+    // Keeps the ring on the timesteps from first_timestep on
+    void _prefetch(const uint32_t first_timestep);
+    void _prefetch_loop();
+};
+
+#endif // VOLUME_SEQUENCE_H_
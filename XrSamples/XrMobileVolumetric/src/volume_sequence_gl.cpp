@@ -0,0 +1,122 @@
+#include "volume_sequence.h"
+
+#include <GLES3/gl3.h>
+#include <android/log.h>
+
+// GL side of the sequence: the textures of the ring & their uploads
+
+void sVolumeSequence::init_gl() {
+    for(uint32_t i = 0; i < ring_size; i++) {
+        glGenTextures(1, &entries[i].texture);
+        glBindTexture(GL_TEXTURE_3D, entries[i].texture);
+
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        glTexStorage3D(GL_TEXTURE_3D,
+                       1,
+                       GL_R8,
+                       dims[0],
+                       dims[1],
+                       dims[2]);
+    }
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    __android_log_print(ANDROID_LOG_VERBOSE,
+                        "VolumeSequence",
+                        "Sequence %s: %u timesteps of %ux%ux%u, ring of %u (%.1f MB of staging & of textures)",
+                        base_dir,
+                        timestep_count,
+                        dims[0],
+                        dims[1],
+                        dims[2],
+                        ring_size,
+                        get_memory_size() / (1024.0 * 1024.0));
+}
+
+void sVolumeSequence::destroy_gl() {
+    for(uint32_t i = 0; i < ring_size; i++) {
+        if (entries[i].texture != 0) {
+            glDeleteTextures(1, &entries[i].texture);
+            entries[i].texture = 0;
+        }
+    }
+}
+
+void sVolumeSequence::upload(sUploadScheduler *scheduler) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    const size_t slice_size = (size_t) dims[0] * dims[1];
+    uint32_t slab_depth = (uint32_t) (SEQUENCE_UPLOAD_SLAB_SIZE / slice_size);
+    slab_depth = (slab_depth == 0) ? 1 : slab_depth;
+
+    const uint32_t target = _get_target_timestep();
+    for(;;) {
+        // The loaded timestep that is the next to show
+        uint32_t entry_id = SEQUENCE_NO_TIMESTEP;
+        uint32_t min_distance = SEQUENCE_NO_TIMESTEP;
+        for(uint32_t i = 0; i < ring_size; i++) {
+            if (entries[i].state.load(std::memory_order_acquire) != ENTRY_LOADED) {
+                continue;
+            }
+            const uint32_t distance = _get_distance(target, entries[i].timestep);
+            if (distance < min_distance) {
+                min_distance = distance;
+                entry_id = i;
+            }
+        }
+        if (entry_id == SEQUENCE_NO_TIMESTEP) {
+            break;
+        }
+
+        // In slabs, so a timestep can span several frames
+        sSequenceEntry &entry = entries[entry_id];
+        glBindTexture(GL_TEXTURE_3D, entry.texture);
+        while (entry.uploaded_slices < dims[2]) {
+            const uint32_t depth = (entry.uploaded_slices + slab_depth > dims[2]) ? dims[2] - entry.uploaded_slices : slab_depth;
+            const size_t slab_size = slice_size * depth;
+            if (!scheduler->can_upload(slab_size)) {
+                break;
+            }
+
+            glTexSubImage3D(GL_TEXTURE_3D,
+                            0,
+                            0,
+                            0,
+                            entry.uploaded_slices,
+                            dims[0],
+                            dims[1],
+                            depth,
+                            GL_RED,
+                            GL_UNSIGNED_BYTE,
+                            entry.staging + slice_size * entry.uploaded_slices);
+            scheduler->add_upload(slab_size);
+            entry.uploaded_slices += depth;
+        }
+
+        if (entry.uploaded_slices < dims[2]) {
+            break;
+        }
+        entry.state.store(ENTRY_RESIDENT, std::memory_order_relaxed);
+    }
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    if (stats_log_pending) {
+        const sSequenceStats curr_stats = get_stats();
+        __android_log_print(ANDROID_LOG_VERBOSE,
+                            "VolumeSequence",
+                            "Sequence %s: %u shown, %u dropped, %u frames held, %u wasted loads; %.1f MB/s sustained, %.1f MB/s read, %.1f MB/s needed",
+                            base_dir,
+                            curr_stats.shown_timesteps,
+                            curr_stats.dropped_timesteps,
+                            curr_stats.held_frames,
+                            curr_stats.wasted_loads,
+                            curr_stats.get_sustained_mb_s(),
+                            curr_stats.get_read_mb_s(),
+                            (timestep_size / (1024.0 * 1024.0)) * fps * playback_rate);
+        stats_log_pending = false;
+    }
+}
@@ -0,0 +1,702 @@
+#include "volume_streamer.h"
+
+#include <GLES3/gl3.h>
+#include <android/log.h>
+#include <cstring>
+#include <cassert>
+
+// Sizes of a mip level, as GL sees them
+static void get_level_dims(const sTexture &texture,
+                           const uint32_t level,
+                           uint32_t dims[3]) {
+    dims[0] = (uint32_t) texture.width;
+    dims[1] = (uint32_t) texture.height;
+    dims[2] = (uint32_t) texture.depth;
+    for(uint32_t i = 0; i < level; i++) {
+        dims[0] = VolumeMips::get_next_level_size(dims[0]);
+        dims[1] = VolumeMips::get_next_level_size(dims[1]);
+        dims[2] = VolumeMips::get_next_level_size(dims[2]);
+    }
+}
+
+// Of a slab of a level; the slab of the preview level holds the levels over it too
+static size_t get_slab_size(const sStreamJob &job,
+                            const uint8_t level,
+                            const uint32_t slab_id) {
+    uint32_t dims[3];
+    get_level_dims(*job.texture,
+                   level,
+                   dims);
+
+    if (job.is_progressive && level == job.preview_level) {
+        const uint32_t level_count = VolumeMips::get_mip_count(job.texture->width,
+                                                               job.texture->height,
+                                                               job.texture->depth);
+        size_t size = 0;
+        for(uint32_t i = level; i < level_count; i++) {
+            size += (size_t) dims[0] * dims[1] * dims[2] * VOLUME_BYTES_PER_VOXEL;
+            dims[0] = VolumeMips::get_next_level_size(dims[0]);
+            dims[1] = VolumeMips::get_next_level_size(dims[1]);
+            dims[2] = VolumeMips::get_next_level_size(dims[2]);
+        }
+        return size;
+    }
+
+    const uint32_t z_start = slab_id * job.level_slab_depths[level];
+    const uint32_t slab_depth = (z_start + job.level_slab_depths[level] > dims[2]) ? dims[2] - z_start : job.level_slab_depths[level];
+    return (size_t) dims[0] * dims[1] * slab_depth * VOLUME_BYTES_PER_VOXEL;
+}
+
+/**
+ * Point samples the z slices [z_start, z_end) of a level, on the center of
+ * each of its texels
+ * */
+static void sample_level_slices(const uint8_t *volume,
+                                const uint32_t volume_dims[3],
+                                const uint32_t level_dims[3],
+                                const uint32_t z_start,
+                                const uint32_t z_end,
+                                uint8_t *result) {
+    const size_t volume_slice = (size_t) volume_dims[0] * volume_dims[1];
+    for(uint32_t z = z_start; z < z_end; z++) {
+        const uint32_t src_z = ((2 * z + 1) * volume_dims[2]) / (2 * level_dims[2]);
+        for(uint32_t y = 0; y < level_dims[1]; y++) {
+            const uint32_t src_y = ((2 * y + 1) * volume_dims[1]) / (2 * level_dims[1]);
+            const uint8_t *src_row = volume + src_z * volume_slice + (size_t) src_y * volume_dims[0];
+            for(uint32_t x = 0; x < level_dims[0]; x++) {
+                *(result++) = src_row[((2 * x + 1) * volume_dims[0]) / (2 * level_dims[0])];
+            }
+        }
+    }
+}
+
+void sVolumeStreamer::init() {
+    if (running) {
+        return;
+    }
+
+    for(uint8_t i = 0; i < STREAMER_PBO_COUNT; i++) {
+        glGenBuffers(1, &slots[i].pbo);
+        slots[i].state.store(SLOT_FREE);
+    }
+
+    queue_start = 0;
+    queue_size = 0;
+    running = true;
+
+    loader_thread = std::thread(&sVolumeStreamer::_loader_loop,
+                                this);
+}
+
+void sVolumeStreamer::destroy() {
+    if (!running) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        running = false;
+    }
+    queue_condition.notify_all();
+    loader_thread.join();
+
+    for(uint8_t i = 0; i < STREAMER_PBO_COUNT; i++) {
+        if (slots[i].mapped_data != NULL) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slots[i].pbo);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            slots[i].mapped_data = NULL;
+        }
+        glDeleteBuffers(1, &slots[i].pbo);
+        slots[i].state.store(SLOT_FREE);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    for(uint8_t i = 0; i < STREAMER_MAX_JOBS; i++) {
+        jobs[i].acceleration.clean();
+        jobs[i].file.close();
+        jobs[i].cached.close();
+        jobs[i].reader.close();
+        free(jobs[i].inflated);
+        jobs[i].inflated = NULL;
+        jobs[i].active = false;
+    }
+}
+
+bool sVolumeStreamer::add_job(const uint8_t texture_id,
+                              sTexture *texture,
+                              const char *volume_dir,
+                              const fVolumeLoadedCallback on_loaded,
+                              void *user_data,
+                              sDerivedCache *cache,
+                              const uint64_t cache_key,
+                              const float source_ms) {
+    const uint8_t job_id = _get_free_job();
+
+    sStreamJob &job = jobs[job_id];
+    if (!job.file.open(volume_dir)) {
+        __android_log_print(ANDROID_LOG_ERROR,
+                            "VolumeStreamer",
+                            "Cannot map volume %s",
+                            volume_dir);
+        return false;
+    }
+
+    const size_t volume_size = (size_t) texture->width * texture->height * texture->depth * VOLUME_BYTES_PER_VOXEL;
+    if (job.file.size < volume_size) {
+        __android_log_print(ANDROID_LOG_ERROR,
+                            "VolumeStreamer",
+                            "Volume %s is %zu bytes, expected %zu",
+                            volume_dir,
+                            job.file.size,
+                            volume_size);
+        job.file.close();
+        return false;
+    }
+    job.file.advise_sequential_read();
+    job.voxels = job.file.data;
+
+    job.cache = cache;
+    job.cache_key = cache_key;
+    job.source_ms = source_ms;
+
+    _start_job(job_id,
+               texture_id,
+               texture,
+               on_loaded,
+               user_data);
+
+    return true;
+}
+
+bool sVolumeStreamer::add_archive_job(const uint8_t texture_id,
+                                      sTexture *texture,
+                                      const sApkArchive &archive,
+                                      const uint32_t entry_id,
+                                      const fVolumeLoadedCallback on_loaded,
+                                      void *user_data,
+                                      sDerivedCache *cache,
+                                      const uint64_t cache_key,
+                                      const float source_ms) {
+    const size_t volume_size = (size_t) texture->width * texture->height * texture->depth * VOLUME_BYTES_PER_VOXEL;
+    if (archive.entries[entry_id].size < volume_size) {
+        __android_log_print(ANDROID_LOG_ERROR,
+                            "VolumeStreamer",
+                            "Volume %i is %llu bytes on the APK, expected %zu",
+                            texture_id,
+                            (unsigned long long) archive.entries[entry_id].size,
+                            volume_size);
+        return false;
+    }
+
+    const uint8_t job_id = _get_free_job();
+    sStreamJob &job = jobs[job_id];
+
+    // Opened in place, the inflate state cannot be moved
+    if (!job.reader.open(archive, entry_id)) {
+        return false;
+    }
+    if (job.reader.get_view() != NULL) {
+        job.voxels = (const char*) job.reader.get_view();
+        archive.file.advise_will_need(archive.entries[entry_id].data_offset,
+                                      volume_size);
+    } else {
+        job.inflated = (uint8_t*) malloc(volume_size);
+        job.voxels = (const char*) job.inflated;
+    }
+
+    job.cache = cache;
+    job.cache_key = cache_key;
+    job.source_ms = source_ms;
+
+    _start_job(job_id,
+               texture_id,
+               texture,
+               on_loaded,
+               user_data);
+
+    return true;
+}
+
+bool sVolumeStreamer::add_cached_job(const uint8_t texture_id,
+                                     sTexture *texture,
+                                     sDerivedBlob *blob,
+                                     const fVolumeLoadedCallback on_loaded,
+                                     void *user_data) {
+    const sDerivedSection *volume = blob->find_section(DERIVED_VOLUME);
+    if (volume == NULL ||
+        volume->dims[0] != (uint32_t) texture->width ||
+        volume->dims[1] != (uint32_t) texture->height ||
+        volume->dims[2] != (uint32_t) texture->depth) {
+        __android_log_print(ANDROID_LOG_ERROR,
+                            "VolumeStreamer",
+                            "The cache entry of volume %i does not match it",
+                            texture_id);
+        return false;
+    }
+
+    const uint8_t job_id = _get_free_job();
+    sStreamJob &job = jobs[job_id];
+
+    // The job owns the mapping now; a view (a baked entry on the APK) is only
+    // borrowed. The section is on the header of the blob, that is reset
+    job.voxels = (const char*) blob->get_section_data(volume);
+    job.cached = *blob;
+    *blob = {};
+    if (job.cached.file.is_open()) {
+        job.cached.file.advise_sequential_read();
+    }
+
+    job.cache = NULL;
+    job.source_ms = 0.0f;
+
+    _start_job(job_id,
+               texture_id,
+               texture,
+               on_loaded,
+               user_data);
+
+    return true;
+}
+
+uint8_t sVolumeStreamer::_get_free_job() const {
+    uint8_t job_id = 0;
+    for(; job_id < STREAMER_MAX_JOBS; job_id++) {
+        if (!jobs[job_id].active) {
+            break;
+        }
+    }
+    assert(job_id < STREAMER_MAX_JOBS && "No more space for volume streaming jobs");
+
+    return job_id;
+}
+
+void sVolumeStreamer::_start_job(const uint8_t job_id,
+                                 const uint8_t texture_id,
+                                 sTexture *texture,
+                                 const fVolumeLoadedCallback on_loaded,
+                                 void *user_data) {
+    sStreamJob &job = jobs[job_id];
+
+    job.texture_id = texture_id;
+    job.texture = texture;
+
+    // Progressive if the voxels can be read out of order: the deflated
+    // entries are only there as they are inflated
+    const uint32_t level_count = VolumeMips::get_mip_count(texture->width,
+                                                           texture->height,
+                                                           texture->depth);
+    uint32_t level_dims[3];
+    job.preview_level = 0;
+    for(; job.preview_level < level_count - 1; job.preview_level++) {
+        get_level_dims(*texture,
+                       job.preview_level,
+                       level_dims);
+        if (level_dims[0] <= STREAMER_PREVIEW_SIZE && level_dims[1] <= STREAMER_PREVIEW_SIZE && level_dims[2] <= STREAMER_PREVIEW_SIZE) {
+            break;
+        }
+    }
+    job.is_progressive = job.inflated == NULL && job.preview_level > 0;
+    job.preview_level = (job.is_progressive) ? job.preview_level : 0;
+    job.request_level = job.preview_level;
+
+    job.slab_count = 0;
+    for(uint32_t level = 0; level < VOLUME_MAX_MIP_LEVELS; level++) {
+        job.level_slab_depths[level] = 0;
+        job.level_slab_counts[level] = 0;
+        job.level_slabs_requested[level] = 0;
+        job.level_slabs_uploaded[level] = 0;
+
+        const bool is_streamed = level == 0 ||
+                                 (job.is_progressive && level == job.preview_level) ||
+                                 (job.is_progressive && level < job.preview_level && level >= STREAMER_MIN_REFINE_LEVEL);
+        if (!is_streamed) {
+            continue;
+        }
+
+        get_level_dims(*texture,
+                       level,
+                       level_dims);
+        const size_t slice_size = (size_t) level_dims[0] * level_dims[1] * VOLUME_BYTES_PER_VOXEL;
+        job.level_slab_depths[level] = (uint32_t) (STREAMER_SLAB_SIZE / slice_size);
+        job.level_slab_depths[level] = (job.level_slab_depths[level] == 0) ? 1 : job.level_slab_depths[level];
+        job.level_slab_counts[level] = (level > 0 && level == job.preview_level) ? 1 : (level_dims[2] + job.level_slab_depths[level] - 1) / job.level_slab_depths[level];
+        job.slab_count += job.level_slab_counts[level];
+    }
+    job.slabs_requested = 0;
+    job.slabs_uploaded = 0;
+    job.on_loaded = on_loaded;
+    job.user_data = user_data;
+    job.start_time = std::chrono::steady_clock::now();
+
+    texture->is_loaded = false;
+    texture->resident_level = VOLUME_NO_RESIDENT_LEVEL;
+    texture->load_progress = 0.0f;
+    texture->create_empty_volume_storage(texture->width,
+                                         texture->height,
+                                         texture->depth);
+
+    job.active = true;
+}
+
+void sVolumeStreamer::update(sUploadScheduler *scheduler) {
+    if (!running) {
+        return;
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Upload the slabs that the loader has finished
+    for(uint8_t i = 0; i < STREAMER_PBO_COUNT; i++) {
+        sStreamSlot &slot = slots[i];
+        if (slot.state.load(std::memory_order_acquire) != SLOT_FILLED) {
+            continue;
+        }
+
+        if (scheduler != NULL && !scheduler->can_upload(slot.size)) {
+            break;
+        }
+
+        sStreamJob &job = jobs[slot.job_id];
+        sTexture &texture = *job.texture;
+        uint32_t level_dims[3];
+        get_level_dims(texture,
+                       slot.level,
+                       level_dims);
+        const uint32_t z_start = slot.slab_id * job.level_slab_depths[slot.level];
+        const uint32_t slab_depth = (z_start + job.level_slab_depths[slot.level] > level_dims[2]) ? level_dims[2] - z_start : job.level_slab_depths[slot.level];
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        slot.mapped_data = NULL;
+
+        glBindTexture(GL_TEXTURE_3D, texture.texture_id);
+        if (job.is_progressive && slot.level == job.preview_level) {
+            // The preview level & all the ones over it, one after the other
+            const uint32_t level_count = VolumeMips::get_mip_count(texture.width,
+                                                                   texture.height,
+                                                                   texture.depth);
+            size_t pbo_offset = 0;
+            for(uint32_t level = slot.level; level < level_count; level++) {
+                glTexSubImage3D(GL_TEXTURE_3D,
+                                level,
+                                0,
+                                0,
+                                0,
+                                level_dims[0],
+                                level_dims[1],
+                                level_dims[2],
+                                GL_RED,
+                                GL_UNSIGNED_BYTE,
+                                (void*) pbo_offset);
+                pbo_offset += (size_t) level_dims[0] * level_dims[1] * level_dims[2] * VOLUME_BYTES_PER_VOXEL;
+                level_dims[0] = VolumeMips::get_next_level_size(level_dims[0]);
+                level_dims[1] = VolumeMips::get_next_level_size(level_dims[1]);
+                level_dims[2] = VolumeMips::get_next_level_size(level_dims[2]);
+            }
+        } else {
+            glTexSubImage3D(GL_TEXTURE_3D,
+                            slot.level,
+                            0,
+                            0,
+                            z_start,
+                            level_dims[0],
+                            level_dims[1],
+                            slab_depth,
+                            GL_RED,
+                            GL_UNSIGNED_BYTE,
+                            (void*) 0); // Offset on the PBO
+        }
+        glBindTexture(GL_TEXTURE_3D, 0);
+
+        slot.state.store(SLOT_FREE, std::memory_order_relaxed);
+
+        if (scheduler != NULL) {
+            scheduler->add_upload(slot.size);
+        }
+
+        job.level_slabs_uploaded[slot.level]++;
+        job.slabs_uploaded++;
+        texture.load_progress = (float) job.slabs_uploaded / job.slab_count;
+        if (job.slabs_uploaded == job.slab_count) {
+            // The acceleration structures are uploaded on the timed window too
+            if (scheduler != NULL) {
+                scheduler->add_untimed_work();
+            }
+            _finish_job(slot.job_id);
+        } else if (job.is_progressive) {
+            _update_resident_level(slot.job_id);
+        }
+    }
+
+    // Hand the free PBOs to the loader
+    uint8_t queued_slots = 0;
+    uint8_t job_id = 0;
+    for(uint8_t i = 0; i < STREAMER_PBO_COUNT; i++) {
+        sStreamSlot &slot = slots[i];
+        if (slot.state.load(std::memory_order_relaxed) != SLOT_FREE) {
+            continue;
+        }
+
+        // Get a job with slabs left to read
+        for(; job_id < STREAMER_MAX_JOBS; job_id++) {
+            if (jobs[job_id].active && jobs[job_id].slabs_requested < jobs[job_id].slab_count) {
+                break;
+            }
+        }
+        if (job_id == STREAMER_MAX_JOBS) {
+            break;
+        }
+
+        // From the coarse levels to level 0, skipping the ones that are not streamed
+        sStreamJob &job = jobs[job_id];
+        while (job.level_slabs_requested[job.request_level] == job.level_slab_counts[job.request_level]) {
+            job.request_level--;
+        }
+
+        slot.job_id = job_id;
+        slot.level = job.request_level;
+        slot.slab_id = job.level_slabs_requested[slot.level]++;
+        slot.size = get_slab_size(job,
+                                  slot.level,
+                                  slot.slab_id);
+        job.slabs_requested++;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER,
+                     slot.size,
+                     NULL,
+                     GL_STREAM_DRAW);
+        slot.mapped_data = (char*) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER,
+                                                     0,
+                                                     slot.size,
+                                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        assert(slot.mapped_data != NULL && "Cannot map the streaming PBO");
+
+        slot.state.store(SLOT_LOADING, std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue[(queue_start + queue_size) % STREAMER_PBO_COUNT] = i;
+        queue_size++;
+        queued_slots++;
+    }
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (queued_slots > 0) {
+        queue_condition.notify_one();
+    }
+}
+
+bool sVolumeStreamer::is_idle() const {
+    for(uint8_t i = 0; i < STREAMER_MAX_JOBS; i++) {
+        if (jobs[i].active) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void sVolumeStreamer::_update_resident_level(const uint8_t job_id) {
+    const sStreamJob &job = jobs[job_id];
+    sTexture &texture = *job.texture;
+
+    // Down from the current one, while the next finer level is complete
+    uint8_t level = (texture.resident_level == VOLUME_NO_RESIDENT_LEVEL) ? job.preview_level + 1 : texture.resident_level;
+    while (level > 1 &&
+           job.level_slab_counts[level - 1] > 0 &&
+           job.level_slabs_uploaded[level - 1] == job.level_slab_counts[level - 1]) {
+        level--;
+    }
+
+    if (level > job.preview_level || level == texture.resident_level) {
+        return;
+    }
+
+    if (texture.resident_level == VOLUME_NO_RESIDENT_LEVEL) {
+        const double preview_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.start_time).count();
+        __android_log_print(ANDROID_LOG_VERBOSE,
+                            "VolumeStreamer",
+                            "Volume %i preview (level %i) shown after %f ms",
+                            job.texture_id,
+                            level,
+                            preview_time);
+    }
+
+    texture.set_resident_level(level);
+}
+
+void sVolumeStreamer::_finish_job(const uint8_t job_id) {
+    sStreamJob &job = jobs[job_id];
+
+    // The max chain replaces the point sampled levels of the preview
+    job.texture->upload_acceleration(job.acceleration);
+    job.acceleration.clean();
+    if (job.is_progressive) {
+        job.texture->set_resident_level(0);
+    }
+
+    const double load_time = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - job.start_time).count();
+    const size_t volume_size = (size_t) job.texture->width * job.texture->height * job.texture->depth * VOLUME_BYTES_PER_VOXEL;
+    __android_log_print(ANDROID_LOG_VERBOSE,
+                        "VolumeStreamer",
+                        "Volume %i streamed%s: %zu bytes in %f ms (%f MB/s)",
+                        job.texture_id,
+                        (job.cached.file.is_open()) ? " from the derived cache" : (job.cached.is_open()) ? " baked" : "",
+                        volume_size,
+                        load_time,
+                        (volume_size / (1024.0 * 1024.0)) / (load_time / 1000.0));
+
+    job.file.close();
+    job.cached.close();
+    job.reader.close();
+    free(job.inflated);
+    job.inflated = NULL;
+    job.voxels = NULL;
+    job.texture->is_loaded = true;
+    job.active = false;
+
+    if (job.on_loaded != NULL) {
+        job.on_loaded(job.texture_id,
+                      job.user_data);
+    }
+}
+
+void sVolumeStreamer::_build_acceleration(const uint8_t job_id) {
+    sStreamJob &job = jobs[job_id];
+    if (job.cached.is_open() && job.acceleration.load_from_blob(job.cached)) {
+        return;
+    }
+
+    const auto build_start = std::chrono::steady_clock::now();
+    const uint32_t volume_dims[3] = {(uint32_t) job.texture->width,
+                                     (uint32_t) job.texture->height,
+                                     (uint32_t) job.texture->depth};
+    job.acceleration.build((const uint8_t*) job.voxels,
+                           volume_dims,
+                           job.texture->distance_field_threshold,
+                           0);
+    const float build_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+
+    if (job.cache == NULL) {
+        return;
+    }
+
+    // Before the slab is handed back, so the structures are not cleaned under the store
+    sDerivedBlobWriter writer = {};
+    writer.add_section(DERIVED_VOLUME,
+                       0,
+                       volume_dims,
+                       GL_R8,
+                       job.voxels,
+                       (size_t) volume_dims[0] * volume_dims[1] * volume_dims[2] * VOLUME_BYTES_PER_VOXEL);
+    job.acceleration.add_to_blob(&writer);
+    if (!job.cache->store(job.cache_key,
+                          &writer,
+                          job.source_ms + build_ms)) {
+        __android_log_print(ANDROID_LOG_WARN,
+                            "VolumeStreamer",
+                            "Cannot store volume %i on the derived cache",
+                            job.texture_id);
+    }
+}
+
+void sVolumeStreamer::_loader_loop() {
+    for(;;) {
+        uint8_t slot_id;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_condition.wait(lock, [this]{
+                return queue_size > 0 || !running;
+            });
+
+            if (!running) {
+                return;
+            }
+
+            slot_id = queue[queue_start];
+            queue_start = (queue_start + 1) % STREAMER_PBO_COUNT;
+            queue_size--;
+        }
+
+        sStreamSlot &slot = slots[slot_id];
+        sStreamJob &job = jobs[slot.job_id];
+        if (slot.level > 0) {
+            _fill_level_slab(slot);
+            slot.state.store(SLOT_FILLED, std::memory_order_release);
+            continue;
+        }
+
+        const size_t slab_offset = (size_t) slot.slab_id * job.level_slab_depths[0] * job.texture->width * job.texture->height * VOLUME_BYTES_PER_VOXEL;
+
+        // The slabs come in order, so the deflated entries are inflated front to back
+        if (job.inflated != NULL) {
+            const size_t read_bytes = job.reader.read(job.inflated + slab_offset,
+                                                      slot.size);
+            if (read_bytes < slot.size) {
+                memset(job.inflated + slab_offset + read_bytes,
+                       0,
+                       slot.size - read_bytes);
+            }
+        }
+
+        memcpy(slot.mapped_data,
+               job.voxels + slab_offset,
+               slot.size);
+
+        // The slabs are loaded in order, so the whole volume is on the page cache now
+        if (slot.slab_id == job.level_slab_counts[0] - 1) {
+            _build_acceleration(slot.job_id);
+        }
+
+        slot.state.store(SLOT_FILLED, std::memory_order_release);
+    }
+}
+
+void sVolumeStreamer::_fill_level_slab(const sStreamSlot &slot) {
+    const sStreamJob &job = jobs[slot.job_id];
+    const uint32_t volume_dims[3] = {(uint32_t) job.texture->width,
+                                     (uint32_t) job.texture->height,
+                                     (uint32_t) job.texture->depth};
+    uint32_t level_dims[3];
+    get_level_dims(*job.texture,
+                   slot.level,
+                   level_dims);
+
+    if (slot.level != job.preview_level) {
+        const uint32_t z_start = slot.slab_id * job.level_slab_depths[slot.level];
+        const uint32_t z_end = (z_start + job.level_slab_depths[slot.level] > level_dims[2]) ? level_dims[2] : z_start + job.level_slab_depths[slot.level];
+        sample_level_slices((const uint8_t*) job.voxels,
+                            volume_dims,
+                            level_dims,
+                            z_start,
+                            z_end,
+                            (uint8_t*) slot.mapped_data);
+        return;
+    }
+
+    // The preview level, and the max chain over it after it
+    uint8_t *preview = (uint8_t*) slot.mapped_data;
+    sample_level_slices((const uint8_t*) job.voxels,
+                        volume_dims,
+                        level_dims,
+                        0,
+                        level_dims[2],
+                        preview);
+
+    sVolumeMipChain chain = {};
+    VolumeMips::build_max_chain(preview,
+                                level_dims,
+                                false,
+                                1,
+                                &chain);
+
+    size_t offset = (size_t) level_dims[0] * level_dims[1] * level_dims[2] * VOLUME_BYTES_PER_VOXEL;
+    for(uint32_t level = 0; level < chain.level_count; level++) {
+        memcpy(preview + offset,
+               chain.levels[level],
+               chain.get_level_size(level));
+        offset += chain.get_level_size(level);
+    }
+    assert(offset == slot.size && "The preview does not match its slab");
+    chain.clean();
+}
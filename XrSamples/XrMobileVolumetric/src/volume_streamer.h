@@ -0,0 +1,180 @@
+#ifndef VOLUME_STREAMER_H_
+#define VOLUME_STREAMER_H_
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+
+#include "texture.h"
+#include "mapped_file.h"
+#include "upload_scheduler.h"
+#include "derived_cache.h"
+#include "apk_archive.h"
+#include "volume_mips.h"
+
+#define STREAMER_PBO_COUNT 4
+#define STREAMER_MAX_JOBS 4
+#define STREAMER_SLAB_SIZE (2 * 1024 * 1024) // Target bytes per upload
+#define STREAMER_PREVIEW_SIZE 32 // Max side of the first level shown, on progressive loads
+#define STREAMER_MIN_REFINE_LEVEL 2 // The finer ones cost as much as level 0, so they wait for it
+
+/**
+ * Async volume loading
+ * A loader thread copies z-slabs of the volume file into mapped pixel-unpack
+ * buffers, and the GL thread, once per frame, unmaps the filled ones and
+ * streams them with glTexSubImage3D into an immutable glTexStorage3D texture.
+ * The render loop never waits on the disk: if a slab is not ready, it is
+ * picked up next frame.
+ * The empty space skipping structures are built on the loader thread too,
+ * and uploaded with the last slab.
+ * With a derived cache, a volume is streamed from its cache entry, with the
+ * structures already built; and a volume that was not there is stored on
+ * it once its structures are.
+ * Progressive loads: when the voxels are readable up front (mapped files,
+ * cache entries & stored APK entries), a coarse preview level of at most
+ * STREAMER_PREVIEW_SIZE per side is streamed first, with the levels over
+ * it, and then the finer levels down to STREAMER_MIN_REFINE_LEVEL before
+ * level 0; the base level of the texture follows the finest complete one,
+ * so the volume shows after a few KBs, whatever its size. These levels are
+ * point sampled, and replaced by the max chain once level 0 is in.
+ * */
+
+typedef void (*fVolumeLoadedCallback)(const uint8_t texture_id,
+                                      void *user_data);
+
+enum eStreamSlotState : uint8_t {
+    SLOT_FREE = 0,
+    SLOT_LOADING, // Mapped & waiting for the loader thread
+    SLOT_FILLED   // Ready to be unmapped & uploaded, on the GL thread
+};
+
+struct sStreamJob {
+    bool        active = false;
+    uint8_t     texture_id = 0;
+    sTexture    *texture = NULL;
+
+    // Of all the levels
+    uint32_t    slab_count = 0;
+    uint32_t    slabs_requested = 0;
+    uint32_t    slabs_uploaded = 0;
+
+    // Per mip level: z-slices per slab & slabs; the levels without slabs are
+    // not streamed. On progressive loads, the slab of the preview level
+    // holds every level over it too
+    bool        is_progressive = false;
+    uint8_t     preview_level = 0;
+    uint8_t     request_level = 0; // Of the next slab to read
+    uint32_t    level_slab_depths[VOLUME_MAX_MIP_LEVELS] = {};
+    uint32_t    level_slab_counts[VOLUME_MAX_MIP_LEVELS] = {};
+    uint32_t    level_slabs_requested[VOLUME_MAX_MIP_LEVELS] = {};
+    uint32_t    level_slabs_uploaded[VOLUME_MAX_MIP_LEVELS] = {};
+
+    // The voxels come from the mapped volume, from its derived cache entry,
+    // or from an entry of the APK: a view if it is stored, or inflated slab
+    // by slab, on the loader thread, into the job buffer that the
+    // structures need anyway
+    sMappedFile file = {};
+    sDerivedBlob cached = {};
+    sArchiveReader reader = {};
+    uint8_t     *inflated = NULL;
+    const char  *voxels = NULL;
+
+    // Where the volume & its structures are stored once built, if not from the cache
+    sDerivedCache *cache = NULL;
+    uint64_t    cache_key = 0;
+    float       source_ms = 0.0f; // What getting the volume took, extraction included
+
+    // Built by the loader thread with the last slab
+    sVolumeAcceleration acceleration = {};
+
+    fVolumeLoadedCallback on_loaded = NULL;
+    void        *user_data = NULL;
+
+    std::chrono::steady_clock::time_point start_time;
+};
+
+struct sStreamSlot {
+    uint32_t                pbo = 0;
+    std::atomic<uint8_t>    state{SLOT_FREE};
+
+    uint8_t                 job_id = 0;
+    uint8_t                 level = 0;
+    uint32_t                slab_id = 0; // On its level
+    char                    *mapped_data = NULL;
+    size_t                  size = 0;
+};
+
+struct sVolumeStreamer {
+    sStreamJob  jobs[STREAMER_MAX_JOBS];
+    sStreamSlot slots[STREAMER_PBO_COUNT];
+
+    // Loader thread & its queue of slots to fill
+    std::thread             loader_thread;
+    std::mutex              queue_mutex;
+    std::condition_variable queue_condition;
+    uint8_t                 queue[STREAMER_PBO_COUNT];
+    uint8_t                 queue_start = 0;
+    uint8_t                 queue_size = 0;
+    bool                    running = false;
+
+    // Both on the GL thread
+    void init();
+    void destroy();
+
+    // Allocates the texture storage, and starts streaming the volume on it;
+    // with a cache, the volume & its structures are stored on it as cache_key
+    bool add_job(const uint8_t texture_id,
+                 sTexture *texture,
+                 const char *volume_dir,
+                 const fVolumeLoadedCallback on_loaded,
+                 void *user_data,
+                 sDerivedCache *cache = NULL,
+                 const uint64_t cache_key = 0,
+                 const float source_ms = 0.0f);
+
+    // Streams a volume straight from an entry of the APK, without extracting it
+    bool add_archive_job(const uint8_t texture_id,
+                         sTexture *texture,
+                         const sApkArchive &archive,
+                         const uint32_t entry_id,
+                         const fVolumeLoadedCallback on_loaded,
+                         void *user_data,
+                         sDerivedCache *cache = NULL,
+                         const uint64_t cache_key = 0,
+                         const float source_ms = 0.0f);
+
+    // Streams the volume of a derived cache entry, that the job takes, or of
+    // a baked one on the APK, with its pre-built structures
+    bool add_cached_job(const uint8_t texture_id,
+                        sTexture *texture,
+                        sDerivedBlob *blob,
+                        const fVolumeLoadedCallback on_loaded,
+                        void *user_data);
+
+    // Call once per frame, on the GL thread; the slabs are uploaded only
+    // while they fit on the frame budget of the scheduler
+    void update(sUploadScheduler *scheduler);
+
+    bool is_idle() const;
+
+    uint8_t _get_free_job() const;
+    void _start_job(const uint8_t job_id,
+                    const uint8_t texture_id,
+                    sTexture *texture,
+                    const fVolumeLoadedCallback on_loaded,
+                    void *user_data);
+
+    // Clamps the texture to the finest complete level, on progressive loads
+    void _update_resident_level(const uint8_t job_id);
+    void _finish_job(const uint8_t job_id);
+    // On the loader thread, with the last slab: from the cache entry, or built & stored on it
+    void _build_acceleration(const uint8_t job_id);
+    // On the loader thread, the point sampled slab of a coarse level
+    void _fill_level_slab(const sStreamSlot &slot);
+    void _loader_loop();
+};
+
+#endif // VOLUME_STREAMER_H_
@@ -0,0 +1,306 @@
+/**
+ * Offline baker of GPU ready bundles
+ * Does on the host all the work that the app would do on each launch: the
+ * volumes get their max mips (the occupancy levels), min/max grid & distance
+ * field, and the images are decoded to raw RGBA8, with their mips. Each asset
+ * is written as an entry of the derived cache format, so the app can upload
+ * it section by section, straight from the APK, with glTexStorage* +
+ * glTexSub* and without generating anything (see sMaterialManager::add_baked_texture
+ * & load_async_baked_texture3D). A manifest.txt lists what is in the bundle.
+ * The bundle goes under assets/, and its entries have to be stored on the APK
+ * without compression (noCompress 'vdc' on build.gradle).
+ * Build on the host:
+ *  g++ -std=c++17 -O2 -I../src -I../../../3rdParty/stb/src bake_bundle.cpp ../src/volume_mips.cpp ../src/distance_field.cpp ../src/minmax_grid.cpp ../src/volume_acceleration.cpp ../src/derived_cache.cpp ../../../3rdParty/stb/src/stb_image.c -pthread -o bake_bundle
+ * Usage:
+ *  bake_bundle <bundle_dir> [--volume <name> <raw_file> <width> <height> <depth> [threshold]]... [--image <name> <image_file>]...
+ * Writes <bundle_dir>/<name>.vdc for each asset, and <bundle_dir>/manifest.txt
+ * */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <sys/stat.h>
+
+#include <stb_image.h>
+
+#include "volume_acceleration.h"
+#include "derived_cache.h"
+#include "mapped_file.h"
+
+#define FORMAT_R8 0x8229
+#define FORMAT_RGBA8 0x8058
+#define IMAGE_MAX_MIP_LEVELS 16
+#define BAKE_MAX_ASSETS 32
+
+struct sBakedAsset {
+    char        name[128];
+    char        source[256];
+    uint64_t    key;
+    float       build_ms;
+    sDerivedBlobHeader header;
+};
+
+// The key of a baked entry: its source & what it was built with
+uint64_t get_volume_key(const sMappedFile &source,
+                        const sAccelerationParams &params) {
+    return DerivedCache::make_key(DerivedCache::hash(source.data,
+                                                     source.size),
+                                  &params,
+                                  sizeof(params));
+}
+
+bool bake_volume(const char *bundle_dir,
+                 const char *name,
+                 const char *raw_file,
+                 const uint32_t volume_dims[3],
+                 const float threshold,
+                 sBakedAsset *asset) {
+    sMappedFile source = {};
+    const size_t volume_size = (size_t) volume_dims[0] * volume_dims[1] * volume_dims[2];
+    if (!source.open(raw_file) || source.size < volume_size) {
+        printf("Cannot read the volume %s, or it is smaller than %ux%ux%u\n", raw_file, volume_dims[0], volume_dims[1], volume_dims[2]);
+        source.close();
+        return false;
+    }
+    source.advise_sequential_read();
+
+    sAccelerationParams params = {};
+    memcpy(params.volume_dims, volume_dims, sizeof(params.volume_dims));
+    params.distance_field_threshold = threshold;
+
+    const auto build_start = std::chrono::steady_clock::now();
+    sVolumeAcceleration acceleration = {};
+    acceleration.build((const uint8_t*) source.data,
+                       volume_dims,
+                       threshold,
+                       0);
+    const float build_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+
+    sDerivedBlobWriter writer = {};
+    writer.header.key = get_volume_key(source,
+                                       params);
+    writer.header.build_ms = build_ms;
+    writer.add_section(DERIVED_VOLUME,
+                       0,
+                       volume_dims,
+                       FORMAT_R8,
+                       source.data,
+                       volume_size);
+    acceleration.add_to_blob(&writer);
+
+    char entry_dir[512];
+    snprintf(entry_dir, sizeof(entry_dir), "%s/%s.vdc", bundle_dir, name);
+    const bool written = writer.write(entry_dir);
+
+    acceleration.clean();
+    source.close();
+
+    if (written) {
+        snprintf(asset->name, sizeof(asset->name), "%s", name);
+        snprintf(asset->source, sizeof(asset->source), "%s", raw_file);
+        asset->key = writer.header.key;
+        asset->build_ms = build_ms;
+        asset->header = writer.header;
+    }
+    return written;
+}
+
+bool bake_image(const char *bundle_dir,
+                const char *name,
+                const char *image_file,
+                sBakedAsset *asset) {
+    int width = 0, height = 0, channels = 0;
+    const auto build_start = std::chrono::steady_clock::now();
+    uint8_t *pixels = stbi_load(image_file,
+                                &width,
+                                &height,
+                                &channels,
+                                4);
+    if (pixels == NULL) {
+        printf("Cannot decode the image %s\n", image_file);
+        return false;
+    }
+
+    // Box filtered mips, like glGenerateMipmap
+    uint8_t *levels[IMAGE_MAX_MIP_LEVELS] = {pixels};
+    uint32_t dims[IMAGE_MAX_MIP_LEVELS][3] = {{(uint32_t) width, (uint32_t) height, 1}};
+    uint32_t level_count = 1;
+    for(; level_count < IMAGE_MAX_MIP_LEVELS && (dims[level_count - 1][0] > 1 || dims[level_count - 1][1] > 1); level_count++) {
+        const uint32_t *src_dims = dims[level_count - 1];
+        uint32_t *dst_dims = dims[level_count];
+        dst_dims[0] = (src_dims[0] > 1) ? src_dims[0] / 2 : 1;
+        dst_dims[1] = (src_dims[1] > 1) ? src_dims[1] / 2 : 1;
+        dst_dims[2] = 1;
+
+        const uint8_t *src = levels[level_count - 1];
+        uint8_t *dst = (uint8_t*) malloc((size_t) dst_dims[0] * dst_dims[1] * 4);
+        for(uint32_t y = 0; y < dst_dims[1]; y++) {
+            const uint32_t y0 = (y * 2 < src_dims[1]) ? y * 2 : src_dims[1] - 1;
+            const uint32_t y1 = (y * 2 + 1 < src_dims[1]) ? y * 2 + 1 : y0;
+            for(uint32_t x = 0; x < dst_dims[0]; x++) {
+                const uint32_t x0 = (x * 2 < src_dims[0]) ? x * 2 : src_dims[0] - 1;
+                const uint32_t x1 = (x * 2 + 1 < src_dims[0]) ? x * 2 + 1 : x0;
+                for(uint32_t c = 0; c < 4; c++) {
+                    const uint32_t sum = src[((size_t) y0 * src_dims[0] + x0) * 4 + c] +
+                                         src[((size_t) y0 * src_dims[0] + x1) * 4 + c] +
+                                         src[((size_t) y1 * src_dims[0] + x0) * 4 + c] +
+                                         src[((size_t) y1 * src_dims[0] + x1) * 4 + c];
+                    dst[((size_t) y * dst_dims[0] + x) * 4 + c] = (uint8_t) ((sum + 2) / 4);
+                }
+            }
+        }
+        levels[level_count] = dst;
+    }
+    const float build_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - build_start).count();
+
+    sDerivedBlobWriter writer = {};
+    writer.header.key = DerivedCache::make_key(DerivedCache::hash_file(image_file),
+                                               &level_count,
+                                               sizeof(level_count));
+    writer.header.build_ms = build_ms;
+    for(uint32_t level = 0; level < level_count; level++) {
+        writer.add_section(DERIVED_TEXTURE_2D,
+                           level,
+                           dims[level],
+                           FORMAT_RGBA8,
+                           levels[level],
+                           (size_t) dims[level][0] * dims[level][1] * 4);
+    }
+
+    char entry_dir[512];
+    snprintf(entry_dir, sizeof(entry_dir), "%s/%s.vdc", bundle_dir, name);
+    const bool written = writer.write(entry_dir);
+
+    stbi_image_free(pixels);
+    for(uint32_t level = 1; level < level_count; level++) {
+        free(levels[level]);
+    }
+
+    if (written) {
+        snprintf(asset->name, sizeof(asset->name), "%s", name);
+        snprintf(asset->source, sizeof(asset->source), "%s", image_file);
+        asset->key = writer.header.key;
+        asset->build_ms = build_ms;
+        asset->header = writer.header;
+    }
+    return written;
+}
+
+const char* get_section_name(const uint32_t type) {
+    switch(type) {
+        case DERIVED_VOLUME: return "volume";
+        case DERIVED_MAX_MIP: return "max_mip";
+        case DERIVED_MINMAX_GRID: return "minmax_grid";
+        case DERIVED_DISTANCE_FIELD: return "distance_field";
+        case DERIVED_TEXTURE_2D: return "texture_2d";
+        default: return "unknown";
+    }
+}
+
+bool write_manifest(const char *bundle_dir,
+                    const sBakedAsset *assets,
+                    const uint32_t asset_count) {
+    char manifest_dir[512];
+    snprintf(manifest_dir, sizeof(manifest_dir), "%s/manifest.txt", bundle_dir);
+    FILE *manifest = fopen(manifest_dir, "w");
+    if (manifest == NULL) {
+        return false;
+    }
+
+    fprintf(manifest, "# Baked bundle, derived cache format version %u\n", DERIVED_CACHE_FORMAT_VERSION);
+    fprintf(manifest, "# asset <name>.vdc <source> <key> <build_ms> <section_count>\n");
+    fprintf(manifest, "#  section <type> <level> <width>x<height>x<depth> <gl_format> <value> <offset> <size>\n");
+    for(uint32_t i = 0; i < asset_count; i++) {
+        const sBakedAsset &asset = assets[i];
+        fprintf(manifest,
+                "asset %s.vdc %s %016llx %.1f %u\n",
+                asset.name,
+                asset.source,
+                (unsigned long long) asset.key,
+                asset.build_ms,
+                asset.header.section_count);
+        for(uint32_t j = 0; j < asset.header.section_count; j++) {
+            const sDerivedSection &section = asset.header.sections[j];
+            fprintf(manifest,
+                    " section %s %u %ux%ux%u 0x%04X %g %llu %llu\n",
+                    get_section_name(section.type),
+                    section.level,
+                    section.dims[0],
+                    section.dims[1],
+                    section.dims[2],
+                    section.gl_format,
+                    section.value,
+                    (unsigned long long) section.offset,
+                    (unsigned long long) section.size);
+        }
+    }
+
+    return fclose(manifest) == 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        printf("Usage: %s <bundle_dir> [--volume <name> <raw_file> <width> <height> <depth> [threshold]]... [--image <name> <image_file>]...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *bundle_dir = argv[1];
+    mkdir(bundle_dir,
+          0777);
+
+    sBakedAsset *assets = (sBakedAsset*) calloc(BAKE_MAX_ASSETS, sizeof(sBakedAsset));
+    uint32_t asset_count = 0;
+    bool baked = true;
+    for(int i = 2; baked && i < argc; i++) {
+        if (asset_count >= BAKE_MAX_ASSETS) {
+            printf("Too many assets for a bundle, the max is %u\n", BAKE_MAX_ASSETS);
+            baked = false;
+        } else if (strcmp(argv[i], "--volume") == 0 && i + 5 < argc) {
+            const uint32_t volume_dims[3] = {(uint32_t) atoi(argv[i + 3]),
+                                             (uint32_t) atoi(argv[i + 4]),
+                                             (uint32_t) atoi(argv[i + 5])};
+            float threshold = DISTANCE_FIELD_DEFAULT_THRESHOLD;
+            const char *name = argv[i + 1], *raw_file = argv[i + 2];
+            i += 5;
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+                threshold = (float) atof(argv[++i]);
+            }
+
+            baked = bake_volume(bundle_dir,
+                                name,
+                                raw_file,
+                                volume_dims,
+                                threshold,
+                                &assets[asset_count]);
+        } else if (strcmp(argv[i], "--image") == 0 && i + 2 < argc) {
+            baked = bake_image(bundle_dir,
+                               argv[i + 1],
+                               argv[i + 2],
+                               &assets[asset_count]);
+            i += 2;
+        } else {
+            printf("Unknown or incomplete argument %s\n", argv[i]);
+            baked = false;
+        }
+
+        if (baked) {
+            const sBakedAsset &asset = assets[asset_count++];
+            printf("%-24s %2u sections, built in %8.1f ms\n",
+                   asset.name,
+                   asset.header.section_count,
+                   asset.build_ms);
+        }
+    }
+
+    baked = baked && write_manifest(bundle_dir,
+                                    assets,
+                                    asset_count);
+    free(assets);
+
+    if (!baked) {
+        printf("Cannot bake the bundle %s\n", bundle_dir);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+/**
+ * Benchmark of the draw submission of Render::sInstance against the draw
+ * count: a scene of random draws (volume tiles & helper meshes, over some
+ * shaders, materials & meshes, part of them blended, at random depths) is
+ * compiled to sort keys & radix sorted, as render_frame does every frame, and
+ * then walked as it submits it, counting the program, texture & VAO binds that
+ * it issues and skips.
+ * Against the insertion order (rebinding on every draw, as before the draw
+ * list), it reports the CPU time of compiling & sorting, and the GL calls of
+ * the submission, with the same costs as the GLStats counts: 1 call per
+ * program & VAO bind, 2 per texture (glActiveTexture & glBindTexture), 1 per
+ * draw & per uniform range.
+ * It also checks that the passes keep their order, and that the blended draws
+ * go back to front.
+ * Build on the host:
+ *  g++ -std=c++17 -O2 -I../src draw_list_bench.cpp ../src/draw_list.cpp -o draw_list_bench
+ * Usage:
+ *  draw_list_bench [shaders] [materials] [meshes] [transparent fraction] [seed]
+ * */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+
+#include "draw_list.h"
+
+#define BENCH_PASS_COUNT 3
+#define BENCH_TEXTURES_PER_MATERIAL 3
+#define BENCH_FRAMES 200
+
+struct sBenchDraw {
+    uint8_t pass_id;
+    bool    is_transparent;
+    uint8_t shader_id;
+    uint8_t material_id;
+    uint8_t mesh_id;
+    float   depth;
+};
+
+struct sSubmitStats {
+    uint32_t program_binds = 0;
+    uint32_t material_binds = 0;
+    uint32_t vao_binds = 0;
+    uint32_t gl_calls = 0;
+
+    void add_draw(const sBenchDraw &draw,
+                  int32_t *bound_shader,
+                  int32_t *bound_material,
+                  int32_t *bound_mesh) {
+        if (draw.material_id != *bound_material) {
+            if (draw.shader_id != *bound_shader) {
+                program_binds++;
+                gl_calls++;
+                *bound_shader = draw.shader_id;
+            }
+            material_binds++;
+            gl_calls += BENCH_TEXTURES_PER_MATERIAL * 2;
+            *bound_material = draw.material_id;
+        }
+        if (draw.mesh_id != *bound_mesh) {
+            vao_binds++;
+            gl_calls++;
+            *bound_mesh = draw.mesh_id;
+        }
+        gl_calls += 2; // Uniform range & draw
+    }
+};
+
+void run_draw_count(const uint32_t draw_count,
+                    const uint32_t shader_count,
+                    const uint32_t material_count,
+                    const uint32_t mesh_count,
+                    const float transparent_fraction,
+                    const uint32_t seed) {
+    std::mt19937 random(seed + draw_count);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    // Each material has a single shader, as on the material manager; the
+    // draws are added pass by pass, in random order inside each one
+    uint8_t material_shaders[256];
+    for(uint32_t material = 0; material < material_count; material++) {
+        material_shaders[material] = (uint8_t) (random() % shader_count);
+    }
+
+    sBenchDraw *draws = (sBenchDraw*) malloc(sizeof(sBenchDraw) * draw_count);
+    for(uint32_t i = 0; i < draw_count; i++) {
+        draws[i].pass_id = (uint8_t) ((uint64_t) i * BENCH_PASS_COUNT / draw_count);
+        draws[i].is_transparent = unit(random) < transparent_fraction;
+        draws[i].material_id = (uint8_t) (random() % material_count);
+        draws[i].shader_id = material_shaders[draws[i].material_id];
+        draws[i].mesh_id = (uint8_t) (random() % mesh_count);
+        draws[i].depth = 0.1f + unit(random) * 20.0f;
+    }
+
+    sDrawList draw_list = {};
+    draw_list.init(draw_count);
+
+    double compile_ms = 0.0;
+    double sort_ms = 0.0;
+    double walk_ms = 0.0;
+    sSubmitStats sorted_stats = {};
+    for(uint32_t frame = 0; frame < BENCH_FRAMES; frame++) {
+        const auto compile_start = std::chrono::steady_clock::now();
+        draw_list.clear();
+        for(uint32_t i = 0; i < draw_count; i++) {
+            const sBenchDraw &draw = draws[i];
+            draw_list.add(DrawKey::compile(draw.pass_id,
+                                           (draw.is_transparent) ? DRAW_LAYER_TRANSPARENT : DRAW_LAYER_OPAQUE,
+                                           draw.shader_id,
+                                           draw.material_id,
+                                           draw.mesh_id,
+                                           draw.depth),
+                          (uint16_t) i,
+                          (uint16_t) i);
+        }
+        const auto sort_start = std::chrono::steady_clock::now();
+        draw_list.sort();
+        const auto walk_start = std::chrono::steady_clock::now();
+
+        // The walk of the submission, with the ids of the keys
+        sorted_stats = {};
+        int32_t bound_shader = -1;
+        int32_t bound_material = -1;
+        int32_t bound_mesh = -1;
+        for(uint32_t i = 0; i < draw_list.count; i++) {
+            const uint64_t key = draw_list.items[i].key;
+            const sBenchDraw draw = {DrawKey::get_pass(key),
+                                     DrawKey::get_layer(key) == DRAW_LAYER_TRANSPARENT,
+                                     DrawKey::get_shader(key),
+                                     DrawKey::get_material(key),
+                                     DrawKey::get_mesh(key),
+                                     0.0f};
+            sorted_stats.add_draw(draw,
+                                  &bound_shader,
+                                  &bound_material,
+                                  &bound_mesh);
+        }
+        const auto walk_end = std::chrono::steady_clock::now();
+
+        compile_ms += std::chrono::duration<double, std::milli>(sort_start - compile_start).count();
+        sort_ms += std::chrono::duration<double, std::milli>(walk_start - sort_start).count();
+        walk_ms += std::chrono::duration<double, std::milli>(walk_end - walk_start).count();
+    }
+
+    // The passes in order, the opaque draws first, and the blended ones back to front
+    bool is_ordered = true;
+    for(uint32_t i = 1; i < draw_list.count; i++) {
+        const sBenchDraw &previous = draws[draw_list.items[i - 1].draw_id];
+        const sBenchDraw &current = draws[draw_list.items[i].draw_id];
+        if (previous.pass_id != current.pass_id) {
+            is_ordered = is_ordered && previous.pass_id < current.pass_id;
+            continue;
+        }
+        is_ordered = is_ordered && (!previous.is_transparent || current.is_transparent);
+        if (previous.is_transparent && current.is_transparent) {
+            is_ordered = is_ordered && DrawKey::quantize_depth(previous.depth) >= DrawKey::quantize_depth(current.depth);
+        }
+    }
+
+    // Insertion order, rebinding everything on every draw
+    sSubmitStats insertion_stats = {};
+    for(uint32_t i = 0; i < draw_count; i++) {
+        int32_t bound_shader = -1;
+        int32_t bound_material = -1;
+        int32_t bound_mesh = -1;
+        insertion_stats.add_draw(draws[i],
+                                 &bound_shader,
+                                 &bound_material,
+                                 &bound_mesh);
+    }
+
+    printf("%5u draws: compile %7.2f us, sort %7.2f us (%u bytes skipped), walk %6.2f us | GL calls %6u -> %6u (%5.1f%%); program binds %5u -> %4u, material %5u -> %4u, VAO %5u -> %4u%s\n",
+           draw_count,
+           compile_ms * 1000.0 / BENCH_FRAMES,
+           sort_ms * 1000.0 / BENCH_FRAMES,
+           draw_list.skipped_radix_passes,
+           walk_ms * 1000.0 / BENCH_FRAMES,
+           insertion_stats.gl_calls,
+           sorted_stats.gl_calls,
+           100.0 * sorted_stats.gl_calls / insertion_stats.gl_calls,
+           insertion_stats.program_binds,
+           sorted_stats.program_binds,
+           insertion_stats.material_binds,
+           sorted_stats.material_binds,
+           insertion_stats.vao_binds,
+           sorted_stats.vao_binds,
+           (is_ordered) ? "" : " OUT OF ORDER");
+
+    draw_list.clean();
+    free(draws);
+}
+
+int main(int argc, char **argv) {
+    const uint32_t shader_count = (argc > 1) ? (uint32_t) atoi(argv[1]) : 4;
+    const uint32_t material_count = (argc > 2) ? (uint32_t) atoi(argv[2]) : 16;
+    const uint32_t mesh_count = (argc > 3) ? (uint32_t) atoi(argv[3]) : 8;
+    const float transparent_fraction = (argc > 4) ? (float) atof(argv[4]) : 0.5f;
+    const uint32_t seed = (argc > 5) ? (uint32_t) strtoul(argv[5], NULL, 10) : 1234u;
+
+    if (shader_count == 0 || shader_count > 256 || material_count == 0 || material_count > 256 || mesh_count == 0 || mesh_count > 256) {
+        printf("Usage: %s [shaders] [materials] [meshes] [transparent fraction] [seed]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%u shaders, %u materials (%u textures each), %u meshes, %.0f%% blended, %u passes\n",
+           shader_count,
+           material_count,
+           BENCH_TEXTURES_PER_MATERIAL,
+           mesh_count,
+           transparent_fraction * 100.0f,
+           BENCH_PASS_COUNT);
+
+    const uint32_t draw_counts[] = {16, 64, 256, 1024, 4096, 16384};
+    for(uint32_t i = 0; i < sizeof(draw_counts) / sizeof(draw_counts[0]); i++) {
+        run_draw_count(draw_counts[i],
+                       shader_count,
+                       material_count,
+                       mesh_count,
+                       transparent_fraction,
+                       seed);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+/**
+ * Round trip of the EAC R11 codec, on the CPU
+ * Compresses a volume at each quality, decodes it back as the GPU would, and
+ * reports the error & the encode speed. It fails if a flat block does not
+ * decode exactly, or if a higher quality gives a higher error.
+ * Build on the host:
+ *  g++ -std=c++17 -O2 -I../src eac_roundtrip.cpp ../src/eac_codec.cpp -pthread -o eac_roundtrip
+ * Usage:
+ *  eac_roundtrip [<raw_file> <width> <height> <depth>] [--threads n]
+ * Without a volume, a synthetic 128^3 one is used.
+ * */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+
+#include "eac_codec.h"
+#include "mapped_file.h"
+
+#define TEST_VOLUME_SIZE 128
+
+// Smooth blobs, hard edges & noise: the cases that stress the encoder
+uint8_t* create_test_volume(const uint32_t size) {
+    const size_t voxel_count = (size_t) size * size * size;
+    uint8_t *volume = (uint8_t*) malloc(voxel_count);
+
+    uint32_t seed = 1234u;
+    for(uint32_t z = 0; z < size; z++) {
+        for(uint32_t y = 0; y < size; y++) {
+            for(uint32_t x = 0; x < size; x++) {
+                seed = seed * 1664525u + 1013904223u;
+                const float dx = (float) x / size - 0.5f, dy = (float) y / size - 0.5f, dz = (float) z / size - 0.5f;
+                const float radius = sqrtf(dx * dx + dy * dy + dz * dz);
+                float value = (radius < 0.35f) ? 200.0f * (1.0f - radius / 0.35f) : 0.0f;
+                value += (x > size / 2 && y < size / 4) ? 60.0f : 0.0f;
+                value += (float) ((seed >> 24) & 0x0F);
+                volume[((size_t) z * size + y) * size + x] = (uint8_t) ((value > 255.0f) ? 255.0f : value);
+            }
+        }
+    }
+    return volume;
+}
+
+// Every flat block has to decode to its value
+bool check_flat_blocks() {
+    for(uint32_t quality = EAC_QUALITY_FAST; quality <= EAC_QUALITY_HIGH; quality++) {
+        for(uint32_t value = 0; value < 256; value++) {
+            uint8_t texels[16], block[EAC_BLOCK_BYTES];
+            uint16_t decoded[16];
+            memset(texels, value, sizeof(texels));
+            EacCodec::encode_block(texels,
+                                   (eEacQuality) quality,
+                                   block);
+            EacCodec::decode_block(block,
+                                   decoded);
+            for(uint32_t i = 0; i < 16; i++) {
+                if (EacCodec::to_8_bits(decoded[i]) != value) {
+                    printf("Flat block of %u decodes to %u at quality %u\n", value, EacCodec::to_8_bits(decoded[i]), quality);
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    uint32_t thread_count = 0;
+    if (argc > 2 && strcmp(argv[argc - 2], "--threads") == 0) {
+        thread_count = (uint32_t) atoi(argv[argc - 1]);
+        argc -= 2;
+    }
+
+    uint32_t volume_dims[3] = {TEST_VOLUME_SIZE, TEST_VOLUME_SIZE, TEST_VOLUME_SIZE};
+    sMappedFile file = {};
+    const uint8_t *volume = NULL;
+    uint8_t *test_volume = NULL;
+    if (argc >= 5) {
+        volume_dims[0] = (uint32_t) atoi(argv[2]);
+        volume_dims[1] = (uint32_t) atoi(argv[3]);
+        volume_dims[2] = (uint32_t) atoi(argv[4]);
+        if (!file.open(argv[1]) || file.size < (size_t) volume_dims[0] * volume_dims[1] * volume_dims[2]) {
+            printf("Cannot read the volume %s\n", argv[1]);
+            return EXIT_FAILURE;
+        }
+        volume = (const uint8_t*) file.data;
+    } else {
+        test_volume = create_test_volume(TEST_VOLUME_SIZE);
+        volume = test_volume;
+    }
+
+    bool passed = check_flat_blocks();
+
+    const size_t voxel_count = (size_t) volume_dims[0] * volume_dims[1] * volume_dims[2];
+    uint8_t *decoded = (uint8_t*) malloc(voxel_count);
+    const char *quality_names[] = {"fast", "normal", "high"};
+    double previous_mse = INFINITY;
+
+    printf("%ux%ux%u, %.1f MB as R8\n", volume_dims[0], volume_dims[1], volume_dims[2], voxel_count / (1024.0 * 1024.0));
+    printf("quality   encode ms     MB/s   decode ms   max err   mean err   PSNR dB   size MB\n");
+    for(uint32_t quality = EAC_QUALITY_FAST; quality <= EAC_QUALITY_HIGH; quality++) {
+        sEacVolume compressed = {};
+        const auto encode_start = std::chrono::steady_clock::now();
+        EacCodec::compress_volume(volume,
+                                  volume_dims,
+                                  (eEacQuality) quality,
+                                  thread_count,
+                                  &compressed);
+        const double encode_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - encode_start).count();
+
+        const auto decode_start = std::chrono::steady_clock::now();
+        EacCodec::decompress_volume(compressed,
+                                    thread_count,
+                                    decoded);
+        const double decode_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decode_start).count();
+
+        uint32_t max_error = 0;
+        uint64_t error_sum = 0, squared_error_sum = 0;
+        for(size_t i = 0; i < voxel_count; i++) {
+            const uint32_t error = (uint32_t) abs((int32_t) decoded[i] - (int32_t) volume[i]);
+            max_error = (error > max_error) ? error : max_error;
+            error_sum += error;
+            squared_error_sum += (uint64_t) error * error;
+        }
+        const double mse = (double) squared_error_sum / voxel_count;
+        const double psnr = (mse > 0.0) ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+
+        printf("%-7s %11.1f %8.1f %11.1f %9u %10.3f %9.2f %9.1f\n",
+               quality_names[quality],
+               encode_ms,
+               (voxel_count / (1024.0 * 1024.0)) / (encode_ms / 1000.0),
+               decode_ms,
+               max_error,
+               (double) error_sum / voxel_count,
+               psnr,
+               compressed.get_size() / (1024.0 * 1024.0));
+
+        // Each quality searches a superset of the previous one
+        if (mse > previous_mse) {
+            printf("The %s quality has more error than the previous one\n", quality_names[quality]);
+            passed = false;
+        }
+        previous_mse = mse;
+
+        compressed.clean();
+    }
+
+    free(decoded);
+    free(test_volume);
+    file.close();
+
+    printf("%s\n", (passed) ? "PASSED" : "FAILED");
+    return (passed) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,237 @@
+/**
+ * Headless benchmark of the frame loop (sFramePipeline), serial vs with the
+ * render thread, against a mock of the XR runtime pacing:
+ *  - wait_frame blocks until the previous frame was begun, and then until the
+ *    next vsync after the last one it returned on; it predicts the display
+ *    one period after the frames in flight (1 serial, 2 pipelined), as the
+ *    runtimes do once they see how deep the app pipelines
+ *  - a frame is late if it is ended after its display time - one period, when
+ *    the compositor latches it
+ * The simulation & the recording are spun (or slept, with --sleep) for their
+ * cost, and the loop reports the frame rate, the vsyncs without a new frame,
+ * the late frames and the CPU headroom left on the frame period.
+ * With a single core there is nothing to overlap, so spin only on multi-core hosts.
+ * Build on the host:
+ *  g++ -std=c++17 -O2 -I../src frame_pacing_bench.cpp -pthread -o frame_pacing_bench
+ * Usage:
+ *  frame_pacing_bench [refresh_hz] [simulation_ms] [render_ms] [frames] [--sleep]
+ * */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "frame_pipeline.h"
+
+typedef std::chrono::steady_clock sClock;
+
+struct sMockXrRuntime {
+    double                  period_ms = 1000.0 / 72.0;
+    uint32_t                pipeline_depth = 1;
+    sClock::time_point      start;
+
+    std::mutex              mutex;
+    std::condition_variable condition;
+    uint64_t                waited_frames = 0;
+    uint64_t                begun_frames = 0;
+    uint64_t                last_vsync = 0;
+
+    uint64_t                ended_frames = 0;
+    uint64_t                late_frames = 0;
+
+    void init(const double refresh_hz,
+              const uint32_t depth) {
+        period_ms = 1000.0 / refresh_hz;
+        pipeline_depth = depth;
+        start = sClock::now();
+        waited_frames = 0;
+        begun_frames = 0;
+        last_vsync = 0;
+        ended_frames = 0;
+        late_frames = 0;
+    }
+
+    inline double get_time_ms() const {
+        return std::chrono::duration<double, std::milli>(sClock::now() - start).count();
+    }
+
+    // Returns the predicted display time, in ms
+    double wait_frame() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]{
+                return begun_frames == waited_frames;
+            });
+        }
+
+        // The next vsync, never the same one twice
+        uint64_t vsync = (uint64_t) (get_time_ms() / period_ms) + 1;
+        vsync = (vsync <= last_vsync) ? last_vsync + 1 : vsync;
+        std::this_thread::sleep_until(start + std::chrono::duration_cast<sClock::duration>(std::chrono::duration<double, std::milli>(vsync * period_ms)));
+        last_vsync = vsync;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        waited_frames++;
+        return (vsync + pipeline_depth + 1) * period_ms;
+    }
+
+    void begin_frame() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            begun_frames++;
+        }
+        condition.notify_all();
+    }
+
+    void end_frame(const double display_time) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ended_frames++;
+        if (get_time_ms() > display_time - period_ms) {
+            late_frames++;
+        }
+    }
+};
+
+struct sMockPacket {
+    double display_time = 0.0;
+    float  pose[16] = {}; // Handed over as a real frame would
+};
+
+struct sBenchState {
+    sMockXrRuntime *runtime = NULL;
+    double         render_ms = 0.0;
+    bool           use_sleep = false;
+    double         render_busy_ms = 0.0; // Summed on the render stage
+};
+
+// The CPU cost of a stage
+void spend_time(const double ms,
+                const bool use_sleep) {
+    if (use_sleep) {
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms));
+        return;
+    }
+
+    const auto end = sClock::now() + std::chrono::duration_cast<sClock::duration>(std::chrono::duration<double, std::milli>(ms));
+    volatile uint32_t counter = 0;
+    while (sClock::now() < end) {
+        counter = counter + 1;
+    }
+}
+
+void render_mock_frame(const sMockPacket &packet,
+                       void *user_data) {
+    sBenchState *state = (sBenchState*) user_data;
+    const auto render_start = sClock::now();
+
+    state->runtime->begin_frame();
+    spend_time(state->render_ms,
+               state->use_sleep);
+    state->runtime->end_frame(packet.display_time);
+
+    state->render_busy_ms += std::chrono::duration<double, std::milli>(sClock::now() - render_start).count();
+}
+
+void run_loop(const bool threaded,
+              const double refresh_hz,
+              const double simulation_ms,
+              const double render_ms,
+              const uint32_t frame_count,
+              const bool use_sleep) {
+    sMockXrRuntime runtime;
+    runtime.init(refresh_hz,
+                 (threaded) ? 2 : 1);
+
+    sBenchState state = {};
+    state.runtime = &runtime;
+    state.render_ms = render_ms;
+    state.use_sleep = use_sleep;
+
+    sFramePipeline<sMockPacket> pipeline;
+    pipeline.init(threaded,
+                  render_mock_frame,
+                  NULL,
+                  NULL,
+                  &state);
+
+    double simulation_busy_ms = 0.0;
+    const double loop_start = runtime.get_time_ms();
+    for(uint32_t frame = 0; frame < frame_count; frame++) {
+        sMockPacket packet = {};
+        packet.display_time = runtime.wait_frame();
+
+        const auto simulation_start = sClock::now();
+        spend_time(simulation_ms,
+                   use_sleep);
+        packet.pose[0] = (float) frame;
+        simulation_busy_ms += std::chrono::duration<double, std::milli>(sClock::now() - simulation_start).count();
+
+        pipeline.submit(packet);
+    }
+    pipeline.flush();
+    const double loop_ms = runtime.get_time_ms() - loop_start;
+    pipeline.destroy();
+
+    // The vsyncs of the loop that showed no new frame
+    const uint64_t vsync_count = (uint64_t) (loop_ms / runtime.period_ms);
+    const uint64_t missed_vsyncs = (vsync_count > frame_count) ? vsync_count - frame_count : 0;
+
+    const double simulation_frame_ms = simulation_busy_ms / frame_count;
+    const double render_frame_ms = state.render_busy_ms / frame_count;
+    const double cpu_frame_ms = (threaded) ? ((simulation_frame_ms > render_frame_ms) ? simulation_frame_ms : render_frame_ms) : simulation_frame_ms + render_frame_ms;
+
+    printf("%-9s %6.1f fps, %4llu vsyncs without a new frame, %4llu late frames; CPU frame %6.2f ms (simulation %.2f, render %.2f), headroom %6.2f ms of %.2f\n",
+           (threaded) ? "pipelined" : "serial",
+           frame_count / (loop_ms / 1000.0),
+           (unsigned long long) missed_vsyncs,
+           (unsigned long long) runtime.late_frames,
+           cpu_frame_ms,
+           simulation_frame_ms,
+           render_frame_ms,
+           runtime.period_ms - cpu_frame_ms,
+           runtime.period_ms);
+}
+
+int main(int argc, char **argv) {
+    bool use_sleep = false;
+    if (argc > 1 && strcmp(argv[argc - 1], "--sleep") == 0) {
+        use_sleep = true;
+        argc--;
+    }
+
+    const double refresh_hz = (argc > 1) ? atof(argv[1]) : 72.0;
+    const double simulation_ms = (argc > 2) ? atof(argv[2]) : 6.0;
+    const double render_ms = (argc > 3) ? atof(argv[3]) : 9.0;
+    const uint32_t frame_count = (argc > 4) ? (uint32_t) atoi(argv[4]) : 300;
+
+    if (refresh_hz <= 0.0 || frame_count == 0) {
+        printf("Usage: %s [refresh_hz] [simulation_ms] [render_ms] [frames] [--sleep]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%.0f Hz, simulation %.2f ms, render %.2f ms, %u frames%s\n",
+           refresh_hz,
+           simulation_ms,
+           render_ms,
+           frame_count,
+           (use_sleep) ? ", slept" : ", spun");
+
+    run_loop(false,
+             refresh_hz,
+             simulation_ms,
+             render_ms,
+             frame_count,
+             use_sleep);
+    run_loop(true,
+             refresh_hz,
+             simulation_ms,
+             render_ms,
+             frame_count,
+             use_sleep);
+
+    return EXIT_SUCCESS;
+}
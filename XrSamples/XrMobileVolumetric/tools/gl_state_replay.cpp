@@ -0,0 +1,434 @@
+/**
+ * Replays the GL state changes of render frames through sGLStateCache, on a
+ * recording stub of GL (no GPU nor context): the stub keeps the state that
+ * the calls leave, and logs them.
+ * The frames follow Render::sInstance::render_frame, for both eyes: a low
+ * resolution feedback pass, the scene pass (volume tiles, helper meshes
+ * without culling & with another blend function) and a composite quad, with
+ * change_graphic_state, the material binds, the VAOs & the uniform ranges.
+ * Between the frames the uploads bind textures on their own, as they do.
+ * On every draw it checks that the stub holds the state the draw asked for
+ * (so no call the draw needed was elided), and it reports the calls issued &
+ * elided per frame, against issuing them all.
+ * Build on the host (needs the GLES3 headers, not the library):
+ *  g++ -std=c++17 -O2 -I../src gl_state_replay.cpp ../src/gl_state_cache.cpp -o gl_state_replay
+ * Usage:
+ *  gl_state_replay [volume tiles] [helper meshes] [frames] [--log]
+ * */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "gl_state_cache.h"
+
+#define STUB_TEXTURE_UNITS 16
+#define STUB_UNIFORM_BUFFERS 4
+#define STUB_MAX_LOG_CALLS 64
+
+// The state of the stub, as GL would hold it
+struct sStubGL {
+    uint32_t program = 0;
+    uint32_t vertex_array = 0;
+    uint32_t framebuffer = 0;
+    int32_t  viewport[4] = {};
+    int32_t  scissor[4] = {};
+    uint32_t active_texture_unit = 0;
+    uint32_t textures[STUB_TEXTURE_UNITS][GL_STATE_TEXTURE_TARGET_COUNT] = {};
+    uint32_t uniform_buffers[STUB_UNIFORM_BUFFERS][3] = {};
+    bool     capabilities[GL_STATE_CAPABILITY_COUNT] = {};
+    bool     depth_mask = true;
+    uint32_t depth_function = GL_LESS;
+    uint32_t cull_face = GL_BACK;
+    uint32_t front_face = GL_CCW;
+    uint32_t blend_func[2] = {GL_ONE, GL_ZERO};
+    float    clear_color[4] = {};
+
+    uint32_t call_count = 0;
+    bool     log_calls = false;
+    uint32_t logged_calls = 0;
+
+    void record(const char *call) {
+        call_count++;
+        if (log_calls && logged_calls < STUB_MAX_LOG_CALLS) {
+            printf("    %s\n", call);
+            logged_calls++;
+        }
+    }
+};
+
+static sStubGL stub_gl;
+
+static uint32_t get_capability_index(const GLenum capability) {
+    for(uint32_t i = 0; i < GL_STATE_CAPABILITY_COUNT; i++) {
+        if (gl_state_capabilities[i] == capability) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+static uint32_t get_target_index(const GLenum target) {
+    for(uint32_t i = 0; i < GL_STATE_TEXTURE_TARGET_COUNT; i++) {
+        if (gl_state_texture_targets[i] == target) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+// The recording stub ===========================================
+void glUseProgram(GLuint program) {
+    stub_gl.program = program;
+    stub_gl.record("glUseProgram");
+}
+
+void glBindVertexArray(GLuint array) {
+    stub_gl.vertex_array = array;
+    stub_gl.record("glBindVertexArray");
+}
+
+void glBindFramebuffer(GLenum, GLuint framebuffer) {
+    stub_gl.framebuffer = framebuffer;
+    stub_gl.record("glBindFramebuffer");
+}
+
+void glViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    const int32_t viewport[4] = {x, y, width, height};
+    memcpy(stub_gl.viewport, viewport, sizeof(viewport));
+    stub_gl.record("glViewport");
+}
+
+void glScissor(GLint x, GLint y, GLsizei width, GLsizei height) {
+    const int32_t scissor[4] = {x, y, width, height};
+    memcpy(stub_gl.scissor, scissor, sizeof(scissor));
+    stub_gl.record("glScissor");
+}
+
+void glActiveTexture(GLenum texture) {
+    stub_gl.active_texture_unit = texture - GL_TEXTURE0;
+    stub_gl.record("glActiveTexture");
+}
+
+void glBindTexture(GLenum target, GLuint texture) {
+    stub_gl.textures[stub_gl.active_texture_unit][get_target_index(target)] = texture;
+    stub_gl.record("glBindTexture");
+}
+
+void glBindBufferBase(GLenum, GLuint index, GLuint buffer) {
+    stub_gl.uniform_buffers[index][0] = buffer;
+    stub_gl.uniform_buffers[index][1] = 0;
+    stub_gl.uniform_buffers[index][2] = 0;
+    stub_gl.record("glBindBufferBase");
+}
+
+void glBindBufferRange(GLenum, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+    stub_gl.uniform_buffers[index][0] = buffer;
+    stub_gl.uniform_buffers[index][1] = (uint32_t) offset;
+    stub_gl.uniform_buffers[index][2] = (uint32_t) size;
+    stub_gl.record("glBindBufferRange");
+}
+
+void glEnable(GLenum cap) {
+    stub_gl.capabilities[get_capability_index(cap)] = true;
+    stub_gl.record("glEnable");
+}
+
+void glDisable(GLenum cap) {
+    stub_gl.capabilities[get_capability_index(cap)] = false;
+    stub_gl.record("glDisable");
+}
+
+void glDepthMask(GLboolean flag) {
+    stub_gl.depth_mask = flag;
+    stub_gl.record("glDepthMask");
+}
+
+void glDepthFunc(GLenum func) {
+    stub_gl.depth_function = func;
+    stub_gl.record("glDepthFunc");
+}
+
+void glCullFace(GLenum mode) {
+    stub_gl.cull_face = mode;
+    stub_gl.record("glCullFace");
+}
+
+void glFrontFace(GLenum mode) {
+    stub_gl.front_face = mode;
+    stub_gl.record("glFrontFace");
+}
+
+void glBlendFunc(GLenum sfactor, GLenum dfactor) {
+    stub_gl.blend_func[0] = sfactor;
+    stub_gl.blend_func[1] = dfactor;
+    stub_gl.record("glBlendFunc");
+}
+
+void glClearColor(GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha) {
+    const float color[4] = {red, green, blue, alpha};
+    memcpy(stub_gl.clear_color, color, sizeof(color));
+    stub_gl.record("glClearColor");
+}
+
+// The frames ===========================================
+// Render::sGLState, & what a draw binds
+struct sReplayDraw {
+    bool     depth_test_enabled = true;
+    bool     write_to_depth_buffer = true;
+    uint32_t depth_function = GL_LESS;
+    bool     culling_enabled = true;
+    uint32_t culling_mode = GL_BACK;
+    uint32_t front_face = GL_CCW;
+    bool     blending_enabled = true;
+    uint32_t blend_func_x = GL_ONE;
+    uint32_t blend_func_y = GL_ONE_MINUS_SRC_ALPHA;
+
+    uint32_t material = 0;
+    uint32_t program = 1;
+    uint32_t texture_count = 0;
+    uint32_t texture_targets[4] = {};
+    uint32_t textures[4] = {};
+    uint32_t vertex_array = 1;
+    uint32_t uniform_offset = 0;
+};
+
+struct sReplayPass {
+    uint32_t    framebuffer;
+    int32_t     width;
+    int32_t     height;
+    sReplayDraw *draws;
+    uint32_t    draw_count;
+};
+
+struct sReplayStats {
+    uint32_t mismatches = 0;
+    uint32_t draws = 0;
+    uint32_t requested_calls = 0; // Without the cache: every change, on every draw
+};
+
+// As Render::sInstance::change_graphic_state
+static void change_graphic_state(sGLStateCache *gl_state,
+                                 const sReplayDraw &draw) {
+    gl_state->set_capability(GL_STATE_DEPTH_TEST,
+                             draw.depth_test_enabled);
+    gl_state->set_depth_mask(draw.write_to_depth_buffer);
+    gl_state->set_depth_function(draw.depth_function);
+    gl_state->set_capability(GL_STATE_CULL_FACE,
+                             draw.culling_enabled);
+    gl_state->set_cull_face(draw.culling_mode);
+    gl_state->set_front_face(draw.front_face);
+    gl_state->set_capability(GL_STATE_BLEND,
+                             draw.blending_enabled);
+    gl_state->set_blend_func(draw.blend_func_x,
+                             draw.blend_func_y);
+}
+
+static bool stub_matches(const sReplayPass &pass,
+                         const sReplayDraw &draw,
+                         const uint32_t uniform_buffer) {
+    bool matches = stub_gl.framebuffer == pass.framebuffer;
+    matches = matches && stub_gl.viewport[2] == pass.width && stub_gl.viewport[3] == pass.height;
+    matches = matches && stub_gl.scissor[2] == pass.width && stub_gl.scissor[3] == pass.height;
+    matches = matches && stub_gl.program == draw.program && stub_gl.vertex_array == draw.vertex_array;
+    for(uint32_t i = 0; i < draw.texture_count; i++) {
+        matches = matches && stub_gl.textures[i][get_target_index(draw.texture_targets[i])] == draw.textures[i];
+    }
+    matches = matches && stub_gl.uniform_buffers[2][0] == uniform_buffer && stub_gl.uniform_buffers[2][1] == draw.uniform_offset;
+    matches = matches && stub_gl.capabilities[GL_STATE_DEPTH_TEST] == draw.depth_test_enabled;
+    matches = matches && stub_gl.depth_mask == draw.write_to_depth_buffer;
+    matches = matches && stub_gl.depth_function == draw.depth_function;
+    matches = matches && stub_gl.capabilities[GL_STATE_CULL_FACE] == draw.culling_enabled;
+    matches = matches && stub_gl.cull_face == draw.culling_mode && stub_gl.front_face == draw.front_face;
+    matches = matches && stub_gl.capabilities[GL_STATE_BLEND] == draw.blending_enabled;
+    matches = matches && stub_gl.blend_func[0] == draw.blend_func_x && stub_gl.blend_func[1] == draw.blend_func_y;
+    return matches;
+}
+
+static void replay_frame(sGLStateCache *gl_state,
+                         const sReplayPass *passes,
+                         const uint32_t pass_count,
+                         sReplayStats *stats) {
+    const uint32_t frame_ubo = 100;
+    const uint32_t view_ubo = 101;
+    const uint32_t draw_ubo = 102;
+
+    gl_state->begin_frame();
+    gl_state->bind_uniform_buffer(0, frame_ubo, 0, 0);
+    gl_state->bind_uniform_buffer(1, view_ubo, 0, 0);
+    stats->requested_calls += 2;
+
+    for(uint32_t eye = 0; eye < 2; eye++) {
+        for(uint32_t j = 0; j < pass_count; j++) {
+            const sReplayPass &pass = passes[j];
+            // As FBO_bind
+            gl_state->bind_framebuffer(pass.framebuffer);
+            gl_state->set_viewport(0, 0, pass.width, pass.height);
+            gl_state->set_scissor(0, 0, pass.width, pass.height);
+            gl_state->set_clear_color(0.0f, 0.0f, 0.0f, 1.0f);
+            stats->requested_calls += 4;
+
+            int32_t bound_material = -1;
+            for(uint32_t i = 0; i < pass.draw_count; i++) {
+                const sReplayDraw &draw = pass.draws[i];
+                change_graphic_state(gl_state,
+                                     draw);
+                stats->requested_calls += 11; // With the 3 enables
+
+                // The material: the program & its textures
+                if ((int32_t) draw.material != bound_material) {
+                    gl_state->use_program(draw.program);
+                    for(uint32_t t = 0; t < draw.texture_count; t++) {
+                        gl_state->bind_texture(t,
+                                               draw.texture_targets[t],
+                                               draw.textures[t]);
+                    }
+                    bound_material = (int32_t) draw.material;
+                }
+                stats->requested_calls += 1 + draw.texture_count * 2;
+
+                gl_state->bind_vertex_array(draw.vertex_array);
+                gl_state->bind_uniform_buffer(2,
+                                              draw_ubo,
+                                              draw.uniform_offset + eye * 4096,
+                                              96);
+                stats->requested_calls += 2;
+
+                sReplayDraw eye_draw = draw;
+                eye_draw.uniform_offset += eye * 4096;
+                if (!stub_matches(pass, eye_draw, draw_ubo)) {
+                    stats->mismatches++;
+                }
+                stats->draws++;
+            }
+        }
+    }
+
+    gl_state->bind_framebuffer(0);
+    stats->requested_calls++;
+    gl_state->end_frame();
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[argc - 1], "--log") == 0) {
+        stub_gl.log_calls = true;
+        argc--;
+    }
+
+    const uint32_t tile_count = (argc > 1) ? (uint32_t) atoi(argv[1]) : 8;
+    const uint32_t helper_count = (argc > 2) ? (uint32_t) atoi(argv[2]) : 4;
+    const uint32_t frame_count = (argc > 3) ? (uint32_t) atoi(argv[3]) : 3;
+    if (tile_count == 0 || frame_count == 0) {
+        printf("Usage: %s [volume tiles] [helper meshes] [frames] [--log]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // Feedback pass: the first tile, square
+    sReplayDraw feedback_draw = {};
+    feedback_draw.material = 1;
+    feedback_draw.program = 3;
+    feedback_draw.texture_count = 2;
+    feedback_draw.texture_targets[0] = GL_TEXTURE_3D;
+    feedback_draw.textures[0] = 20;
+    feedback_draw.texture_targets[1] = GL_TEXTURE_3D;
+    feedback_draw.textures[1] = 21;
+    feedback_draw.vertex_array = 10;
+
+    // Scene: the tiles, the same mesh & shader, a volume each; then the
+    // helpers, without culling & with their own blending, on a second mesh
+    const uint32_t scene_count = tile_count + helper_count;
+    sReplayDraw *scene_draws = (sReplayDraw*) malloc(sizeof(sReplayDraw) * scene_count);
+    for(uint32_t i = 0; i < scene_count; i++) {
+        sReplayDraw draw = {};
+        if (i < tile_count) {
+            draw.material = 2 + i;
+            draw.program = 4;
+            draw.texture_count = 3;
+            draw.texture_targets[0] = GL_TEXTURE_3D;
+            draw.textures[0] = 30 + i;
+            draw.texture_targets[1] = GL_TEXTURE_3D;
+            draw.textures[1] = 21;
+            draw.texture_targets[2] = GL_TEXTURE_2D_ARRAY;
+            draw.textures[2] = 22;
+            draw.vertex_array = 10;
+        } else {
+            draw.material = 2 + tile_count;
+            draw.program = 5;
+            draw.texture_count = 1;
+            draw.texture_targets[0] = GL_TEXTURE_2D;
+            draw.textures[0] = 40;
+            draw.vertex_array = 11;
+            draw.culling_enabled = false;
+            draw.blend_func_x = GL_SRC_ALPHA;
+        }
+        draw.uniform_offset = (i + 1) * 256;
+        scene_draws[i] = draw;
+    }
+
+    // Composite quad, on the swapchain
+    sReplayDraw quad_draw = {};
+    quad_draw.depth_test_enabled = false;
+    quad_draw.culling_enabled = false;
+    quad_draw.material = 3 + tile_count;
+    quad_draw.program = 6;
+    quad_draw.texture_count = 1;
+    quad_draw.texture_targets[0] = GL_TEXTURE_2D;
+    quad_draw.textures[0] = 50;
+    quad_draw.vertex_array = 12;
+    quad_draw.uniform_offset = (scene_count + 1) * 256;
+
+    // Non square targets, so a swapped viewport shows
+    const sReplayPass passes[3] = {
+        {1, 128, 128, &feedback_draw, 1},
+        {2, 1440, 1584, scene_draws, scene_count},
+        {3, 1832, 1920, &quad_draw, 1}
+    };
+
+    sGLStateCache gl_state;
+    gl_state.init();
+
+    printf("%u volume tiles, %u helpers, %u passes, 2 eyes\n",
+           tile_count,
+           helper_count,
+           3);
+
+    uint32_t total_mismatches = 0;
+    for(uint32_t frame = 0; frame < frame_count; frame++) {
+        if (stub_gl.log_calls) {
+            printf("  frame %u:\n", frame);
+            stub_gl.logged_calls = 0;
+        }
+
+        // The uploads between the frames bind on their own
+        glActiveTexture(GL_TEXTURE0 + 2);
+        glBindTexture(GL_TEXTURE_3D, 99);
+        glUseProgram(7);
+
+        sReplayStats stats = {};
+        const uint32_t stub_calls_start = stub_gl.call_count;
+        replay_frame(&gl_state,
+                     passes,
+                     3,
+                     &stats);
+        const uint32_t stub_calls = stub_gl.call_count - stub_calls_start;
+        total_mismatches += stats.mismatches;
+
+        printf("frame %u: %u draws, %u state calls without the cache; issued %u (stub saw %u), elided %u (%.1f%%); %u draws with a wrong state\n",
+               frame,
+               stats.draws,
+               stats.requested_calls,
+               gl_state.last_issued_calls,
+               stub_calls,
+               gl_state.last_elided_calls,
+               100.0 * gl_state.last_elided_calls / (gl_state.last_issued_calls + gl_state.last_elided_calls),
+               stats.mismatches);
+    }
+
+    free(scene_draws);
+
+    if (total_mismatches > 0) {
+        printf("FAILED: %u draws did not get the state they asked for\n", total_mismatches);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
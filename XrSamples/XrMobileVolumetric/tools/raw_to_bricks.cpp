@@ -0,0 +1,193 @@
+/**
+ * Offline converter from headerless .raw volumes to the bricked container (.vbrk)
+ * Build on the host:
+ *  g++ -std=c++17 -O2 -I../src raw_to_bricks.cpp ../src/bricked_volume.cpp ../src/brick_codec.cpp ../src/volume_mips.cpp -pthread -o raw_to_bricks
+ * Usage:
+ *  raw_to_bricks <input.raw> <width> <height> <depth> <output.vbrk> [uint8|uint16] [brick_size] [empty_value] [lod_count] [--compress]
+ * With lod_count > 1 (uint8 only), the max-reduced levels of detail for the
+ * out-of-core streaming are written too, as <output.vbrk>.lodN
+ * With --compress, each brick is stored delta + LZ compressed (BrickCodec)
+ * */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "bricked_volume.h"
+#include "volume_mips.h"
+
+// Each level is the max of the 2x2x2 voxels of the previous one, so no
+// feature is lost for the empty space skipping on the coarse levels
+bool write_lods(const char *raw_dir,
+                const uint32_t width,
+                const uint32_t height,
+                const uint32_t depth,
+                const uint32_t brick_size,
+                const uint32_t empty_value,
+                const uint32_t lod_count,
+                const char *result_dir,
+                const eBrickCodec codec) {
+    sMappedFile raw_file = {};
+    if (!raw_file.open(raw_dir)) {
+        fprintf(stderr, "Failed to read %s\n", raw_dir);
+        return false;
+    }
+
+    const uint8_t *prev_level = (const uint8_t*) raw_file.data;
+    uint8_t *level_data = NULL;
+    uint32_t dims[3] = {width, height, depth};
+    char lod_dir[512];
+
+    for(uint32_t level = 1; level < lod_count; level++) {
+        if (dims[0] == 1 && dims[1] == 1 && dims[2] == 1) {
+            break;
+        }
+
+        const uint32_t next_dims[3] = {
+            VolumeMips::get_next_level_size(dims[0]),
+            VolumeMips::get_next_level_size(dims[1]),
+            VolumeMips::get_next_level_size(dims[2])
+        };
+        uint8_t *next_level = (uint8_t*) malloc((size_t) next_dims[0] * next_dims[1] * next_dims[2]);
+        VolumeMips::reduce_max(prev_level,
+                               dims,
+                               next_level,
+                               0,
+                               next_dims[2],
+                               0);
+        free(level_data);
+        level_data = next_level;
+        prev_level = next_level;
+        memcpy(dims, next_dims, sizeof(dims));
+
+        BrickedVolume::get_lod_dir(result_dir,
+                                   level,
+                                   lod_dir,
+                                   sizeof(lod_dir));
+        if (!BrickedVolume::convert_from_memory((const char*) level_data,
+                                                dims[0],
+                                                dims[1],
+                                                dims[2],
+                                                VOXEL_UINT8,
+                                                brick_size,
+                                                empty_value,
+                                                lod_dir,
+                                                codec)) {
+            fprintf(stderr, "Failed to write %s\n", lod_dir);
+            free(level_data);
+            raw_file.close();
+            return false;
+        }
+
+        printf("%s: level %u, %ux%ux%u\n",
+               lod_dir,
+               level,
+               dims[0],
+               dims[1],
+               dims[2]);
+    }
+
+    free(level_data);
+    raw_file.close();
+    return true;
+}
+
+int main(int argc, char **argv) {
+    eBrickCodec codec = BRICK_CODEC_RAW;
+    if (argc > 1 && strcmp(argv[argc - 1], "--compress") == 0) {
+        codec = BRICK_CODEC_DELTA_LZ;
+        argc--;
+    }
+
+    if (argc < 6) {
+        fprintf(stderr,
+                "Usage: %s <input.raw> <width> <height> <depth> <output.vbrk> [uint8|uint16] [brick_size] [empty_value] [lod_count] [--compress]\n",
+                argv[0]);
+        return 1;
+    }
+
+    const char *raw_dir = argv[1];
+    const uint32_t width = (uint32_t) atoi(argv[2]);
+    const uint32_t height = (uint32_t) atoi(argv[3]);
+    const uint32_t depth = (uint32_t) atoi(argv[4]);
+    const char *result_dir = argv[5];
+
+    eVoxelType voxel_type = VOXEL_UINT8;
+    if (argc > 6 && strcmp(argv[6], "uint16") == 0) {
+        voxel_type = VOXEL_UINT16;
+    }
+
+    uint32_t brick_size = BRICKED_VOLUME_DEFAULT_BRICK_SIZE;
+    if (argc > 7) {
+        brick_size = (uint32_t) atoi(argv[7]);
+    }
+
+    uint32_t empty_value = 0;
+    if (argc > 8) {
+        empty_value = (uint32_t) atoi(argv[8]);
+    }
+
+    uint32_t lod_count = 1;
+    if (argc > 9) {
+        lod_count = (uint32_t) atoi(argv[9]);
+    }
+
+    if (width == 0 || height == 0 || depth == 0 || brick_size == 0) {
+        fprintf(stderr, "Invalid volume or brick size\n");
+        return 1;
+    }
+
+    if (lod_count == 0 || (lod_count > 1 && voxel_type != VOXEL_UINT8)) {
+        fprintf(stderr, "Levels of detail are only supported on uint8 volumes\n");
+        return 1;
+    }
+
+    if (!BrickedVolume::convert_from_raw(raw_dir,
+                                         width,
+                                         height,
+                                         depth,
+                                         voxel_type,
+                                         brick_size,
+                                         empty_value,
+                                         result_dir,
+                                         codec)) {
+        fprintf(stderr, "Failed to convert %s\n", raw_dir);
+        return 1;
+    }
+
+    // Report the result
+    sBrickedVolume volume = {};
+    if (!volume.open(result_dir)) {
+        fprintf(stderr, "Failed to read back %s\n", result_dir);
+        return 1;
+    }
+
+    uint32_t empty_bricks = 0, compressed_bricks = 0;
+    for(uint32_t i = 0; i < volume.get_brick_count(); i++) {
+        if (volume.bricks[i].flags & BRICK_EMPTY) {
+            empty_bricks++;
+        } else if (volume.is_brick_compressed(i)) {
+            compressed_bricks++;
+        }
+    }
+
+    printf("%s: %ux%ux%u, %u bricks of %u^3, %u empty (%.1f%%), %u compressed, %zu bytes\n",
+           result_dir,
+           width,
+           height,
+           depth,
+           volume.get_brick_count(),
+           brick_size,
+           empty_bricks,
+           100.0f * empty_bricks / volume.get_brick_count(),
+           compressed_bricks,
+           volume.file.size);
+
+    volume.close();
+
+    if (lod_count > 1 && !write_lods(raw_dir, width, height, depth, brick_size, empty_value, lod_count, result_dir, codec)) {
+        return 1;
+    }
+
+    return 0;
+}
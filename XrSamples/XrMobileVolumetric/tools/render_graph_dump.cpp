@@ -0,0 +1,356 @@
+/**
+ * Compiles render graphs on the CPU (sRenderGraph, no GL) and prints what
+ * Render::sInstance would run: the order, the culled passes, the lifetimes
+ * of the resources, the physical targets they alias on, the framebuffers &
+ * the invalidations, the textures that each pass samples (get_texture); and
+ * the memory traffic of the targets (each write,
+ * store & read of a whole target) next to the one of RGBA32F targets that
+ * are always stored, as before the formats & the invalidations.
+ * The graphs:
+ *  - volume: the brick feedback, a low resolution volume pass, its
+ *    upsampling & a composite on the swapchain, with a debug view that
+ *    nothing reads (culled)
+ *  - post: an HDR scene, then a chain of full resolution RGBA8 effects, that
+ *    alias on two targets
+ *  - declared out of order: the composite added before the passes it reads
+ *  - cycle: two passes reading each other, that fails to compile
+ * Each one is checked: every pass runs after the writers of what it reads,
+ * the aliased resources never overlap, the read attachments are never
+ * invalidated, no pass samples a texture that it renders to, and the kept
+ * ones are never culled.
+ * Build on the host:
+ *  g++ -std=c++17 -O2 -I../src render_graph_dump.cpp ../src/render_graph.cpp -o render_graph_dump
+ * */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "render_graph.h"
+
+#define EYE_WIDTH 1440
+#define EYE_HEIGHT 1584
+#define DEPTH_PIXEL_SIZE 4 // GL_DEPTH_COMPONENT24
+#define LEGACY_PIXEL_SIZE 16 // RGBA32F
+#define FIRST_TEXTURE_HANDLE 10 // After the textures of the scene
+
+static uint64_t get_resource_size(const sGraphResource &resource,
+                                  const bool is_legacy) {
+    uint32_t pixel_size = DEPTH_PIXEL_SIZE;
+    if (resource.desc.type == GRAPH_COLOR_TARGET) {
+        // The swapchain keeps its format
+        pixel_size = (is_legacy && !resource.is_imported) ? LEGACY_PIXEL_SIZE : render_target_format_sizes[resource.desc.format];
+    }
+    return (uint64_t) resource.desc.width * resource.desc.height * pixel_size;
+}
+
+// Bytes per frame that the passes that run move between the tiles & memory
+static uint64_t get_frame_traffic(const sRenderGraph &graph,
+                                  const bool is_legacy) {
+    uint64_t traffic = 0;
+    for(uint8_t k = 0; k < graph.order_count; k++) {
+        const sGraphPass &pass = graph.passes[graph.order[k]];
+        for(uint8_t i = 0; i < pass.read_count; i++) {
+            traffic += get_resource_size(graph.resources[pass.reads[i]], is_legacy);
+        }
+        for(uint8_t a = 0; a < GRAPH_ATTACHMENT_COUNT; a++) {
+            if (pass.writes[a] == GRAPH_NONE) {
+                continue;
+            }
+            // Invalidated attachments are never stored
+            if (is_legacy || !(pass.invalidate_mask & (1u << a))) {
+                traffic += get_resource_size(graph.resources[pass.writes[a]], is_legacy);
+            }
+        }
+    }
+    return traffic;
+}
+
+static bool check_graph(const sRenderGraph &graph) {
+    bool is_valid = true;
+
+    uint8_t positions[GRAPH_MAX_PASSES];
+    memset(positions, GRAPH_NONE, sizeof(positions));
+    for(uint8_t k = 0; k < graph.order_count; k++) {
+        positions[graph.order[k]] = k;
+    }
+
+    for(uint8_t k = 0; k < graph.order_count; k++) {
+        const sGraphPass &pass = graph.passes[graph.order[k]];
+
+        // The writers of what it reads run before it
+        for(uint8_t i = 0; i < pass.read_count; i++) {
+            for(uint8_t q = 0; q < graph.pass_count; q++) {
+                const sGraphPass &writer = graph.passes[q];
+                bool writes = false;
+                for(uint8_t a = 0; a < GRAPH_ATTACHMENT_COUNT; a++) {
+                    writes = writes || writer.writes[a] == pass.reads[i];
+                }
+                if (writes && q != graph.order[k] && q < graph.order[k] && (writer.is_culled || positions[q] > k)) {
+                    printf("  ! %s reads %s before %s writes it\n", pass.name, graph.resources[pass.reads[i]].name, writer.name);
+                    is_valid = false;
+                }
+            }
+        }
+
+        // No feedback loops: the textures it samples are not attached
+        for(uint8_t i = 0; i < pass.read_count; i++) {
+            if (graph.resources[pass.reads[i]].desc.type != GRAPH_COLOR_TARGET) {
+                continue;
+            }
+            const uint32_t texture = graph.get_texture(pass.reads[i]);
+            for(uint8_t a = GRAPH_ATTACHMENT_COLOR0; a <= GRAPH_ATTACHMENT_COLOR1; a++) {
+                const uint8_t written = pass.writes[a];
+                if (written != GRAPH_NONE && !graph.resources[written].is_imported && graph.get_texture(written) == texture) {
+                    printf("  ! %s samples texture %u, that it renders to\n", pass.name, texture);
+                    is_valid = false;
+                }
+            }
+        }
+
+        // The invalidated attachments are not read later
+        for(uint8_t a = 0; a < GRAPH_ATTACHMENT_COUNT; a++) {
+            if (!(pass.invalidate_mask & (1u << a))) {
+                continue;
+            }
+            const sGraphResource &resource = graph.resources[pass.writes[a]];
+            if (resource.keep_contents || resource.last_use > k) {
+                printf("  ! %s invalidates %s, that is used later\n", pass.name, resource.name);
+                is_valid = false;
+            }
+        }
+    }
+
+    // The resources on the same target do not overlap
+    for(uint8_t r = 0; r < graph.resource_count; r++) {
+        for(uint8_t s = r + 1; s < graph.resource_count; s++) {
+            const sGraphResource &a = graph.resources[r];
+            const sGraphResource &b = graph.resources[s];
+            if (a.physical_id == GRAPH_NONE || a.physical_id != b.physical_id) {
+                continue;
+            }
+            if (!(a.last_use < b.first_use || b.last_use < a.first_use)) {
+                printf("  ! %s & %s overlap on target %u\n", a.name, b.name, a.physical_id);
+                is_valid = false;
+            }
+        }
+        const sGraphResource &resource = graph.resources[r];
+        if (resource.keep_contents && resource.first_use == GRAPH_NONE) {
+            printf("  ! %s is kept, but nothing writes it\n", resource.name);
+            is_valid = false;
+        }
+    }
+
+    return is_valid;
+}
+
+static bool dump_graph(const char *title,
+                       sRenderGraph *graph,
+                       const bool expect_failure = false) {
+    printf("%s:\n", title);
+    const bool compiled = graph->compile();
+    if (!compiled) {
+        printf("  does not compile%s\n\n", (expect_failure) ? ", as expected" : "");
+        return expect_failure;
+    }
+
+    // As Render::sInstance::compile_render_graph, that creates the new ones
+    for(uint8_t t = 0; t < graph->physical_target_count; t++) {
+        sGraphPhysicalTarget &target = graph->physical_targets[t];
+        if (!target.is_allocated) {
+            target.handle = FIRST_TEXTURE_HANDLE + t;
+            target.is_allocated = true;
+        }
+    }
+
+    printf("  order:");
+    for(uint8_t k = 0; k < graph->order_count; k++) {
+        printf(" %s", graph->passes[graph->order[k]].name);
+    }
+    printf("\n  culled:");
+    for(uint8_t p = 0; p < graph->pass_count; p++) {
+        if (graph->passes[p].is_culled) {
+            printf(" %s", graph->passes[p].name);
+        }
+    }
+    printf("\n");
+
+    for(uint8_t r = 0; r < graph->resource_count; r++) {
+        const sGraphResource &resource = graph->resources[r];
+        if (resource.first_use == GRAPH_NONE) {
+            printf("  %-16s unused\n", resource.name);
+            continue;
+        }
+        printf("  %-16s %4ux%-4u %-10s, passes %u-%u, %s",
+               resource.name,
+               resource.desc.width,
+               resource.desc.height,
+               (resource.desc.type == GRAPH_DEPTH_TARGET) ? "depth" : render_target_format_names[resource.desc.format],
+               resource.first_use,
+               resource.last_use,
+               (resource.is_imported) ? "imported" : "target");
+        if (!resource.is_imported) {
+            printf(" %u", resource.physical_id);
+        }
+        printf("\n");
+    }
+
+    for(uint8_t k = 0; k < graph->order_count; k++) {
+        const sGraphPass &pass = graph->passes[graph->order[k]];
+        printf("  %-16s ", pass.name);
+        if (pass.writes_imported) {
+            printf("swapchain");
+        } else if (pass.framebuffer_id != GRAPH_NONE) {
+            printf("framebuffer %u", pass.framebuffer_id);
+        } else {
+            printf("no targets");
+        }
+        // The depths are renderbuffers, only waited on
+        for(uint8_t i = 0; i < pass.read_count; i++) {
+            const sGraphResource &resource = graph->resources[pass.reads[i]];
+            if (resource.desc.type == GRAPH_COLOR_TARGET) {
+                printf(", samples %s (texture %u)", resource.name, graph->get_texture(pass.reads[i]));
+            } else {
+                printf(", waits on %s", resource.name);
+            }
+        }
+        if (pass.invalidate_mask != 0) {
+            printf(", invalidates");
+            for(uint8_t a = 0; a < GRAPH_ATTACHMENT_COUNT; a++) {
+                if (pass.invalidate_mask & (1u << a)) {
+                    printf(" %s", graph_attachment_names[a]);
+                }
+            }
+        }
+        printf("\n");
+    }
+
+    uint32_t target_count = 0;
+    for(uint8_t t = 0; t < graph->physical_target_count; t++) {
+        target_count += (graph->physical_targets[t].resource_count > 0) ? 1 : 0;
+    }
+    uint32_t transient_count = 0;
+    for(uint8_t r = 0; r < graph->resource_count; r++) {
+        transient_count += (!graph->resources[r].is_imported && graph->resources[r].first_use != GRAPH_NONE) ? 1 : 0;
+    }
+    printf("  %u transient resources on %u physical targets, %u framebuffers on the pool\n",
+           transient_count,
+           target_count,
+           graph->framebuffer_count);
+    const uint64_t traffic = get_frame_traffic(*graph, false);
+    const uint64_t legacy_traffic = get_frame_traffic(*graph, true);
+    printf("  %.1f MB of target traffic per eye & frame, %.1f MB as RGBA32F stored targets (%.0f%%)\n",
+           traffic / (1024.0 * 1024.0),
+           legacy_traffic / (1024.0 * 1024.0),
+           (100.0 * traffic) / legacy_traffic);
+
+    const bool is_valid = check_graph(*graph);
+    printf("  %s\n\n", (is_valid) ? "valid" : "INVALID");
+    return is_valid && !expect_failure;
+}
+
+static void import_swapchain(sRenderGraph *graph,
+                             uint8_t *color,
+                             uint8_t *depth) {
+    *color = graph->import_resource("swapchain_color",
+                                    {EYE_WIDTH, EYE_HEIGHT, GRAPH_COLOR_TARGET},
+                                    true);
+    *depth = graph->import_resource("swapchain_depth",
+                                    {EYE_WIDTH, EYE_HEIGHT, GRAPH_DEPTH_TARGET},
+                                    false);
+}
+
+int main() {
+    bool all_valid = true;
+    uint8_t swapchain_color = 0;
+    uint8_t swapchain_depth = 0;
+
+    // Volume
+    sRenderGraph graphs[4];
+    sRenderGraph *graph = &graphs[0];
+    import_swapchain(graph, &swapchain_color, &swapchain_depth);
+    const uint8_t feedback = graph->add_resource("feedback", {128, 128, GRAPH_COLOR_TARGET}, true);
+    const uint8_t volume_color = graph->add_resource("volume_color", {EYE_WIDTH / 2, EYE_HEIGHT / 2, GRAPH_COLOR_TARGET, TARGET_RGBA16F});
+    const uint8_t volume_depth = graph->add_resource("volume_depth", {EYE_WIDTH / 2, EYE_HEIGHT / 2, GRAPH_DEPTH_TARGET});
+    const uint8_t upsampled = graph->add_resource("upsampled", {EYE_WIDTH, EYE_HEIGHT, GRAPH_COLOR_TARGET, TARGET_R11G11B10F});
+    const uint8_t debug_view = graph->add_resource("debug_view", {EYE_WIDTH / 2, EYE_HEIGHT / 2, GRAPH_COLOR_TARGET});
+
+    uint8_t pass = graph->add_pass("feedback", 0, true);
+    graph->write(pass, feedback, GRAPH_ATTACHMENT_COLOR0);
+    pass = graph->add_pass("volume", 1);
+    graph->write(pass, volume_color, GRAPH_ATTACHMENT_COLOR0);
+    graph->write(pass, volume_depth, GRAPH_ATTACHMENT_DEPTH);
+    pass = graph->add_pass("debug", 2);
+    graph->read(pass, volume_depth);
+    graph->write(pass, debug_view, GRAPH_ATTACHMENT_COLOR0);
+    pass = graph->add_pass("upsample", 3);
+    graph->read(pass, volume_color);
+    graph->write(pass, upsampled, GRAPH_ATTACHMENT_COLOR0);
+    pass = graph->add_pass("composite", 4);
+    graph->read(pass, upsampled);
+    graph->write(pass, swapchain_color, GRAPH_ATTACHMENT_COLOR0);
+    graph->write(pass, swapchain_depth, GRAPH_ATTACHMENT_DEPTH);
+    all_valid = dump_graph("volume", graph) && all_valid;
+
+    // The same graph, compiled again, takes everything from the pools
+    const uint8_t pooled_targets = graph->physical_target_count;
+    const uint8_t pooled_framebuffers = graph->framebuffer_count;
+    graph->compile();
+    if (graph->physical_target_count != pooled_targets || graph->framebuffer_count != pooled_framebuffers) {
+        printf("  ! the second compile grew the pools\n\n");
+        all_valid = false;
+    }
+
+    // Post: scene, then effects ping-ponging at full resolution
+    graph = &graphs[1];
+    import_swapchain(graph, &swapchain_color, &swapchain_depth);
+    const char effect_names[4][9] = {"tonemap", "sharpen", "vignette", "dither"};
+    const char effect_output_names[4][13] = {"tonemap_out", "sharpen_out", "vignette_out", "dither_out"};
+    uint8_t previous = graph->add_resource("scene", {EYE_WIDTH, EYE_HEIGHT, GRAPH_COLOR_TARGET, TARGET_R11G11B10F});
+    const uint8_t scene_depth = graph->add_resource("scene_depth", {EYE_WIDTH, EYE_HEIGHT, GRAPH_DEPTH_TARGET});
+    pass = graph->add_pass("scene", 0);
+    graph->write(pass, previous, GRAPH_ATTACHMENT_COLOR0);
+    graph->write(pass, scene_depth, GRAPH_ATTACHMENT_DEPTH);
+    for(uint8_t i = 0; i < 4; i++) {
+        const uint8_t output = graph->add_resource(effect_output_names[i], {EYE_WIDTH, EYE_HEIGHT, GRAPH_COLOR_TARGET});
+        pass = graph->add_pass(effect_names[i], 1 + i);
+        graph->read(pass, previous);
+        graph->write(pass, output, GRAPH_ATTACHMENT_COLOR0);
+        previous = output;
+    }
+    pass = graph->add_pass("present", 5);
+    graph->read(pass, previous);
+    graph->write(pass, swapchain_color, GRAPH_ATTACHMENT_COLOR0);
+    all_valid = dump_graph("post", graph) && all_valid;
+
+    // Declared out of order
+    graph = &graphs[2];
+    import_swapchain(graph, &swapchain_color, &swapchain_depth);
+    const uint8_t shadow = graph->add_resource("shadow", {1024, 1024, GRAPH_DEPTH_TARGET});
+    const uint8_t lit = graph->add_resource("lit", {EYE_WIDTH, EYE_HEIGHT, GRAPH_COLOR_TARGET, TARGET_RGB10_A2});
+    pass = graph->add_pass("composite", 0);
+    graph->read(pass, lit);
+    graph->write(pass, swapchain_color, GRAPH_ATTACHMENT_COLOR0);
+    pass = graph->add_pass("lighting", 1);
+    graph->read(pass, shadow);
+    graph->write(pass, lit, GRAPH_ATTACHMENT_COLOR0);
+    pass = graph->add_pass("shadow", 2);
+    graph->write(pass, shadow, GRAPH_ATTACHMENT_DEPTH);
+    all_valid = dump_graph("declared out of order", graph) && all_valid;
+
+    // Cycle
+    graph = &graphs[3];
+    import_swapchain(graph, &swapchain_color, &swapchain_depth);
+    const uint8_t a = graph->add_resource("a", {256, 256, GRAPH_COLOR_TARGET});
+    const uint8_t b = graph->add_resource("b", {256, 256, GRAPH_COLOR_TARGET});
+    pass = graph->add_pass("first", 0);
+    graph->read(pass, b);
+    graph->write(pass, a, GRAPH_ATTACHMENT_COLOR0);
+    pass = graph->add_pass("second", 1, true);
+    graph->read(pass, a);
+    graph->write(pass, b, GRAPH_ATTACHMENT_COLOR0);
+    all_valid = dump_graph("cycle", graph, true) && all_valid;
+
+    printf("%s\n", (all_valid) ? "All graphs as expected" : "FAILED");
+    return (all_valid) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,380 @@
+/**
+ * Headless replay of the out-of-core brick cache (sVolumeResidency)
+ * Runs a camera path over a volume with its levels of detail (see raw_to_bricks
+ * lod_count), without GL, and reports the hit rate & the I/O of the cache.
+ * Build on the host (glm is not on the repo):
+ *  g++ -std=c++17 -O2 -I../src -I<glm> residency_replay.cpp ../src/volume_residency.cpp ../src/bricked_volume.cpp ../src/brick_codec.cpp -pthread -o residency_replay
+ * Usage:
+ *  residency_replay <volume.vbrk> [orbit|<poses.txt>] [cache_slots] [frames] [--sync] [--feedback] [--record <poses.txt>]
+ * The poses file has a frame per line: the 16 floats of the view-projection
+ * of each eye (1 or 2), column major, on the space where the volume is [0, 1]^3.
+ * With --sync each frame waits for its loads, as if the disk kept up; if not,
+ * the frames are paced at 90 Hz and the loads arrive when they arrive.
+ * With --feedback, the feedback pass is done on the CPU (the same march as
+ * streamed_feedback_shader, on nearest samples) and handed to the cache
+ * FEEDBACK_LATENCY frames later, like the GPU readback.
+ * */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/matrix_transform.hpp>
+
+#include "volume_residency.h"
+
+#define FRAME_TIME_MS 11
+#define EYE_SEPARATION 0.128f // The volume is ~0.5 m on the sample, so ~64 mm
+#define FEEDBACK_SIZE 64
+#define FEEDBACK_LATENCY 3 // FEEDBACK_READBACK_COUNT
+#define FEEDBACK_STEP_SIZE 0.007f
+#define FEEDBACK_MAX_ITERATIONS 350
+#define DENSITY_THRESHOLD 0.15f
+
+// Orbit around the volume, dollying in and out
+void get_orbit_pose(const uint32_t frame,
+                    const uint32_t frame_count,
+                    glm::mat4x4 view_projs[2]) {
+    const float t = (float) frame / frame_count;
+    const float angle = t * 2.0f * 3.14159265f;
+    const float distance = 1.5f + 1.0f * cosf(t * 3.0f * 2.0f * 3.14159265f);
+
+    const glm::vec3 center = glm::vec3(0.5f, 0.5f, 0.5f);
+    const glm::vec3 eye = center + glm::vec3(sinf(angle) * distance, 0.3f, cosf(angle) * distance);
+    const glm::vec3 right = glm::normalize(glm::cross(center - eye, glm::vec3(0.0f, 1.0f, 0.0f)));
+    const glm::mat4x4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.05f, 100.0f);
+
+    for(uint32_t i = 0; i < 2; i++) {
+        const glm::vec3 eye_offset = right * (EYE_SEPARATION * ((i == 0) ? -0.5f : 0.5f));
+        view_projs[i] = projection * glm::lookAt(eye + eye_offset,
+                                                 center + eye_offset,
+                                                 glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+}
+
+// Returns the number of views read, 0 at the end of the file
+uint32_t read_pose(FILE *file,
+                   glm::mat4x4 view_projs[2]) {
+    char line[4096];
+    if (fgets(line, sizeof(line), file) == NULL) {
+        return 0;
+    }
+
+    float values[32];
+    uint32_t count = 0;
+    char *curr = line;
+    while (count < 32) {
+        char *end = NULL;
+        const float value = strtof(curr, &end);
+        if (end == curr) {
+            break;
+        }
+        values[count++] = value;
+        curr = end;
+    }
+
+    const uint32_t views = count / 16;
+    for(uint32_t v = 0; v < views; v++) {
+        for(uint32_t i = 0; i < 16; i++) {
+            view_projs[v][i / 4][i % 4] = values[v * 16 + i];
+        }
+    }
+    return views;
+}
+
+void write_pose(FILE *file,
+                const glm::mat4x4 *view_projs,
+                const uint32_t views) {
+    for(uint32_t v = 0; v < views; v++) {
+        for(uint32_t i = 0; i < 16; i++) {
+            fprintf(file, "%g ", view_projs[v][i / 4][i % 4]);
+        }
+    }
+    fprintf(file, "\n");
+}
+
+// Nearest voxel of a level, from its bricks
+float sample_level(const sBrickedVolume &lod,
+                   const glm::vec3 &pos) {
+    const sBrickedVolumeHeader *header = lod.header;
+    const uint32_t dims[3] = {header->width, header->height, header->depth};
+    uint32_t voxel[3], brick[3];
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        const float coord = pos[axis] * dims[axis];
+        voxel[axis] = (coord <= 0.0f) ? 0 : (uint32_t) coord;
+        voxel[axis] = (voxel[axis] >= dims[axis]) ? dims[axis] - 1 : voxel[axis];
+        brick[axis] = voxel[axis] / header->brick_size;
+    }
+
+    const uint32_t brick_index = lod.get_brick_index(brick[0], brick[1], brick[2]);
+    const uint8_t *data = (const uint8_t*) lod.get_brick_data(brick_index);
+
+    // Compressed levels: the last brick sampled stays decoded
+    static thread_local const sBrickedVolume *decoded_lod = NULL;
+    static thread_local uint32_t decoded_brick = UINT32_MAX;
+    static thread_local uint8_t *decoded = NULL;
+    if (data == NULL && lod.is_brick_compressed(brick_index) && !(lod.bricks[brick_index].flags & BRICK_EMPTY)) {
+        if (decoded_lod != &lod || decoded_brick != brick_index) {
+            decoded = (uint8_t*) realloc(decoded, (size_t) header->brick_size * header->brick_size * header->brick_size);
+            decoded_lod = &lod;
+            decoded_brick = (lod.decode_brick(brick_index, decoded)) ? brick_index : UINT32_MAX;
+        }
+        data = (decoded_brick == brick_index) ? decoded : NULL;
+    }
+    if (data == NULL) {
+        return 0.0f;
+    }
+    uint32_t origin[3], size[3];
+    lod.get_brick_extent(brick_index, origin, size);
+    return data[((size_t) (voxel[2] - origin[2]) * size[1] + (voxel[1] - origin[1])) * size[0] + (voxel[0] - origin[0])] / 255.0f;
+}
+
+// CPU version of streamed_feedback_shader, for a view
+void render_feedback(const sVolumeResidency &residency,
+                     const glm::mat4x4 &view_proj,
+                     uint8_t *pages) {
+    const glm::mat4x4 inv_view_proj = glm::inverse(view_proj);
+    const glm::vec4 eye_h = inv_view_proj * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+    const glm::vec3 eye = glm::vec3(eye_h) / eye_h.w;
+
+    const sBrickedVolumeHeader *header = residency.lods[0].header;
+    const glm::vec3 volume_size = glm::vec3(header->width, header->height, header->depth);
+    const float max_size = std::max(volume_size.x, std::max(volume_size.y, volume_size.z));
+    const float brick_size = (float) residency.brick_size;
+
+    for(uint32_t py = 0; py < FEEDBACK_SIZE; py++) {
+        for(uint32_t px = 0; px < FEEDBACK_SIZE; px++) {
+            uint8_t *out = &pages[((size_t) py * FEEDBACK_SIZE + px) * 4];
+            memset(out, 0, 4);
+
+            // Ray of the pixel, and of its neighbour for the pixel angle
+            const float ndc_x = ((px + 0.5f) / FEEDBACK_SIZE) * 2.0f - 1.0f;
+            const float ndc_y = ((py + 0.5f) / FEEDBACK_SIZE) * 2.0f - 1.0f;
+            glm::vec4 far_h = inv_view_proj * glm::vec4(ndc_x, ndc_y, 1.0f, 1.0f);
+            const glm::vec3 ray_dir = glm::normalize(glm::vec3(far_h) / far_h.w - eye);
+            far_h = inv_view_proj * glm::vec4(ndc_x + 2.0f / FEEDBACK_SIZE, ndc_y, 1.0f, 1.0f);
+            const float pixel_angle = glm::length(glm::normalize(glm::vec3(far_h) / far_h.w - eye) - ray_dir);
+
+            // Entry on the box
+            float t_enter = 0.0f, t_exit = 1e30f;
+            for(uint32_t axis = 0; axis < 3; axis++) {
+                const float inv_dir = 1.0f / ((fabsf(ray_dir[axis]) > 1e-6f) ? ray_dir[axis] : 1e-6f);
+                float t0 = (0.0f - eye[axis]) * inv_dir, t1 = (1.0f - eye[axis]) * inv_dir;
+                if (t0 > t1) {
+                    std::swap(t0, t1);
+                }
+                t_enter = std::max(t_enter, t0);
+                t_exit = std::min(t_exit, t1);
+            }
+            if (t_enter > t_exit) {
+                continue;
+            }
+
+            glm::vec3 pos = eye + ray_dir * (t_enter + 0.0001f);
+            bool has_request = false;
+            for(uint32_t i = 0; i < FEEDBACK_MAX_ITERATIONS; i++) {
+                if (pos.x < 0.0f || pos.y < 0.0f || pos.z < 0.0f || pos.x > 1.0f || pos.y > 1.0f || pos.z > 1.0f) {
+                    break;
+                }
+
+                uint32_t page[3];
+                for(uint32_t axis = 0; axis < 3; axis++) {
+                    const float coord = floorf(pos[axis] * volume_size[axis] / brick_size);
+                    page[axis] = (coord <= 0.0f) ? 0 : (uint32_t) coord;
+                    page[axis] = (page[axis] >= residency.page_table_dims[axis]) ? residency.page_table_dims[axis] - 1 : page[axis];
+                }
+                const uint8_t *entry = &residency.page_table[(page[0] + (page[1] + page[2] * residency.page_table_dims[1]) * residency.page_table_dims[0]) * 4];
+                const int32_t level = (int32_t) entry[3] - 1;
+
+                if (entry[3] != RESIDENCY_EMPTY_PAGE) {
+                    const float pixel_voxels = glm::length(pos - eye) * pixel_angle * max_size;
+                    int32_t desired_level = (int32_t) floorf(log2f(std::max(pixel_voxels, 1.0f)) + residency.lod_bias);
+                    desired_level = std::min(std::max(desired_level, 0), (int32_t) residency.lod_count - 1);
+                    if (!has_request && (level < 0 || level > desired_level)) {
+                        out[0] = (uint8_t) page[0];
+                        out[1] = (uint8_t) page[1];
+                        out[2] = (uint8_t) page[2];
+                        out[3] = (uint8_t) (desired_level + 1);
+                        has_request = true;
+                    }
+
+                    if (level >= 0 && DENSITY_THRESHOLD <= sample_level(residency.lods[level], pos)) {
+                        if (!has_request) {
+                            out[0] = (uint8_t) page[0];
+                            out[1] = (uint8_t) page[1];
+                            out[2] = (uint8_t) page[2];
+                            out[3] = (uint8_t) (level + 1);
+                        }
+                        break;
+                    }
+                }
+
+                if (level < 0 || entry[3] == RESIDENCY_EMPTY_PAGE) {
+                    // Jump over the brick
+                    float brick_exit = 1e30f;
+                    for(uint32_t axis = 0; axis < 3; axis++) {
+                        const float plane = ((ray_dir[axis] >= 0.0f) ? page[axis] + 1.0f : (float) page[axis]) * brick_size / volume_size[axis];
+                        brick_exit = std::min(brick_exit, fabsf(plane - pos[axis]) / std::max(fabsf(ray_dir[axis]), 0.00001f));
+                    }
+                    pos = pos + ray_dir * (std::max(ceilf(brick_exit / FEEDBACK_STEP_SIZE), 1.0f) * FEEDBACK_STEP_SIZE);
+                    continue;
+                }
+
+                pos = pos + ray_dir * FEEDBACK_STEP_SIZE;
+            }
+        }
+    }
+}
+
+void print_stats(const char *label,
+                 const sResidencyStats &stats,
+                 const uint32_t frames) {
+    printf("%-10s %7u frames, %8u needed, hit rate %5.1f%%, %6u requested, %6u loaded, %6u evicted, %6u dropped, %8.2f MB read\n",
+           label,
+           frames,
+           stats.needed_bricks,
+           100.0f * stats.get_hit_rate(),
+           stats.requested_bricks,
+           stats.loaded_bricks,
+           stats.evictions,
+           stats.dropped_requests,
+           stats.bytes_read / (1024.0 * 1024.0));
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("Usage: %s <volume.vbrk> [orbit|<poses.txt>] [cache_slots] [frames] [--sync] [--record <poses.txt>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char *volume_dir = argv[1];
+    const char *path = (argc > 2) ? argv[2] : "orbit";
+    const uint32_t cache_slots = (argc > 3) ? (uint32_t) atoi(argv[3]) : RESIDENCY_DEFAULT_SLOT_COUNT;
+    uint32_t frame_count = (argc > 4) ? (uint32_t) atoi(argv[4]) : 900;
+
+    bool sync = false;
+    bool feedback = false;
+    FILE *record_file = NULL;
+    for(int i = 5; i < argc; i++) {
+        if (strcmp(argv[i], "--sync") == 0) {
+            sync = true;
+        } else if (strcmp(argv[i], "--feedback") == 0) {
+            feedback = true;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_file = fopen(argv[++i], "w");
+        }
+    }
+
+    FILE *pose_file = NULL;
+    if (strcmp(path, "orbit") != 0) {
+        pose_file = fopen(path, "r");
+        if (pose_file == NULL) {
+            printf("Cannot open the poses %s\n", path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    sVolumeResidency *residency = new sVolumeResidency();
+    if (!residency->init(volume_dir,
+                         cache_slots,
+                         RESIDENCY_DEFAULT_WORKER_COUNT,
+                         0.0f,
+                         true)) {
+        printf("Cannot open the volume %s\n", volume_dir);
+        return EXIT_FAILURE;
+    }
+
+    residency->use_feedback = feedback;
+
+    printf("%s: %u levels of detail, bricks of %u^3, cache of %u slots (%.1f MB), %s loads, %s requests\n",
+           volume_dir,
+           residency->lod_count,
+           residency->brick_size,
+           residency->slot_count,
+           residency->slot_count * residency->get_slot_size() / (1024.0 * 1024.0),
+           (sync) ? "sync" : "async",
+           (feedback) ? "feedback" : "frustum");
+    if (residency->slot_count < residency->requested_slot_count) {
+        printf("  %u slots requested, reduced to fit the atlas on %u^3 voxels\n",
+               residency->requested_slot_count,
+               BRICK_ATLAS_MAX_TEXTURE_SIZE);
+    }
+
+    // Ring of feedbacks in flight, of both views
+    const uint32_t feedback_pages = FEEDBACK_SIZE * FEEDBACK_SIZE * 2;
+    uint8_t *feedback_ring = (uint8_t*) calloc((size_t) feedback_pages * 4, FEEDBACK_LATENCY);
+
+    const glm::mat4x4 model = glm::mat4x4(1.0f);
+    sResidencyStats window_stats = {};
+    uint32_t window_frames = 0;
+    uint32_t frame = 0;
+    for(; frame < frame_count; frame++) {
+        glm::mat4x4 view_projs[2];
+        uint32_t views = 2;
+        if (pose_file != NULL) {
+            views = read_pose(pose_file, view_projs);
+            if (views == 0) {
+                break;
+            }
+        } else {
+            get_orbit_pose(frame, frame_count, view_projs);
+        }
+        if (record_file != NULL) {
+            write_pose(record_file, view_projs, views);
+        }
+
+        if (feedback && frame >= FEEDBACK_LATENCY) {
+            residency->set_feedback(&feedback_ring[(size_t) (frame % FEEDBACK_LATENCY) * feedback_pages * 4],
+                                    feedback_pages);
+        }
+
+        residency->update(view_projs,
+                          views,
+                          model);
+        if (sync) {
+            residency->wait_for_loads();
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(FRAME_TIME_MS));
+        }
+
+        if (feedback) {
+            uint8_t *frame_feedback = &feedback_ring[(size_t) (frame % FEEDBACK_LATENCY) * feedback_pages * 4];
+            memset(frame_feedback, 0, (size_t) feedback_pages * 4);
+            for(uint32_t v = 0; v < views; v++) {
+                render_feedback(*residency,
+                                view_projs[v],
+                                &frame_feedback[(size_t) v * FEEDBACK_SIZE * FEEDBACK_SIZE * 4]);
+            }
+        }
+
+        // Stats of the frame are complete on the next update; close enough per window
+        window_stats.add(residency->frame_stats);
+        window_frames++;
+        if (window_frames == 90) {
+            char label[32];
+            snprintf(label, sizeof(label), "@%u", frame + 1);
+            print_stats(label, window_stats, window_frames);
+            window_stats = {};
+            window_frames = 0;
+        }
+    }
+
+    print_stats("total", residency->get_total_stats(), frame);
+
+    residency->destroy();
+    delete residency;
+    free(feedback_ring);
+    if (pose_file != NULL) {
+        fclose(pose_file);
+    }
+    if (record_file != NULL) {
+        fclose(record_file);
+    }
+
+    return EXIT_SUCCESS;
+}
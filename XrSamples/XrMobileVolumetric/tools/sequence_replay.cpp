@@ -0,0 +1,101 @@
+/**
+ * Headless playback of a time-varying volume (sVolumeSequence)
+ * Plays a sequence at 90 Hz frames, without GL, and reports the MB/s that
+ * the prefetch sustains and the timesteps dropped, to size the ring.
+ * Build on the host:
+ *  g++ -std=c++17 -O2 -I../src sequence_replay.cpp ../src/volume_sequence.cpp -pthread -o sequence_replay
+ * Usage:
+ *  sequence_replay <sequence_dir> <width> <height> <depth> [ring_size] [fps] [seconds] [--hold]
+ * The sequence is a folder of raw R8 timesteps, 0000.raw, 0001.raw...
+ * The uploads are not timed here, so the drops are the ones of the disk alone.
+ * */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+
+#include "volume_sequence.h"
+
+#define FRAME_TIME_MS 11
+
+void print_stats(const char *label,
+                 const sSequenceStats &stats,
+                 const double needed_mb_s) {
+    printf("%-8s %7.2f s, %5u shown, %5u dropped, %6u frames held, %4u wasted loads, %8.1f MB/s sustained, %8.1f MB/s read, %8.1f MB/s needed\n",
+           label,
+           stats.elapsed_seconds,
+           stats.shown_timesteps,
+           stats.dropped_timesteps,
+           stats.held_frames,
+           stats.wasted_loads,
+           stats.get_sustained_mb_s(),
+           stats.get_read_mb_s(),
+           needed_mb_s);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 5) {
+        printf("Usage: %s <sequence_dir> <width> <height> <depth> [ring_size] [fps] [seconds] [--hold]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const uint32_t ring_size = (argc > 5) ? (uint32_t) atoi(argv[5]) : SEQUENCE_DEFAULT_RING_SIZE;
+    const float fps = (argc > 6) ? (float) atof(argv[6]) : SEQUENCE_DEFAULT_FPS;
+    const double seconds = (argc > 7) ? atof(argv[7]) : 10.0;
+    const bool hold = argc > 8 && strcmp(argv[8], "--hold") == 0;
+
+    sVolumeSequence *sequence = new sVolumeSequence();
+    if (!sequence->init(argv[1],
+                        (uint32_t) atoi(argv[2]),
+                        (uint32_t) atoi(argv[3]),
+                        (uint32_t) atoi(argv[4]),
+                        ring_size,
+                        fps,
+                        true)) {
+        printf("Cannot open the sequence %s\n", argv[1]);
+        delete sequence;
+        return EXIT_FAILURE;
+    }
+    sequence->rate_mode = (hold) ? SEQUENCE_HOLD_LATE : SEQUENCE_DROP_LATE;
+
+    const double needed_mb_s = (sequence->timestep_size / (1024.0 * 1024.0)) * fps;
+    printf("%s: %u timesteps of %.1f MB, ring of %u, %.1f timesteps/s, %s\n",
+           argv[1],
+           sequence->timestep_count,
+           sequence->timestep_size / (1024.0 * 1024.0),
+           sequence->ring_size,
+           fps,
+           (hold) ? "holding" : "dropping");
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double next_report = 1.0;
+    for(;;) {
+        sequence->update();
+
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= next_report) {
+            char label[32];
+            snprintf(label, sizeof(label), "@%.0fs", next_report);
+            print_stats(label,
+                        sequence->get_stats(),
+                        needed_mb_s);
+            next_report += 1.0;
+        }
+        if (elapsed >= seconds) {
+            break;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(FRAME_TIME_MS));
+    }
+
+    print_stats("total",
+                sequence->get_stats(),
+                needed_mb_s);
+
+    sequence->destroy();
+    delete sequence;
+
+    return EXIT_SUCCESS;
+}
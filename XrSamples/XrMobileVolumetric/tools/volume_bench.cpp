@@ -0,0 +1,656 @@
+/**
+ * Host benchmarks of the CPU volume processing
+ * Build on the host:
+ *  g++ -std=c++17 -O2 -I../src volume_bench.cpp ../src/volume_mips.cpp ../src/distance_field.cpp ../src/minmax_grid.cpp ../src/volume_acceleration.cpp ../src/derived_cache.cpp ../src/bricked_volume.cpp ../src/brick_codec.cpp ../src/volume_quantize.cpp -pthread -o volume_bench
+ * Usage:
+ *  volume_bench mips|distance [max_size] [repetitions]
+ *  volume_bench cache <cache_dir> [max_size]
+ *  volume_bench bricks <work_dir> [<raw_file> <width> <height> <depth>] [brick_size]
+ *  volume_bench quantize [size] [repetitions]
+ * Add -DVOLUME_QUANTIZE_NO_SIMD to measure the quantization without the SIMD kernels.
+ * */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+#include "volume_mips.h"
+#include "distance_field.h"
+#include "volume_acceleration.h"
+#include "bricked_volume.h"
+#include "volume_quantize.h"
+#include "parallel_for.h"
+
+// Sparse blobs over a low noise floor, like a scanned volume
+uint8_t* create_test_volume(const uint32_t size) {
+    const size_t voxel_count = (size_t) size * size * size;
+    uint8_t *volume = (uint8_t*) malloc(voxel_count);
+
+    uint32_t seed = 1234u;
+    for(size_t i = 0; i < voxel_count; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        volume[i] = (uint8_t) ((seed >> 24) & 0x1F);
+    }
+
+    for(uint32_t blob = 0; blob < 32; blob++) {
+        seed = seed * 1664525u + 1013904223u;
+        const uint32_t cx = (seed >> 8) % size, cy = (seed >> 16) % size, cz = (seed >> 4) % size;
+        const int32_t radius = 1 + (int32_t) (size / 32);
+        for(int32_t z = -radius; z <= radius; z++) {
+            for(int32_t y = -radius; y <= radius; y++) {
+                for(int32_t x = -radius; x <= radius; x++) {
+                    const int64_t px = cx + x, py = cy + y, pz = cz + z;
+                    if (px < 0 || py < 0 || pz < 0 || px >= size || py >= size || pz >= size) {
+                        continue;
+                    }
+                    volume[(pz * size + py) * size + px] = 255;
+                }
+            }
+        }
+    }
+
+    return volume;
+}
+
+// Brute force check: each texel of the chain is >= every level 0 voxel under it
+bool check_conservative(const uint8_t *volume,
+                        const uint32_t size,
+                        const sVolumeMipChain &chain) {
+    for(uint32_t i = 0; i < chain.level_count; i++) {
+        const uint32_t level = chain.first_level + i;
+        const uint32_t *dims = chain.dims[i];
+        for(uint32_t z = 0; z < size; z++) {
+            for(uint32_t y = 0; y < size; y++) {
+                for(uint32_t x = 0; x < size; x++) {
+                    uint32_t tx = x >> level, ty = y >> level, tz = z >> level;
+                    tx = (tx >= dims[0]) ? dims[0] - 1 : tx;
+                    ty = (ty >= dims[1]) ? dims[1] - 1 : ty;
+                    tz = (tz >= dims[2]) ? dims[2] - 1 : tz;
+                    const uint8_t texel = chain.levels[i][((size_t) tz * dims[1] + ty) * dims[0] + tx];
+                    if (texel < volume[((size_t) z * size + y) * size + x]) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void bench_mips(const uint32_t max_size,
+                const uint32_t repetitions) {
+    const uint32_t core_count = std::thread::hardware_concurrency();
+    printf("Max mip chain build, ms (best of %u), %u cores\n", repetitions, core_count);
+    printf("%8s", "size");
+    for(uint32_t threads = 1; threads <= core_count; threads *= 2) {
+        printf(" %8u t", threads);
+    }
+    printf("\n");
+
+    for(uint32_t size = 64; size <= max_size; size *= 2) {
+        uint8_t *volume = create_test_volume(size);
+        const uint32_t dims[3] = {size, size, size};
+
+        printf("%8u", size);
+        for(uint32_t threads = 1; threads <= core_count; threads *= 2) {
+            double best_ms = 1e30;
+            for(uint32_t r = 0; r < repetitions; r++) {
+                sVolumeMipChain chain = {};
+                const auto start = std::chrono::steady_clock::now();
+                VolumeMips::build_max_chain(volume,
+                                            dims,
+                                            false,
+                                            threads,
+                                            &chain);
+                const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                best_ms = (ms < best_ms) ? ms : best_ms;
+
+                if (r == 0 && threads == 1 && size <= 128 && !check_conservative(volume, size, chain)) {
+                    printf("\nMip chain of size %u is not conservative\n", size);
+                    exit(EXIT_FAILURE);
+                }
+                chain.clean();
+            }
+            printf(" %10.2f", best_ms);
+        }
+        printf("\n");
+
+        free(volume);
+    }
+}
+
+void bench_distance_field(const uint32_t max_size,
+                          const uint32_t repetitions) {
+    const uint32_t core_count = std::thread::hardware_concurrency();
+    printf("Distance field build, ms (best of %u), %u cores\n", repetitions, core_count);
+    printf("%8s", "size");
+    for(uint32_t threads = 1; threads <= core_count; threads *= 2) {
+        printf(" %8u t", threads);
+    }
+    printf(" %10s\n", "mean dist");
+
+    for(uint32_t size = 64; size <= max_size; size *= 2) {
+        uint8_t *volume = create_test_volume(size);
+        const uint32_t dims[3] = {size, size, size};
+
+        printf("%8u", size);
+        double mean_distance = 0.0;
+        for(uint32_t threads = 1; threads <= core_count; threads *= 2) {
+            double best_ms = 1e30;
+            for(uint32_t r = 0; r < repetitions; r++) {
+                sDistanceField field = {};
+                const auto start = std::chrono::steady_clock::now();
+                DistanceField::build(volume,
+                                     dims,
+                                     DISTANCE_FIELD_DEFAULT_THRESHOLD,
+                                     threads,
+                                     &field);
+                const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                best_ms = (ms < best_ms) ? ms : best_ms;
+
+                if (r == 0 && threads == 1) {
+                    for(size_t i = 0; i < field.get_voxel_count(); i++) {
+                        mean_distance += field.distances[i];
+                    }
+                    mean_distance /= field.get_voxel_count();
+                }
+                field.clean();
+            }
+            printf(" %10.2f", best_ms);
+        }
+        // Roughly the voxels that a sphere tracing step skips on this volume
+        printf(" %10.2f\n", mean_distance);
+
+        free(volume);
+    }
+}
+
+// Cold start (build & store) against warm start (map the entry), per size
+void bench_derived_cache(const char *cache_dir,
+                         const uint32_t max_size) {
+    sDerivedCache *cache = new sDerivedCache();
+    if (!cache->init(cache_dir)) {
+        printf("Cannot create the cache on %s\n", cache_dir);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Derived cache, ms\n");
+    printf("%8s %10s %10s %10s %10s\n", "size", "hash", "cold", "warm", "MB");
+    for(uint32_t size = 64; size <= max_size; size *= 2) {
+        uint8_t *volume = create_test_volume(size);
+        const size_t volume_size = (size_t) size * size * size;
+
+        sAccelerationParams params = {};
+        params.volume_dims[0] = params.volume_dims[1] = params.volume_dims[2] = size;
+
+        auto start = std::chrono::steady_clock::now();
+        const uint64_t key = DerivedCache::make_key(DerivedCache::hash(volume, volume_size),
+                                                    &params,
+                                                    sizeof(params));
+        const double hash_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        // Cold: build & store
+        start = std::chrono::steady_clock::now();
+        sVolumeAcceleration built = {};
+        built.build(volume,
+                    params.volume_dims,
+                    params.distance_field_threshold,
+                    0);
+        sDerivedBlobWriter writer = {};
+        writer.add_section(DERIVED_VOLUME,
+                           0,
+                           params.volume_dims,
+                           0x8229, // GL_R8
+                           volume,
+                           volume_size);
+        built.add_to_blob(&writer);
+        const double build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (!cache->store(key, &writer, (float) build_ms)) {
+            printf("Cannot store the entry of size %u\n", size);
+            exit(EXIT_FAILURE);
+        }
+        const double cold_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        // Warm: map, and touch every byte as the upload would
+        start = std::chrono::steady_clock::now();
+        sDerivedBlob blob = {};
+        sVolumeAcceleration loaded = {};
+        if (!cache->open(key, &blob) || !loaded.load_from_blob(blob)) {
+            printf("Cannot open the entry of size %u\n", size);
+            exit(EXIT_FAILURE);
+        }
+        uint64_t checksum = 0;
+        for(uint32_t i = 0; i < blob.header.section_count; i++) {
+            checksum += DerivedCache::hash(blob.get_section_data(&blob.header.sections[i]),
+                                           blob.header.sections[i].size);
+        }
+        const double warm_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        // The entry has to give back what was built
+        bool equal = loaded.mip_chain.level_count == built.mip_chain.level_count &&
+                     loaded.minmax_grid.cell_size == built.minmax_grid.cell_size &&
+                     loaded.distance_field.threshold == built.distance_field.threshold &&
+                     memcmp(loaded.minmax_grid.cells, built.minmax_grid.cells, built.minmax_grid.get_cell_count() * 2) == 0 &&
+                     memcmp(loaded.distance_field.distances, built.distance_field.distances, built.distance_field.get_voxel_count()) == 0 &&
+                     memcmp(blob.get_section_data(blob.find_section(DERIVED_VOLUME)), volume, volume_size) == 0;
+        for(uint32_t i = 0; equal && i < built.mip_chain.level_count; i++) {
+            equal = memcmp(loaded.mip_chain.levels[i], built.mip_chain.levels[i], built.mip_chain.get_level_size(i)) == 0;
+        }
+        if (!equal) {
+            printf("The entry of size %u does not match the build\n", size);
+            exit(EXIT_FAILURE);
+        }
+
+        printf("%8u %10.2f %10.2f %10.2f %10.1f (%llx)\n",
+               size,
+               hash_ms,
+               cold_ms,
+               warm_ms,
+               blob.file.size / (1024.0 * 1024.0),
+               (unsigned long long) checksum);
+
+        loaded.clean();
+        blob.close();
+        built.clean();
+        free(volume);
+    }
+
+    // A different version or parameters is a miss
+    sDerivedBlob blob = {};
+    if (cache->open(DerivedCache::make_key(0, "", 0), &blob)) {
+        printf("Unexpected hit\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const sDerivedCacheStats stats = cache->get_stats();
+    printf("%u hits, %u misses, %u stores, %.2f ms saved\n",
+           stats.hits,
+           stats.misses,
+           stats.stores,
+           stats.saved_ms);
+    delete cache;
+}
+
+// Decodes every brick, on thread_count threads; returns the ms, false on result if any is corrupt
+double decode_all_bricks(const sBrickedVolume &volume,
+                         const uint32_t thread_count,
+                         uint8_t *staging,
+                         const size_t brick_bytes,
+                         bool *result) {
+    std::atomic<uint32_t> corrupt{0};
+    const auto start = std::chrono::steady_clock::now();
+    Parallel::for_range(0, volume.get_brick_count(), thread_count, [&](const uint32_t brick_start, const uint32_t brick_end) {
+        for(uint32_t i = brick_start; i < brick_end; i++) {
+            if (!volume.decode_brick(i, staging + brick_bytes * i)) {
+                corrupt.fetch_add(1);
+            }
+        }
+    });
+    *result = corrupt.load() == 0;
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Size & decode speed of the compressed bricked container, against the raw one
+void bench_bricks(const char *work_dir,
+                  const char *raw_dir,
+                  const uint32_t volume_dims[3],
+                  const uint32_t brick_size) {
+    sMappedFile raw_file = {};
+    const char *volume = NULL;
+    uint8_t *test_volume = NULL;
+    const size_t volume_size = (size_t) volume_dims[0] * volume_dims[1] * volume_dims[2];
+    if (raw_dir != NULL) {
+        if (!raw_file.open(raw_dir) || raw_file.size < volume_size) {
+            printf("Cannot read the volume %s\n", raw_dir);
+            exit(EXIT_FAILURE);
+        }
+        volume = raw_file.data;
+    } else {
+        test_volume = create_test_volume(volume_dims[0]);
+        volume = (const char*) test_volume;
+    }
+
+    char raw_bricks_dir[512], compressed_bricks_dir[512];
+    snprintf(raw_bricks_dir, sizeof(raw_bricks_dir), "%s/bench_raw.vbrk", work_dir);
+    snprintf(compressed_bricks_dir, sizeof(compressed_bricks_dir), "%s/bench_compressed.vbrk", work_dir);
+
+    const auto compress_start = std::chrono::steady_clock::now();
+    const bool converted = BrickedVolume::convert_from_memory(volume, volume_dims[0], volume_dims[1], volume_dims[2], VOXEL_UINT8, brick_size, 0, compressed_bricks_dir, BRICK_CODEC_DELTA_LZ);
+    const double compress_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - compress_start).count();
+    if (!converted ||
+        !BrickedVolume::convert_from_memory(volume, volume_dims[0], volume_dims[1], volume_dims[2], VOXEL_UINT8, brick_size, 0, raw_bricks_dir, BRICK_CODEC_RAW)) {
+        printf("Cannot write the bricked volumes on %s\n", work_dir);
+        exit(EXIT_FAILURE);
+    }
+
+    sBrickedVolume raw_bricks = {}, compressed_bricks = {};
+    if (!raw_bricks.open(raw_bricks_dir) || !compressed_bricks.open(compressed_bricks_dir)) {
+        printf("Cannot open the bricked volumes on %s\n", work_dir);
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t compressed_count = 0, empty_count = 0;
+    for(uint32_t i = 0; i < compressed_bricks.get_brick_count(); i++) {
+        empty_count += (compressed_bricks.bricks[i].flags & BRICK_EMPTY) ? 1 : 0;
+        compressed_count += (compressed_bricks.is_brick_compressed(i)) ? 1 : 0;
+    }
+
+    // A slot per brick, so every thread decodes to its own memory
+    const size_t brick_bytes = (size_t) brick_size * brick_size * brick_size;
+    uint8_t *staging = (uint8_t*) malloc(brick_bytes * compressed_bricks.get_brick_count());
+    uint8_t *expected = (uint8_t*) malloc(brick_bytes);
+    bool valid = true;
+
+    printf("%ux%ux%u, bricks of %u^3: %u bricks, %u empty, %u compressed\n", volume_dims[0], volume_dims[1], volume_dims[2], brick_size, compressed_bricks.get_brick_count(), empty_count, compressed_count);
+    printf("raw %.2f MB, bricked %.2f MB, compressed %.2f MB: %.2fx the bricked, %.2fx the raw, compressed in %.1f ms\n",
+           volume_size / (1024.0 * 1024.0),
+           raw_bricks.file.size / (1024.0 * 1024.0),
+           compressed_bricks.file.size / (1024.0 * 1024.0),
+           (double) raw_bricks.file.size / compressed_bricks.file.size,
+           (double) volume_size / compressed_bricks.file.size,
+           compress_ms);
+
+    const uint32_t core_count = std::thread::hardware_concurrency();
+    printf("%8s %12s %12s %12s %12s\n", "threads", "raw ms", "decode ms", "GB/s", "GB/s/core");
+    for(uint32_t threads = 1; threads <= core_count; threads *= 2) {
+        double raw_ms = 1e30, decode_ms = 1e30;
+        for(uint32_t r = 0; r < 3; r++) {
+            bool decoded = false;
+            const double ms = decode_all_bricks(raw_bricks, threads, staging, brick_bytes, &decoded);
+            raw_ms = (ms < raw_ms) ? ms : raw_ms;
+            const double compressed_ms = decode_all_bricks(compressed_bricks, threads, staging, brick_bytes, &decoded);
+            decode_ms = (compressed_ms < decode_ms) ? compressed_ms : decode_ms;
+            valid = valid && decoded;
+        }
+        const double gb_s = (volume_size / (1024.0 * 1024.0 * 1024.0)) / (decode_ms / 1000.0);
+        printf("%8u %12.2f %12.2f %12.2f %12.2f\n", threads, raw_ms, decode_ms, gb_s, gb_s / threads);
+    }
+
+    // Every brick has to decode to the raw voxels
+    for(uint32_t i = 0; valid && i < raw_bricks.get_brick_count(); i++) {
+        valid = raw_bricks.decode_brick(i, expected) &&
+                memcmp(expected, staging + brick_bytes * i, raw_bricks.get_brick_voxel_size(i)) == 0;
+    }
+    printf("%s\n", (valid) ? "Round trip OK" : "Round trip FAILED");
+
+    free(expected);
+    free(staging);
+    raw_bricks.close();
+    compressed_bricks.close();
+    remove(raw_bricks_dir);
+    remove(compressed_bricks_dir);
+    raw_file.close();
+    free(test_volume);
+
+    if (!valid) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+// 16 bit scan: air with noise, a body with soft tissue, and denser bones in it
+uint16_t* create_test_volume16(const uint32_t size) {
+    const size_t voxel_count = (size_t) size * size * size;
+    uint16_t *volume = (uint16_t*) malloc(voxel_count * sizeof(uint16_t));
+
+    Parallel::for_range(0, size, 0, [&](const uint32_t z_start, const uint32_t z_end) {
+        uint32_t seed = 1234u + z_start;
+        for(uint32_t z = z_start; z < z_end; z++) {
+            for(uint32_t y = 0; y < size; y++) {
+                for(uint32_t x = 0; x < size; x++) {
+                    seed = seed * 1664525u + 1013904223u;
+                    const float dx = (float) x / size - 0.5f, dy = (float) y / size - 0.5f, dz = (float) z / size - 0.5f;
+                    const float body = dx * dx + dy * dy;
+                    const float bone = (dx - 0.1f) * (dx - 0.1f) + dy * dy + (dz * 0.2f) * (dz * 0.2f);
+                    uint32_t value = 40 + ((seed >> 24) & 0x3F);
+                    value += (body < 0.16f) ? 1000 + (uint32_t) (200.0f * (0.16f - body)) : 0;
+                    value += (bone < 0.004f) ? 1800 + ((seed >> 16) & 0xFF) : 0;
+                    volume[((size_t) z * size + y) * size + x] = (uint16_t) value;
+                }
+            }
+        }
+    });
+    return volume;
+}
+
+// RMS error of the quantized volume back on the units of the source
+double get_quantize_rms(const uint16_t *volume,
+                        const sQuantizedVolume &quantized) {
+    const double window_size = quantized.window[1] - quantized.window[0];
+    const size_t row = quantized.dims[0];
+    const size_t slice = row * quantized.dims[1];
+    double squared_error = 0.0;
+    for(uint32_t z = 0; z < quantized.dims[2]; z++) {
+        for(uint32_t y = 0; y < quantized.dims[1]; y++) {
+            for(uint32_t x = 0; x < quantized.dims[0]; x++) {
+                const size_t index = z * slice + y * row + x;
+                double scale = 1.0, offset = 0.0;
+                if (quantized.brick_ranges != NULL) {
+                    const uint32_t brick = ((z / quantized.brick_size) * quantized.brick_counts[1] + y / quantized.brick_size) * quantized.brick_counts[0] + x / quantized.brick_size;
+                    scale = quantized.brick_ranges[brick * 2];
+                    offset = quantized.brick_ranges[brick * 2 + 1];
+                }
+                double source = volume[index];
+                source = (source < quantized.window[0]) ? quantized.window[0] : ((source > quantized.window[1]) ? quantized.window[1] : source);
+                const double value = quantized.window[0] + (offset + quantized.voxels[index] / 255.0 * scale) * window_size;
+                squared_error += (value - source) * (value - source);
+            }
+        }
+    }
+    return sqrt(squared_error / quantized.get_voxel_count());
+}
+
+// Source or dequantized voxel, on the window & [0, 1]
+static double get_window_voxel(const uint16_t *volume,
+                               const sQuantizedVolume &quantized,
+                               const bool is_source,
+                               const uint32_t x,
+                               const uint32_t y,
+                               const uint32_t z) {
+    const size_t index = ((size_t) z * quantized.dims[1] + y) * quantized.dims[0] + x;
+    if (is_source) {
+        const double source = (volume[index] - quantized.window[0]) / (quantized.window[1] - quantized.window[0]);
+        return (source < 0.0) ? 0.0 : ((source > 1.0) ? 1.0 : source);
+    }
+    const uint32_t brick = ((z / quantized.brick_size) * quantized.brick_counts[1] + y / quantized.brick_size) * quantized.brick_counts[0] + x / quantized.brick_size;
+    return quantized.brick_ranges[brick * 2 + 1] + quantized.voxels[index] / 255.0 * quantized.brick_ranges[brick * 2];
+}
+
+/**
+ * Trilinear sample at pos (in voxels, the centers on integers), as
+ * quantized_isosurface_shader does: each voxel dequantized with its own brick
+ * before the interpolation. With filter_codes, as the sampler filtering the
+ * codes, and then the range of the brick of pos (what it did before)
+ * */
+static double sample_window(const uint16_t *volume,
+                            const sQuantizedVolume &quantized,
+                            const bool is_source,
+                            const bool filter_codes,
+                            const double pos[3]) {
+    uint32_t corner_min[3], corner_max[3];
+    double t[3];
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        const double floor_pos = floor(pos[axis]);
+        corner_min[axis] = (uint32_t) ((floor_pos < 0.0) ? 0.0 : floor_pos);
+        corner_max[axis] = (corner_min[axis] + 1 < quantized.dims[axis]) ? corner_min[axis] + 1 : corner_min[axis];
+        t[axis] = pos[axis] - corner_min[axis];
+        t[axis] = (t[axis] < 0.0) ? 0.0 : ((t[axis] > 1.0) ? 1.0 : t[axis]);
+    }
+
+    double corners[8];
+    for(uint32_t i = 0; i < 8; i++) {
+        const uint32_t x = (i & 1) ? corner_max[0] : corner_min[0];
+        const uint32_t y = (i & 2) ? corner_max[1] : corner_min[1];
+        const uint32_t z = (i & 4) ? corner_max[2] : corner_min[2];
+        if (filter_codes) {
+            corners[i] = quantized.voxels[((size_t) z * quantized.dims[1] + y) * quantized.dims[0] + x] / 255.0;
+        } else {
+            corners[i] = get_window_voxel(volume, quantized, is_source, x, y, z);
+        }
+    }
+
+    const double x00 = corners[0] + (corners[1] - corners[0]) * t[0];
+    const double x10 = corners[2] + (corners[3] - corners[2]) * t[0];
+    const double x01 = corners[4] + (corners[5] - corners[4]) * t[0];
+    const double x11 = corners[6] + (corners[7] - corners[6]) * t[0];
+    const double y0 = x00 + (x10 - x00) * t[1];
+    const double y1 = x01 + (x11 - x01) * t[1];
+    const double value = y0 + (y1 - y0) * t[2];
+    if (!filter_codes) {
+        return value;
+    }
+
+    // The brick of the sample position
+    uint32_t brick_pos[3];
+    for(uint32_t axis = 0; axis < 3; axis++) {
+        const double voxel = (pos[axis] + 0.5 < 0.0) ? 0.0 : pos[axis] + 0.5;
+        brick_pos[axis] = (uint32_t) voxel / quantized.brick_size;
+        brick_pos[axis] = (brick_pos[axis] < quantized.brick_counts[axis]) ? brick_pos[axis] : quantized.brick_counts[axis] - 1;
+    }
+    const uint32_t brick = (brick_pos[2] * quantized.brick_counts[1] + brick_pos[1]) * quantized.brick_counts[0] + brick_pos[0];
+    return quantized.brick_ranges[brick * 2 + 1] + value * quantized.brick_ranges[brick * 2];
+}
+
+/**
+ * RMS error, on the units of the source, of the samples across the x faces
+ * of the bricks (a quarter, half & three quarters of the way between the
+ * voxels on each side), against the trilinear of the source
+ * */
+static double get_brick_face_rms(const uint16_t *volume,
+                                 const sQuantizedVolume &quantized,
+                                 const bool filter_codes) {
+    const double fractions[3] = {0.25, 0.5, 0.75};
+    double squared_error = 0.0;
+    uint64_t sample_count = 0;
+    for(uint32_t face = quantized.brick_size; face < quantized.dims[0]; face += quantized.brick_size) {
+        for(uint32_t z = 0; z < quantized.dims[2]; z++) {
+            for(uint32_t y = 0; y < quantized.dims[1]; y++) {
+                for(uint32_t f = 0; f < 3; f++) {
+                    // Half a voxel off on y & z too, so the edges mix 4 voxels
+                    const double pos[3] = {face - 1.0 + fractions[f], y + 0.5 * (f == 1), (double) z};
+                    const double reference = sample_window(volume, quantized, true, false, pos);
+                    const double sample = sample_window(volume, quantized, false, filter_codes, pos);
+                    squared_error += (sample - reference) * (sample - reference);
+                    sample_count++;
+                }
+            }
+        }
+    }
+    const double window_size = quantized.window[1] - quantized.window[0];
+    return sqrt(squared_error / sample_count) * window_size;
+}
+
+// Histogram, global & per brick quantization of a 16 bit volume
+void bench_quantize(const uint32_t size,
+                    const uint32_t repetitions) {
+    uint16_t *volume = create_test_volume16(size);
+    const size_t voxel_count = (size_t) size * size * size;
+    const double source_gb = voxel_count * sizeof(uint16_t) / (1024.0 * 1024.0 * 1024.0);
+    const uint32_t dims[3] = {size, size, size};
+#if defined(VOLUME_QUANTIZE_NO_SIMD)
+    const char *kernels = "scalar";
+#else
+    const char *kernels = "SIMD";
+#endif
+
+    sVolumeHistogram *histogram = (sVolumeHistogram*) malloc(sizeof(sVolumeHistogram));
+    VolumeQuantize::build_histogram(volume, QUANTIZE_SOURCE_UINT16, voxel_count, 0, histogram);
+    float window[2];
+    VolumeQuantize::get_auto_window(*histogram, QUANTIZE_DEFAULT_LOW_PERCENTILE, QUANTIZE_DEFAULT_HIGH_PERCENTILE, window);
+    printf("%u^3 uint16 (%.2f GB), %s kernels: values [%.0f, %.0f], window [%.1f, %.1f]\n", size, source_gb, kernels, histogram->min_value, histogram->max_value, window[0], window[1]);
+
+    sQuantizeConfig global_config = {};
+    global_config.auto_window = false;
+    memcpy(global_config.window, window, sizeof(window));
+    sQuantizeConfig brick_config = global_config;
+    brick_config.per_brick = true;
+
+    const uint32_t core_count = std::thread::hardware_concurrency();
+    printf("GB/s of source (best of %u)\n", repetitions);
+    printf("%8s %12s %12s %12s\n", "threads", "histogram", "global", "per brick");
+    for(uint32_t threads = 1; threads <= core_count; threads *= 2) {
+        double best_ms[3] = {1e30, 1e30, 1e30};
+        for(uint32_t r = 0; r < repetitions; r++) {
+            auto start = std::chrono::steady_clock::now();
+            VolumeQuantize::build_histogram(volume, QUANTIZE_SOURCE_UINT16, voxel_count, threads, histogram);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            best_ms[0] = (ms < best_ms[0]) ? ms : best_ms[0];
+
+            const sQuantizeConfig *configs[2] = {&global_config, &brick_config};
+            for(uint32_t i = 0; i < 2; i++) {
+                sQuantizedVolume quantized = {};
+                start = std::chrono::steady_clock::now();
+                VolumeQuantize::quantize_volume(volume, QUANTIZE_SOURCE_UINT16, dims, *configs[i], threads, &quantized);
+                ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                best_ms[i + 1] = (ms < best_ms[i + 1]) ? ms : best_ms[i + 1];
+                quantized.clean();
+            }
+        }
+        printf("%8u %12.2f %12.2f %12.2f\n", threads, source_gb / (best_ms[0] / 1000.0), source_gb / (best_ms[1] / 1000.0), source_gb / (best_ms[2] / 1000.0));
+    }
+
+    sQuantizedVolume global = {}, bricked = {};
+    VolumeQuantize::quantize_volume(volume, QUANTIZE_SOURCE_UINT16, dims, global_config, 0, &global);
+    VolumeQuantize::quantize_volume(volume, QUANTIZE_SOURCE_UINT16, dims, brick_config, 0, &bricked);
+    printf("RMS error inside the window: global %.2f, per brick %.2f (one 8 bit step is %.2f)\n",
+           get_quantize_rms(volume, global),
+           get_quantize_rms(volume, bricked),
+           (window[1] - window[0]) / 255.0f);
+    // The samples between two bricks: their codes are on different ranges
+    const double face_rms = get_brick_face_rms(volume, bricked, false);
+    printf("RMS error across the brick faces: per voxel ranges %.2f, filtered codes %.2f%s\n",
+           face_rms,
+           get_brick_face_rms(volume, bricked, true),
+           (face_rms <= 2.0 * get_quantize_rms(volume, bricked)) ? "" : " (FAILED, the faces are worse than the voxels)");
+
+    global.clean();
+    bricked.clean();
+    free(histogram);
+    free(volume);
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("Usage: %s mips|distance [max_size] [repetitions]\n", argv[0]);
+        printf("       %s cache <cache_dir> [max_size]\n", argv[0]);
+        printf("       %s bricks <work_dir> [<raw_file> <width> <height> <depth>] [brick_size]\n", argv[0]);
+        printf("       %s quantize [size] [repetitions]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (strcmp(argv[1], "mips") == 0) {
+        const uint32_t max_size = (argc > 2) ? (uint32_t) atoi(argv[2]) : 512;
+        const uint32_t repetitions = (argc > 3) ? (uint32_t) atoi(argv[3]) : 3;
+        bench_mips(max_size, repetitions);
+    } else if (strcmp(argv[1], "distance") == 0) {
+        const uint32_t max_size = (argc > 2) ? (uint32_t) atoi(argv[2]) : 512;
+        const uint32_t repetitions = (argc > 3) ? (uint32_t) atoi(argv[3]) : 3;
+        bench_distance_field(max_size, repetitions);
+    } else if (strcmp(argv[1], "cache") == 0 && argc > 2) {
+        const uint32_t max_size = (argc > 3) ? (uint32_t) atoi(argv[3]) : 256;
+        bench_derived_cache(argv[2], max_size);
+    } else if (strcmp(argv[1], "bricks") == 0 && argc > 2) {
+        const bool has_volume = argc > 6;
+        const uint32_t volume_dims[3] = {(has_volume) ? (uint32_t) atoi(argv[4]) : 256,
+                                         (has_volume) ? (uint32_t) atoi(argv[5]) : 256,
+                                         (has_volume) ? (uint32_t) atoi(argv[6]) : 256};
+        const int brick_size_arg = (has_volume) ? 7 : 3;
+        const uint32_t brick_size = (argc > brick_size_arg) ? (uint32_t) atoi(argv[brick_size_arg]) : BRICKED_VOLUME_DEFAULT_BRICK_SIZE;
+        bench_bricks(argv[2],
+                     (has_volume) ? argv[3] : NULL,
+                     volume_dims,
+                     brick_size);
+    } else if (strcmp(argv[1], "quantize") == 0) {
+        const uint32_t size = (argc > 2) ? (uint32_t) atoi(argv[2]) : 512;
+        const uint32_t repetitions = (argc > 3) ? (uint32_t) atoi(argv[3]) : 3;
+        bench_quantize(size, repetitions);
+    } else {
+        printf("Unknown benchmark %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/**
+ * Writes procedural volumes (see sProceduralVolume) as headerless GL_R8 .raw
+ * files, for the scaling benchmarks; the volume is generated & written by
+ * slabs of slices, so it can be larger than the memory (up to 2048^3 and over).
+ * The .raw can go through raw_to_bricks, volume_bench bricks, eac_roundtrip...
+ * Build on the host:
+ *  g++ -std=c++17 -O2 -I../src volume_gen.cpp ../src/procedural_volume.cpp -pthread -o volume_gen
+ * Usage:
+ *  volume_gen <spheres|noise|particles|shells|dense> <size | width height depth> <output.raw> [occupancy] [frequency] [seed] [--threads n]
+ * */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+
+#include "procedural_volume.h"
+
+#define SLAB_MAX_BYTES (256u << 20)
+
+int main(int argc, char **argv) {
+    uint32_t thread_count = 0;
+    if (argc > 2 && strcmp(argv[argc - 2], "--threads") == 0) {
+        thread_count = (uint32_t) atoi(argv[argc - 1]);
+        argc -= 2;
+    }
+
+    if (argc < 4) {
+        printf("Usage: %s <spheres|noise|particles|shells|dense> <size | width height depth> <output.raw> [occupancy] [frequency] [seed] [--threads n]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    sProceduralVolumeDesc desc = {};
+    desc.shape = PROCEDURAL_SHAPE_COUNT;
+    for(uint32_t shape = 0; shape < PROCEDURAL_SHAPE_COUNT; shape++) {
+        if (strcmp(argv[1], procedural_shape_names[shape]) == 0) {
+            desc.shape = (eProceduralShape) shape;
+        }
+    }
+    if (desc.shape == PROCEDURAL_SHAPE_COUNT) {
+        printf("Unknown shape %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    // A single size, or the three of them
+    const bool has_dims = argc > 5 && atoi(argv[3]) > 0 && atoi(argv[4]) > 0;
+    desc.dims[0] = (uint32_t) atoi(argv[2]);
+    desc.dims[1] = (has_dims) ? (uint32_t) atoi(argv[3]) : desc.dims[0];
+    desc.dims[2] = (has_dims) ? (uint32_t) atoi(argv[4]) : desc.dims[0];
+    const int first_option = (has_dims) ? 6 : 4;
+    const char *result_dir = argv[first_option - 1];
+    if (argc > first_option) {
+        desc.occupancy = (float) atof(argv[first_option]);
+    }
+    if (argc > first_option + 1) {
+        desc.frequency = (float) atof(argv[first_option + 1]);
+    }
+    if (argc > first_option + 2) {
+        desc.seed = (uint32_t) strtoul(argv[first_option + 2], NULL, 10);
+    }
+
+    FILE *result = fopen(result_dir, "wb");
+    if (result == NULL) {
+        printf("Cannot write %s\n", result_dir);
+        return EXIT_FAILURE;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    sProceduralVolume volume = {};
+    volume.init(desc);
+    const double init_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    const size_t slice = volume.get_slice_size();
+    uint32_t slab_depth = (uint32_t) (SLAB_MAX_BYTES / slice);
+    slab_depth = (slab_depth < 1) ? 1 : slab_depth;
+    uint8_t *slab = (uint8_t*) malloc(slice * slab_depth);
+
+    double generate_ms = 0.0;
+    size_t occupied = 0;
+    bool written = true;
+    for(uint32_t z = 0; z < desc.dims[2] && written; z += slab_depth) {
+        const uint32_t z_end = (z + slab_depth < desc.dims[2]) ? z + slab_depth : desc.dims[2];
+        const auto slab_start = std::chrono::steady_clock::now();
+        volume.generate_slices(z,
+                               z_end,
+                               thread_count,
+                               slab);
+        generate_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - slab_start).count();
+
+        const size_t slab_size = slice * (z_end - z);
+        occupied += (size_t) (ProceduralVolume::get_occupancy(slab, slab_size) * slab_size + 0.5f);
+        written = fwrite(slab, 1, slab_size, result) == slab_size;
+    }
+
+    free(slab);
+    volume.clean();
+    written = fclose(result) == 0 && written;
+    if (!written) {
+        printf("Cannot write %s\n", result_dir);
+        return EXIT_FAILURE;
+    }
+
+    const size_t voxel_count = volume.get_size();
+    printf("%s: %s %ux%ux%u, occupancy %.4f (requested %.4f), frequency %.1f, seed %u\n",
+           result_dir,
+           procedural_shape_names[desc.shape],
+           desc.dims[0],
+           desc.dims[1],
+           desc.dims[2],
+           (double) occupied / voxel_count,
+           desc.occupancy,
+           desc.frequency,
+           desc.seed);
+    printf("init %.1f ms, generated in %.1f ms, %.1f Mvoxels/s\n",
+           init_ms,
+           generate_ms,
+           voxel_count / 1e6 / (generate_ms / 1000.0));
+    return EXIT_SUCCESS;
+}